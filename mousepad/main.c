@@ -30,6 +30,7 @@
 /* globals */
 static gchar    **filenames = NULL;
 static gboolean   opt_version = FALSE;
+static gboolean   opt_stdin = FALSE;
 #ifdef HAVE_DBUS
 static gboolean   opt_disable_server = FALSE;
 static gboolean   opt_quit = FALSE;
@@ -44,6 +45,7 @@ static const GOptionEntry option_entries[] =
   { "disable-server", '\0', 0, G_OPTION_ARG_NONE, &opt_disable_server, N_("Do not register with the D-BUS session message bus"), NULL },
   { "quit", 'q', 0, G_OPTION_ARG_NONE, &opt_quit, N_("Quit a running Mousepad instance"), NULL },
 #endif
+  { "stdin", '\0', 0, G_OPTION_ARG_NONE, &opt_stdin, N_("Read a new document from the standard input, like a \"-\" file"), NULL },
   { "version", 'v', 0, G_OPTION_ARG_NONE, &opt_version, N_("Print version information and exit"), NULL },
   { G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL, NULL },
   { NULL }
@@ -57,6 +59,9 @@ main (gint argc, gchar **argv)
   MousepadApplication *application;
   GError              *error = NULL;
   gchar               *working_directory;
+  gchar              **names;
+  guint                n;
+  gboolean             has_dash = FALSE;
 #ifdef HAVE_DBUS
   MousepadDBusService *dbus_service;
 #endif
@@ -129,11 +134,28 @@ main (gint argc, gchar **argv)
     }
 #endif /* !HAVE_DBUS */
 
+  /* a dash in the filenames reads the standard input */
+  for (n = 0; filenames != NULL && filenames[n] != NULL; n++)
+    if (strcmp (filenames[n], "-") == 0)
+      has_dash = TRUE;
+
+  /* append the dash for --stdin, the window opens it with the files */
+  if (G_UNLIKELY (opt_stdin && !has_dash))
+    {
+      names = g_new0 (gchar *, n + 2);
+      if (n > 0)
+        memcpy (names, filenames, n * sizeof (gchar *));
+      names[n] = g_strdup ("-");
+      g_free (filenames);
+      filenames = names;
+    }
+
   /* get the current working directory */
   working_directory = g_get_current_dir ();
 
 #ifdef HAVE_DBUS
-  if (G_LIKELY (!opt_disable_server))
+  /* another instance can not read our standard input */
+  if (G_LIKELY (!opt_disable_server && !opt_stdin && !has_dash))
     {
       /* check if we can reuse an existing instance */
       if (mousepad_dbus_client_launch_files (filenames, working_directory, &error))
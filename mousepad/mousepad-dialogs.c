@@ -283,6 +283,62 @@ mousepad_dialogs_go_to (GtkWindow     *parent,
 
 
 
+gboolean
+mousepad_dialogs_go_to_line (GtkWindow *parent,
+                             gint      *line,
+                             gint       n_lines)
+{
+  GtkWidget *dialog;
+  GtkWidget *hbox;
+  GtkWidget *label;
+  GtkWidget *line_spin;
+  gint       response;
+
+  g_return_val_if_fail (line != NULL, FALSE);
+
+  /* build the dialog */
+  dialog = gtk_dialog_new_with_buttons (_("Go To"),
+                                        parent,
+                                        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                        GTK_STOCK_CANCEL, MOUSEPAD_RESPONSE_CANCEL,
+                                        GTK_STOCK_JUMP_TO, MOUSEPAD_RESPONSE_JUMP_TO,
+                                        NULL);
+  gtk_dialog_set_default_response (GTK_DIALOG (dialog), MOUSEPAD_RESPONSE_JUMP_TO);
+  gtk_window_set_resizable (GTK_WINDOW (dialog), FALSE);
+
+  /* line number box */
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 12);
+  gtk_box_pack_start (GTK_BOX (gtk_dialog_get_content_area (GTK_DIALOG(dialog))), hbox, TRUE, TRUE, 0);
+  gtk_container_set_border_width (GTK_CONTAINER (hbox), 6);
+  gtk_widget_show (hbox);
+
+  label = gtk_label_new_with_mnemonic (_("_Line number:"));
+  gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+  gtk_misc_set_alignment (GTK_MISC (label), 0, 0.5);
+  gtk_widget_show (label);
+
+  line_spin = gtk_spin_button_new_with_range (1, MAX (n_lines, 1), 1);
+  gtk_entry_set_activates_default (GTK_ENTRY (line_spin), TRUE);
+  gtk_box_pack_start (GTK_BOX (hbox), line_spin, FALSE, FALSE, 0);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (label), line_spin);
+  gtk_spin_button_set_snap_to_ticks (GTK_SPIN_BUTTON (line_spin), TRUE);
+  gtk_entry_set_width_chars (GTK_ENTRY (line_spin), 10);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (line_spin), *line);
+  gtk_widget_show (line_spin);
+
+  /* run the dialog */
+  response = gtk_dialog_run (GTK_DIALOG (dialog));
+  if (response == MOUSEPAD_RESPONSE_JUMP_TO)
+    *line = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (line_spin));
+
+  /* destroy the dialog */
+  gtk_widget_destroy (dialog);
+
+  return (response == MOUSEPAD_RESPONSE_JUMP_TO);
+}
+
+
+
 gboolean
 mousepad_dialogs_clear_recent (GtkWindow *parent)
 {
@@ -57,6 +57,10 @@ gint       mousepad_dialogs_other_tab_size      (GtkWindow     *parent,
 gboolean   mousepad_dialogs_go_to               (GtkWindow     *parent,
                                                  GtkTextBuffer *buffer);
 
+gboolean   mousepad_dialogs_go_to_line          (GtkWindow     *parent,
+                                                 gint          *line,
+                                                 gint           n_lines);
+
 gboolean   mousepad_dialogs_clear_recent        (GtkWindow     *parent);
 
 gint       mousepad_dialogs_save_changes        (GtkWindow     *parent,
@@ -0,0 +1,361 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-diff.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+
+
+/* number of bytes compared at once when looking for the common start and end */
+#define MOUSEPAD_DIFF_BLOCK_SIZE (4096)
+
+/* most line edits we look for, a region with more changes is replaced as a whole */
+#define MOUSEPAD_DIFF_MAX_EDITS  (1024)
+
+/* most line comparisons we do before we give up on the same */
+#define MOUSEPAD_DIFF_MAX_COST   (16 * 1024 * 1024)
+
+
+
+typedef struct _MousepadDiffLine  MousepadDiffLine;
+typedef struct _MousepadDiffMatch MousepadDiffMatch;
+
+struct _MousepadDiffLine
+{
+  /* the line, including its line ending */
+  const gchar *text;
+  gsize        length;
+  guint        hash;
+};
+
+struct _MousepadDiffMatch
+{
+  /* index of a line in the old and the new text */
+  gint old_line;
+  gint new_line;
+};
+
+
+
+static gsize
+mousepad_diff_common_prefix (const gchar *a,
+                             const gchar *b,
+                             gsize        length)
+{
+  gsize n = 0, block;
+
+  /* find the block with the first difference, memcmp is a lot faster than a loop */
+  while (n < length)
+    {
+      block = MIN (length - n, MOUSEPAD_DIFF_BLOCK_SIZE);
+      if (memcmp (a + n, b + n, block) != 0)
+        break;
+      n += block;
+    }
+
+  while (n < length && a[n] == b[n])
+    n++;
+
+  return n;
+}
+
+
+
+static gsize
+mousepad_diff_common_suffix (const gchar *a,
+                             const gchar *b,
+                             gsize        length)
+{
+  gsize n = 0, block;
+
+  /* a and b point to the end of the texts */
+  while (n < length)
+    {
+      block = MIN (length - n, MOUSEPAD_DIFF_BLOCK_SIZE);
+      if (memcmp (a - n - block, b - n - block, block) != 0)
+        break;
+      n += block;
+    }
+
+  while (n < length && a[-1 - (gssize) n] == b[-1 - (gssize) n])
+    n++;
+
+  return n;
+}
+
+
+
+static GArray *
+mousepad_diff_split (const gchar *text,
+                     const gchar *end)
+{
+  GArray           *lines;
+  MousepadDiffLine  line;
+  const gchar      *p, *n;
+
+  lines = g_array_new (FALSE, FALSE, sizeof (MousepadDiffLine));
+
+  while (text < end)
+    {
+      /* the line runs up to and including the next lf */
+      n = memchr (text, '\n', end - text);
+      line.text = text;
+      line.length = (n != NULL ? n + 1 : end) - text;
+
+      /* fnv-1a hash, so most lines are compared without looking at their bytes */
+      line.hash = 2166136261u;
+      for (p = text; p < text + line.length; p++)
+        line.hash = (line.hash ^ (guchar) *p) * 16777619u;
+
+      g_array_append_val (lines, line);
+      text += line.length;
+    }
+
+  return lines;
+}
+
+
+
+static inline gboolean
+mousepad_diff_line_equal (const MousepadDiffLine *a,
+                          const MousepadDiffLine *b)
+{
+  return (a->hash == b->hash
+          && a->length == b->length
+          && memcmp (a->text, b->text, a->length) == 0);
+}
+
+
+
+static gboolean
+mousepad_diff_myers (const MousepadDiffLine *a,
+                     gint                    n,
+                     const MousepadDiffLine *b,
+                     gint                    m,
+                     GArray                 *matches)
+{
+  MousepadDiffMatch  match;
+  GArray            *trace;
+  gint              *v, *vs;
+  gint               max_d, offset;
+  gint               d, k, x, y, prev_k, prev_x, prev_y;
+  gsize              cost = 0;
+
+  max_d = MIN (n + m, MOUSEPAD_DIFF_MAX_EDITS);
+  offset = max_d + 1;
+
+  /* furthest reaching x on each diagonal k, and a copy of it for each number of edits */
+  v = g_new0 (gint, 2 * max_d + 3);
+  trace = g_array_new (FALSE, FALSE, sizeof (gint));
+
+  for (d = 0; d <= max_d; d++)
+    {
+      /* the diagonals -d - 1 to d + 1, before this round */
+      g_array_append_vals (trace, v + offset - d - 1, 2 * d + 3);
+
+      for (k = -d; k <= d; k += 2)
+        {
+          /* step down (an insert) or right (a delete) from the best neighbour */
+          if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+            x = v[offset + k + 1];
+          else
+            x = v[offset + k - 1] + 1;
+          y = x - k;
+
+          /* follow the equal lines */
+          while (x < n && y < m && mousepad_diff_line_equal (a + x, b + y))
+            {
+              x++;
+              y++;
+            }
+
+          v[offset + k] = x;
+          cost += x + 1;
+
+          if (x >= n && y >= m)
+            goto found;
+        }
+
+      if (G_UNLIKELY (cost > MOUSEPAD_DIFF_MAX_COST))
+        break;
+    }
+
+  /* too many changes to be worth it */
+  g_array_free (trace, TRUE);
+  g_free (v);
+
+  return FALSE;
+
+  found:
+
+  /* walk back from the end and collect the equal lines on the way */
+  for (x = n, y = m; d >= 0; d--)
+    {
+      vs = &g_array_index (trace, gint, d * d + 2 * d) + d + 1;
+
+      k = x - y;
+      if (k == -d || (k != d && vs[k - 1] < vs[k + 1]))
+        prev_k = k + 1;
+      else
+        prev_k = k - 1;
+
+      prev_x = vs[prev_k];
+      prev_y = prev_x - prev_k;
+
+      while (x > prev_x && y > prev_y)
+        {
+          x--;
+          y--;
+
+          match.old_line = x;
+          match.new_line = y;
+          g_array_append_val (matches, match);
+        }
+
+      x = prev_x;
+      y = prev_y;
+    }
+
+  g_array_free (trace, TRUE);
+  g_free (v);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_diff_add_hunk (GArray *hunks,
+                        gsize   old_offset,
+                        gsize   old_end,
+                        gsize   new_offset,
+                        gsize   new_end)
+{
+  MousepadDiffHunk hunk;
+
+  if (old_offset == old_end && new_offset == new_end)
+    return;
+
+  hunk.old_offset = old_offset;
+  hunk.old_length = old_end - old_offset;
+  hunk.new_offset = new_offset;
+  hunk.new_length = new_end - new_offset;
+
+  g_array_append_val (hunks, hunk);
+}
+
+
+
+static inline gsize
+mousepad_diff_line_offset (GArray      *lines,
+                           gint         line,
+                           const gchar *text,
+                           gsize        end_offset)
+{
+  /* byte offset of the start of a line in the text, the end for the line after the last */
+  if (line < (gint) lines->len)
+    return g_array_index (lines, MousepadDiffLine, line).text - text;
+
+  return end_offset;
+}
+
+
+
+GArray *
+mousepad_diff_lines (const gchar *old_text,
+                     gsize        old_length,
+                     const gchar *new_text,
+                     gsize        new_length)
+{
+  GArray            *hunks, *old_lines, *new_lines, *matches;
+  MousepadDiffMatch *match;
+  gsize              prefix, suffix;
+  gsize              old_end, new_end;
+  gint               old_line, new_line;
+  guint              i;
+
+  hunks = g_array_new (FALSE, FALSE, sizeof (MousepadDiffHunk));
+
+  /* the lines both texts start with, up to the last lf before the first difference */
+  prefix = mousepad_diff_common_prefix (old_text, new_text, MIN (old_length, new_length));
+  if (prefix == old_length && prefix == new_length)
+    return hunks;
+  while (prefix > 0 && old_text[prefix - 1] != '\n')
+    prefix--;
+
+  /* the lines both texts end with, without overlapping the start */
+  suffix = mousepad_diff_common_suffix (old_text + old_length, new_text + new_length,
+                                        MIN (old_length, new_length) - prefix);
+  while (suffix > 0
+         && ((old_length - suffix > prefix && old_text[old_length - suffix - 1] != '\n')
+             || (new_length - suffix > prefix && new_text[new_length - suffix - 1] != '\n')))
+    suffix--;
+
+  old_end = old_length - suffix;
+  new_end = new_length - suffix;
+
+  /* only added or only removed lines */
+  if (prefix == old_end || prefix == new_end)
+    {
+      mousepad_diff_add_hunk (hunks, prefix, old_end, prefix, new_end);
+      return hunks;
+    }
+
+  /* diff the lines in between */
+  old_lines = mousepad_diff_split (old_text + prefix, old_text + old_end);
+  new_lines = mousepad_diff_split (new_text + prefix, new_text + new_end);
+  matches = g_array_new (FALSE, FALSE, sizeof (MousepadDiffMatch));
+
+  if (mousepad_diff_myers ((MousepadDiffLine *) old_lines->data, old_lines->len,
+                           (MousepadDiffLine *) new_lines->data, new_lines->len,
+                           matches))
+    {
+      /* the changes are the gaps between the equal lines, which we collected from the end */
+      old_line = new_line = 0;
+      for (i = matches->len; i > 0; i--)
+        {
+          match = &g_array_index (matches, MousepadDiffMatch, i - 1);
+
+          mousepad_diff_add_hunk (hunks,
+                                  mousepad_diff_line_offset (old_lines, old_line, old_text, old_end),
+                                  mousepad_diff_line_offset (old_lines, match->old_line, old_text, old_end),
+                                  mousepad_diff_line_offset (new_lines, new_line, new_text, new_end),
+                                  mousepad_diff_line_offset (new_lines, match->new_line, new_text, new_end));
+
+          old_line = match->old_line + 1;
+          new_line = match->new_line + 1;
+        }
+
+      mousepad_diff_add_hunk (hunks,
+                              mousepad_diff_line_offset (old_lines, old_line, old_text, old_end), old_end,
+                              mousepad_diff_line_offset (new_lines, new_line, new_text, new_end), new_end);
+    }
+  else
+    {
+      /* replace everything in between */
+      mousepad_diff_add_hunk (hunks, prefix, old_end, prefix, new_end);
+    }
+
+  g_array_free (old_lines, TRUE);
+  g_array_free (new_lines, TRUE);
+  g_array_free (matches, TRUE);
+
+  return hunks;
+}
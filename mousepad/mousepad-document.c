@@ -22,6 +22,7 @@
 #include <mousepad/mousepad-document.h>
 #include <mousepad/mousepad-marshal.h>
 #include <mousepad/mousepad-view.h>
+#include <mousepad/mousepad-viewer.h>
 #include <mousepad/mousepad-window.h>
 
 #include <gtksourceview/gtksourcebuffer.h>
@@ -45,6 +46,9 @@ static void      mousepad_document_notify_cursor_position  (GtkTextBuffer
 static void      mousepad_document_notify_has_selection    (GtkTextBuffer          *buffer,
                                                             GParamSpec             *pspec,
                                                             MousepadDocument       *document);
+static void      mousepad_document_notify_editable         (GtkTextView            *textview,
+                                                            GParamSpec             *pspec,
+                                                            MousepadDocument       *document);
 static void      mousepad_document_notify_overwrite        (GtkTextView            *textview,
                                                             GParamSpec             *pspec,
                                                             MousepadDocument       *document);
@@ -62,6 +66,15 @@ static void      mousepad_document_drag_data_received      (GtkWidget
 static void      mousepad_document_filename_changed        (MousepadDocument       *document,
                                                             const gchar            *filename);
 static void      mousepad_document_label_color             (MousepadDocument       *document);
+static void      mousepad_document_load_progress           (MousepadFile           *file,
+                                                            gdouble                 fraction,
+                                                            MousepadDocument       *document);
+static void      mousepad_document_load_finished           (MousepadFile           *file,
+                                                            gint                    result,
+                                                            const GError           *error,
+                                                            MousepadDocument       *document);
+static void      mousepad_document_follow_appended         (MousepadFile           *file,
+                                                            MousepadDocument       *document);
 static void      mousepad_document_tab_button_clicked      (GtkWidget              *widget,
                                                             MousepadDocument       *document);
 
@@ -92,6 +105,9 @@ struct _MousepadDocumentPrivate
   /* utf-8 valid document names */
   gchar               *utf8_filename;
   gchar               *utf8_basename;
+
+  /* the viewer of a large file, NULL for normal documents */
+  MousepadViewer      *viewer;
 };
 
 
@@ -177,6 +193,7 @@ mousepad_document_init (MousepadDocument *document)
   document->priv->utf8_filename = NULL;
   document->priv->utf8_basename = NULL;
   document->priv->label = NULL;
+  document->priv->viewer = NULL;
 
   /* setup the scolled window */
   gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (document), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
@@ -192,10 +209,16 @@ mousepad_document_init (MousepadDocument *document)
 
   /* connect signals to the file */
   g_signal_connect_swapped (G_OBJECT (document->file), "filename-changed", G_CALLBACK (mousepad_document_filename_changed), document);
+  g_signal_connect (G_OBJECT (document->file), "load-progress", G_CALLBACK (mousepad_document_load_progress), document);
+  g_signal_connect (G_OBJECT (document->file), "load-finished", G_CALLBACK (mousepad_document_load_finished), document);
+  g_signal_connect (G_OBJECT (document->file), "follow-appended", G_CALLBACK (mousepad_document_follow_appended), document);
 
   /* create the highlight tag */
   document->tag = gtk_text_buffer_create_tag (document->buffer, NULL, "background", "#ffff78", NULL);
 
+  /* keep track of the matches of the search */
+  document->match_index = mousepad_match_index_new (document->buffer);
+
   /* setup the textview */
   document->textview = g_object_new (MOUSEPAD_TYPE_VIEW, "buffer", document->buffer, NULL);
   gtk_container_add (GTK_CONTAINER (document), GTK_WIDGET (document->textview));
@@ -211,6 +234,7 @@ mousepad_document_init (MousepadDocument *document)
   g_signal_connect_swapped (G_OBJECT (document->buffer), "modified-changed", G_CALLBACK (mousepad_document_label_color), document);
   g_signal_connect_swapped (G_OBJECT (document->file), "readonly-changed", G_CALLBACK (mousepad_document_label_color), document);
   g_signal_connect (G_OBJECT (document->textview), "notify::overwrite", G_CALLBACK (mousepad_document_notify_overwrite), document);
+  g_signal_connect (G_OBJECT (document->textview), "notify::editable", G_CALLBACK (mousepad_document_notify_editable), document);
   g_signal_connect (G_OBJECT (document->textview), "drag-data-received", G_CALLBACK (mousepad_document_drag_data_received), document);
   g_signal_connect (G_OBJECT (document->buffer), "notify::language", G_CALLBACK (mousepad_document_notify_language), document);
 }
@@ -226,9 +250,16 @@ mousepad_document_finalize (GObject *object)
   g_free (document->priv->utf8_filename);
   g_free (document->priv->utf8_basename);
 
+  /* stop viewing the file */
+  if (document->priv->viewer != NULL)
+    mousepad_viewer_free (document->priv->viewer);
+
   /* release the file */
   g_object_unref (G_OBJECT (document->file));
 
+  /* release the matches */
+  mousepad_match_index_free (document->match_index);
+
   /* release the buffer reference */
   g_object_unref (G_OBJECT (document->buffer));
 
@@ -255,6 +286,10 @@ mousepad_document_notify_cursor_position (GtkTextBuffer    *buffer,
   /* get the current line number */
   line = gtk_text_iter_get_line (&iter) + 1;
 
+  /* the viewer only has a part of the file in the buffer */
+  if (G_UNLIKELY (document->priv->viewer != NULL))
+    line = MIN (mousepad_viewer_get_first_line (document->priv->viewer) + line, G_MAXINT);
+
   /* get the tab size */
   tab_size = MOUSEPAD_SETTING_GET_INT (TAB_WIDTH);
 
@@ -298,6 +333,21 @@ mousepad_document_notify_has_selection (GtkTextBuffer    *buffer,
 
 
 
+static void
+mousepad_document_notify_editable (GtkTextView      *textview,
+                                   GParamSpec       *pspec,
+                                   MousepadDocument *document)
+{
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (GTK_IS_TEXT_VIEW (textview));
+
+  /* the edit actions follow it, the viewer makes the text editable once
+   * its line index is complete */
+  mousepad_document_notify_has_selection (document->buffer, NULL, document);
+}
+
+
+
 static void
 mousepad_document_notify_overwrite (GtkTextView      *textview,
                                     GParamSpec       *pspec,
@@ -426,6 +476,115 @@ mousepad_document_label_color (MousepadDocument *document)
 
 
 
+static void
+mousepad_document_load_progress (MousepadFile     *file,
+                                 gdouble           fraction,
+                                 MousepadDocument *document)
+{
+  gchar *label;
+
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* the text is incomplete, so don't allow editing */
+  gtk_text_view_set_editable (GTK_TEXT_VIEW (document->textview), FALSE);
+
+  /* show the progress in the tab label */
+  if (G_LIKELY (document->priv->label))
+    {
+      if (G_LIKELY (fraction >= 0.00))
+        label = g_strdup_printf (_("%s (%d%%)"), mousepad_document_get_basename (document), (gint) (fraction * 100));
+      else
+        label = g_strdup_printf (_("%s (loading)"), mousepad_document_get_basename (document));
+      gtk_label_set_text (GTK_LABEL (document->priv->label), label);
+      g_free (label);
+    }
+}
+
+
+
+static void
+mousepad_document_load_finished (MousepadFile     *file,
+                                 gint              result,
+                                 const GError     *error,
+                                 MousepadDocument *document)
+{
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* allow editing again */
+  gtk_text_view_set_editable (GTK_TEXT_VIEW (document->textview), TRUE);
+
+  /* restore the tab label */
+  if (G_LIKELY (document->priv->label))
+    gtk_label_set_text (GTK_LABEL (document->priv->label), mousepad_document_get_basename (document));
+}
+
+
+
+static void
+mousepad_document_follow_appended (MousepadFile     *file,
+                                   MousepadDocument *document)
+{
+  GtkTextIter  end_iter;
+  GtkTextMark *mark;
+
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  if (! MOUSEPAD_SETTING_GET_BOOLEAN (FOLLOW_AUTO_SCROLL))
+    return;
+
+  /* scroll to the end, with a mark because the new lines are not validated yet */
+  gtk_text_buffer_get_end_iter (document->buffer, &end_iter);
+  mark = gtk_text_buffer_create_mark (document->buffer, NULL, &end_iter, FALSE);
+  gtk_text_view_scroll_mark_onscreen (GTK_TEXT_VIEW (document->textview), mark);
+  gtk_text_buffer_delete_mark (document->buffer, mark);
+}
+
+
+
+gboolean
+mousepad_document_open_viewer (MousepadDocument  *document,
+                               GError           **error)
+{
+  GtkAdjustment *vadjustment;
+
+  g_return_val_if_fail (MOUSEPAD_IS_DOCUMENT (document), FALSE);
+  g_return_val_if_fail (document->priv->viewer == NULL, FALSE);
+  g_return_val_if_fail (mousepad_file_get_filename (document->file) != NULL, FALSE);
+
+  /* map the file and show the start of it */
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (document));
+  document->priv->viewer = mousepad_viewer_new (GTK_TEXT_VIEW (document->textview), vadjustment,
+                                                mousepad_file_get_line_index (document->file),
+                                                mousepad_file_get_filename (document->file), error);
+
+  if (G_UNLIKELY (document->priv->viewer == NULL))
+    return FALSE;
+
+  /* the buffer only holds a part of the file, the file saves the pieces of the viewer */
+  mousepad_file_set_piece_table (document->file, mousepad_viewer_get_piece_table (document->priv->viewer));
+  mousepad_file_set_encoding (document->file, MOUSEPAD_ENCODING_UTF_8);
+
+  /* guess the language from the start of the file */
+  mousepad_file_set_language (document->file, mousepad_file_guess_language (document->file, NULL, 0));
+
+  return TRUE;
+}
+
+
+
+MousepadViewer *
+mousepad_document_get_viewer (MousepadDocument *document)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_DOCUMENT (document), NULL);
+
+  return document->priv->viewer;
+}
+
+
+
 void
 mousepad_document_set_overwrite (MousepadDocument *document,
                                  gboolean          overwrite)
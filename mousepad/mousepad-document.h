@@ -19,7 +19,9 @@
 
 #include <mousepad/mousepad-util.h>
 #include <mousepad/mousepad-file.h>
+#include <mousepad/mousepad-match-index.h>
 #include <mousepad/mousepad-view.h>
+#include <mousepad/mousepad-viewer.h>
 
 G_BEGIN_DECLS
 
@@ -54,12 +56,20 @@ struct _MousepadDocument
 
   /* the highlight tag */
   GtkTextTag              *tag;
+
+  /* the matches of the last search */
+  MousepadMatchIndex      *match_index;
 };
 
 GType             mousepad_document_get_type       (void) G_GNUC_CONST;
 
 MousepadDocument *mousepad_document_new            (void);
 
+gboolean          mousepad_document_open_viewer    (MousepadDocument *document,
+                                                    GError          **error);
+
+MousepadViewer   *mousepad_document_get_viewer     (MousepadDocument *document);
+
 void              mousepad_document_set_overwrite  (MousepadDocument *document,
                                                     gboolean          overwrite);
 
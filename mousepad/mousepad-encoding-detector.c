@@ -0,0 +1,1020 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-encoding-detector.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+
+
+/* number of high bytes after which the statistics are trusted */
+#define MOUSEPAD_ENCODING_DETECTOR_MIN_HIGH_BYTES (16)
+
+
+
+typedef struct _MousepadEncodingCandidate MousepadEncodingCandidate;
+typedef struct _MousepadEncodingMachine   MousepadEncodingMachine;
+typedef struct _MousepadEncodingStats     MousepadEncodingStats;
+
+typedef enum
+{
+  /* single byte encodings are compared on their byte maps */
+  FAMILY_SINGLE_BYTE,
+  FAMILY_UTF_8,
+  FAMILY_UTF_16LE,
+  FAMILY_UTF_16BE,
+  FAMILY_UTF_32LE,
+  FAMILY_UTF_32BE,
+  FAMILY_ISO_2022_JP,
+  FAMILY_ISO_2022_KR,
+  FAMILY_SHIFT_JIS,
+  FAMILY_EUC_JP,
+  FAMILY_KOREAN,
+  FAMILY_CHINESE_SIMPLIFIED,
+  FAMILY_CHINESE_TRADITIONAL
+}
+MousepadEncodingFamily;
+
+struct _MousepadEncodingCandidate
+{
+  MousepadEncoding        encoding;
+  MousepadEncodingFamily  family;
+  gdouble                 score;
+
+  /* position in the candidate list, breaks ties */
+  guint                   order;
+
+  /* byte map of single byte encodings */
+  const gunichar         *map;
+};
+
+struct _MousepadEncodingMachine
+{
+  /* the encoding, and the superset used when extended byte ranges are seen */
+  MousepadEncoding        encoding;
+  MousepadEncoding        extended_encoding;
+  MousepadEncodingFamily  family;
+
+  /* bytes left in the current character and its lead byte */
+  guint                   state;
+  guchar                  lead;
+
+  /* valid multibyte characters, the most frequent ones of the language,
+   * invalid sequences and valid but rarely used bytes */
+  gsize                   n_chars;
+  gsize                   n_common;
+  gsize                   n_errors;
+  gsize                   n_rare;
+
+  /* characters with a trail byte in the ascii range */
+  gsize                   n_low_trails;
+  guint                   extended : 1;
+};
+
+struct _MousepadEncodingStats
+{
+  /* number of times each byte occurs */
+  gsize                   hist[256];
+
+  /* nul bytes at each position modulo 4 */
+  gsize                   zeros[4];
+
+  /* bytes with the high bit set */
+  gsize                   n_high;
+
+  /* pairs of adjacent high bytes */
+  guint32                *pairs;
+  gsize                   n_pairs;
+
+  /* high bytes next to an ascii letter, or between two of them */
+  gsize                   adjacent[128];
+  gsize                   inside[128];
+  gsize                   n_adjacent;
+
+  /* spaces after a high byte */
+  gsize                   n_spaced;
+};
+
+
+
+/* letters of the languages written in single byte encodings, the most frequent first */
+static const gchar letters_western[] = "éàèçáóíüöäñúêôâßãõûîëœïåøæÿ";
+static const gchar letters_central[] = "ěłčřšžąęýżśůćőńűźďťňáéíóúöüôäľĺŕ";
+static const gchar letters_cyrillic[] = "оеаинтсрвлкмдпуяызьбгчйхжшюцщэфъёіїєґў";
+static const gchar letters_greek[] = "αοιετσνηυρπκμλωδγχθφβξζψςάέίόήύώϊΐϋΰ";
+static const gchar letters_turkish[] = "ıüşçğöâîû";
+static const gchar letters_hebrew[] = "יוהלארתבמשעםנדקכחפצסטגןזףךץ";
+static const gchar letters_arabic[] = "اليمنوهرتبعدقفسكحجشطصزخضذثءغظةىأإآؤئ";
+static const gchar letters_baltic[] = "ąčęėįšųūžāēģīķļņōŗõäöü";
+static const gchar letters_thai[] = "านอรกเงมยลวดทสติีะบคัปุหพ่้ขจใชไโแำซผถภธศษฉฐฝ";
+static const gchar letters_romanian[] = "ăâîșțşţ";
+
+
+
+/* the most frequent characters of chinese and korean text, sorted */
+static const guint16 common_gbk[] =
+{
+  0xa1a2, 0xa1a3, 0xa3ac, 0xb2bb, 0xb3f6, 0xb4f3, 0xb5bd, 0xb5c4,
+  0xb5d8, 0xb8f6, 0xb9fa, 0xbacd, 0xbecd, 0xc0b4, 0xc1cb, 0xc3c7,
+  0xc8cb, 0xc9cf, 0xcab1, 0xcac7, 0xcbb5, 0xcbfb, 0xceaa, 0xced2,
+  0xd2aa, 0xd2b2, 0xd2bb, 0xd2d4, 0xd3d0, 0xd4da, 0xd5e2, 0xd6d0
+};
+
+static const guint16 common_big5[] =
+{
+  0xa141, 0xa142, 0xa143, 0xa440, 0xa446, 0xa448, 0xa457, 0xa45d,
+  0xa46a, 0xa4a3, 0xa4a4, 0xa548, 0xa54c, 0xa558, 0xa661, 0xa662,
+  0xa6b3, 0xa7da, 0xa8d3, 0xa8ec, 0xa94d, 0xaaba, 0xac4f, 0xacb0,
+  0xad6e, 0xadcc, 0xadd3, 0xaec9, 0xb0ea, 0xb36f, 0xb44e, 0xbba1
+};
+
+static const guint16 common_korean[] =
+{
+  0xb0a1, 0xb0ed, 0xb1e2, 0xb3aa, 0xb4c2, 0xb4d9, 0xb4eb, 0xb5b5,
+  0xb5e9, 0xb7ce, 0xb8a6, 0xb8ae, 0xbbe7, 0xbcad, 0xbcf6, 0xbeee,
+  0xbfa1, 0xc0b8, 0xc0bb, 0xc0c7, 0xc0cc, 0xc0ce, 0xc0da, 0xc1f6,
+  0xc7cf, 0xc7d1
+};
+
+
+
+/* single byte encodings, the most used first */
+static const struct
+{
+  MousepadEncoding  encoding;
+  const gchar      *letters;
+}
+single_byte_encodings[] =
+{
+  { MOUSEPAD_ENCODING_WINDOWS_1252, letters_western },
+  { MOUSEPAD_ENCODING_ISO_8859_1,   letters_western },
+  { MOUSEPAD_ENCODING_ISO_8859_15,  letters_western },
+  { MOUSEPAD_ENCODING_WINDOWS_1250, letters_central },
+  { MOUSEPAD_ENCODING_ISO_8859_2,   letters_central },
+  { MOUSEPAD_ENCODING_WINDOWS_1251, letters_cyrillic },
+  { MOUSEPAD_ENCODING_KOI8_R,       letters_cyrillic },
+  { MOUSEPAD_ENCODING_ISO_8859_5,   letters_cyrillic },
+  { MOUSEPAD_ENCODING_CP_866,       letters_cyrillic },
+  { MOUSEPAD_ENCODING_KOI8_U,       letters_cyrillic },
+  { MOUSEPAD_ENCODING_WINDOWS_1253, letters_greek },
+  { MOUSEPAD_ENCODING_ISO_8859_7,   letters_greek },
+  { MOUSEPAD_ENCODING_WINDOWS_1254, letters_turkish },
+  { MOUSEPAD_ENCODING_ISO_8859_9,   letters_turkish },
+  { MOUSEPAD_ENCODING_WINDOWS_1255, letters_hebrew },
+  { MOUSEPAD_ENCODING_ISO_8859_8,   letters_hebrew },
+  { MOUSEPAD_ENCODING_WINDOWS_1256, letters_arabic },
+  { MOUSEPAD_ENCODING_ISO_8859_6,   letters_arabic },
+  { MOUSEPAD_ENCODING_WINDOWS_1257, letters_baltic },
+  { MOUSEPAD_ENCODING_ISO_8859_13,  letters_baltic },
+  { MOUSEPAD_ENCODING_ISO_8859_4,   letters_baltic },
+  { MOUSEPAD_ENCODING_TIS_620,      letters_thai },
+  { MOUSEPAD_ENCODING_WINDOWS_1258, NULL },
+  { MOUSEPAD_ENCODING_IBM_850,      letters_western },
+  { MOUSEPAD_ENCODING_IBM_852,      letters_central },
+  { MOUSEPAD_ENCODING_IBM_855,      letters_cyrillic },
+  { MOUSEPAD_ENCODING_IBM_857,      letters_turkish },
+  { MOUSEPAD_ENCODING_IBM_862,      letters_hebrew },
+  { MOUSEPAD_ENCODING_IBM_864,      letters_arabic },
+  { MOUSEPAD_ENCODING_ISO_8859_3,   NULL },
+  { MOUSEPAD_ENCODING_ISO_8859_10,  letters_western },
+  { MOUSEPAD_ENCODING_ISO_8859_14,  letters_western },
+  { MOUSEPAD_ENCODING_ISO_8859_16,  letters_romanian },
+  { MOUSEPAD_ENCODING_ISO_IR_111,   letters_cyrillic },
+  { MOUSEPAD_ENCODING_ARMSCII_8,    NULL },
+  { MOUSEPAD_ENCODING_GEOSTD8,      NULL },
+  { MOUSEPAD_ENCODING_TCVN,         NULL },
+  { MOUSEPAD_ENCODING_VISCII,       NULL }
+};
+
+/* the characters of the high bytes in each single byte encoding, 0 if unmapped */
+static gunichar single_byte_maps[G_N_ELEMENTS (single_byte_encodings)][128];
+
+/* how typical each high byte is for the languages of the encoding, between 0 and 1 */
+static gfloat single_byte_weights[G_N_ELEMENTS (single_byte_encodings)][128];
+
+
+
+static void
+mousepad_encoding_detector_init_weights (const gunichar *map,
+                                         const gchar    *letters,
+                                         gfloat         *weights)
+{
+  const gchar *p;
+  guint        i, rank, n_letters;
+  gunichar     c;
+
+  n_letters = letters != NULL ? g_utf8_strlen (letters, -1) : 0;
+
+  for (i = 0; i < 128; i++)
+    {
+      /* low when we know nothing about the languages, those are rarely used */
+      weights[i] = 0.2;
+      if (n_letters == 0 || !g_unichar_isalpha (map[i]))
+        continue;
+
+      /* more frequent letters get a higher weight, others none */
+      weights[i] = 0.0;
+      c = g_unichar_tolower (map[i]);
+      for (p = letters, rank = 0; *p != '\0'; p = g_utf8_next_char (p), rank++)
+        if (g_utf8_get_char (p) == c)
+          {
+            weights[i] = 8.0 / (8.0 + rank);
+            break;
+          }
+    }
+}
+
+
+
+static void
+mousepad_encoding_detector_init_maps (void)
+{
+  static gsize  initialized = 0;
+  GIConv        conv;
+  guint         i, c;
+  gchar         inbuf[1], outbuf[8];
+  gchar        *in, *out;
+  gsize         n_in, n_out;
+
+  if (g_once_init_enter (&initialized))
+    {
+      for (i = 0; i < G_N_ELEMENTS (single_byte_encodings); i++)
+        {
+          /* an encoding iconv does not know never scores */
+          conv = g_iconv_open ("UTF-8", mousepad_encoding_get_charset (single_byte_encodings[i].encoding));
+          if (G_UNLIKELY (conv == (GIConv) -1))
+            continue;
+
+          for (c = 0x80; c <= 0xff; c++)
+            {
+              inbuf[0] = c;
+              in = inbuf, n_in = 1;
+              out = outbuf, n_out = sizeof (outbuf);
+
+              /* reset the state and convert the byte */
+              g_iconv (conv, NULL, NULL, NULL, NULL);
+              if (g_iconv (conv, &in, &n_in, &out, &n_out) != (gsize) -1 && n_in == 0 && out > outbuf)
+                single_byte_maps[i][c - 0x80] = g_utf8_get_char (outbuf);
+            }
+
+          g_iconv_close (conv);
+
+          mousepad_encoding_detector_init_weights (single_byte_maps[i], single_byte_encodings[i].letters,
+                                                   single_byte_weights[i]);
+        }
+
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+
+
+static gboolean
+mousepad_encoding_detector_is_common (const guint16 *table,
+                                      guint          n_entries,
+                                      guchar         lead,
+                                      guchar         trail)
+{
+  guint16 code = (lead << 8) | trail;
+  guint   low = 0, high = n_entries, mid;
+
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      if (table[mid] == code)
+        return TRUE;
+      else if (table[mid] < code)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_encoding_detector_machine_feed (MousepadEncodingMachine *machine,
+                                         guchar                   c)
+{
+  guchar lead = machine->lead;
+
+  switch (machine->family)
+    {
+      case FAMILY_SHIFT_JIS:
+        if (machine->state == 0)
+          {
+            /* half-width katakana are rare in text, but any single high byte looks like one */
+            if (c >= 0xa1 && c <= 0xdf)
+              machine->n_rare++;
+            else if ((c >= 0x81 && c <= 0x9f) || (c >= 0xe0 && c <= 0xfc))
+              machine->state = 1;
+            else if (c >= 0x80)
+              machine->n_errors++;
+
+            machine->lead = c;
+          }
+        else if ((c >= 0x40 && c <= 0x7e) || (c >= 0x80 && c <= 0xfc))
+          {
+            /* hiragana and katakana */
+            machine->n_common += (lead == 0x82 || lead == 0x83);
+            machine->n_low_trails += (c < 0x80);
+            machine->n_chars++;
+            machine->state = 0;
+          }
+        else
+          {
+            machine->n_errors++;
+            machine->state = 0;
+          }
+        break;
+
+      case FAMILY_EUC_JP:
+        if (machine->state == 0)
+          {
+            /* a two byte character, a half width katakana or a three byte character */
+            if (c >= 0xa1 && c <= 0xfe)
+              machine->state = 1;
+            else if (c == 0x8e)
+              machine->state = 3;
+            else if (c == 0x8f)
+              machine->state = 2;
+            else if (c >= 0x80)
+              machine->n_errors++;
+
+            machine->lead = c;
+          }
+        else if (machine->state == 3 ? (c >= 0xa1 && c <= 0xdf) : (c >= 0xa1 && c <= 0xfe))
+          {
+            if (machine->state == 2)
+              {
+                machine->state = 1;
+              }
+            else
+              {
+                /* hiragana and katakana */
+                machine->n_common += (lead == 0xa4 || lead == 0xa5);
+                machine->n_chars++;
+                machine->state = 0;
+              }
+          }
+        else
+          {
+            machine->n_errors++;
+            machine->state = 0;
+          }
+        break;
+
+      case FAMILY_KOREAN:
+        if (machine->state == 0)
+          {
+            if (c >= 0x81 && c <= 0xfe)
+              machine->state = 1;
+            else if (c >= 0x80)
+              machine->n_errors++;
+
+            machine->lead = c;
+          }
+        else if ((c >= 0x41 && c <= 0x5a) || (c >= 0x61 && c <= 0x7a) || (c >= 0x81 && c <= 0xfe))
+          {
+            /* the uhc extensions to euc-kr */
+            if (lead < 0xa1 || c < 0xa1)
+              machine->extended = TRUE;
+
+            machine->n_common += mousepad_encoding_detector_is_common (common_korean, G_N_ELEMENTS (common_korean), lead, c);
+            machine->n_low_trails += (c < 0x80);
+            machine->n_chars++;
+            machine->state = 0;
+          }
+        else
+          {
+            machine->n_errors++;
+            machine->state = 0;
+          }
+        break;
+
+      case FAMILY_CHINESE_SIMPLIFIED:
+        if (machine->state == 0)
+          {
+            if (c >= 0x81 && c <= 0xfe)
+              machine->state = 1;
+            else if (c >= 0x80)
+              machine->n_errors++;
+
+            machine->lead = c;
+          }
+        else if (machine->state == 1 && c >= 0x30 && c <= 0x39)
+          {
+            /* four byte gb18030 sequence */
+            machine->extended = TRUE;
+            machine->state = 2;
+          }
+        else if (machine->state == 1 && ((c >= 0x40 && c <= 0x7e) || (c >= 0x80 && c <= 0xfe)))
+          {
+            machine->n_common += mousepad_encoding_detector_is_common (common_gbk, G_N_ELEMENTS (common_gbk), lead, c);
+            machine->n_low_trails += (c < 0x80);
+            machine->n_chars++;
+            machine->state = 0;
+          }
+        else if (machine->state == 2 && c >= 0x81 && c <= 0xfe)
+          {
+            machine->state = 3;
+          }
+        else if (machine->state == 3 && c >= 0x30 && c <= 0x39)
+          {
+            machine->n_chars++;
+            machine->state = 0;
+          }
+        else
+          {
+            machine->n_errors++;
+            machine->state = 0;
+          }
+        break;
+
+      case FAMILY_CHINESE_TRADITIONAL:
+        if (machine->state == 0)
+          {
+            if (c >= 0x81 && c <= 0xfe)
+              {
+                /* hkscs extensions */
+                if (c < 0xa1)
+                  machine->extended = TRUE;
+
+                machine->lead = c;
+                machine->state = 1;
+              }
+            else if (c >= 0x80)
+              machine->n_errors++;
+          }
+        else if ((c >= 0x40 && c <= 0x7e) || (c >= 0xa1 && c <= 0xfe))
+          {
+            machine->n_common += mousepad_encoding_detector_is_common (common_big5, G_N_ELEMENTS (common_big5), lead, c);
+            machine->n_low_trails += (c < 0x80);
+            machine->n_chars++;
+            machine->state = 0;
+          }
+        else
+          {
+            machine->n_errors++;
+            machine->state = 0;
+          }
+        break;
+
+      default:
+        g_assert_not_reached ();
+    }
+}
+
+
+
+static gdouble
+mousepad_encoding_detector_machine_validity (const MousepadEncodingMachine *machine)
+{
+  gdouble validity;
+
+  if (machine->n_chars == 0)
+    return 0.0;
+
+  /* a few invalid sequences quickly rule out the encoding */
+  validity = (gdouble) machine->n_chars / (machine->n_chars + 8 * machine->n_errors + machine->n_rare);
+
+  /* an accented latin letter followed by an ascii letter also looks like a
+   * character with a trail byte below 0x80, real text has most above it */
+  return validity * MIN (1.0, 2.5 * (machine->n_chars - machine->n_low_trails) / machine->n_chars);
+}
+
+
+
+static gdouble
+mousepad_encoding_detector_machine_common (const MousepadEncodingMachine *machine,
+                                           const MousepadEncodingStats   *stats)
+{
+  gdouble common, spacing;
+
+  if (machine->n_chars == 0)
+    return 0.0;
+
+  /* the most frequent characters make up more than a third of real text,
+   * and next to nothing of text decoded with the wrong encoding */
+  common = MIN (1.0, 2.5 * machine->n_common / machine->n_chars);
+
+  /* korean puts spaces between words, chinese and japanese do not */
+  spacing = (gdouble) stats->n_spaced / machine->n_chars;
+  if (machine->family == FAMILY_KOREAN)
+    common *= MIN (1.0, 0.5 + 3.0 * spacing);
+  else
+    common *= MAX (0.0, 1.0 - 2.0 * spacing);
+
+  return common;
+}
+
+
+
+static gdouble
+mousepad_encoding_detector_machine_score (const MousepadEncodingMachine *machine,
+                                          const MousepadEncodingStats   *stats)
+{
+  gdouble validity, common;
+
+  validity = mousepad_encoding_detector_machine_validity (machine);
+  common = mousepad_encoding_detector_machine_common (machine, stats);
+
+  return validity * validity * validity * (0.3 + 0.7 * common);
+}
+
+
+
+static gboolean
+mousepad_encoding_detector_is_punctuation (gunichar c)
+{
+  switch (g_unichar_type (c))
+    {
+      case G_UNICODE_CONNECT_PUNCTUATION:
+      case G_UNICODE_DASH_PUNCTUATION:
+      case G_UNICODE_CLOSE_PUNCTUATION:
+      case G_UNICODE_FINAL_PUNCTUATION:
+      case G_UNICODE_INITIAL_PUNCTUATION:
+      case G_UNICODE_OTHER_PUNCTUATION:
+      case G_UNICODE_OPEN_PUNCTUATION:
+        return TRUE;
+
+      default:
+        return FALSE;
+    }
+}
+
+
+
+static gdouble
+mousepad_encoding_detector_single_byte_score (const MousepadEncodingStats *stats,
+                                              const gunichar              *map,
+                                              const gfloat                *weights)
+{
+  gdouble         score = 0.0, language = 0.0;
+  gsize           n_letters = 0;
+  gunichar        a, b;
+  GUnicodeScript  script_a, script_b;
+  guint           i, j;
+  gsize           n;
+
+  for (i = 0; i < 128; i++)
+    {
+      n = stats->hist[i + 0x80];
+      if (n == 0)
+        continue;
+
+      a = map[i];
+      if (a == 0 || g_unichar_iscntrl (a) || !g_unichar_isdefined (a))
+        {
+          /* control characters and unmapped bytes are unlikely in text */
+          score -= 4.0 * n;
+        }
+      else if (g_unichar_isalpha (a))
+        {
+          /* letters, uppercase letters are less common */
+          score += (g_unichar_isupper (a) ? 0.7 : 1.0) * n;
+
+          /* how well the letters match the languages of the encoding */
+          language += weights[i] * n;
+          n_letters += n;
+
+          /* accented latin letters are found between ascii letters, other scripts are not */
+          if (g_unichar_get_script (a) == G_UNICODE_SCRIPT_LATIN)
+            score += stats->adjacent[i];
+          else
+            score -= stats->adjacent[i];
+        }
+      else if (mousepad_encoding_detector_is_punctuation (a))
+        {
+          /* punctuation is found before or after a word, not inside it */
+          score += n + stats->adjacent[i] - 3.0 * stats->inside[i];
+        }
+      else
+        {
+          /* other symbols, which are not found in the middle of words */
+          score += 0.5 * n - stats->adjacent[i];
+        }
+    }
+
+  /* runs of high bytes are words in a non-latin script, they should not mix
+   * scripts or go from lower to upper case */
+  for (i = 0; i < 128; i++)
+    {
+      a = map[i];
+      if (stats->hist[i + 0x80] == 0 || !g_unichar_isalpha (a))
+        continue;
+
+      script_a = g_unichar_get_script (a);
+
+      for (j = 0; j < 128; j++)
+        {
+          n = stats->pairs[i * 128 + j];
+          if (n == 0)
+            continue;
+
+          b = map[j];
+          if (!g_unichar_isalpha (b))
+            continue;
+
+          script_b = g_unichar_get_script (b);
+          if (script_a == G_UNICODE_SCRIPT_LATIN
+              || script_a != script_b
+              || (g_unichar_islower (a) && g_unichar_isupper (b)))
+            score -= n;
+          else
+            score += n;
+        }
+    }
+
+  score = CLAMP (score / (stats->n_high + stats->n_pairs + stats->n_adjacent), 0.0, 1.0);
+
+  /* letter frequencies tell apart encodings that decode to plausible text */
+  if (n_letters > 0)
+    score *= 0.3 + 0.7 * language / n_letters;
+
+  return score;
+}
+
+
+
+static gboolean
+mousepad_encoding_detector_utf8_valid (const gchar *contents,
+                                       gsize        length)
+{
+  const gchar *end;
+  const guchar *p;
+  guint         needed, n;
+
+  if (g_utf8_validate (contents, length, &end))
+    return TRUE;
+
+  /* allow a character cut off at the end of the sample, not of a whole file */
+  if (length < MOUSEPAD_ENCODING_DETECTOR_SAMPLE_SIZE)
+    return FALSE;
+
+  p = (const guchar *) end;
+  n = (contents + length) - end;
+  if (*p >= 0xc2 && *p <= 0xdf)
+    needed = 2;
+  else if (*p >= 0xe0 && *p <= 0xef)
+    needed = 3;
+  else if (*p >= 0xf0 && *p <= 0xf4)
+    needed = 4;
+  else
+    return FALSE;
+
+  if (n >= needed)
+    return FALSE;
+
+  while (--n > 0)
+    if ((*++p & 0xc0) != 0x80)
+      return FALSE;
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_encoding_detector_equivalent (const MousepadEncodingCandidate *a,
+                                       const MousepadEncodingCandidate *b,
+                                       const MousepadEncodingStats     *stats)
+{
+  guint i;
+
+  if (a->family != b->family)
+    return FALSE;
+
+  if (a->family != FAMILY_SINGLE_BYTE)
+    return TRUE;
+
+  /* single byte encodings that map the bytes in the text to the same characters */
+  for (i = 0; i < 128; i++)
+    if (stats->hist[i + 0x80] > 0 && a->map[i] != b->map[i])
+      return FALSE;
+
+  return TRUE;
+}
+
+
+
+static gint
+mousepad_encoding_detector_compare (gconstpointer a,
+                                    gconstpointer b)
+{
+  const MousepadEncodingCandidate *ca = a;
+  const MousepadEncodingCandidate *cb = b;
+
+  if (ca->score != cb->score)
+    return ca->score > cb->score ? -1 : 1;
+
+  return (gint) ca->order - (gint) cb->order;
+}
+
+
+
+static void
+mousepad_encoding_detector_add (GArray                 *candidates,
+                                MousepadEncoding        encoding,
+                                MousepadEncodingFamily  family,
+                                gdouble                 score,
+                                const gunichar         *map)
+{
+  MousepadEncodingCandidate candidate;
+
+  if (score <= 0.0)
+    return;
+
+  /* prefer the encoding of the user's locale in a tie */
+  if (encoding == mousepad_encoding_user ())
+    score = MIN (score + 0.02, 1.0);
+
+  candidate.encoding = encoding;
+  candidate.family = family;
+  candidate.score = score;
+  candidate.order = candidates->len;
+  candidate.map = map;
+
+  g_array_append_val (candidates, candidate);
+}
+
+
+
+/**
+ * mousepad_encoding_detect:
+ * @contents  : the raw file contents, or the start of it.
+ * @length    : length of @contents.
+ * @guesses   : return location for the guesses, best first.
+ * @n_guesses : room in @guesses.
+ *
+ * Scans @contents once and scores the encodings from byte statistics:
+ * byte order marks, nul byte patterns, the validity of the multibyte
+ * encodings and how well the high bytes decode to text in each single
+ * byte encoding.
+ *
+ * Return value: the number of guesses stored in @guesses.
+ **/
+guint
+mousepad_encoding_detect (const gchar           *contents,
+                          gsize                  length,
+                          MousepadEncodingGuess *guesses,
+                          guint                  n_guesses)
+{
+  MousepadEncodingStats      stats;
+  MousepadEncodingMachine    machines[5];
+  MousepadEncodingCandidate *candidate, *best, swap;
+  GArray                    *candidates;
+  const guchar              *p, *end;
+  guchar                     c, prev = 0, prev2 = 0;
+  gboolean                   in_sequence = FALSE;
+  gsize                      n_units, nuls;
+  gdouble                    score, confidence, nul_penalty, multibyte_penalty, validity;
+  guint                      i, n;
+
+  g_return_val_if_fail (contents != NULL || length == 0, 0);
+  g_return_val_if_fail (guesses != NULL || n_guesses == 0, 0);
+
+  if (length == 0 || n_guesses == 0)
+    return 0;
+
+  p = (const guchar *) contents;
+
+  /* a byte order mark leaves no doubt */
+  if (length >= 3 && p[0] == 0xef && p[1] == 0xbb && p[2] == 0xbf)
+    guesses[0].encoding = MOUSEPAD_ENCODING_UTF_8;
+  else if (length >= 4 && p[0] == 0xff && p[1] == 0xfe && p[2] == 0x00 && p[3] == 0x00)
+    guesses[0].encoding = MOUSEPAD_ENCODING_UTF_32LE;
+  else if (length >= 4 && p[0] == 0x00 && p[1] == 0x00 && p[2] == 0xfe && p[3] == 0xff)
+    guesses[0].encoding = MOUSEPAD_ENCODING_UTF_32BE;
+  else if (length >= 2 && p[0] == 0xff && p[1] == 0xfe)
+    guesses[0].encoding = MOUSEPAD_ENCODING_UTF_16LE;
+  else if (length >= 2 && p[0] == 0xfe && p[1] == 0xff)
+    guesses[0].encoding = MOUSEPAD_ENCODING_UTF_16BE;
+  else
+    guesses[0].encoding = MOUSEPAD_ENCODING_NONE;
+
+  if (guesses[0].encoding != MOUSEPAD_ENCODING_NONE)
+    {
+      guesses[0].confidence = 1.0;
+      return 1;
+    }
+
+  /* setup the multibyte state machines */
+  memset (machines, 0, sizeof (machines));
+  machines[0].family = FAMILY_SHIFT_JIS;
+  machines[0].encoding = machines[0].extended_encoding = MOUSEPAD_ENCODING_SHIFT_JIS;
+  machines[1].family = FAMILY_EUC_JP;
+  machines[1].encoding = machines[1].extended_encoding = MOUSEPAD_ENCODING_EUC_JP;
+  machines[2].family = FAMILY_KOREAN;
+  machines[2].encoding = MOUSEPAD_ENCODING_EUC_KR;
+  machines[2].extended_encoding = MOUSEPAD_ENCODING_UHC;
+  machines[3].family = FAMILY_CHINESE_SIMPLIFIED;
+  machines[3].encoding = MOUSEPAD_ENCODING_GBK;
+  machines[3].extended_encoding = MOUSEPAD_ENCODING_GB18030;
+  machines[4].family = FAMILY_CHINESE_TRADITIONAL;
+  machines[4].encoding = MOUSEPAD_ENCODING_BIG5;
+  machines[4].extended_encoding = MOUSEPAD_ENCODING_BIG5_HKSCS;
+
+  /* collect the byte statistics in a single pass */
+  memset (&stats, 0, sizeof (stats));
+  stats.pairs = g_new0 (guint32, 128 * 128);
+
+  for (end = p + length; p < end; p++)
+    {
+      c = *p;
+      stats.hist[c]++;
+
+      if (G_UNLIKELY (c == 0))
+        stats.zeros[((const gchar *) p - contents) & 3]++;
+
+      if (c >= 0x80)
+        {
+          if (prev >= 0x80)
+            {
+              stats.pairs[(prev - 0x80) * 128 + (c - 0x80)]++;
+              stats.n_pairs++;
+            }
+          else if (g_ascii_isalpha (prev))
+            {
+              stats.adjacent[c - 0x80]++;
+              stats.n_adjacent++;
+            }
+        }
+      else if (prev >= 0x80)
+        {
+          if (g_ascii_isalpha (c))
+            {
+              stats.adjacent[prev - 0x80]++;
+              stats.n_adjacent++;
+
+              if (g_ascii_isalpha (prev2))
+                stats.inside[prev - 0x80]++;
+            }
+          else if (c == ' ')
+            {
+              stats.n_spaced++;
+            }
+        }
+
+      /* ascii outside a multibyte character does not change the machines */
+      if (c >= 0x80 || in_sequence)
+        {
+          for (in_sequence = FALSE, i = 0; i < G_N_ELEMENTS (machines); i++)
+            {
+              mousepad_encoding_detector_machine_feed (&machines[i], c);
+              in_sequence |= (machines[i].state != 0);
+            }
+        }
+
+      prev2 = prev;
+      prev = c;
+    }
+
+  for (i = 128; i < 256; i++)
+    stats.n_high += stats.hist[i];
+
+  candidates = g_array_new (FALSE, FALSE, sizeof (MousepadEncodingCandidate));
+
+  /* nul bytes in the high or low half of the code units */
+  n_units = MAX (length / 4, 1);
+  mousepad_encoding_detector_add (candidates, MOUSEPAD_ENCODING_UTF_32LE, FAMILY_UTF_32LE,
+                                  ((gdouble) MIN (stats.zeros[2], stats.zeros[3]) - stats.zeros[0]) / n_units, NULL);
+  mousepad_encoding_detector_add (candidates, MOUSEPAD_ENCODING_UTF_32BE, FAMILY_UTF_32BE,
+                                  ((gdouble) MIN (stats.zeros[0], stats.zeros[1]) - stats.zeros[3]) / n_units, NULL);
+  mousepad_encoding_detector_add (candidates, MOUSEPAD_ENCODING_UTF_16LE, FAMILY_UTF_16LE,
+                                  ((gdouble) MIN (stats.zeros[1], stats.zeros[3]) - MAX (stats.zeros[0], stats.zeros[2])) / n_units, NULL);
+  mousepad_encoding_detector_add (candidates, MOUSEPAD_ENCODING_UTF_16BE, FAMILY_UTF_16BE,
+                                  ((gdouble) MIN (stats.zeros[0], stats.zeros[2]) - MAX (stats.zeros[1], stats.zeros[3])) / n_units, NULL);
+
+  /* the 8 bit encodings are unlikely when the text has nul bytes */
+  nuls = stats.hist[0];
+  nul_penalty = CLAMP (1.0 - 4.0 * nuls / length, 0.0, 1.0);
+
+  /* escape sequences of the 7 bit encodings */
+  if (stats.hist[0x1b] > 0 && stats.n_high == 0)
+    {
+      if (g_strstr_len (contents, length, "\033$B") != NULL
+          || g_strstr_len (contents, length, "\033$@") != NULL)
+        mousepad_encoding_detector_add (candidates, MOUSEPAD_ENCODING_ISO_2022_JP, FAMILY_ISO_2022_JP,
+                                        0.95 * nul_penalty, NULL);
+
+      if (g_strstr_len (contents, length, "\033$)C") != NULL)
+        mousepad_encoding_detector_add (candidates, MOUSEPAD_ENCODING_ISO_2022_KR, FAMILY_ISO_2022_KR,
+                                        0.95 * nul_penalty, NULL);
+    }
+
+  if (mousepad_encoding_detector_utf8_valid (contents, length))
+    mousepad_encoding_detector_add (candidates, MOUSEPAD_ENCODING_UTF_8, FAMILY_UTF_8,
+                                    (candidates->len > 0 ? 0.5 : 1.0) * nul_penalty, NULL);
+
+  if (stats.n_high > 0)
+    {
+      /* multibyte encodings */
+      for (i = 0, multibyte_penalty = 1.0; i < G_N_ELEMENTS (machines); i++)
+        {
+          mousepad_encoding_detector_add (candidates,
+                                          machines[i].extended ? machines[i].extended_encoding : machines[i].encoding,
+                                          machines[i].family,
+                                          mousepad_encoding_detector_machine_score (&machines[i], &stats) * nul_penalty,
+                                          NULL);
+
+          /* single byte text rarely has all its high bytes in valid pairs
+           * that decode to frequent characters */
+          if (machines[i].n_chars >= 8)
+            {
+              validity = mousepad_encoding_detector_machine_validity (&machines[i]);
+              validity *= validity * mousepad_encoding_detector_machine_common (&machines[i], &stats);
+              multibyte_penalty = MIN (multibyte_penalty, 1.0 - 0.5 * validity * validity);
+            }
+        }
+
+      /* single byte encodings */
+      mousepad_encoding_detector_init_maps ();
+
+      for (i = 0; i < G_N_ELEMENTS (single_byte_encodings); i++)
+        {
+          score = mousepad_encoding_detector_single_byte_score (&stats, single_byte_maps[i], single_byte_weights[i]);
+          mousepad_encoding_detector_add (candidates, single_byte_encodings[i].encoding, FAMILY_SINGLE_BYTE,
+                                          score * nul_penalty * multibyte_penalty, single_byte_maps[i]);
+        }
+    }
+
+  /* rank the candidates */
+  g_array_sort (candidates, mousepad_encoding_detector_compare);
+
+  /* encodings that decode the text the same way are ranked by preference,
+   * not by how well their languages match the text */
+  for (i = 0; i < candidates->len; i++)
+    for (n = i + 1; n < candidates->len; n++)
+      {
+        best = &g_array_index (candidates, MousepadEncodingCandidate, i);
+        candidate = &g_array_index (candidates, MousepadEncodingCandidate, n);
+        if (candidate->order < best->order
+            && mousepad_encoding_detector_equivalent (best, candidate, &stats))
+          {
+            score = best->score;
+            swap = *best;
+            *best = *candidate;
+            *candidate = swap;
+            candidate->score = best->score;
+            best->score = score;
+          }
+      }
+
+  if (candidates->len > 0)
+    {
+      /* the confidence depends on how far ahead the best guess is of the
+       * first one that decodes the text differently */
+      best = &g_array_index (candidates, MousepadEncodingCandidate, 0);
+      confidence = MIN (1.0, 2.0 * best->score);
+      for (i = 1; i < candidates->len; i++)
+        {
+          candidate = &g_array_index (candidates, MousepadEncodingCandidate, i);
+          if (!mousepad_encoding_detector_equivalent (best, candidate, &stats))
+            {
+              confidence *= CLAMP (0.5 + 2.0 * (best->score - candidate->score) / best->score, 0.0, 1.0);
+              break;
+            }
+        }
+
+      /* a few accented letters are not enough to be sure */
+      if (stats.n_high > 0 && stats.n_high < MOUSEPAD_ENCODING_DETECTOR_MIN_HIGH_BYTES)
+        confidence *= 0.5 + 0.5 * stats.n_high / MOUSEPAD_ENCODING_DETECTOR_MIN_HIGH_BYTES;
+
+      /* return the best guesses, relative to the confidence in the best */
+      for (n = 0; n < n_guesses && n < candidates->len; n++)
+        {
+          candidate = &g_array_index (candidates, MousepadEncodingCandidate, n);
+          guesses[n].encoding = candidate->encoding;
+          guesses[n].confidence = confidence * candidate->score / best->score;
+        }
+    }
+  else
+    {
+      n = 0;
+    }
+
+  /* cleanup */
+  g_array_free (candidates, TRUE);
+  g_free (stats.pairs);
+
+  return n;
+}
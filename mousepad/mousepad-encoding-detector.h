@@ -0,0 +1,48 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_ENCODING_DETECTOR_H__
+#define __MOUSEPAD_ENCODING_DETECTOR_H__
+
+#include <mousepad/mousepad-encoding.h>
+
+G_BEGIN_DECLS
+
+/* guesses with at least this confidence are used without asking the user */
+#define MOUSEPAD_ENCODING_DETECTOR_CONFIDENT (0.8)
+
+/* number of bytes at the start of a file the detector looks at */
+#define MOUSEPAD_ENCODING_DETECTOR_SAMPLE_SIZE (4 * 1024 * 1024)
+
+typedef struct _MousepadEncodingGuess MousepadEncodingGuess;
+
+struct _MousepadEncodingGuess
+{
+  MousepadEncoding encoding;
+
+  /* between 0 and 1, lowered when another encoding that decodes
+   * the text differently scores about as well */
+  gdouble          confidence;
+};
+
+guint mousepad_encoding_detect (const gchar           *contents,
+                                gsize                  length,
+                                MousepadEncodingGuess *guesses,
+                                guint                  n_guesses);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_ENCODING_DETECTOR_H__ */
@@ -24,13 +24,39 @@
 #include <glib/gstdio.h>
 #include <gtksourceview/gtksourceview.h>
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+
+
+/* number of detected encodings shown at the top of the combo box */
+#define MOUSEPAD_ENCODING_DIALOG_N_GUESSES    (5)
+
+/* number of encodings tested at the same time */
+#define MOUSEPAD_ENCODING_DIALOG_MAX_THREADS  (4)
+
+/* bytes at the start of the file every encoding is tested on first */
+#define MOUSEPAD_ENCODING_DIALOG_PREFIX_SIZE  (64 * 1024)
+
+/* size of the input and output windows of a test conversion */
+#define MOUSEPAD_ENCODING_DIALOG_WINDOW_SIZE  (64 * 1024)
+
+/* bytes at the start of the file shown in the preview */
+#define MOUSEPAD_ENCODING_DIALOG_PREVIEW_SIZE (256 * 1024)
+
+
+
+typedef struct _MousepadEncodingTest     MousepadEncodingTest;
+typedef struct _MousepadEncodingTestTask MousepadEncodingTestTask;
+
 
 
 static void     mousepad_encoding_dialog_finalize               (GObject                     *object);
 static void     mousepad_encoding_dialog_response               (GtkDialog                   *dialog,
                                                                  gint                         response_id);
-//~ static gboolean mousepad_encoding_dialog_test_encodings_idle    (gpointer                     user_data);
-//~ static void     mousepad_encoding_dialog_test_encodings_destroy (gpointer                     user_data);
+static void     mousepad_encoding_dialog_test_unref             (MousepadEncodingTest        *test);
+static void     mousepad_encoding_dialog_test_finished          (MousepadEncodingDialog      *dialog);
 static void     mousepad_encoding_dialog_test_encodings         (MousepadEncodingDialog      *dialog);
 static void     mousepad_encoding_dialog_cancel_test_encodings  (GtkWidget                   *button,
                                                                  MousepadEncodingDialog      *dialog);
@@ -55,6 +81,42 @@ struct _MousepadEncodingDialogClass
   GtkDialogClass __parent__;
 };
 
+struct _MousepadEncodingTest
+{
+  /* shared by the dialog and the tasks */
+  gint                    ref_count;
+
+  /* set to stop the workers */
+  volatile gint           cancelled;
+
+  /* the file contents, only the start of a compressed file */
+  GBytes                 *bytes;
+  const gchar            *contents;
+  gsize                   length;
+  gboolean                complete;
+
+  /* the dialog, NULL once it is destroyed, only used in the main loop */
+  MousepadEncodingDialog *dialog;
+
+  /* finished tasks and the encodings that passed, only used in the main loop */
+  guint                   n_finished;
+  gboolean               *passed;
+};
+
+struct _MousepadEncodingTestTask
+{
+  MousepadEncodingTest   *test;
+
+  /* index in encoding_infos */
+  guint                   index;
+
+  /* whether the task tests the whole file, after the prefix */
+  gboolean                full;
+
+  /* result of the test */
+  gboolean                passed;
+};
+
 struct _MousepadEncodingDialog
 {
   GtkDialog __parent__;
@@ -62,11 +124,8 @@ struct _MousepadEncodingDialog
   /* the file */
   MousepadDocument *document;
 
-  /* encoding test idle id */
-  guint          timer_id;
-
-  /* boolean to cancel the testing loop */
-  guint          cancel_testing : 1;
+  /* the running encoding test */
+  MousepadEncodingTest *test;
 
   /* dialog widget */
   GtkWidget     *button_ok;
@@ -83,10 +142,18 @@ struct _MousepadEncodingDialog
   /* other encodings combo box */
   GtkListStore  *store;
   GtkWidget     *combo;
+
+  /* detected encodings, the most likely first */
+  MousepadEncodingGuess guesses[MOUSEPAD_ENCODING_DIALOG_N_GUESSES];
+  guint                 n_guesses;
 };
 
 
 
+static GThreadPool *test_pool = NULL;
+
+
+
 G_DEFINE_TYPE (MousepadEncodingDialog, mousepad_encoding_dialog, GTK_TYPE_DIALOG)
 
 
@@ -214,9 +281,13 @@ mousepad_encoding_dialog_finalize (GObject *object)
 {
   MousepadEncodingDialog *dialog = MOUSEPAD_ENCODING_DIALOG (object);
 
-  /* stop running timeout */
-  if (G_UNLIKELY (dialog->timer_id))
-    g_source_remove (dialog->timer_id);
+  /* stop the workers, the tasks still queued release the test */
+  if (G_UNLIKELY (dialog->test != NULL))
+    {
+      g_atomic_int_set (&dialog->test->cancelled, TRUE);
+      dialog->test->dialog = NULL;
+      mousepad_encoding_dialog_test_unref (dialog->test);
+    }
 
   /* clear and release store */
   gtk_list_store_clear (dialog->store);
@@ -231,82 +302,223 @@ static void
 mousepad_encoding_dialog_response (GtkDialog *dialog,
                                    gint       response_id)
 {
+  MousepadEncodingTest *test = MOUSEPAD_ENCODING_DIALOG (dialog)->test;
+
   /* make sure we cancel encoding testing asap */
-  MOUSEPAD_ENCODING_DIALOG (dialog)->cancel_testing = TRUE;
+  if (test != NULL)
+    g_atomic_int_set (&test->cancelled, TRUE);
+}
+
+
+
+static void
+mousepad_encoding_dialog_test_unref (MousepadEncodingTest *test)
+{
+  if (g_atomic_int_dec_and_test (&test->ref_count))
+    {
+      /* release the file contents */
+      if (G_LIKELY (test->bytes != NULL))
+        g_bytes_unref (test->bytes);
+
+      g_free (test->passed);
+      g_slice_free (MousepadEncodingTest, test);
+    }
 }
 
 
 
 static gboolean
-mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
+mousepad_encoding_dialog_convert (const gchar    *contents,
+                                  gsize           length,
+                                  gboolean        eof,
+                                  const gchar    *charset,
+                                  volatile gint  *cancelled,
+                                  GString        *output,
+                                  GError        **error)
 {
-  MousepadEncodingDialog *dialog = MOUSEPAD_ENCODING_DIALOG (user_data);
-  const gchar            *filename;
-  GMappedFile            *mapped_file;
-  GError                 *error = NULL;
-  const gchar            *contents;
-  gsize                   length, written;
-  guint                   i, n;
-  gchar                  *encoded;
+  GIConv    conv;
+  gchar    *inbuf, *outbuf, *window;
+  gsize     inbytes, outbytes, n, result;
+  gsize     offset = 0;
+  gint      errsv;
+  gboolean  succeed = TRUE;
+
+  conv = g_iconv_open ("UTF-8", charset);
+  if (G_UNLIKELY (conv == (GIConv) -1))
+    {
+      /* set an error */
+      g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_NO_CONVERSION,
+                   _("Conversion from character set '%s' to '%s' is not supported"),
+                   charset, "UTF-8");
 
-  /* get the filename */
-  filename = mousepad_file_get_filename (dialog->document->file);
+      return FALSE;
+    }
 
-  /* check if the file exists */
-  if (filename && g_file_test (filename, G_FILE_TEST_EXISTS))
+  /* fixed size output window, appended to the output if we keep the text */
+  window = g_malloc (MOUSEPAD_ENCODING_DIALOG_WINDOW_SIZE);
+
+  while (succeed && offset < length)
     {
-      /* try to open the file */
-      mapped_file = g_mapped_file_new (filename, FALSE, &error);
+      /* stop as soon as the test is cancelled */
+      if (cancelled != NULL && g_atomic_int_get (cancelled))
+        {
+          succeed = FALSE;
+          break;
+        }
+
+      n = MIN (length - offset, MOUSEPAD_ENCODING_DIALOG_WINDOW_SIZE);
+      inbuf = (gchar *) contents + offset;
+      inbytes = n;
 
-      if (G_LIKELY (mapped_file))
+      do
         {
-          /* get the mapped file contents and length */
-          contents = g_mapped_file_get_contents (mapped_file);
-          length = g_mapped_file_get_length (mapped_file);
+          outbuf = window;
+          outbytes = MOUSEPAD_ENCODING_DIALOG_WINDOW_SIZE;
+          result = g_iconv (conv, &inbuf, &inbytes, &outbuf, &outbytes);
+          errsv = errno;
 
-          if (G_LIKELY (contents && length > 0))
+          if (output != NULL)
+            g_string_append_len (output, window, outbuf - window);
+        }
+      while (result == (gsize) -1 && errsv == E2BIG);
+
+      if (result == (gsize) -1)
+        {
+          if (errsv != EINVAL)
+            {
+              /* invalid sequence */
+              g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                           _("Invalid byte sequence in conversion input"));
+              succeed = FALSE;
+            }
+          else if (offset + n == length)
+            {
+              /* an incomplete sequence at the end of a prefix was cut off */
+              if (eof)
+                g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+                             _("Partial character sequence at end of input"));
+              succeed = ! eof;
+              break;
+            }
+          else if (inbytes == n)
             {
-              /* test all the encodings */
-              for (i = 0, n = 0; i < n_encoding_infos && !dialog->cancel_testing; i++)
-                {
-                  /* set progress bar fraction */
-                  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (dialog->progress_bar), (i + 1.00) / n_encoding_infos);
-
-                  /* try to convert the content */
-                  encoded = g_convert (contents, length, "UTF-8", encoding_infos[i].charset, NULL, &written, NULL);
-
-                  if (G_LIKELY (encoded))
-                    {
-                      /* glib uses a faster validator when the string is nul-terminated */
-                      if (G_LIKELY (written > 0 && encoded[written] == '\0'))
-                        written = -1;
-
-                      /* validate the encoded content */
-                      if (G_LIKELY (g_utf8_validate (encoded, written, NULL)))
-                        {
-                          /* insert in the store */
-                          gtk_list_store_insert_with_values (dialog->store, NULL, n++,
-                                                             COLUMN_LABEL, encoding_infos[i].charset,
-                                                             COLUMN_ID, encoding_infos[i].encoding, -1);
-                        }
-
-                      /* cleanup */
-                      g_free (encoded);
-                    }
-
-                  /* iterate the main loop to update the gui */
-                  while (gtk_events_pending ())
-                    gtk_main_iteration ();
-                }
+              /* the window does not move on */
+              g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                           _("Invalid byte sequence in conversion input"));
+              succeed = FALSE;
             }
+        }
 
-          /* close the mapped file */
-#if GLIB_CHECK_VERSION (2, 21, 0)
-          g_mapped_file_unref (mapped_file);
-#else
-          g_mapped_file_free (mapped_file);
-#endif
+      /* continue after the last converted byte */
+      offset += n - inbytes;
+    }
+
+  g_free (window);
+  g_iconv_close (conv);
+
+  return succeed;
+}
+
+
+
+static gboolean
+mousepad_encoding_dialog_test_idle (gpointer user_data)
+{
+  MousepadEncodingTestTask *task = user_data;
+  MousepadEncodingTest     *test = task->test;
+  MousepadEncodingDialog   *dialog = test->dialog;
+  guint                     i, j, n;
+
+  /* ignore results of a destroyed dialog or cancelled test */
+  if (dialog != NULL && dialog->test == test && ! g_atomic_int_get (&test->cancelled))
+    {
+      test->n_finished++;
+
+      /* set progress bar fraction */
+      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (dialog->progress_bar),
+                                     (gdouble) test->n_finished / n_encoding_infos);
+
+      if (task->passed)
+        {
+          /* skip the detected encodings, they are already in the store */
+          for (j = 0; j < dialog->n_guesses; j++)
+            if (dialog->guesses[j].encoding == encoding_infos[task->index].encoding)
+              break;
+
+          if (j == dialog->n_guesses)
+            {
+              /* keep the order of the encodings, whatever order the tests finish in */
+              for (i = 0, n = dialog->n_guesses; i < task->index; i++)
+                n += test->passed[i];
+
+              /* insert in the store */
+              gtk_list_store_insert_with_values (dialog->store, NULL, n,
+                                                 COLUMN_LABEL, encoding_infos[task->index].charset,
+                                                 COLUMN_ID, encoding_infos[task->index].encoding, -1);
+
+              test->passed[task->index] = TRUE;
+            }
         }
+
+      /* all the encodings are tested */
+      if (test->n_finished == n_encoding_infos)
+        mousepad_encoding_dialog_test_finished (dialog);
+    }
+
+  /* cleanup */
+  mousepad_encoding_dialog_test_unref (test);
+  g_slice_free (MousepadEncodingTestTask, task);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_encoding_dialog_test_run (gpointer data,
+                                   gpointer user_data)
+{
+  MousepadEncodingTestTask *task = data;
+  MousepadEncodingTest     *test = task->test;
+  const gchar              *charset = encoding_infos[task->index].charset;
+
+  if (! task->full)
+    {
+      /* reject most encodings quickly on the start of the file */
+      task->passed = mousepad_encoding_dialog_convert (test->contents,
+                                                       MIN (test->length, MOUSEPAD_ENCODING_DIALOG_PREFIX_SIZE),
+                                                       test->complete && test->length <= MOUSEPAD_ENCODING_DIALOG_PREFIX_SIZE,
+                                                       charset, &test->cancelled, NULL, NULL);
+
+      /* queue the whole file for the survivors, after the other prefix tests */
+      if (task->passed && test->length > MOUSEPAD_ENCODING_DIALOG_PREFIX_SIZE)
+        {
+          task->full = TRUE;
+          g_thread_pool_push (test_pool, task, NULL);
+          return;
+        }
+    }
+  else
+    {
+      task->passed = mousepad_encoding_dialog_convert (test->contents, test->length, test->complete,
+                                                       charset, &test->cancelled, NULL, NULL);
+    }
+
+  /* hand the result to the main loop */
+  g_idle_add (mousepad_encoding_dialog_test_idle, task);
+}
+
+
+
+static void
+mousepad_encoding_dialog_test_finished (MousepadEncodingDialog *dialog)
+{
+  /* release the test, running tasks notice it was cancelled */
+  if (dialog->test != NULL)
+    {
+      g_atomic_int_set (&dialog->test->cancelled, TRUE);
+      mousepad_encoding_dialog_test_unref (dialog->test);
+      dialog->test = NULL;
     }
 
   /* hide progress bar and cancel button */
@@ -317,33 +529,60 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
   gtk_widget_show (dialog->radio_other);
   gtk_widget_show (dialog->combo);
 
-  /* select the first item */
-  gtk_combo_box_set_active (GTK_COMBO_BOX (dialog->combo), 0);
-
-  return FALSE;
+  /* select the first item, unless the most likely encoding is selected already */
+  if (dialog->n_guesses == 0)
+    gtk_combo_box_set_active (GTK_COMBO_BOX (dialog->combo), 0);
 }
 
 
 
 static void
-mousepad_encoding_dialog_test_encodings_destroy (gpointer user_data)
+mousepad_encoding_dialog_test_encodings (MousepadEncodingDialog *dialog)
 {
-  MOUSEPAD_ENCODING_DIALOG (user_data)->timer_id = 0;
-}
+  MousepadEncodingTest     *test;
+  MousepadEncodingTestTask *task;
+  const gchar              *filename;
+  guint                     i;
 
+  if (G_UNLIKELY (dialog->test != NULL))
+    return;
 
+  /* create the test */
+  test = g_slice_new0 (MousepadEncodingTest);
+  test->ref_count = 1;
+  test->dialog = dialog;
+  test->passed = g_new0 (gboolean, n_encoding_infos);
+  dialog->test = test;
 
-static void
-mousepad_encoding_dialog_test_encodings (MousepadEncodingDialog *dialog)
-{
-  if (G_LIKELY (dialog->timer_id == 0))
+  /* get the filename */
+  filename = mousepad_file_get_filename (dialog->document->file);
+
+  /* try to open the file, compressed files give their decompressed start */
+  if (filename && g_file_test (filename, G_FILE_TEST_EXISTS))
+    test->bytes = mousepad_file_map_contents (filename, &test->complete, NULL);
+
+  if (G_LIKELY (test->bytes != NULL))
+    test->contents = g_bytes_get_data (test->bytes, &test->length);
+
+  if (G_UNLIKELY (test->contents == NULL || test->length == 0))
     {
-      /* reset boolean */
-      dialog->cancel_testing = FALSE;
+      /* nothing to test */
+      mousepad_encoding_dialog_test_finished (dialog);
+      return;
+    }
+
+  /* test the encodings in the worker pool, the results arrive in idles */
+  if (G_UNLIKELY (test_pool == NULL))
+    test_pool = g_thread_pool_new (mousepad_encoding_dialog_test_run, NULL,
+                                   MOUSEPAD_ENCODING_DIALOG_MAX_THREADS, FALSE, NULL);
 
-      /* start a new idle function */
-      dialog->timer_id = g_idle_add_full (G_PRIORITY_LOW, mousepad_encoding_dialog_test_encodings_idle,
-                                          dialog, mousepad_encoding_dialog_test_encodings_destroy);
+  for (i = 0; i < n_encoding_infos; i++)
+    {
+      task = g_slice_new0 (MousepadEncodingTestTask);
+      task->test = test;
+      task->index = i;
+      g_atomic_int_inc (&test->ref_count);
+      g_thread_pool_push (test_pool, task, NULL);
     }
 }
 
@@ -353,8 +592,8 @@ static void
 mousepad_encoding_dialog_cancel_test_encodings (GtkWidget              *button,
                                                 MousepadEncodingDialog *dialog)
 {
-  /* cancel the testing loop */
-  dialog->cancel_testing = TRUE;
+  /* stop the workers and show the encodings found so far */
+  mousepad_encoding_dialog_test_finished (dialog);
 }
 
 
@@ -364,24 +603,63 @@ mousepad_encoding_dialog_read_file (MousepadEncodingDialog *dialog,
                                     MousepadEncoding        encoding)
 {
   GtkTextIter  start, end;
+  GBytes      *bytes;
   GError      *error = NULL;
+  GString     *preview;
+  const gchar *filename;
+  const gchar *contents;
+  gsize        length;
   gchar       *message;
-  gint         result;
+  gboolean     complete;
+  gboolean     succeed = FALSE;
 
   /* clear buffer */
   gtk_text_buffer_get_bounds (dialog->document->buffer, &start, &end);
   gtk_text_buffer_delete (dialog->document->buffer, &start, &end);
 
-  /* set encoding */
+  /* set encoding, the file is loaded with it when the user confirms */
   mousepad_file_set_encoding (dialog->document->file, encoding);
 
-  /* try to open the file */
-  result = mousepad_file_open (dialog->document->file, NULL, &error);
+  /* try to open the file, compressed files give their decompressed start */
+  filename = mousepad_file_get_filename (dialog->document->file);
+  bytes = mousepad_file_map_contents (filename, &complete, &error);
+
+  if (G_LIKELY (bytes))
+    {
+      /* get the file contents and length */
+      contents = g_bytes_get_data (bytes, &length);
+
+      /* only decode the start of the file, up to the first invalid sequence in it */
+      preview = g_string_new (NULL);
+      succeed = (contents == NULL
+                 || mousepad_encoding_dialog_convert (contents, MIN (length, MOUSEPAD_ENCODING_DIALOG_PREVIEW_SIZE),
+                                                      complete && length <= MOUSEPAD_ENCODING_DIALOG_PREVIEW_SIZE,
+                                                      mousepad_encoding_get_charset (encoding),
+                                                      NULL, preview, &error));
+
+      /* show the decoded text */
+      gtk_text_buffer_get_start_iter (dialog->document->buffer, &start);
+      gtk_text_buffer_insert (dialog->document->buffer, &start, preview->str, preview->len);
+      gtk_text_buffer_set_modified (dialog->document->buffer, FALSE);
+
+      /* show the text in front of the invalid sequence */
+      gtk_text_buffer_get_iter_at_offset (dialog->document->buffer, &start, succeed ? 0 : -1);
+      gtk_text_buffer_place_cursor (dialog->document->buffer, &start);
+      gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (dialog->document->textview),
+                                    gtk_text_buffer_get_insert (dialog->document->buffer),
+                                    0.0, FALSE, 0.0, 0.0);
+
+      /* cleanup */
+      g_string_free (preview, TRUE);
+
+      /* release the file contents */
+      g_bytes_unref (bytes);
+    }
 
   /* set sensitivity of the ok button */
-  gtk_widget_set_sensitive (dialog->button_ok, result == 0);
+  gtk_widget_set_sensitive (dialog->button_ok, succeed);
 
-  if (result == 0)
+  if (succeed)
     {
       /* no error, hide the box */
       gtk_widget_hide (dialog->error_box);
@@ -462,6 +740,7 @@ mousepad_encoding_dialog_new (GtkWindow    *parent,
                               MousepadFile *file)
 {
   MousepadEncodingDialog *dialog;
+  guint                   i;
 
   g_return_val_if_fail (GTK_IS_WINDOW (parent), NULL);
   g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
@@ -475,8 +754,26 @@ mousepad_encoding_dialog_new (GtkWindow    *parent,
   /* set the filename */
   mousepad_file_set_filename (dialog->document->file, mousepad_file_get_filename (file));
 
-  /* start with the system encoding */
-  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (dialog->radio_system), TRUE);
+  /* put the detected encodings at the top of the other encodings */
+  dialog->n_guesses = mousepad_file_guess_encodings (file, dialog->guesses, MOUSEPAD_ENCODING_DIALOG_N_GUESSES);
+  for (i = 0; i < dialog->n_guesses; i++)
+    gtk_list_store_insert_with_values (dialog->store, NULL, i,
+                                       COLUMN_LABEL, mousepad_encoding_get_charset (dialog->guesses[i].encoding),
+                                       COLUMN_ID, dialog->guesses[i].encoding, -1);
+
+  if (dialog->n_guesses > 0)
+    {
+      /* start with the most likely encoding */
+      gtk_widget_show (dialog->radio_other);
+      gtk_widget_show (dialog->combo);
+      gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (dialog->radio_other), TRUE);
+      gtk_combo_box_set_active (GTK_COMBO_BOX (dialog->combo), 0);
+    }
+  else
+    {
+      /* start with the system encoding */
+      gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (dialog->radio_system), TRUE);
+    }
 
   /* queue idle function */
   mousepad_encoding_dialog_test_encodings (dialog);
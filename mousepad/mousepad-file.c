@@ -16,7 +16,13 @@
 
 #include <mousepad/mousepad-private.h>
 #include <mousepad/mousepad-gtkcompat.h>
+#include <mousepad/mousepad-diff.h>
 #include <mousepad/mousepad-file.h>
+#include <mousepad/mousepad-line-index.h>
+#include <mousepad/mousepad-marshal.h>
+#include <mousepad/mousepad-piece-table.h>
+#include <mousepad/mousepad-settings.h>
+#include <mousepad/mousepad-text-scan.h>
 
 #include <glib/gstdio.h>
 #include <gtksourceview/gtksourcebuffer.h>
@@ -35,15 +41,92 @@
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 
 #include <errno.h>
 
 
+
+/* number of bytes read, decoded and inserted per step of the streaming loader */
+#define MOUSEPAD_FILE_LOAD_CHUNK_SIZE      (256 * 1024)
+
+/* files of at least this size are loaded in chunks from the main loop */
+#define MOUSEPAD_FILE_STREAMING_MIN_SIZE   (1024 * 1024)
+
+/* run after the redraws, but before the text view validates its lines */
+#define MOUSEPAD_FILE_LOAD_PRIORITY        (G_PRIORITY_HIGH_IDLE + 22)
+
+/* room for an incomplete multibyte sequence left over from the previous chunk */
+#define MOUSEPAD_FILE_LOAD_CARRY_SIZE      (16)
+
+/* number of decoded blocks the worker thread can queue ahead of the main loop */
+#define MOUSEPAD_FILE_LOAD_MAX_BLOCKS      (4)
+
+/* milliseconds the worker thread waits for a pipe before it checks for a cancel */
+#define MOUSEPAD_FILE_LOAD_POLL_TIMEOUT    (100)
+
+/* size of the input and output windows of the charset converter */
+#define MOUSEPAD_FILE_CONVERT_WINDOW_SIZE  (256 * 1024)
+
+/* number of characters taken from the buffer per step when saving */
+#define MOUSEPAD_FILE_SAVE_CHUNK_SIZE      (64 * 1024)
+
+/* number of chunks the main loop queues ahead of the saving worker */
+#define MOUSEPAD_FILE_SAVE_MAX_CHUNKS      (4)
+
+/* number of files written at the same time */
+#define MOUSEPAD_FILE_SAVE_MAX_THREADS     (4)
+
+/* largest decompressed size of a file that is decompressed at once, larger
+ * files are only opened by the streaming loader */
+#define MOUSEPAD_FILE_DECOMPRESS_MAX_SIZE  (64 * 1024 * 1024)
+
+/* bytes at the start of a file that tell if it is compressed */
+#define MOUSEPAD_FILE_MAGIC_SIZE           (6)
+
+/* bytes at the start of a file used to guess its content type */
+#define MOUSEPAD_FILE_SNIFF_SIZE           (4096)
+
+/* milliseconds between a change on disk and reading the appended bytes */
+#define MOUSEPAD_FILE_FOLLOW_DELAY         (100)
+
+/* milliseconds between checks of a followed file without a monitor */
+#define MOUSEPAD_FILE_FOLLOW_POLL_INTERVAL (1000)
+
+/* microseconds a followed file is read before the main loop runs again */
+#define MOUSEPAD_FILE_FOLLOW_TIME_BUDGET   (20 * 1000)
+
+
+
+typedef struct _MousepadFileLoader      MousepadFileLoader;
+typedef struct _MousepadFileLoaderBlock MousepadFileLoaderBlock;
+typedef struct _MousepadFileSaver       MousepadFileSaver;
+typedef struct _MousepadFileReloader    MousepadFileReloader;
+typedef struct _MousepadFileConverter   MousepadFileConverter;
+typedef struct _MousepadFileFollow      MousepadFileFollow;
+typedef struct _MousepadFileInsert      MousepadFileInsert;
+typedef struct _MousepadFileStatus      MousepadFileStatus;
+
+typedef gboolean (*MousepadFileConverterFunc) (gchar        *text,
+                                               gsize         length,
+                                               gpointer      user_data,
+                                               GError      **error);
+
+
+
 enum
 {
   /* EXTERNALLY_MODIFIED, */
   FILENAME_CHANGED,
   READONLY_CHANGED,
+  LOAD_PROGRESS,
+  LOAD_FINISHED,
+  SAVE_FINISHED,
+  RELOAD_FINISHED,
+  FOLLOW_APPENDED,
+  FOLLOW_STOPPED,
   LAST_SIGNAL
 };
 
@@ -52,6 +135,21 @@ struct _MousepadFileClass
   GObjectClass __parent__;
 };
 
+struct _MousepadFileStatus
+{
+  /* whether the file status is known */
+  gboolean            valid;
+
+  /* modification time, with nanoseconds when the platform has them */
+  gint64              mtime;
+  glong               mtime_nsec;
+
+  /* size and identity of the file */
+  guint64             size;
+  guint64             inode;
+  guint64             device;
+};
+
 struct _MousepadFile
 {
   GObject             __parent__;
@@ -68,28 +166,269 @@ struct _MousepadFile
   /* line ending of the file */
   MousepadLineEnding  line_ending;
 
-  /* our last modification time */
-  gint                mtime;
+  /* compression of the file, it is written back the same way */
+  MousepadCompression compression;
+
+  /* the file status after our last read or write */
+  MousepadFileStatus  status;
+
+  /* monitor for changes on disk, events are coalesced in a flag until the next check */
+  GFileMonitor       *monitor;
+  guint               monitor_changed : 1;
+
+  /* result of the last check for external modifications */
+  guint               externally_modified : 1;
 
   /* if file is read-only */
   guint               readonly : 1;
 
+  /* whether the file was loaded with more than one line ending style */
+  guint               mixed_line_endings : 1;
+
   /* whether we write the bom at the start of the file */
   guint               write_bom : 1;
 
   /* whether the filetype has been set by user or we should guess it */
   gboolean            user_set_language;
+
+  /* basename of the file when the language was last guessed */
+  gchar              *language_basename;
+
+  /* the running streaming loader, if any */
+  MousepadFileLoader *loader;
+
+  /* the running background save, if any */
+  MousepadFileSaver  *saver;
+
+  /* the running background reload, if any */
+  MousepadFileReloader *reloader;
+
+  /* byte offsets of the lines in the buffer */
+  MousepadLineIndex  *line_index;
+
+  /* the whole document when the buffer only shows a part of it, and the
+   * status of the file it maps */
+  MousepadPieceTable *piece_table;
+  MousepadFileStatus  piece_status;
+
+  /* appends what is written to the file, when following it */
+  MousepadFileFollow *follow;
+};
+
+struct _MousepadFileConverter
+{
+  /* the charset converter */
+  GIConv              iconv;
+
+  /* input window, starting with the bytes carried over from the previous window */
+  gchar              *inbuf;
+  gsize               n_carry;
+
+  /* output window */
+  gchar              *outbuf;
+};
+
+struct _MousepadFileLoader
+{
+  /* the file we're loading */
+  MousepadFile       *file;
+
+  /* file descriptor, total size and number of bytes read */
+  gint                fd;
+  gsize               size;
+  gsize               offset;
+
+  /* whether we read from a pipe, its size is unknown and reads can block */
+  gboolean            is_pipe;
+
+  /* the encoding we decode from, a bom can override it */
+  MousepadEncoding    encoding;
+  gboolean            has_bom;
+
+  /* converter to utf-8, for non utf-8 files */
+  MousepadFileConverter converter;
+
+  /* decompressor for compressed files, with the compressed bytes it has not read yet */
+  GConverter         *decompressor;
+  gchar              *raw;
+  gsize               raw_pos;
+  gsize               raw_length;
+  gboolean            raw_eof;
+  gboolean            member_finished;
+
+  /* bytes carried over to the next chunk */
+  gchar               carry[MOUSEPAD_FILE_LOAD_CARRY_SIZE];
+  gsize               n_carry;
+
+  /* number of line endings of each style seen so far */
+  MousepadTextStats   eol_stats;
+
+  /* state of the decoder */
+  guint               first_chunk : 1;
+
+  /* whether the last decoded byte was a cr */
+  gboolean            last_was_cr;
+
+  /* the worker thread decoding the file */
+  GThread            *thread;
+
+  /* decoded blocks waiting to be inserted by the main loop,
+   * protected by the mutex */
+  GMutex              mutex;
+  GCond               cond;
+  GQueue              blocks;
+  guint               idle_id;
+  gint                cancelled;
+};
+
+struct _MousepadFileLoaderBlock
+{
+  /* normalized utf-8 text */
+  gchar              *text;
+  gsize               length;
+
+  /* how far we are in the file */
+  gdouble             fraction;
+
+  /* the last block, with the result of the load */
+  gboolean            last;
+  gint                retval;
+  GError             *error;
+};
+
+struct _MousepadFileInsert
+{
+  /* the file we load and where we insert in its buffer */
+  MousepadFile       *file;
+  GtkTextIter         iter;
+
+  /* or the string we append to, when reloading */
+  GString            *text;
+
+  /* line endings seen so far */
+  MousepadTextStats   stats;
+  gboolean            last_was_cr;
+
+  /* whether the converted text was not valid */
+  gboolean            not_utf8_valid;
+};
+
+struct _MousepadFileFollow
+{
+  /* byte offset in the file up to where we've read */
+  guint64             offset;
+
+  /* appends the decoded text to the end of the buffer */
+  MousepadFileInsert  insert;
+
+  /* converter to utf-8, for non utf-8 files */
+  MousepadFileConverter converter;
+
+  /* the timeout that reads the appended bytes */
+  guint               timeout_id;
+};
+
+struct _MousepadFileSaver
+{
+  /* the file we're saving */
+  MousepadFile       *file;
+
+  /* what to write, copied from the file when the save started */
+  gchar              *filename;
+  MousepadEncoding    encoding;
+  MousepadLineEnding  line_ending;
+  gboolean            write_bom;
+  MousepadCompression compression;
+
+  /* the file we write to, through the compressor for compressed files */
+  gint                fd;
+  GConverter         *compressor;
+  gchar              *outbuf;
+
+  /* the buffer text as it was when the save started, the main loop queues it
+   * in chunks from the mark and copies it early when the user edits it, the
+   * queue is protected by the mutex */
+  GtkTextMark        *mark;
+  GQueue              chunks;
+  gboolean            queued_all;
+  guint               feed_id;
+
+  /* or the pieces of the document, written as they are */
+  MousepadPieceTable *table;
+  GArray             *pieces;
+  GMappedFile        *mapped_file;
+  MousepadFileStatus  mapped_status;
+
+  /* set by the worker when the file is written, protected by the mutex */
+  GMutex              mutex;
+  GCond               cond;
+  gboolean            done;
+  guint               idle_id;
+
+  /* result of the save */
+  gboolean            succeed;
+  GError             *error;
+  MousepadFileStatus  status;
+};
+
+struct _MousepadFileReloader
+{
+  /* the file we're reloading */
+  MousepadFile       *file;
+
+  /* the file we read and the encoding we decode from, a bom can override it */
+  gchar              *filename;
+  MousepadEncoding    encoding;
+
+  /* the buffer text when the worker started, it is freed once diffed */
+  gchar              *old_text;
+
+  /* set when the buffer changed while the worker ran, the reload starts over */
+  gboolean            stale;
+
+  /* the worker thread and the idle that hands its result to the main loop */
+  GThread            *thread;
+  guint               idle_id;
+
+  /* the new text and what was found while decoding it */
+  gchar              *text;
+  gsize               length;
+  MousepadCompression compression;
+  MousepadEncoding    bom_encoding;
+  MousepadTextStats   stats;
+
+  /* the hunks that turn the buffer text into the new text, with their
+   * character offsets in the buffer */
+  GArray             *hunks;
+  glong              *offsets;
+
+  /* result of the reload */
+  gboolean            succeed;
+  GError             *error;
+  MousepadFileStatus  status;
+  gboolean            readonly;
 };
 
 
 
-static void  mousepad_file_finalize         (GObject            *object);
-static void  mousepad_file_set_readonly     (MousepadFile       *file,
-                                             gboolean            readonly);
+static void     mousepad_file_finalize         (GObject              *object);
+static void     mousepad_file_loader_stop      (MousepadFileLoader   *loader);
+static void     mousepad_file_loader_free      (MousepadFileLoader   *loader);
+static void     mousepad_file_saver_join       (MousepadFileSaver    *saver);
+static void     mousepad_file_saver_free       (MousepadFileSaver    *saver);
+static gboolean mousepad_file_reloader_idle    (gpointer              user_data);
+static void     mousepad_file_reloader_free    (MousepadFileReloader *reloader);
+static void     mousepad_file_reload_wait      (MousepadFile         *file);
+static void     mousepad_file_monitor_stop     (MousepadFile         *file);
+static void     mousepad_file_follow_schedule  (MousepadFile         *file);
+static void     mousepad_file_follow_stop      (MousepadFile         *file,
+                                                const GError         *error);
 
 
 
-static guint file_signals[LAST_SIGNAL];
+static guint        file_signals[LAST_SIGNAL];
+static GThreadPool *saver_pool = NULL;
+static GHashTable  *content_type_cache = NULL;
 
 
 
@@ -131,6 +470,55 @@ mousepad_file_class_init (MousepadFileClass *klass)
                   0, NULL, NULL,
                   g_cclosure_marshal_VOID__STRING,
                   G_TYPE_NONE, 1, G_TYPE_STRING);
+
+  file_signals[LOAD_PROGRESS] =
+    g_signal_new (I_("load-progress"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__DOUBLE,
+                  G_TYPE_NONE, 1, G_TYPE_DOUBLE);
+
+  file_signals[LOAD_FINISHED] =
+    g_signal_new (I_("load-finished"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  _mousepad_marshal_VOID__INT_POINTER,
+                  G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_POINTER);
+
+  file_signals[SAVE_FINISHED] =
+    g_signal_new (I_("save-finished"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  _mousepad_marshal_VOID__BOOLEAN_POINTER,
+                  G_TYPE_NONE, 2, G_TYPE_BOOLEAN, G_TYPE_POINTER);
+
+  file_signals[RELOAD_FINISHED] =
+    g_signal_new (I_("reload-finished"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  _mousepad_marshal_VOID__BOOLEAN_POINTER,
+                  G_TYPE_NONE, 2, G_TYPE_BOOLEAN, G_TYPE_POINTER);
+
+  file_signals[FOLLOW_APPENDED] =
+    g_signal_new (I_("follow-appended"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE, 0);
+
+  file_signals[FOLLOW_STOPPED] =
+    g_signal_new (I_("follow-stopped"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__POINTER,
+                  G_TYPE_NONE, 1, G_TYPE_POINTER);
+
 }
 
 
@@ -147,9 +535,13 @@ mousepad_file_init (MousepadFile *file)
   file->line_ending       = MOUSEPAD_EOL_UNIX;
 #endif
   file->readonly          = TRUE;
-  file->mtime             = 0;
+  file->mixed_line_endings = FALSE;
+  file->monitor           = NULL;
   file->write_bom         = FALSE;
   file->user_set_language = FALSE;
+  file->loader            = NULL;
+  file->saver             = NULL;
+  file->reloader          = NULL;
 }
 
 
@@ -159,8 +551,36 @@ mousepad_file_finalize (GObject *object)
 {
   MousepadFile *file = MOUSEPAD_FILE (object);
 
+  /* stop a running loader, without touching the buffer */
+  if (G_UNLIKELY (file->loader != NULL))
+    {
+      mousepad_file_loader_stop (file->loader);
+      mousepad_file_loader_free (file->loader);
+    }
+
+  /* let a running save write the file, the result is dropped */
+  if (G_UNLIKELY (file->saver != NULL))
+    {
+      mousepad_file_saver_join (file->saver);
+      g_source_remove (file->saver->idle_id);
+      mousepad_file_saver_free (file->saver);
+    }
+
+  /* let a running reload read the file, the buffer is left alone */
+  if (G_UNLIKELY (file->reloader != NULL))
+    mousepad_file_reloader_free (file->reloader);
+
+  /* stop following and watching the file */
+  mousepad_file_set_follow (file, FALSE);
+  mousepad_file_monitor_stop (file);
+
   /* cleanup */
   g_free (file->filename);
+  g_free (file->language_basename);
+  mousepad_line_index_free (file->line_index);
+
+  if (file->piece_table != NULL)
+    mousepad_piece_table_unref (file->piece_table);
 
   /* release the reference from the buffer */
   g_object_unref (G_OBJECT (file->buffer));
@@ -170,7 +590,7 @@ mousepad_file_finalize (GObject *object)
 
 
 
-static void
+void
 mousepad_file_set_readonly (MousepadFile *file,
                             gboolean      readonly)
 {
@@ -188,6 +608,124 @@ mousepad_file_set_readonly (MousepadFile *file,
 
 
 
+static void
+mousepad_file_status_from_stat (MousepadFileStatus *status,
+                                const struct stat  *statb)
+{
+  status->valid = TRUE;
+  status->mtime = statb->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  status->mtime_nsec = statb->st_mtim.tv_nsec;
+#else
+  status->mtime_nsec = 0;
+#endif
+  status->size = statb->st_size;
+  status->inode = statb->st_ino;
+  status->device = statb->st_dev;
+}
+
+
+
+static gboolean
+mousepad_file_status_equal (const MousepadFileStatus *a,
+                            const MousepadFileStatus *b)
+{
+  return (a->mtime == b->mtime
+          && a->mtime_nsec == b->mtime_nsec
+          && a->size == b->size
+          && a->inode == b->inode
+          && a->device == b->device);
+}
+
+
+
+static void
+mousepad_file_set_status (MousepadFile             *file,
+                          const MousepadFileStatus *status)
+{
+  /* store the status of the file we've read or written */
+  if (G_LIKELY (status != NULL))
+    file->status = *status;
+  else
+    file->status.valid = FALSE;
+
+  /* the file on disk matches the buffer again */
+  file->externally_modified = FALSE;
+
+  /* follow the file from its new end */
+  if (G_UNLIKELY (file->follow != NULL))
+    {
+      file->follow->offset = (status != NULL) ? status->size : 0;
+      file->follow->insert.last_was_cr = FALSE;
+
+      /* forget the state of the converter */
+      if (file->follow->converter.iconv != (GIConv) -1)
+        {
+          g_iconv (file->follow->converter.iconv, NULL, NULL, NULL, NULL);
+          file->follow->converter.n_carry = 0;
+        }
+    }
+}
+
+
+
+static void
+mousepad_file_monitor_changed (GFileMonitor      *monitor,
+                               GFile             *gfile,
+                               GFile             *other_file,
+                               GFileMonitorEvent  event_type,
+                               MousepadFile      *file)
+{
+  /* only remember something happened, the next check looks at the file */
+  file->monitor_changed = TRUE;
+
+  /* read what was appended to a followed file */
+  if (G_UNLIKELY (file->follow != NULL))
+    mousepad_file_follow_schedule (file);
+}
+
+
+
+static void
+mousepad_file_monitor_stop (MousepadFile *file)
+{
+  if (file->monitor != NULL)
+    {
+      mousepad_disconnect_by_func (G_OBJECT (file->monitor), mousepad_file_monitor_changed, file);
+      g_file_monitor_cancel (file->monitor);
+      g_object_unref (G_OBJECT (file->monitor));
+      file->monitor = NULL;
+    }
+}
+
+
+
+static void
+mousepad_file_monitor_start (MousepadFile *file)
+{
+  GFile *gfile;
+
+  /* stop watching the old file */
+  mousepad_file_monitor_stop (file);
+
+  /* the first check always looks at the file */
+  file->monitor_changed = TRUE;
+
+  if (G_UNLIKELY (file->filename == NULL))
+    return;
+
+  /* without a monitor we fall back to checking the file every time */
+  gfile = g_file_new_for_path (file->filename);
+  file->monitor = g_file_monitor_file (gfile, G_FILE_MONITOR_NONE, NULL, NULL);
+  g_object_unref (G_OBJECT (gfile));
+
+  if (G_LIKELY (file->monitor != NULL))
+    g_signal_connect (G_OBJECT (file->monitor), "changed",
+                      G_CALLBACK (mousepad_file_monitor_changed), file);
+}
+
+
+
 static MousepadEncoding
 mousepad_file_encoding_read_bom (const gchar *contents,
                                  gsize        length,
@@ -269,6 +807,9 @@ mousepad_file_new (GtkTextBuffer *buffer)
   /* set the buffer */
   file->buffer = GTK_TEXT_BUFFER (g_object_ref (G_OBJECT (buffer)));
 
+  /* index the lines of the buffer */
+  file->line_index = mousepad_line_index_new (buffer);
+
   return file;
 }
 
@@ -286,6 +827,13 @@ mousepad_file_set_filename (MousepadFile *file,
   /* set the filename */
   file->filename = g_strdup (filename);
 
+  /* watch the new file for changes */
+  mousepad_file_monitor_start (file);
+
+  /* a followed file without a monitor is checked from a timeout */
+  if (G_UNLIKELY (file->follow != NULL))
+    mousepad_file_follow_schedule (file);
+
   /* send a signal that the name has been changed */
   g_signal_emit (G_OBJECT (file), file_signals[FILENAME_CHANGED], 0, file->filename);
 }
@@ -391,6 +939,97 @@ mousepad_file_get_line_ending (MousepadFile *file)
 
 
 
+gboolean
+mousepad_file_get_mixed_line_endings (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return file->mixed_line_endings;
+}
+
+
+
+MousepadCompression
+mousepad_file_get_compression (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), MOUSEPAD_COMPRESSION_NONE);
+
+  return file->compression;
+}
+
+
+
+static void
+mousepad_file_set_line_ending_from_stats (MousepadFile            *file,
+                                          const MousepadTextStats *stats)
+{
+  guint n_styles;
+
+  /* remember if the file mixes styles, saving will make them all the same */
+  n_styles = (stats->n_lf > 0) + (stats->n_cr > 0) + (stats->n_crlf > 0);
+  file->mixed_line_endings = (n_styles > 1);
+
+  /* keep the default when there are no line endings */
+  if (n_styles == 0)
+    return;
+
+  /* use the line ending style found most in the file */
+  if (stats->n_lf >= stats->n_crlf && stats->n_lf >= stats->n_cr)
+    file->line_ending = MOUSEPAD_EOL_UNIX;
+  else if (stats->n_crlf >= stats->n_cr)
+    file->line_ending = MOUSEPAD_EOL_DOS;
+  else
+    file->line_ending = MOUSEPAD_EOL_MAC;
+}
+
+
+
+static gsize
+mousepad_file_normalize_line_endings (gchar       *dest,
+                                      const gchar *text,
+                                      gsize        length,
+                                      gboolean    *last_was_cr)
+{
+  const gchar *p = text, *n, *end = text + length;
+  gchar       *q = dest;
+
+  /* drop the lf of a cr+lf pair that was split over two chunks */
+  if (G_UNLIKELY (*last_was_cr) && length > 0)
+    {
+      if (*p == '\n')
+        p++;
+
+      *last_was_cr = FALSE;
+    }
+
+  /* copy the text between the cr characters, dest can be the same as text */
+  while ((n = memchr (p, '\r', end - p)) != NULL)
+    {
+      if (q != p)
+        memmove (q, p, n - p);
+      q += n - p;
+
+      /* every cr becomes a lf */
+      *q++ = '\n';
+      p = n + 1;
+
+      /* skip the lf of a cr+lf pair, or remember the cr at the end of the text */
+      if (G_UNLIKELY (p == end))
+        *last_was_cr = TRUE;
+      else if (*p == '\n')
+        p++;
+    }
+
+  /* copy the remaining part */
+  if (q != p)
+    memmove (q, p, end - p);
+  q += end - p;
+
+  return q - dest;
+}
+
+
+
 void
 mousepad_file_set_language (MousepadFile      *file,
                             GtkSourceLanguage *language)
@@ -446,18 +1085,102 @@ mousepad_file_get_language_id (MousepadFile *file)
 
 
 
+static gboolean
+mousepad_file_content_type_cacheable (const gchar *basename)
+{
+  const gchar *extension;
+
+  /* names without an extension, like scripts, are mostly told apart by
+   * their content, don't let one of them decide for the others */
+  extension = strrchr (basename, '.');
+
+  return (extension != NULL && extension != basename && extension[1] != '\0');
+}
+
+
+
+static gboolean
+mousepad_file_same_basename (MousepadFile *file)
+{
+  gchar    *basename;
+  gboolean  same;
+
+  if (file->filename == NULL || file->language_basename == NULL)
+    return FALSE;
+
+  basename = g_path_get_basename (file->filename);
+  same = (strcmp (basename, file->language_basename) == 0);
+  g_free (basename);
+
+  return same;
+}
+
+
+
 GtkSourceLanguage *
-mousepad_file_guess_language (MousepadFile *file)
+mousepad_file_guess_language (MousepadFile *file,
+                              const gchar  *data,
+                              gsize         length)
 {
   gchar             *content_type;
+  gchar             *sniffed = NULL;
+  gchar             *basename = NULL;
   gboolean           result_uncertain;
+  GtkTextIter        start_iter, end_iter;
   GtkSourceLanguage *language = NULL;
 
-  content_type = g_content_type_guess (file->filename, NULL, 0, &result_uncertain);
-  if (result_uncertain)
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  /* without data, sniff the start of the buffer */
+  if (data == NULL)
+    {
+      gtk_text_buffer_get_start_iter (file->buffer, &start_iter);
+      end_iter = start_iter;
+      gtk_text_iter_forward_chars (&end_iter, MOUSEPAD_FILE_SNIFF_SIZE);
+      data = sniffed = gtk_text_buffer_get_slice (file->buffer, &start_iter, &end_iter, TRUE);
+      length = strlen (sniffed);
+    }
+
+  length = MIN (length, MOUSEPAD_FILE_SNIFF_SIZE);
+
+  /* remember the name we guessed for, saving under the same name keeps the language */
+  if (file->filename != NULL)
+    basename = g_path_get_basename (file->filename);
+  g_free (file->language_basename);
+  file->language_basename = basename;
+
+  if (G_UNLIKELY (content_type_cache == NULL))
+    content_type_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  /* looking up the shared mime info is expensive, remember the content
+   * types the file name decided on its own, the content can't change those */
+  content_type = NULL;
+  if (basename != NULL && mousepad_file_content_type_cacheable (basename))
+    {
+      content_type = g_strdup (g_hash_table_lookup (content_type_cache, basename));
+      if (content_type == NULL)
+        {
+          /* without data the guess is only certain when the name matched a single type */
+          content_type = g_content_type_guess (file->filename, NULL, 0, &result_uncertain);
+          if (result_uncertain)
+            {
+              g_free (content_type);
+              content_type = NULL;
+            }
+          else
+            g_hash_table_insert (content_type_cache, g_strdup (basename), g_strdup (content_type));
+        }
+    }
+
+  /* let the content decide */
+  if (content_type == NULL)
     {
-      g_free (content_type);
-      content_type = NULL;
+      content_type = g_content_type_guess (file->filename, (const guchar *) data, length, &result_uncertain);
+      if (result_uncertain)
+        {
+          g_free (content_type);
+          content_type = NULL;
+        }
     }
 
   if (G_LIKELY (content_type != NULL || file->filename != NULL))
@@ -468,29 +1191,529 @@ mousepad_file_guess_language (MousepadFile *file)
     }
 
   g_free (content_type);
+  g_free (sniffed);
 
   return language;
 }
 
 
 
-gint
-mousepad_file_open (MousepadFile  *file,
-                    const gchar   *template_filename,
-                    GError       **error)
+guint
+mousepad_file_guess_encodings (MousepadFile          *file,
+                               MousepadEncodingGuess *guesses,
+                               guint                  n_guesses)
 {
-  GMappedFile      *mapped_file;
-  const gchar      *filename;
-  gint              retval = ERROR_READING_FAILED;
-  gsize             file_size, written;
-  gsize             bom_length;
-  const gchar      *contents;
-  gchar            *encoded = NULL;
+  GBytes      *bytes;
+  const gchar *contents;
+  gsize        length;
+  gboolean     complete;
+  guint        n = 0;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), 0);
+  g_return_val_if_fail (guesses != NULL || n_guesses == 0, 0);
+
+  if (G_UNLIKELY (file->filename == NULL))
+    return 0;
+
+  /* try to open the file, compressed files give their decompressed start */
+  bytes = mousepad_file_map_contents (file->filename, &complete, NULL);
+
+  if (G_LIKELY (bytes))
+    {
+      contents = g_bytes_get_data (bytes, &length);
+
+      /* the start of the file is enough to tell the encoding */
+      if (G_LIKELY (contents != NULL && length > 0))
+        n = mousepad_encoding_detect (contents, MIN (length, MOUSEPAD_ENCODING_DETECTOR_SAMPLE_SIZE),
+                                      guesses, n_guesses);
+
+      g_bytes_unref (bytes);
+    }
+
+  return n;
+}
+
+
+
+static void
+mousepad_file_count_line_endings (MousepadTextStats       *total,
+                                  gboolean                 last_was_cr,
+                                  const gchar             *text,
+                                  gsize                    length,
+                                  const MousepadTextStats *stats)
+{
+  MousepadTextStats  counted = { 0, 0, 0, -1 };
+  const gchar       *p, *end = text + length;
+
+  /* count the line endings ourselves if the text was not scanned */
+  if (stats == NULL)
+    {
+      for (p = text; p < end; p++)
+        {
+          if (*p == '\n')
+            counted.n_lf++;
+          else if (*p == '\r')
+            {
+              if (p + 1 < end && p[1] == '\n')
+                {
+                  counted.n_crlf++;
+                  p++;
+                }
+              else
+                counted.n_cr++;
+            }
+        }
+
+      stats = &counted;
+    }
+
+  total->n_lf += stats->n_lf;
+  total->n_cr += stats->n_cr;
+  total->n_crlf += stats->n_crlf;
+
+  /* a cr at the end of the previous chunk and a lf at the start of this one */
+  if (G_UNLIKELY (last_was_cr) && length > 0 && *text == '\n')
+    {
+      total->n_lf--;
+      total->n_cr--;
+      total->n_crlf++;
+    }
+}
+
+
+
+static gboolean
+mousepad_file_converter_init (MousepadFileConverter  *converter,
+                              const gchar            *to_charset,
+                              const gchar            *from_charset,
+                              GError                **error)
+{
+  converter->n_carry = 0;
+  converter->iconv = g_iconv_open (to_charset, from_charset);
+
+  if (G_UNLIKELY (converter->iconv == (GIConv) -1))
+    {
+      /* set an error */
+      g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_NO_CONVERSION,
+                   _("Conversion from character set '%s' to '%s' is not supported"),
+                   from_charset, to_charset);
+
+      return FALSE;
+    }
+
+  /* fixed size windows, whatever the size of the text we convert */
+  converter->inbuf = g_malloc (MOUSEPAD_FILE_LOAD_CARRY_SIZE + MOUSEPAD_FILE_CONVERT_WINDOW_SIZE);
+  converter->outbuf = g_malloc (MOUSEPAD_FILE_CONVERT_WINDOW_SIZE);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_converter_clear (MousepadFileConverter *converter)
+{
+  if (converter->iconv != (GIConv) -1)
+    {
+      g_iconv_close (converter->iconv);
+      converter->iconv = (GIConv) -1;
+
+      g_free (converter->inbuf);
+      g_free (converter->outbuf);
+    }
+}
+
+
+
+static gboolean
+mousepad_file_converter_convert (MousepadFileConverter      *converter,
+                                 const gchar                *text,
+                                 gsize                       length,
+                                 gboolean                    eof,
+                                 MousepadFileConverterFunc   func,
+                                 gpointer                    user_data,
+                                 GError                    **error)
+{
+  gchar    *inbuf, *outbuf;
+  gsize     inbytes, outbytes, n, result;
+  gint      errsv;
+  gboolean  last;
+
+  do
+    {
+      /* fill the input window after the bytes carried over from the previous one */
+      n = MIN (length, MOUSEPAD_FILE_CONVERT_WINDOW_SIZE);
+      memcpy (converter->inbuf + converter->n_carry, text, n);
+      text += n;
+      length -= n;
+
+      inbuf = converter->inbuf;
+      inbytes = converter->n_carry + n;
+      last = (eof && length == 0);
+
+      while (inbytes > 0)
+        {
+          /* convert as much as fits in the output window */
+          outbuf = converter->outbuf;
+          outbytes = MOUSEPAD_FILE_CONVERT_WINDOW_SIZE;
+          result = g_iconv (converter->iconv, &inbuf, &inbytes, &outbuf, &outbytes);
+          errsv = errno;
+
+          /* hand over the converted text */
+          if (outbuf > converter->outbuf
+              && ! func (converter->outbuf, outbuf - converter->outbuf, user_data, error))
+            return FALSE;
+
+          if (G_LIKELY (result != (gsize) -1))
+            break;
+
+          /* the output window is full, convert the rest */
+          if (errsv == E2BIG)
+            continue;
+
+          /* incomplete sequence at the end of the window, handled in the next round */
+          if (errsv == EINVAL && ! last)
+            break;
+
+          /* set an error */
+          if (errsv == EINVAL)
+            g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+                         _("Partial character sequence at end of input"));
+          else
+            g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                         _("Invalid byte sequence in conversion input"));
+
+          return FALSE;
+        }
+
+      /* an incomplete sequence is never this long */
+      if (G_UNLIKELY (inbytes > MOUSEPAD_FILE_LOAD_CARRY_SIZE))
+        {
+          /* set an error */
+          g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                       _("Invalid byte sequence in conversion input"));
+
+          return FALSE;
+        }
+
+      /* carry the remaining bytes over to the next window */
+      memmove (converter->inbuf, inbuf, inbytes);
+      converter->n_carry = inbytes;
+    }
+  while (length > 0);
+
+  if (eof)
+    {
+      /* flush the state of the converter, like the shift sequence of stateful encodings */
+      do
+        {
+          outbuf = converter->outbuf;
+          outbytes = MOUSEPAD_FILE_CONVERT_WINDOW_SIZE;
+          result = g_iconv (converter->iconv, NULL, NULL, &outbuf, &outbytes);
+          errsv = errno;
+
+          if (outbuf > converter->outbuf
+              && ! func (converter->outbuf, outbuf - converter->outbuf, user_data, error))
+            return FALSE;
+        }
+      while (result == (gsize) -1 && errsv == E2BIG);
+    }
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_open_insert (gchar       *text,
+                           gsize        length,
+                           gpointer     user_data,
+                           GError     **error)
+{
+  MousepadFileInsert *insert = user_data;
+  MousepadTextStats   stats;
+  const gchar        *end;
+
+  /* the converted text should be valid utf-8, this also counts the line endings */
+  if (G_UNLIKELY (mousepad_text_scan (text, length, &end, &stats) == FALSE))
+    {
+      /* set an error */
+      g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                   _("Invalid byte sequence in conversion input"));
+
+      insert->not_utf8_valid = TRUE;
+
+      return FALSE;
+    }
+
+  /* count and normalize the line endings */
+  mousepad_file_count_line_endings (&insert->stats, insert->last_was_cr, text, length, &stats);
+  if (stats.n_cr + stats.n_crlf > 0 || insert->last_was_cr)
+    length = mousepad_file_normalize_line_endings (text, text, length, &insert->last_was_cr);
+
+  /* append the text to the buffer */
+  if (G_UNLIKELY (insert->text != NULL))
+    g_string_append_len (insert->text, text, length);
+  else if (G_LIKELY (length > 0))
+    gtk_text_buffer_insert (insert->file->buffer, &insert->iter, text, length);
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_compression_from_magic (const gchar          *data,
+                                      gsize                 length,
+                                      MousepadCompression  *compression,
+                                      GError              **error)
+{
+  *compression = MOUSEPAD_COMPRESSION_NONE;
+
+  /* gzip */
+  if (length >= 2 && memcmp (data, "\x1f\x8b", 2) == 0)
+    {
+      *compression = MOUSEPAD_COMPRESSION_GZIP;
+
+      return TRUE;
+    }
+
+  /* xz and zstd, we have no decompressor for them */
+  if ((length >= 6 && memcmp (data, "\xfd" "7zXZ\0", 6) == 0)
+      || (length >= 4 && memcmp (data, "\x28\xb5\x2f\xfd", 4) == 0))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   _("The file is compressed in a format that is not supported"));
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_read_compression (gint                  fd,
+                                MousepadCompression  *compression,
+                                GError              **error)
+{
+  gchar  magic[MOUSEPAD_FILE_MAGIC_SIZE];
+  gssize n;
+
+  /* look at the start of the file and go back to it */
+  do
+    n = read (fd, magic, sizeof (magic));
+  while (G_UNLIKELY (n < 0 && errno == EINTR));
+
+  if (G_UNLIKELY (n < 0 || lseek (fd, 0, SEEK_SET) != 0))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+
+      return FALSE;
+    }
+
+  return mousepad_file_compression_from_magic (magic, n, compression, error);
+}
+
+
+
+static gchar *
+mousepad_file_decompress (MousepadCompression   compression,
+                          const gchar          *contents,
+                          gsize                 length,
+                          gsize                 max_length,
+                          gsize                *decompressed_length,
+                          gboolean             *complete,
+                          GError              **error)
+{
+  GConverter      *decompressor;
+  GConverterResult result;
+  GString         *decompressed;
+  gchar           *outbuf;
+  gsize            bytes_read, bytes_written;
+
+  g_return_val_if_fail (compression == MOUSEPAD_COMPRESSION_GZIP, NULL);
+
+  decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+  decompressed = g_string_sized_new (MIN (2 * length, max_length));
+
+  if (complete != NULL)
+    *complete = TRUE;
+  outbuf = g_malloc (MOUSEPAD_FILE_LOAD_CHUNK_SIZE);
+
+  for (;;)
+    {
+      /* decompress the next part */
+      result = g_converter_convert (decompressor, contents, length,
+                                    outbuf, MOUSEPAD_FILE_LOAD_CHUNK_SIZE, G_CONVERTER_INPUT_AT_END,
+                                    &bytes_read, &bytes_written, error);
+
+      if (G_UNLIKELY (result == G_CONVERTER_ERROR))
+        {
+          g_string_free (decompressed, TRUE);
+          decompressed = NULL;
+
+          break;
+        }
+
+      g_string_append_len (decompressed, outbuf, bytes_written);
+      contents += bytes_read;
+      length -= bytes_read;
+
+      /* the end of a member, another one can follow */
+      if (result == G_CONVERTER_FINISHED)
+        {
+          if (length == 0)
+            break;
+
+          g_converter_reset (decompressor);
+        }
+
+      /* stop once the caller has enough */
+      if (decompressed->len >= max_length)
+        {
+          g_string_truncate (decompressed, max_length);
+
+          if (complete != NULL)
+            *complete = FALSE;
+
+          break;
+        }
+    }
+
+  /* cleanup */
+  g_free (outbuf);
+  g_object_unref (G_OBJECT (decompressor));
+
+  if (G_UNLIKELY (decompressed == NULL))
+    return NULL;
+
+  *decompressed_length = decompressed->len;
+
+  return g_string_free (decompressed, FALSE);
+}
+
+
+
+static gchar *
+mousepad_file_decompress_all (MousepadCompression   compression,
+                              const gchar          *contents,
+                              gsize                 length,
+                              gsize                *decompressed_length,
+                              GError              **error)
+{
+  gchar    *decompressed;
+  gboolean  complete;
+
+  /* the whole file is decompressed in memory, refuse files that grow too large */
+  decompressed = mousepad_file_decompress (compression, contents, length,
+                                           MOUSEPAD_FILE_DECOMPRESS_MAX_SIZE + 1,
+                                           decompressed_length, &complete, error);
+  if (G_UNLIKELY (decompressed != NULL && ! complete))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   _("The decompressed file is too large to be read at once"));
+
+      g_free (decompressed);
+
+      return NULL;
+    }
+
+  return decompressed;
+}
+
+
+
+GBytes *
+mousepad_file_map_contents (const gchar  *filename,
+                            gboolean     *complete,
+                            GError      **error)
+{
+  GMappedFile         *mapped_file;
+  MousepadCompression  compression;
+  const gchar         *contents;
+  gchar               *decompressed;
+  gsize                length;
+  GBytes              *bytes = NULL;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (complete != NULL, NULL);
+
+  /* try to open the file */
+  mapped_file = g_mapped_file_new (filename, FALSE, error);
+  if (G_UNLIKELY (mapped_file == NULL))
+    return NULL;
+
+  /* get the mapped file contents and length */
+  contents = g_mapped_file_get_contents (mapped_file);
+  length = g_mapped_file_get_length (mapped_file);
+  *complete = TRUE;
+
+  if (G_UNLIKELY (contents == NULL || length == 0))
+    {
+      /* empty file */
+      bytes = g_bytes_new (NULL, 0);
+    }
+  else if (mousepad_file_compression_from_magic (contents, length, &compression, error))
+    {
+      if (G_LIKELY (compression == MOUSEPAD_COMPRESSION_NONE))
+        {
+          /* the bytes keep the mapping alive */
+          bytes = g_bytes_new_with_free_func (contents, length,
+                                              (GDestroyNotify) g_mapped_file_unref,
+                                              g_mapped_file_ref (mapped_file));
+        }
+      else
+        {
+          /* only the first window the loader would decompress */
+          decompressed = mousepad_file_decompress (compression, contents, length,
+                                                   MOUSEPAD_FILE_LOAD_CHUNK_SIZE,
+                                                   &length, complete, error);
+          if (G_LIKELY (decompressed != NULL))
+            bytes = g_bytes_new_take (decompressed, length);
+        }
+    }
+
+  /* release our reference on the mapped file */
+  g_mapped_file_unref (mapped_file);
+
+  return bytes;
+}
+
+
+
+gint
+mousepad_file_open (MousepadFile  *file,
+                    const gchar   *template_filename,
+                    GError       **error)
+{
+  GMappedFile      *mapped_file;
+  const gchar      *filename;
+  gint              retval = ERROR_READING_FAILED;
+  gsize             file_size;
+  gsize             bom_length;
+  const gchar      *contents;
   const gchar      *charset;
   GtkTextIter       start_iter, end_iter;
   struct stat       statb;
-  const gchar      *end, *n, *m;
+  MousepadFileStatus status;
+  const gchar      *end;
+  gchar            *normalized = NULL;
+  gchar            *decompressed = NULL;
+  gsize             length;
+  const gchar      *sniff_data = NULL;
+  gsize             sniff_length = 0;
+  gboolean          last_was_cr = FALSE;
+  gboolean          succeed;
   MousepadEncoding  bom_encoding;
+  MousepadTextStats stats;
+  MousepadCompression   compression;
+  MousepadFileInsert    insert;
+  MousepadFileConverter converter;
 
   g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
   g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
@@ -503,6 +1726,10 @@ mousepad_file_open (MousepadFile  *file,
   else
     filename = file->filename;
 
+  /* forget the line endings and compression of a previous load */
+  file->mixed_line_endings = FALSE;
+  file->compression = MOUSEPAD_COMPRESSION_NONE;
+
   /* check if the file exists, if not, it's a filename from the command line */
   if (g_file_test (filename, G_FILE_TEST_EXISTS) == FALSE)
     {
@@ -523,8 +1750,27 @@ mousepad_file_open (MousepadFile  *file,
 
       if (G_LIKELY (contents != NULL && file_size > 0))
         {
+          /* recognize compressed files, the rest works on the decompressed contents */
+          if (! mousepad_file_compression_from_magic (contents, file_size, &compression, error))
+            goto failed;
+
+          if (G_UNLIKELY (compression != MOUSEPAD_COMPRESSION_NONE))
+            {
+              decompressed = mousepad_file_decompress_all (compression, contents, file_size,
+                                                           &file_size, error);
+              if (G_UNLIKELY (decompressed == NULL))
+                goto failed;
+
+              contents = decompressed;
+
+              /* a template only gives the contents of a new document */
+              if (G_LIKELY (filename != template_filename))
+                file->compression = compression;
+            }
+
           /* detect if there is a bom with the encoding type */
-          bom_encoding = mousepad_file_encoding_read_bom (contents, file_size, &bom_length);
+          bom_encoding = G_LIKELY (file_size > 0) ? mousepad_file_encoding_read_bom (contents, file_size, &bom_length)
+                                                  : MOUSEPAD_ENCODING_NONE;
           if (G_UNLIKELY (bom_encoding != MOUSEPAD_ENCODING_NONE))
             {
               /* we've found a valid bom at the start of the contents */
@@ -541,10 +1787,12 @@ mousepad_file_open (MousepadFile  *file,
           /* handle encoding and check for utf-8 valid text */
           if (G_LIKELY (file->encoding == MOUSEPAD_ENCODING_UTF_8))
             {
-              validate:
+              /* the content type is sniffed from the mapped contents */
+              sniff_data = contents;
+              sniff_length = file_size;
 
-              /* leave when the contents is not utf-8 valid */
-              if (g_utf8_validate (contents, file_size, &end) == FALSE)
+              /* leave when the contents is not utf-8 valid, this also counts the line endings */
+              if (mousepad_text_scan (contents, file_size, &end, &stats) == FALSE)
                 {
                   /* set return value */
                   retval = ERROR_NOT_UTF8_VALID;
@@ -555,17 +1803,31 @@ mousepad_file_open (MousepadFile  *file,
 
                   goto failed;
                 }
+
+              /* set the line ending style found most in the file */
+              mousepad_file_set_line_ending_from_stats (file, &stats);
+
+              /* turn cr and cr+lf line endings into lf */
+              length = end - contents;
+              if (G_UNLIKELY (stats.n_cr + stats.n_crlf > 0))
+                {
+                  normalized = g_malloc (length);
+                  length = mousepad_file_normalize_line_endings (normalized, contents, length, &last_was_cr);
+                  contents = normalized;
+                }
+
+              /* insert the file contents in the buffer */
+              gtk_text_buffer_get_start_iter (file->buffer, &start_iter);
+              if (G_LIKELY (length > 0))
+                gtk_text_buffer_insert (file->buffer, &start_iter, contents, length);
             }
           else
             {
               /* get the encoding charset */
               charset = mousepad_encoding_get_charset (file->encoding);
 
-              /* convert the contents */
-              encoded = g_convert (contents, file_size, "UTF-8", charset, NULL, &written, error);
-
-              /* check if the string is utf-8 valid */
-              if (G_UNLIKELY (encoded == NULL))
+              /* setup a converter to utf-8 */
+              if (! mousepad_file_converter_init (&converter, "UTF-8", charset, error))
                 {
                   /* set return value */
                   retval = ERROR_CONVERTING_FAILED;
@@ -573,61 +1835,28 @@ mousepad_file_open (MousepadFile  *file,
                   goto failed;
                 }
 
-              /* set new values */
-              contents = encoded;
-              file_size = written;
-
-              /* validate the converted content */
-              goto validate;
-            }
+              /* convert the contents in windows and append them to the buffer */
+              memset (&insert, 0, sizeof (insert));
+              insert.file = file;
+              gtk_text_buffer_get_end_iter (file->buffer, &insert.iter);
+              succeed = mousepad_file_converter_convert (&converter, contents, file_size, TRUE,
+                                                         mousepad_file_open_insert, &insert, error);
 
-          /* detect the line ending, based on the first eol we match */
-          for (n = contents; n < end; n = g_utf8_next_char (n))
-            {
-              if (G_LIKELY (*n == '\n'))
-                {
-                  /* set unix line ending */
-                  file->line_ending = MOUSEPAD_EOL_UNIX;
+              /* cleanup */
+              mousepad_file_converter_clear (&converter);
 
-                  break;
-                }
-              else if (*n == '\r')
+              if (G_UNLIKELY (! succeed))
                 {
-                  /* get next character */
-                  n = g_utf8_next_char (n);
-
-                  /* set dos or mac line ending */
-                  file->line_ending = (*n == '\n') ? MOUSEPAD_EOL_DOS : MOUSEPAD_EOL_MAC;
+                  /* set return value */
+                  retval = insert.not_utf8_valid ? ERROR_NOT_UTF8_VALID : ERROR_CONVERTING_FAILED;
 
-                  break;
+                  goto failed;
                 }
-            }
-
-          /* get the iter at the beginning of the document */
-          gtk_text_buffer_get_start_iter (file->buffer, &start_iter);
-
-          /* insert the file contents in the buffer (for documents with cr line ending) */
-          for (n = m = contents; n < end; n = g_utf8_next_char (n))
-            {
-              if (G_UNLIKELY (*n == '\r'))
-                {
-                  /* insert the text in the buffer */
-                  if (G_LIKELY (n - m > 0))
-                    gtk_text_buffer_insert (file->buffer, &start_iter, m, n - m);
 
-                  /* advance the offset */
-                  m = g_utf8_next_char (n);
-
-                  /* insert a new line when the document is not cr+lf */
-                  if (*m != '\n')
-                    gtk_text_buffer_insert (file->buffer, &start_iter, "\n", 1);
-                }
+              /* set the line ending style found most in the file */
+              mousepad_file_set_line_ending_from_stats (file, &insert.stats);
             }
 
-          /* insert the remaining part, or everything for lf line ending */
-          if (G_LIKELY (n - m > 0))
-            gtk_text_buffer_insert (file->buffer, &start_iter, m, n - m);
-
           /* get the start iter */
           gtk_text_buffer_get_start_iter (file->buffer, &start_iter);
 
@@ -646,8 +1875,9 @@ mousepad_file_open (MousepadFile  *file,
               /* whether the file is readonly (ie. not writable by the user) */
               mousepad_file_set_readonly (file, !((statb.st_mode & S_IWUSR) != 0));
 
-              /* store the file modification time */
-              file->mtime = statb.st_mtime;
+              /* store the file status */
+              mousepad_file_status_from_stat (&status, &statb);
+              mousepad_file_set_status (file, &status);
             }
           else
             {
@@ -658,7 +1888,7 @@ mousepad_file_open (MousepadFile  *file,
       else
         {
           /* this is a new document with content from a template */
-          file->mtime = 0;
+          mousepad_file_set_status (file, NULL);
           mousepad_file_set_readonly (file, FALSE);
         }
 
@@ -671,8 +1901,12 @@ mousepad_file_open (MousepadFile  *file,
           gtk_text_buffer_delete (file->buffer, &start_iter, &end_iter);
         }
 
+      /* guess and set the file's filetype/language, from the start of the content */
+      mousepad_file_set_language (file, mousepad_file_guess_language (file, sniff_data, sniff_length));
+
       /* cleanup */
-      g_free (encoded);
+      g_free (normalized);
+      g_free (decompressed);
 
       /* close the mapped file */
 #if GLIB_CHECK_VERSION (2, 21, 0)
@@ -681,9 +1915,6 @@ mousepad_file_open (MousepadFile  *file,
       g_mapped_file_free (mapped_file);
 #endif
 
-      /* guess and set the file's filetype/language */
-      mousepad_file_set_language (file, mousepad_file_guess_language (file));
-
       /* this does not count as a modified buffer */
       gtk_text_buffer_set_modified (file->buffer, FALSE);
     }
@@ -693,167 +1924,2114 @@ mousepad_file_open (MousepadFile  *file,
 
 
 
-gboolean
-mousepad_file_save (MousepadFile  *file,
-                    GError       **error)
+static void
+mousepad_file_loader_block_free (MousepadFileLoaderBlock *block)
 {
-  gint          fd;
-  gboolean      succeed = FALSE;
-  gchar        *contents, *p;
-  gchar        *encoded;
-  const gchar  *charset;
-  GtkTextIter   start_iter, end_iter;
-  gint          l, m, length;
-  gsize         written;
-  struct stat   statb;
-  gchar       **chunks;
-
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
-  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail (file->filename != NULL, FALSE);
+  if (G_UNLIKELY (block->error != NULL))
+    g_error_free (block->error);
 
-  /* open the file */
-  fd = g_open (file->filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-  if (G_LIKELY (fd != -1))
-    {
-      /* get the buffer bounds */
-      gtk_text_buffer_get_bounds (file->buffer, &start_iter, &end_iter);
+  g_free (block->text);
+  g_slice_free (MousepadFileLoaderBlock, block);
+}
 
-      /* get the buffer contents */
-      contents = gtk_text_buffer_get_slice (file->buffer, &start_iter, &end_iter, TRUE);
 
-      if (G_LIKELY (contents))
-        {
-          /* get the content length */
-          length = strlen (contents);
 
-          /* handle line endings */
-          if (file->line_ending == MOUSEPAD_EOL_MAC)
+static void
+mousepad_file_loader_stop (MousepadFileLoader *loader)
+{
+  g_mutex_lock (&loader->mutex);
+
+  /* tell the worker to stop and wake it up if it waits for the main loop */
+  loader->cancelled = TRUE;
+  g_cond_broadcast (&loader->cond);
+
+  /* stop inserting blocks */
+  if (loader->idle_id != 0)
+    {
+      g_source_remove (loader->idle_id);
+      loader->idle_id = 0;
+    }
+
+  g_mutex_unlock (&loader->mutex);
+
+  /* wait for the worker to finish */
+  g_thread_join (loader->thread);
+  loader->thread = NULL;
+}
+
+
+
+static void
+mousepad_file_loader_free (MousepadFileLoader *loader)
+{
+  MousepadFileLoaderBlock *block;
+
+  /* drop the blocks that were never inserted */
+  while ((block = g_queue_pop_head (&loader->blocks)) != NULL)
+    mousepad_file_loader_block_free (block);
+
+  /* cleanup */
+  mousepad_file_converter_clear (&loader->converter);
+
+  if (loader->decompressor != NULL)
+    g_object_unref (G_OBJECT (loader->decompressor));
+  g_free (loader->raw);
+
+  close (loader->fd);
+
+  g_mutex_clear (&loader->mutex);
+  g_cond_clear (&loader->cond);
+  g_slice_free (MousepadFileLoader, loader);
+}
+
+
+
+static void
+mousepad_file_loader_finish (MousepadFileLoader *loader,
+                             gint                retval,
+                             GError             *error)
+{
+  MousepadFile *file = loader->file;
+  GtkTextIter   start_iter, end_iter;
+  struct stat   statb;
+  MousepadFileStatus status;
+
+  /* the worker has sent its last block, wait for it to exit */
+  g_thread_join (loader->thread);
+  loader->thread = NULL;
+
+  /* set the line ending style found most in the file */
+  mousepad_file_set_line_ending_from_stats (file, &loader->eol_stats);
+
+  if (G_UNLIKELY (loader->has_bom))
+    {
+      /* we've found a valid bom at the start of the contents */
+      file->write_bom = TRUE;
+      file->encoding = loader->encoding;
+    }
+
+  if (G_UNLIKELY (loader->is_pipe))
+    {
+      /* there is no file, and the text can not be read again, so keep what we have */
+      mousepad_file_set_status (file, NULL);
+      mousepad_file_set_readonly (file, FALSE);
+    }
+  else if (G_LIKELY (retval == 0))
+    {
+      /* store the file status */
+      if (G_LIKELY (fstat (loader->fd, &statb) == 0))
+        {
+          /* whether the file is readonly (ie. not writable by the user) */
+          mousepad_file_set_readonly (file, !((statb.st_mode & S_IWUSR) != 0));
+
+          /* store the file status */
+          mousepad_file_status_from_stat (&status, &statb);
+          mousepad_file_set_status (file, &status);
+        }
+      else
+        {
+          /* set return value */
+          retval = ERROR_FILE_STATUS_FAILED;
+        }
+    }
+
+  /* make sure the buffer is empty if we did not succeed */
+  if (G_UNLIKELY (retval != 0 && ! loader->is_pipe))
+    {
+      gtk_text_buffer_get_bounds (file->buffer, &start_iter, &end_iter);
+      gtk_text_buffer_delete (file->buffer, &start_iter, &end_iter);
+    }
+
+  /* the loaded text can not be undone */
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (file->buffer));
+
+  /* set the cursor to the beginning of the document */
+  gtk_text_buffer_get_start_iter (file->buffer, &start_iter);
+  gtk_text_buffer_place_cursor (file->buffer, &start_iter);
+
+  /* guess and set the file's filetype/language, from the start of the buffer */
+  mousepad_file_set_language (file, mousepad_file_guess_language (file, NULL, 0));
+
+  /* this does not count as a modified buffer, unless the text is only in the buffer */
+  gtk_text_buffer_set_modified (file->buffer, loader->is_pipe);
+
+  /* detach and release the loader */
+  file->loader = NULL;
+  mousepad_file_loader_free (loader);
+
+  /* tell the world we're done, the handlers might release the file */
+  g_object_ref (G_OBJECT (file));
+  g_signal_emit (G_OBJECT (file), file_signals[LOAD_FINISHED], 0, retval, error);
+
+  /* a followed file that was rotated and could not be loaded again, or
+   * is compressed now, is no longer followed */
+  if (G_UNLIKELY (file->follow != NULL
+                  && (retval != 0 || file->compression != MOUSEPAD_COMPRESSION_NONE)))
+    mousepad_file_follow_stop (file, error);
+
+  g_object_unref (G_OBJECT (file));
+}
+
+
+
+static gboolean
+mousepad_file_loader_idle (gpointer user_data)
+{
+  MousepadFileLoader      *loader = user_data;
+  MousepadFile            *file = loader->file;
+  MousepadFileLoaderBlock *block;
+  GtkTextIter              end_iter;
+  gdouble                  fraction;
+  gboolean                 has_more;
+
+  /* take the next decoded block and wake up the worker */
+  g_mutex_lock (&loader->mutex);
+  block = g_queue_pop_head (&loader->blocks);
+  if (block == NULL || block->last)
+    loader->idle_id = 0;
+  g_cond_signal (&loader->cond);
+  g_mutex_unlock (&loader->mutex);
+
+  if (G_UNLIKELY (block == NULL))
+    return FALSE;
+
+  if (G_UNLIKELY (block->last))
+    {
+      /* finish the load, this releases the loader */
+      mousepad_file_loader_finish (loader, block->retval, block->error);
+      mousepad_file_loader_block_free (block);
+
+      return FALSE;
+    }
+
+  /* append the text to the buffer */
+  gtk_text_buffer_get_end_iter (file->buffer, &end_iter);
+  gtk_text_buffer_insert (file->buffer, &end_iter, block->text, block->length);
+
+  /* cleanup */
+  fraction = block->fraction;
+  mousepad_file_loader_block_free (block);
+
+  /* keep running while there are blocks waiting */
+  g_mutex_lock (&loader->mutex);
+  has_more = (loader->blocks.length > 0);
+  if (! has_more)
+    loader->idle_id = 0;
+  g_mutex_unlock (&loader->mutex);
+
+  /* report the progress, a handler might cancel the load */
+  g_signal_emit (G_OBJECT (file), file_signals[LOAD_PROGRESS], 0, fraction);
+
+  return has_more;
+}
+
+
+
+static gboolean
+mousepad_file_loader_push (MousepadFileLoader      *loader,
+                           MousepadFileLoaderBlock *block)
+{
+  gboolean cancelled;
+
+  g_mutex_lock (&loader->mutex);
+
+  /* wait until the main loop has caught up */
+  while (loader->blocks.length >= MOUSEPAD_FILE_LOAD_MAX_BLOCKS && ! loader->cancelled)
+    g_cond_wait (&loader->cond, &loader->mutex);
+
+  cancelled = loader->cancelled;
+  if (G_LIKELY (! cancelled))
+    {
+      g_queue_push_tail (&loader->blocks, block);
+
+      /* make sure the main loop inserts it */
+      if (loader->idle_id == 0)
+        loader->idle_id = g_idle_add_full (MOUSEPAD_FILE_LOAD_PRIORITY, mousepad_file_loader_idle, loader, NULL);
+    }
+
+  g_mutex_unlock (&loader->mutex);
+
+  /* nobody is interested anymore */
+  if (G_UNLIKELY (cancelled))
+    mousepad_file_loader_block_free (block);
+
+  return ! cancelled;
+}
+
+
+
+static gboolean
+mousepad_file_loader_push_text (MousepadFileLoader      *loader,
+                                gchar                   *text,
+                                gsize                    length,
+                                const MousepadTextStats *stats)
+{
+  MousepadFileLoaderBlock *block;
+
+  /* count and normalize the line endings */
+  mousepad_file_count_line_endings (&loader->eol_stats, loader->last_was_cr, text, length, stats);
+  if (stats == NULL || stats->n_cr + stats->n_crlf > 0 || loader->last_was_cr)
+    length = mousepad_file_normalize_line_endings (text, text, length, &loader->last_was_cr);
+  if (G_UNLIKELY (length == 0))
+    {
+      g_free (text);
+      return TRUE;
+    }
+
+  /* create a new block, it takes ownership of the text */
+  block = g_slice_new0 (MousepadFileLoaderBlock);
+  block->text = text;
+  block->length = length;
+  block->fraction = (! loader->is_pipe) ? MIN ((gdouble) loader->offset / MAX (loader->size, 1), 1.00) : -1.00;
+
+  return mousepad_file_loader_push (loader, block);
+}
+
+
+
+static gboolean
+mousepad_file_loader_converted (gchar     *text,
+                                gsize      length,
+                                gpointer   user_data,
+                                GError   **error)
+{
+  gchar *copy;
+
+  /* a copy of the converted text, g_memdup() would truncate the length to a guint */
+  copy = g_malloc (length);
+  memcpy (copy, text, length);
+
+  /* hand it to the main loop, stop when cancelled */
+  return mousepad_file_loader_push_text (user_data, copy, length, NULL);
+}
+
+
+
+static gint
+mousepad_file_loader_decode (MousepadFileLoader  *loader,
+                             gchar               *chunk,
+                             gsize                length,
+                             gboolean             eof,
+                             GError             **error)
+{
+  gchar            *inbuf = chunk;
+  gsize             inbytes = length;
+  const gchar      *end;
+  const gchar      *charset;
+  gsize             bom_length;
+  gboolean          succeed;
+  MousepadEncoding  bom_encoding;
+  MousepadTextStats stats;
+
+  if (G_UNLIKELY (loader->first_chunk))
+    {
+      loader->first_chunk = FALSE;
+
+      /* detect if there is a bom with the encoding type */
+      if (G_LIKELY (inbytes > 0))
+        {
+          bom_encoding = mousepad_file_encoding_read_bom (inbuf, inbytes, &bom_length);
+          if (G_UNLIKELY (bom_encoding != MOUSEPAD_ENCODING_NONE))
+            {
+              /* skip the bom */
+              loader->has_bom = TRUE;
+              loader->encoding = bom_encoding;
+              inbuf += bom_length;
+              inbytes -= bom_length;
+            }
+        }
+
+      /* setup a converter for non utf-8 files */
+      if (G_UNLIKELY (loader->encoding != MOUSEPAD_ENCODING_UTF_8))
+        {
+          charset = mousepad_encoding_get_charset (loader->encoding);
+          if (! mousepad_file_converter_init (&loader->converter, "UTF-8", charset, error))
+            {
+              g_free (chunk);
+
+              return ERROR_CONVERTING_FAILED;
+            }
+        }
+    }
+
+  if (G_LIKELY (loader->converter.iconv == (GIConv) -1))
+    {
+      /* validate the utf-8 text, except for an incomplete character at the end of the chunk */
+      if (G_UNLIKELY (mousepad_text_scan (inbuf, inbytes, &end, &stats) == FALSE)
+          && (eof || g_utf8_get_char_validated (end, inbuf + inbytes - end) != (gunichar) -2))
+        {
+          /* set an error */
+          g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                       _("Invalid byte sequence in conversion input"));
+
+          g_free (chunk);
+
+          return ERROR_NOT_UTF8_VALID;
+        }
+
+      /* carry the incomplete character over to the next chunk */
+      loader->n_carry = inbuf + inbytes - end;
+      memcpy (loader->carry, end, loader->n_carry);
+
+      /* hand the valid part to the main loop, skipping the bom */
+      if (G_UNLIKELY (inbuf != chunk))
+        g_memmove (chunk, inbuf, end - inbuf);
+
+      mousepad_file_loader_push_text (loader, chunk, end - inbuf, &stats);
+
+      return 0;
+    }
+
+  /* convert the chunk, the converter carries split sequences over to the next chunk */
+  succeed = mousepad_file_converter_convert (&loader->converter, inbuf, inbytes, eof,
+                                             mousepad_file_loader_converted, loader, error);
+
+  /* cleanup */
+  g_free (chunk);
+
+  /* the converted text was pushed, or the load was cancelled */
+  if (G_UNLIKELY (! succeed) && (error == NULL || *error != NULL))
+    return ERROR_CONVERTING_FAILED;
+
+  return 0;
+}
+
+
+
+static gboolean
+mousepad_file_loader_wait (MousepadFileLoader *loader)
+{
+  struct pollfd pfd;
+  gint          n;
+
+  pfd.fd = loader->fd;
+  pfd.events = POLLIN;
+
+  /* wait until there is something to read, waking up to see if we were cancelled */
+  do
+    {
+      if (g_atomic_int_get (&loader->cancelled))
+        return FALSE;
+
+      n = poll (&pfd, 1, MOUSEPAD_FILE_LOAD_POLL_TIMEOUT);
+    }
+  while (n == 0 || (n < 0 && errno == EINTR));
+
+  return TRUE;
+}
+
+
+
+static gssize
+mousepad_file_loader_read (MousepadFileLoader  *loader,
+                           gchar               *buffer,
+                           gsize                size,
+                           GError             **error)
+{
+  GConverterResult result;
+  gsize            bytes_read, bytes_written;
+  gssize           n;
+
+  for (;;)
+    {
+      /* read the next part of the file, compressed files only when the decompressor needs it */
+      if (loader->decompressor == NULL || (loader->raw_length == 0 && ! loader->raw_eof))
+        {
+          do
+            n = read (loader->fd, loader->decompressor != NULL ? loader->raw : buffer,
+                      loader->decompressor != NULL ? MOUSEPAD_FILE_LOAD_CHUNK_SIZE : size);
+          while (G_UNLIKELY (n < 0 && errno == EINTR));
+
+          if (G_UNLIKELY (n < 0))
+            {
+              /* set an error */
+              g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+
+              return -1;
+            }
+
+          /* update the counter, the progress goes by the bytes in the file */
+          loader->offset += n;
+
+          if (loader->decompressor == NULL)
+            return n;
+
+          loader->raw_pos = 0;
+          loader->raw_length = n;
+          loader->raw_eof = (n == 0);
+        }
+
+      /* the last member has ended and there is nothing after it */
+      if (loader->raw_eof && loader->member_finished)
+        return 0;
+
+      /* decompress what we have, the decompressor keeps what it can't write yet */
+      result = g_converter_convert (loader->decompressor, loader->raw + loader->raw_pos, loader->raw_length,
+                                    buffer, size, loader->raw_eof ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                                    &bytes_read, &bytes_written, error);
+      if (G_UNLIKELY (result == G_CONVERTER_ERROR))
+        return -1;
+
+      loader->raw_pos += bytes_read;
+      loader->raw_length -= bytes_read;
+      if (bytes_read > 0)
+        loader->member_finished = FALSE;
+
+      /* the end of a member, another one can follow */
+      if (result == G_CONVERTER_FINISHED)
+        {
+          g_converter_reset (loader->decompressor);
+          loader->member_finished = TRUE;
+        }
+
+      if (bytes_written > 0)
+        return bytes_written;
+    }
+}
+
+
+
+static gpointer
+mousepad_file_loader_thread (gpointer user_data)
+{
+  MousepadFileLoader      *loader = user_data;
+  MousepadFileLoaderBlock *block;
+  gchar                   *chunk;
+  gssize                   n;
+  gboolean                 eof = FALSE;
+  gint                     retval = 0;
+  GError                  *error = NULL;
+
+  while (! eof && retval == 0 && ! g_atomic_int_get (&loader->cancelled))
+    {
+      /* a pipe can be quiet for a long time, don't block in the read */
+      if (G_UNLIKELY (loader->is_pipe) && ! mousepad_file_loader_wait (loader))
+        break;
+
+      /* start a new chunk with the bytes carried over from the previous one */
+      chunk = g_malloc (MOUSEPAD_FILE_LOAD_CARRY_SIZE + MOUSEPAD_FILE_LOAD_CHUNK_SIZE);
+      memcpy (chunk, loader->carry, loader->n_carry);
+
+      /* read the next part of the file */
+      n = mousepad_file_loader_read (loader, chunk + loader->n_carry, MOUSEPAD_FILE_LOAD_CHUNK_SIZE, &error);
+      if (G_UNLIKELY (n < 0))
+        {
+          g_free (chunk);
+
+          retval = ERROR_READING_FAILED;
+
+          break;
+        }
+
+      eof = (n == 0);
+
+      /* decode and normalize the chunk, this takes ownership of the chunk */
+      retval = mousepad_file_loader_decode (loader, chunk, loader->n_carry + n, eof, &error);
+    }
+
+  /* send the result to the main loop */
+  block = g_slice_new0 (MousepadFileLoaderBlock);
+  block->last = TRUE;
+  block->retval = retval;
+  block->error = error;
+  mousepad_file_loader_push (loader, block);
+
+  return NULL;
+}
+
+
+
+gboolean
+mousepad_file_get_prefers_streaming (MousepadFile *file)
+{
+  struct stat         statb;
+  gint                fd;
+  gboolean            compressed;
+  MousepadCompression compression;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  if (file->filename == NULL
+      || g_stat (file->filename, &statb) != 0
+      || !S_ISREG (statb.st_mode))
+    return FALSE;
+
+  /* whether the file is large enough to be loaded in chunks */
+  if (statb.st_size >= MOUSEPAD_FILE_STREAMING_MIN_SIZE)
+    return TRUE;
+
+  /* compressed files are always loaded in chunks, their size tells nothing, and
+   * the loader reports the formats we can't read */
+  fd = g_open (file->filename, O_RDONLY, 0);
+  if (G_UNLIKELY (fd == -1))
+    return FALSE;
+
+  compressed = (! mousepad_file_read_compression (fd, &compression, NULL)
+                || compression != MOUSEPAD_COMPRESSION_NONE);
+  close (fd);
+
+  return compressed;
+}
+
+
+
+gboolean
+mousepad_file_get_prefers_viewer (MousepadFile *file)
+{
+  struct stat      statb;
+  gint             min_size;
+  gint             fd;
+  gchar            magic[MOUSEPAD_FILE_MAGIC_SIZE];
+  gssize           n_bytes = 0;
+  MousepadEncoding encoding = MOUSEPAD_ENCODING_NONE;
+  MousepadCompression compression;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  /* the viewer only shows utf-8 text */
+  if (file->encoding != MOUSEPAD_ENCODING_NONE && file->encoding != MOUSEPAD_ENCODING_UTF_8)
+    return FALSE;
+
+  /* whether the file is large enough to only view it, 0 disables the viewer */
+  min_size = MOUSEPAD_SETTING_GET_INT (LARGE_FILE_VIEWER_SIZE);
+  if (min_size <= 0
+      || file->filename == NULL
+      || g_stat (file->filename, &statb) != 0
+      || !S_ISREG (statb.st_mode)
+      || statb.st_size < (goffset) min_size * 1024 * 1024)
+    return FALSE;
+
+  /* don't view compressed files, or files with a byte order mark of another unicode encoding */
+  fd = g_open (file->filename, O_RDONLY, 0);
+  if (G_LIKELY (fd != -1))
+    {
+      n_bytes = read (fd, magic, sizeof (magic));
+      close (fd);
+    }
+
+  if (n_bytes > 0)
+    {
+      if (! mousepad_file_compression_from_magic (magic, n_bytes, &compression, NULL)
+          || compression != MOUSEPAD_COMPRESSION_NONE)
+        return FALSE;
+
+      encoding = mousepad_file_encoding_read_bom (magic, n_bytes, NULL);
+    }
+
+  return (encoding == MOUSEPAD_ENCODING_NONE || encoding == MOUSEPAD_ENCODING_UTF_8);
+}
+
+
+
+static void
+mousepad_file_loader_start (MousepadFile *file,
+                            gint          fd)
+{
+  MousepadFileLoader *loader;
+  struct stat         statb;
+
+  /* create the loader */
+  loader = g_slice_new0 (MousepadFileLoader);
+  loader->file = file;
+  loader->fd = fd;
+  loader->encoding = file->encoding;
+  loader->converter.iconv = (GIConv) -1;
+  loader->first_chunk = TRUE;
+  g_mutex_init (&loader->mutex);
+  g_cond_init (&loader->cond);
+  g_queue_init (&loader->blocks);
+  file->loader = loader;
+
+  /* the size of a regular file, for the progress */
+  if (G_LIKELY (fstat (fd, &statb) == 0 && S_ISREG (statb.st_mode)))
+    loader->size = statb.st_size;
+  else
+    loader->is_pipe = TRUE;
+
+  /* decompress compressed files while reading them */
+  if (G_UNLIKELY (file->compression == MOUSEPAD_COMPRESSION_GZIP))
+    {
+      loader->decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+      loader->raw = g_malloc (MOUSEPAD_FILE_LOAD_CHUNK_SIZE);
+    }
+
+  /* the loaded text can not be undone */
+  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (file->buffer));
+
+  /* decode the file in a worker thread, the main loop inserts the blocks */
+  loader->thread = g_thread_new ("mousepad-file-loader", mousepad_file_loader_thread, loader);
+
+  /* report the start right away, so the view is locked before the first block */
+  g_signal_emit (G_OBJECT (file), file_signals[LOAD_PROGRESS], 0, loader->is_pipe ? -1.00 : 0.00);
+}
+
+
+
+gint
+mousepad_file_open_streaming (MousepadFile  *file,
+                              GError       **error)
+{
+  gint fd;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), ERROR_READING_FAILED);
+  g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (file->buffer), ERROR_READING_FAILED);
+  g_return_val_if_fail (error == NULL || *error == NULL, ERROR_READING_FAILED);
+  g_return_val_if_fail (file->filename != NULL, ERROR_READING_FAILED);
+  g_return_val_if_fail (file->loader == NULL, ERROR_READING_FAILED);
+
+  /* open the file */
+  fd = g_open (file->filename, O_RDONLY, 0);
+  if (G_UNLIKELY (fd == -1))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+
+      return ERROR_READING_FAILED;
+    }
+
+  /* recognize compressed files */
+  if (! mousepad_file_read_compression (fd, &file->compression, error))
+    {
+      close (fd);
+
+      return ERROR_READING_FAILED;
+    }
+
+  /* load the file in chunks */
+  mousepad_file_loader_start (file, fd);
+
+  return 0;
+}
+
+
+
+gint
+mousepad_file_open_stdin (MousepadFile  *file,
+                          GError       **error)
+{
+  gint fd;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), ERROR_READING_FAILED);
+  g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (file->buffer), ERROR_READING_FAILED);
+  g_return_val_if_fail (error == NULL || *error == NULL, ERROR_READING_FAILED);
+  g_return_val_if_fail (file->filename == NULL, ERROR_READING_FAILED);
+  g_return_val_if_fail (file->loader == NULL, ERROR_READING_FAILED);
+
+  /* our own descriptor, the loader closes it when done */
+  fd = dup (STDIN_FILENO);
+  if (G_UNLIKELY (fd == -1))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+
+      return ERROR_READING_FAILED;
+    }
+
+  /* append the text in chunks as it arrives */
+  mousepad_file_loader_start (file, fd);
+
+  return 0;
+}
+
+
+
+void
+mousepad_file_open_cancel (MousepadFile *file)
+{
+  GtkTextIter start_iter, end_iter;
+
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  if (G_LIKELY (file->loader == NULL))
+    return;
+
+  /* stop and release the loader */
+  mousepad_file_loader_stop (file->loader);
+  mousepad_file_loader_free (file->loader);
+  file->loader = NULL;
+
+  /* throw away what we have loaded so far */
+  gtk_text_buffer_get_bounds (file->buffer, &start_iter, &end_iter);
+  gtk_text_buffer_delete (file->buffer, &start_iter, &end_iter);
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (file->buffer));
+  gtk_text_buffer_set_modified (file->buffer, FALSE);
+}
+
+
+
+gboolean
+mousepad_file_get_loading (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return (file->loader != NULL);
+}
+
+
+
+static gboolean
+mousepad_file_write (gint          fd,
+                     const gchar  *data,
+                     gsize         length,
+                     GError      **error)
+{
+  gssize n;
+
+  while (length > 0)
+    {
+      /* write */
+      n = write (fd, data, length);
+
+      if (G_UNLIKELY (n < 0))
+        {
+          /* just try again on EAGAIN/EINTR */
+          if (G_LIKELY (errno != EAGAIN && errno != EINTR))
+            {
+              /* set an error */
+              g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+
+              return FALSE;
+            }
+        }
+      else
+        {
+          /* advance the offset */
+          data += n;
+          length -= n;
+        }
+    }
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_saver_output (MousepadFileSaver  *saver,
+                            const gchar        *data,
+                            gsize               length,
+                            gboolean            eof,
+                            GError            **error)
+{
+  GConverterResult result;
+  gsize            bytes_read, bytes_written;
+
+  /* uncompressed files get the bytes as they are */
+  if (G_LIKELY (saver->compressor == NULL))
+    return mousepad_file_write (saver->fd, data, length, error);
+
+  /* the compressor needs input, unless we finish the stream */
+  if (length == 0 && ! eof)
+    return TRUE;
+
+  /* compress the data and write what comes out, at the end until the stream is finished */
+  do
+    {
+      result = g_converter_convert (saver->compressor, data, length,
+                                    saver->outbuf, MOUSEPAD_FILE_SAVE_CHUNK_SIZE,
+                                    eof ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                                    &bytes_read, &bytes_written, error);
+      if (G_UNLIKELY (result == G_CONVERTER_ERROR))
+        return FALSE;
+
+      data += bytes_read;
+      length -= bytes_read;
+
+      if (! mousepad_file_write (saver->fd, saver->outbuf, bytes_written, error))
+        return FALSE;
+    }
+  while (length > 0 || (eof && result != G_CONVERTER_FINISHED));
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_save_converted (gchar     *text,
+                              gsize      length,
+                              gpointer   user_data,
+                              GError   **error)
+{
+  /* write the converted text */
+  return mousepad_file_saver_output (user_data, text, length, FALSE, error);
+}
+
+
+
+static gboolean
+mousepad_file_save_text (MousepadFileSaver      *saver,
+                         MousepadFileConverter  *converter,
+                         const gchar            *text,
+                         gsize                   length,
+                         gboolean                eof,
+                         GError                **error)
+{
+  /* utf-8 text is written as is */
+  if (G_LIKELY (converter->iconv == (GIConv) -1))
+    return mousepad_file_saver_output (saver, text, length, eof, error);
+
+  /* convert the text in windows to the encoding of the file */
+  if (! mousepad_file_converter_convert (converter, text, length, eof,
+                                         mousepad_file_save_converted, saver, error))
+    return FALSE;
+
+  /* finish the compressed stream after the last converted text */
+  return (! eof || mousepad_file_saver_output (saver, "", 0, TRUE, error));
+}
+
+
+
+static void
+mousepad_file_saver_feed (MousepadFileSaver *saver,
+                          const GtkTextIter *until)
+{
+  GtkTextBuffer *buffer = saver->file->buffer;
+  GtkTextIter    start_iter, end_iter;
+  gchar         *chunk;
+  gboolean       full, at_end;
+
+  while (saver->mark != NULL)
+    {
+      gtk_text_buffer_get_iter_at_mark (buffer, &start_iter, saver->mark);
+
+      if (until != NULL)
+        {
+          /* copy the text up to an edit, however much is queued */
+          if (gtk_text_iter_compare (&start_iter, until) >= 0)
+            break;
+        }
+      else
+        {
+          /* keep the queue short, the worker asks for more */
+          g_mutex_lock (&saver->mutex);
+          full = (saver->chunks.length >= MOUSEPAD_FILE_SAVE_MAX_CHUNKS || saver->done);
+          g_mutex_unlock (&saver->mutex);
+
+          if (full)
+            break;
+        }
+
+      end_iter = start_iter;
+      gtk_text_iter_forward_chars (&end_iter, MOUSEPAD_FILE_SAVE_CHUNK_SIZE);
+      if (until != NULL && gtk_text_iter_compare (&end_iter, until) > 0)
+        end_iter = *until;
+
+      chunk = gtk_text_buffer_get_slice (buffer, &start_iter, &end_iter, TRUE);
+
+      /* the rest of the text is taken from where we stopped */
+      at_end = gtk_text_iter_is_end (&end_iter);
+      if (G_UNLIKELY (at_end))
+        {
+          gtk_text_buffer_delete_mark (buffer, saver->mark);
+          saver->mark = NULL;
+        }
+      else
+        gtk_text_buffer_move_mark (buffer, saver->mark, &end_iter);
+
+      /* hand the chunk to the worker */
+      g_mutex_lock (&saver->mutex);
+      if (G_LIKELY (*chunk != '\0'))
+        g_queue_push_tail (&saver->chunks, chunk);
+      else
+        g_free (chunk);
+      saver->queued_all = at_end;
+      g_cond_broadcast (&saver->cond);
+      g_mutex_unlock (&saver->mutex);
+    }
+}
+
+
+
+static gboolean
+mousepad_file_saver_feed_idle (gpointer user_data)
+{
+  MousepadFileSaver *saver = user_data;
+
+  g_mutex_lock (&saver->mutex);
+  saver->feed_id = 0;
+  g_mutex_unlock (&saver->mutex);
+
+  /* the worker ran low on text */
+  mousepad_file_saver_feed (saver, NULL);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_file_saver_insert_text (GtkTextBuffer     *buffer,
+                                 GtkTextIter       *location,
+                                 const gchar       *text,
+                                 gint               length,
+                                 MousepadFileSaver *saver)
+{
+  GtkTextIter iter;
+
+  if (saver->mark == NULL)
+    return;
+
+  /* the text in front of the insert is saved as it is, the mark moves
+   * past the inserted text */
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, saver->mark);
+  if (gtk_text_iter_compare (location, &iter) >= 0)
+    mousepad_file_saver_feed (saver, location);
+}
+
+
+
+static void
+mousepad_file_saver_delete_range (GtkTextBuffer     *buffer,
+                                  GtkTextIter       *start_iter,
+                                  GtkTextIter       *end_iter,
+                                  MousepadFileSaver *saver)
+{
+  GtkTextIter iter;
+
+  if (saver->mark == NULL)
+    return;
+
+  /* the deleted text still has to be saved */
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, saver->mark);
+  if (gtk_text_iter_compare (end_iter, &iter) > 0)
+    mousepad_file_saver_feed (saver, end_iter);
+}
+
+
+
+static gchar *
+mousepad_file_saver_pop (MousepadFileSaver *saver)
+{
+  gchar *chunk;
+
+  g_mutex_lock (&saver->mutex);
+
+  /* wait for the main loop to queue more text */
+  while (saver->chunks.length == 0 && ! saver->queued_all)
+    {
+      if (saver->feed_id == 0)
+        saver->feed_id = g_idle_add (mousepad_file_saver_feed_idle, saver);
+
+      g_cond_wait (&saver->cond, &saver->mutex);
+    }
+
+  chunk = g_queue_pop_head (&saver->chunks);
+
+  /* refill the queue while we write this chunk */
+  if (! saver->queued_all && saver->feed_id == 0)
+    saver->feed_id = g_idle_add (mousepad_file_saver_feed_idle, saver);
+
+  /* wake up a join that feeds the queue */
+  g_cond_broadcast (&saver->cond);
+
+  g_mutex_unlock (&saver->mutex);
+
+  return chunk;
+}
+
+
+
+static gboolean
+mousepad_file_saver_write (MousepadFileSaver  *saver,
+                           GError            **error)
+{
+  gboolean      succeed = FALSE;
+  gboolean      written;
+  gchar        *chunk, *text, *p, *q, *n;
+  gchar        *staging = NULL;
+  gsize         length, staging_size = 0;
+  const gchar  *charset;
+  struct stat   statb;
+  const gchar   bom[] = { (gchar) 0xef, (gchar) 0xbb, (gchar) 0xbf };
+  MousepadFileConverter converter;
+
+  /* utf-8 text is written as is */
+  converter.iconv = (GIConv) -1;
+
+  /* open the file */
+  saver->fd = g_open (saver->filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (G_UNLIKELY (saver->fd == -1))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+
+      return FALSE;
+    }
+
+  /* compress the text like the file we loaded */
+  if (G_UNLIKELY (saver->compression == MOUSEPAD_COMPRESSION_GZIP))
+    {
+      saver->compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+      saver->outbuf = g_malloc (MOUSEPAD_FILE_SAVE_CHUNK_SIZE);
+    }
+
+  /* setup a converter to the encoding if set */
+  if (G_UNLIKELY (saver->encoding != MOUSEPAD_ENCODING_UTF_8))
+    {
+      /* get the charset */
+      charset = mousepad_encoding_get_charset (saver->encoding);
+      if (G_UNLIKELY (charset == NULL))
+        goto failed;
+
+      if (! mousepad_file_converter_init (&converter, charset, "UTF-8", error))
+        goto failed;
+    }
+
+  /* write an utf-8 bom at the start of the contents if needed, the converter
+   * turns it into the bom of the encoding */
+  if (saver->write_bom)
+    if (! mousepad_file_save_text (saver, &converter, bom, sizeof (bom), FALSE, error))
+      goto failed;
+
+  /* write the chunks as the main loop queues them */
+  while ((chunk = mousepad_file_saver_pop (saver)) != NULL)
+    {
+      text = chunk;
+      length = strlen (text);
+
+      /* handle line endings */
+      if (saver->line_ending == MOUSEPAD_EOL_MAC)
+        {
+          /* replace the unix with a mac line ending */
+          for (p = text; (p = memchr (p, '\n', text + length - p)) != NULL; p++)
+            *p = '\r';
+        }
+      else if (saver->line_ending == MOUSEPAD_EOL_DOS)
+        {
+          /* make room for a cr in front of every lf */
+          if (staging_size < 2 * length)
+            {
+              staging_size = 2 * length;
+              staging = g_realloc (staging, staging_size);
+            }
+
+          /* copy the lines with dos line endings in between */
+          for (p = text, q = staging; (n = memchr (p, '\n', text + length - p)) != NULL; p = n + 1)
+            {
+              memcpy (q, p, n - p);
+              q += n - p;
+              *q++ = '\r';
+              *q++ = '\n';
+            }
+
+          /* copy the remaining part */
+          memcpy (q, p, text + length - p);
+          q += text + length - p;
+
+          text = staging;
+          length = q - staging;
+        }
+
+      /* convert and write the chunk */
+      written = mousepad_file_save_text (saver, &converter, text, length, FALSE, error);
+
+      /* release the chunk */
+      g_free (chunk);
+
+      if (! written)
+        goto failed;
+    }
+
+  /* write the rest of the converter, like the shift sequence of stateful encodings,
+   * and the end of the compressed stream */
+  if (! mousepad_file_save_text (saver, &converter, "", 0, TRUE, error))
+    goto failed;
+
+  /* get the new file status */
+  if (G_LIKELY (fstat (saver->fd, &statb) == 0))
+    mousepad_file_status_from_stat (&saver->status, &statb);
+
+  /* everything went file */
+  succeed = TRUE;
+
+  failed:
+
+  /* cleanup */
+  mousepad_file_converter_clear (&converter);
+  g_free (staging);
+
+  if (saver->compressor != NULL)
+    g_object_unref (G_OBJECT (saver->compressor));
+  g_free (saver->outbuf);
+
+  /* close the file */
+  close (saver->fd);
+
+  return succeed;
+}
+
+
+
+static gchar *
+mousepad_file_resolve_symlinks (const gchar *filename)
+{
+  gchar *path, *target, *dirname;
+  guint  n;
+
+  /* follow the links to the file they point to, like open() does */
+  path = g_strdup (filename);
+  for (n = 0; n < 32; n++)
+    {
+      target = g_file_read_link (path, NULL);
+      if (target == NULL)
+        break;
+
+      if (! g_path_is_absolute (target))
+        {
+          dirname = g_path_get_dirname (path);
+          g_free (path);
+          path = g_build_filename (dirname, target, NULL);
+          g_free (dirname);
+          g_free (target);
+        }
+      else
+        {
+          g_free (path);
+          path = target;
+        }
+    }
+
+  return path;
+}
+
+
+
+static gboolean
+mousepad_file_saver_overwrites_pieces (MousepadFileSaver *saver)
+{
+  const gchar   *contents = g_mapped_file_get_contents (saver->mapped_file);
+  gsize          size = g_mapped_file_get_length (saver->mapped_file);
+  GArray        *changed;
+  MousepadPiece *piece;
+  guint64        offset = 0, start, end;
+  guint          i, lo, hi, mid;
+  gboolean       overwrites = FALSE;
+
+  /* the ranges of the file the write changes, in order: the pieces that are
+   * not already at their place in the file, and the end that is cut off */
+  changed = g_array_new (FALSE, FALSE, sizeof (guint64));
+  for (i = 0; i <= saver->pieces->len && offset < size; i++)
+    {
+      if (i < saver->pieces->len)
+        {
+          piece = &g_array_index (saver->pieces, MousepadPiece, i);
+          start = offset;
+          end = offset += piece->length;
+
+          if (piece->data == contents + start)
+            continue;
+        }
+      else
+        {
+          start = offset;
+          end = size;
+        }
+
+      end = MIN (end, size);
+      if (changed->len > 0 && g_array_index (changed, guint64, changed->len - 1) == start)
+        g_array_index (changed, guint64, changed->len - 1) = end;
+      else
+        {
+          g_array_append_val (changed, start);
+          g_array_append_val (changed, end);
+        }
+    }
+
+  /* whether a piece reads a changed range of the mapping */
+  for (i = 0; i < saver->pieces->len && changed->len > 0 && ! overwrites; i++)
+    {
+      piece = &g_array_index (saver->pieces, MousepadPiece, i);
+      if (piece->data < contents || piece->data >= contents + size)
+        continue;
+
+      start = piece->data - contents;
+      end = start + piece->length;
+
+      /* the first changed range that ends after the start of the piece */
+      for (lo = 0, hi = changed->len / 2; lo < hi; )
+        {
+          mid = (lo + hi) / 2;
+          if (g_array_index (changed, guint64, 2 * mid + 1) <= start)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      overwrites = (lo < changed->len / 2 && g_array_index (changed, guint64, 2 * lo) < end);
+    }
+
+  g_array_free (changed, TRUE);
+
+  return overwrites;
+}
+
+
+
+static gboolean
+mousepad_file_saver_write_pieces (MousepadFileSaver  *saver,
+                                  GError            **error)
+{
+  gint           fd = -1;
+  gboolean       succeed = FALSE;
+  gboolean       exists, in_place, dir_writable;
+  gboolean       maps_file, overwrites;
+  const gchar   *contents;
+  gchar         *filename, *dirname;
+  gchar         *temp_filename = NULL;
+  guint64        offset = 0;
+  guint          i;
+  MousepadPiece *piece;
+  struct stat    statb, temp_statb;
+
+  /* write the file a symlink points to, instead of replacing the link */
+  filename = mousepad_file_resolve_symlinks (saver->filename);
+  exists = (g_stat (filename, &statb) == 0);
+
+  /* we rather write a new file and move it over the old one, the pieces point
+   * into the file we read, but that breaks hard links and needs a writable
+   * directory */
+  dirname = g_path_get_dirname (filename);
+  dir_writable = (g_access (dirname, W_OK) == 0);
+  in_place = (exists && (statb.st_nlink > 1 || ! dir_writable));
+  g_free (dirname);
+
+  /* whether the pieces read the mapping of this file, and if writing in place
+   * would change the bytes they read */
+  maps_file = (exists && saver->mapped_status.valid
+               && statb.st_ino == saver->mapped_status.inode
+               && statb.st_dev == saver->mapped_status.device
+               && g_mapped_file_get_length (saver->mapped_file) > 0);
+  contents = maps_file ? g_mapped_file_get_contents (saver->mapped_file) : NULL;
+  overwrites = (maps_file && mousepad_file_saver_overwrites_pieces (saver));
+
+  /* the document can't lose the text it reads, rather break the hard links */
+  if (in_place && overwrites && dir_writable)
+    in_place = FALSE;
+
+  if (! in_place)
+    {
+      temp_filename = g_strconcat (filename, ".XXXXXX", NULL);
+      fd = g_mkstemp (temp_filename);
+      if (G_UNLIKELY (fd == -1))
+        {
+          /* set an error */
+          g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+          goto failed;
+        }
+
+      if (exists)
+        {
+          /* give the new file to the owner of the old one, write in place if we can't */
+          if (fstat (fd, &temp_statb) != 0
+              || ((temp_statb.st_uid != statb.st_uid || temp_statb.st_gid != statb.st_gid)
+                  && fchown (fd, statb.st_uid, statb.st_gid) != 0))
+            {
+              close (fd);
+              fd = -1;
+              g_unlink (temp_filename);
+              g_free (temp_filename);
+              temp_filename = NULL;
+              in_place = TRUE;
+            }
+          else
+            {
+              /* keep the permissions, after the owner because chown clears the setuid bits */
+              fchmod (fd, statb.st_mode & 07777);
+            }
+        }
+    }
+
+  if (in_place)
+    {
+      /* nothing is left to write without changing the text the document reads */
+      if (G_UNLIKELY (overwrites))
+        {
+          /* set an error */
+          g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                       _("The file can not be written in place, because the document "
+                         "still reads the parts of it that would change"));
+          goto failed;
+        }
+
+      /* the pieces read this file, it is cut to its new length once they are written */
+      fd = g_open (filename, O_WRONLY | O_CREAT | (maps_file ? 0 : O_TRUNC), 0666);
+      if (G_UNLIKELY (fd == -1))
+        {
+          /* set an error */
+          g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+          goto failed;
+        }
+    }
+
+  /* the document is utf-8 with the line endings of the file, write the bytes as they are */
+  for (i = 0; i < saver->pieces->len; i++)
+    {
+      piece = &g_array_index (saver->pieces, MousepadPiece, i);
+
+      /* in place, skip the pieces that are already where they belong */
+      if (in_place && maps_file)
+        {
+          if (piece->data == contents + offset)
             {
-              /* replace the unix with a mac line ending */
-              for (p = contents; *p != '\0'; p++)
-                if (G_UNLIKELY (*p == '\n'))
-                  *p = '\r';
+              offset += piece->length;
+              continue;
             }
-          else if (file->line_ending == MOUSEPAD_EOL_DOS)
+
+          if (G_UNLIKELY (lseek (fd, offset, SEEK_SET) == -1))
             {
-              /* split the contents into chunks */
-              chunks = g_strsplit (contents, "\n", -1);
+              g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+              goto failed;
+            }
+        }
+
+      if (! mousepad_file_write (fd, piece->data, piece->length, error))
+        goto failed;
+
+      offset += piece->length;
+    }
+
+  /* cut off the end of the old file */
+  if (in_place && maps_file && G_UNLIKELY (ftruncate (fd, offset) != 0))
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+      goto failed;
+    }
+
+  /* get the new file status, a new inode unless we wrote in place */
+  if (G_LIKELY (fstat (fd, &statb) == 0))
+    mousepad_file_status_from_stat (&saver->status, &statb);
+
+  if (G_UNLIKELY (close (fd) != 0))
+    {
+      fd = -1;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+      goto failed;
+    }
+
+  fd = -1;
+
+  /* replace the old file */
+  if (! in_place && G_UNLIKELY (g_rename (temp_filename, filename) != 0))
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+      goto failed;
+    }
+
+  /* everything went file */
+  succeed = TRUE;
+
+  failed:
+
+  /* cleanup */
+  if (fd != -1)
+    close (fd);
+
+  if (! succeed && temp_filename != NULL)
+    g_unlink (temp_filename);
+
+  g_free (temp_filename);
+  g_free (filename);
+
+  return succeed;
+}
+
+
+
+static void
+mousepad_file_saver_join (MousepadFileSaver *saver)
+{
+  /* wait until the worker is done with the saver */
+  g_mutex_lock (&saver->mutex);
+  while (! saver->done)
+    {
+      /* the worker waits for more text, the idle can't run while we wait */
+      if (saver->mark != NULL && saver->chunks.length < MOUSEPAD_FILE_SAVE_MAX_CHUNKS)
+        {
+          g_mutex_unlock (&saver->mutex);
+          mousepad_file_saver_feed (saver, NULL);
+          g_mutex_lock (&saver->mutex);
+        }
+      else
+        g_cond_wait (&saver->cond, &saver->mutex);
+    }
+  g_mutex_unlock (&saver->mutex);
+}
+
+
+
+static void
+mousepad_file_saver_free (MousepadFileSaver *saver)
+{
+  if (G_UNLIKELY (saver->error != NULL))
+    g_error_free (saver->error);
+
+  g_mutex_clear (&saver->mutex);
+  g_cond_clear (&saver->cond);
+
+  /* stop following the edits of the buffer */
+  if (saver->table == NULL)
+    {
+      mousepad_disconnect_by_func (G_OBJECT (saver->file->buffer), mousepad_file_saver_insert_text, saver);
+      mousepad_disconnect_by_func (G_OBJECT (saver->file->buffer), mousepad_file_saver_delete_range, saver);
+
+      if (saver->mark != NULL)
+        gtk_text_buffer_delete_mark (saver->file->buffer, saver->mark);
+    }
+
+  if (saver->feed_id != 0)
+    g_source_remove (saver->feed_id);
+
+  /* chunks the worker didn't write after an error */
+  g_queue_foreach (&saver->chunks, (GFunc) g_free, NULL);
+  g_queue_clear (&saver->chunks);
+
+  if (saver->table != NULL)
+    {
+      g_array_free (saver->pieces, TRUE);
+      mousepad_piece_table_unref (saver->table);
+      g_mapped_file_unref (saver->mapped_file);
+    }
+
+  g_free (saver->filename);
+  g_slice_free (MousepadFileSaver, saver);
+}
+
+
+
+static gboolean
+mousepad_file_saver_finish (MousepadFileSaver *saver)
+{
+  MousepadFile *file = saver->file;
+  gboolean      succeed = saver->succeed;
+
+  /* wait for the worker to release the saver */
+  mousepad_file_saver_join (saver);
+
+  if (G_LIKELY (succeed))
+    {
+      /* store the new file status */
+      if (G_LIKELY (saver->status.valid))
+        mousepad_file_set_status (file, &saver->status);
+
+      /* we saved succesfully */
+      mousepad_file_set_readonly (file, FALSE);
+
+      /* all lines now have the same line ending */
+      file->mixed_line_endings = FALSE;
+
+      /* if the user hasn't set the filetype, try and re-guess it now
+       * that we have a new filename to go by */
+      if (! file->user_set_language && ! mousepad_file_same_basename (file))
+        mousepad_file_set_language (file, mousepad_file_guess_language (file, NULL, 0));
+    }
+  else
+    {
+      /* the changes have not been saved */
+      gtk_text_buffer_set_modified (file->buffer, TRUE);
+    }
+
+  /* detach the saver */
+  file->saver = NULL;
+
+  /* tell the world we're done */
+  g_object_ref (G_OBJECT (file));
+  g_signal_emit (G_OBJECT (file), file_signals[SAVE_FINISHED], 0, succeed, saver->error);
+  g_object_unref (G_OBJECT (file));
+
+  /* cleanup */
+  mousepad_file_saver_free (saver);
+
+  return succeed;
+}
+
+
+
+static gboolean
+mousepad_file_saver_idle (gpointer user_data)
+{
+  /* the worker is done, update the file in the main loop */
+  mousepad_file_saver_finish (user_data);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_file_saver_run (gpointer data,
+                         gpointer user_data)
+{
+  MousepadFileSaver *saver = data;
+
+  /* encode and write the snapshot */
+  if (saver->pieces != NULL)
+    saver->succeed = mousepad_file_saver_write_pieces (saver, &saver->error);
+  else
+    saver->succeed = mousepad_file_saver_write (saver, &saver->error);
+
+  /* hand the result to the main loop */
+  g_mutex_lock (&saver->mutex);
+  saver->done = TRUE;
+  saver->idle_id = g_idle_add (mousepad_file_saver_idle, saver);
+  g_cond_broadcast (&saver->cond);
+  g_mutex_unlock (&saver->mutex);
+}
+
+
+
+gboolean
+mousepad_file_save (MousepadFile  *file,
+                    GError       **error)
+{
+  MousepadFileSaver *saver;
+  GtkTextIter        start_iter;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail (file->filename != NULL, FALSE);
+
+  /* the buffer is incomplete while the file is loading */
+  if (G_UNLIKELY (file->loader != NULL))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   _("The file \"%s\" is still being loaded"), file->filename);
+
+      return FALSE;
+    }
+
+  /* let a previous save finish first, they write the same file */
+  mousepad_file_save_wait (file);
+
+  /* and a reload, what we write is the reloaded text */
+  mousepad_file_reload_wait (file);
+
+  /* create the saver */
+  saver = g_slice_new0 (MousepadFileSaver);
+  saver->file = file;
+  saver->filename = g_strdup (file->filename);
+  saver->encoding = file->encoding;
+  saver->line_ending = file->line_ending;
+  saver->write_bom = file->write_bom && mousepad_encoding_is_unicode (file->encoding);
+  saver->compression = file->compression;
+  g_mutex_init (&saver->mutex);
+  g_cond_init (&saver->cond);
+
+  if (file->piece_table != NULL)
+    {
+      /* the buffer is a part of the document, copy the list of pieces,
+       * their bytes never change so the user can keep editing */
+      saver->table = mousepad_piece_table_ref (file->piece_table);
+      saver->pieces = mousepad_piece_table_copy_pieces (file->piece_table);
+      saver->mapped_file = g_mapped_file_ref (mousepad_piece_table_get_mapping (file->piece_table));
+      saver->mapped_status = file->piece_status;
+    }
+  else
+    {
+      /* the worker gets the text in chunks while the user keeps editing, the
+       * mark stays in front of the text it still needs and moves past the
+       * text inserted there */
+      gtk_text_buffer_get_start_iter (file->buffer, &start_iter);
+      saver->mark = gtk_text_buffer_create_mark (file->buffer, NULL, &start_iter, FALSE);
+      g_queue_init (&saver->chunks);
+
+      g_signal_connect (G_OBJECT (file->buffer), "insert-text",
+                        G_CALLBACK (mousepad_file_saver_insert_text), saver);
+      g_signal_connect (G_OBJECT (file->buffer), "delete-range",
+                        G_CALLBACK (mousepad_file_saver_delete_range), saver);
+
+      /* queue the first chunks */
+      mousepad_file_saver_feed (saver, NULL);
+    }
+
+  /* the snapshot is what will be on disk, new changes mark the buffer modified again */
+  gtk_text_buffer_set_modified (file->buffer, FALSE);
+
+  /* encode and write the file in the worker pool, shared by all files */
+  if (G_UNLIKELY (saver_pool == NULL))
+    saver_pool = g_thread_pool_new (mousepad_file_saver_run, NULL,
+                                    MOUSEPAD_FILE_SAVE_MAX_THREADS, FALSE, NULL);
+
+  file->saver = saver;
+  g_thread_pool_push (saver_pool, saver, NULL);
+
+  return TRUE;
+}
+
+
+
+gboolean
+mousepad_file_save_wait (MousepadFile *file)
+{
+  MousepadFileSaver *saver;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  saver = file->saver;
+  if (G_LIKELY (saver == NULL))
+    return TRUE;
+
+  /* wait for the worker and finish the save now, instead of in the idle */
+  mousepad_file_saver_join (saver);
+  g_source_remove (saver->idle_id);
+
+  return mousepad_file_saver_finish (saver);
+}
+
+
+
+gboolean
+mousepad_file_get_saving (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return (file->saver != NULL);
+}
+
+
+
+MousepadLineIndex *
+mousepad_file_get_line_index (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  return file->line_index;
+}
+
+
+
+void
+mousepad_file_set_piece_table (MousepadFile       *file,
+                               MousepadPieceTable *table)
+{
+  MousepadFileStatus status;
+  struct stat        statb;
+
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  g_return_if_fail (file->filename != NULL);
+
+  if (table != NULL)
+    mousepad_piece_table_ref (table);
+
+  if (file->piece_table != NULL)
+    mousepad_piece_table_unref (file->piece_table);
+
+  file->piece_table = table;
+  file->piece_status.valid = FALSE;
+
+  /* the table holds the file as we mapped it */
+  if (table != NULL && G_LIKELY (g_stat (file->filename, &statb) == 0))
+    {
+      /* whether the file is readonly (ie. not writable by the user) */
+      mousepad_file_set_readonly (file, !((statb.st_mode & S_IWUSR) != 0));
+
+      /* store the file status */
+      mousepad_file_status_from_stat (&status, &statb);
+      mousepad_file_set_status (file, &status);
+      file->piece_status = status;
+    }
+}
+
+
+
+static gboolean
+mousepad_file_reloader_decode (MousepadFileReloader  *reloader,
+                               const gchar           *contents,
+                               gsize                  length,
+                               GError               **error)
+{
+  const gchar          *charset;
+  const gchar          *end;
+  gchar                *decompressed = NULL;
+  GString              *converted;
+  gsize                 bom_length;
+  gboolean              last_was_cr = FALSE;
+  gboolean              succeed = FALSE;
+  MousepadFileInsert    insert;
+  MousepadFileConverter converter;
+
+  /* decompress compressed files, the file might have been compressed since we loaded it */
+  if (! mousepad_file_compression_from_magic (contents, length, &reloader->compression, error))
+    return FALSE;
+
+  if (G_UNLIKELY (reloader->compression != MOUSEPAD_COMPRESSION_NONE))
+    {
+      decompressed = mousepad_file_decompress_all (reloader->compression, contents, length,
+                                                   &length, error);
+      if (G_UNLIKELY (decompressed == NULL))
+        return FALSE;
+
+      contents = decompressed;
+    }
+
+  /* detect if there is a bom with the encoding type */
+  reloader->bom_encoding = G_LIKELY (length > 0) ? mousepad_file_encoding_read_bom (contents, length, &bom_length)
+                                                  : MOUSEPAD_ENCODING_NONE;
+  if (G_UNLIKELY (reloader->bom_encoding != MOUSEPAD_ENCODING_NONE))
+    {
+      /* skip the bom and use its encoding */
+      reloader->encoding = reloader->bom_encoding;
+      contents += bom_length;
+      length -= bom_length;
+    }
+
+  /* decode the new text, like when the file was opened */
+  if (G_LIKELY (reloader->encoding == MOUSEPAD_ENCODING_UTF_8))
+    {
+      /* leave when the contents is not utf-8 valid, this also counts the line endings */
+      if (mousepad_text_scan (contents, length, &end, &reloader->stats) == FALSE)
+        {
+          /* set an error */
+          g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                       _("Invalid byte sequence in conversion input"));
+
+          goto failed;
+        }
+
+      /* copy the text out of the mapping, turning cr and cr+lf line endings into lf */
+      length = end - contents;
+      reloader->text = g_malloc (length + 1);
+      if (G_UNLIKELY (reloader->stats.n_cr + reloader->stats.n_crlf > 0))
+        length = mousepad_file_normalize_line_endings (reloader->text, contents, length, &last_was_cr);
+      else
+        memcpy (reloader->text, contents, length);
+
+      reloader->text[length] = '\0';
+      reloader->length = length;
+    }
+  else
+    {
+      /* setup a converter to utf-8 */
+      charset = mousepad_encoding_get_charset (reloader->encoding);
+      if (! mousepad_file_converter_init (&converter, "UTF-8", charset, error))
+        goto failed;
+
+      /* convert the contents in windows and append them to a string */
+      memset (&insert, 0, sizeof (insert));
+      insert.file = reloader->file;
+      insert.text = converted = g_string_sized_new (length);
+      succeed = mousepad_file_converter_convert (&converter, contents, length, TRUE,
+                                                 mousepad_file_open_insert, &insert, error);
+
+      /* cleanup */
+      mousepad_file_converter_clear (&converter);
+
+      if (G_UNLIKELY (! succeed))
+        {
+          g_string_free (converted, TRUE);
+          goto failed;
+        }
+
+      reloader->stats = insert.stats;
+      reloader->length = converted->len;
+      reloader->text = g_string_free (converted, FALSE);
+    }
+
+  succeed = TRUE;
+
+  failed:
+
+  /* cleanup */
+  g_free (decompressed);
+
+  return succeed;
+}
+
+
+
+static void
+mousepad_file_reloader_diff (MousepadFileReloader *reloader)
+{
+  MousepadDiffHunk *hunk;
+  const gchar      *p;
+  glong             offset = 0;
+  guint             i;
+
+  /* the line hunks that turn the buffer text into the new text */
+  reloader->hunks = mousepad_diff_lines (reloader->old_text, strlen (reloader->old_text),
+                                         reloader->text, reloader->length);
+
+  /* the character offsets of the hunks in the buffer */
+  reloader->offsets = g_new (glong, 2 * reloader->hunks->len + 1);
+  for (i = 0, p = reloader->old_text; i < reloader->hunks->len; i++)
+    {
+      hunk = &g_array_index (reloader->hunks, MousepadDiffHunk, i);
+      offset += g_utf8_strlen (p, reloader->old_text + hunk->old_offset - p);
+      p = reloader->old_text + hunk->old_offset;
+
+      reloader->offsets[2 * i] = offset;
+      reloader->offsets[2 * i + 1] = offset + g_utf8_strlen (p, hunk->old_length);
+    }
+
+  /* the old text is no longer needed, only the offsets */
+  g_free (reloader->old_text);
+  reloader->old_text = NULL;
+}
+
+
+
+static gpointer
+mousepad_file_reloader_thread (gpointer data)
+{
+  MousepadFileReloader *reloader = data;
+  GMappedFile          *mapped_file = NULL;
+  const gchar          *contents = NULL;
+  gsize                 length = 0;
+  struct stat           statb;
+  gint                  fd;
+
+  /* open the file, the buffer is left alone until we know the new text */
+  fd = g_open (reloader->filename, O_RDONLY, 0);
+  if (G_UNLIKELY (fd == -1))
+    {
+      /* set an error */
+      g_set_error (&reloader->error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+
+      goto finished;
+    }
+
+  /* the status of the file we read */
+  if (G_UNLIKELY (fstat (fd, &statb) != 0))
+    {
+      /* set an error */
+      g_set_error (&reloader->error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   _("Failed to read the status of \"%s\""), reloader->filename);
+
+      goto finished;
+    }
+
+  mousepad_file_status_from_stat (&reloader->status, &statb);
+  reloader->readonly = !((statb.st_mode & S_IWUSR) != 0);
+
+  /* map the file, empty files have no mapping */
+  if (G_LIKELY (statb.st_size > 0))
+    {
+      mapped_file = g_mapped_file_new_from_fd (fd, FALSE, &reloader->error);
+      if (G_UNLIKELY (mapped_file == NULL))
+        goto finished;
+
+      contents = g_mapped_file_get_contents (mapped_file);
+      length = g_mapped_file_get_length (mapped_file);
+    }
+
+  if (G_UNLIKELY (contents == NULL || length == 0))
+    {
+      contents = "";
+      length = 0;
+    }
+
+  /* decode the new text and diff it with the buffer text */
+  reloader->succeed = mousepad_file_reloader_decode (reloader, contents, length, &reloader->error);
+  if (G_LIKELY (reloader->succeed))
+    mousepad_file_reloader_diff (reloader);
+
+  finished:
+
+  /* cleanup */
+  if (mapped_file != NULL)
+    g_mapped_file_unref (mapped_file);
+
+  if (fd != -1)
+    close (fd);
+
+  /* hand the result to the main loop */
+  reloader->idle_id = g_idle_add (mousepad_file_reloader_idle, reloader);
+
+  return NULL;
+}
+
 
-              /* cleanup */
-              g_free (contents);
 
-              /* join the chunks with dos line endings in between */
-              contents = g_strjoinv ("\r\n", chunks);
+static void
+mousepad_file_reloader_changed (GtkTextBuffer        *buffer,
+                                MousepadFileReloader *reloader)
+{
+  /* the hunks no longer match the buffer, diff it again when the worker is done */
+  reloader->stale = TRUE;
+}
 
-              /* cleanup */
-              g_strfreev (chunks);
 
-              /* new contents length */
-              length = strlen (contents);
-            }
 
-          /* add and utf-8 bom at the start of the contents if needed */
-          if (file->write_bom && mousepad_encoding_is_unicode (file->encoding))
-            {
-              /* realloc the contents string */
-              contents = g_realloc (contents, length + 4);
+static void
+mousepad_file_reloader_start (MousepadFileReloader *reloader)
+{
+  GtkTextIter start_iter, end_iter;
 
-              /* move the existing contents 3 bytes */
-              g_memmove (contents + 3, contents, length + 1);
+  /* the worker diffs the buffer text as it is now */
+  gtk_text_buffer_get_bounds (reloader->file->buffer, &start_iter, &end_iter);
+  reloader->old_text = gtk_text_buffer_get_slice (reloader->file->buffer, &start_iter, &end_iter, TRUE);
+  reloader->stale = FALSE;
 
-              /* write an utf-8 bom at the start of the contents */
-              contents[0] = (guchar) 0xef;
-              contents[1] = (guchar) 0xbb;
-              contents[2] = (guchar) 0xbf;
+  /* the encoding we decode from, a bom can override it */
+  reloader->encoding = reloader->file->encoding;
 
-              /* increase the length */
-              length += 3;
-            }
+  /* decode the file and diff it in a worker */
+  reloader->thread = g_thread_new ("mousepad-file-reloader", mousepad_file_reloader_thread, reloader);
+}
 
-          /* convert to the encoding if set */
-          if (G_UNLIKELY (file->encoding != MOUSEPAD_ENCODING_UTF_8))
-            {
-              /* get the charset */
-              charset = mousepad_encoding_get_charset (file->encoding);
-              if (G_UNLIKELY (charset == NULL))
-                goto failed;
 
-              /* convert the content to the user encoding */
-              encoded = g_convert (contents, length, charset, "UTF-8", NULL, &written, error);
 
-              /* return if nothing was encoded */
-              if (G_UNLIKELY (encoded == NULL))
-                goto failed;
+static void
+mousepad_file_reloader_clear (MousepadFileReloader *reloader)
+{
+  /* drop the result of the worker */
+  g_free (reloader->old_text);
+  g_free (reloader->text);
+  g_free (reloader->offsets);
+  if (reloader->hunks != NULL)
+    g_array_free (reloader->hunks, TRUE);
+  g_clear_error (&reloader->error);
+
+  reloader->old_text = NULL;
+  reloader->text = NULL;
+  reloader->offsets = NULL;
+  reloader->hunks = NULL;
+  reloader->succeed = FALSE;
+}
 
-              /* cleanup */
-              g_free (contents);
 
-              /* set the new contents */
-              contents = encoded;
-              length = written;
-            }
 
-          /* write the buffer to the file */
-          for (m = 0; m < length;)
-            {
-              /* write */
-              l = write (fd, contents + m, length - m);
+static void
+mousepad_file_reloader_free (MousepadFileReloader *reloader)
+{
+  /* wait for the worker, the result is dropped */
+  if (reloader->thread != NULL)
+    {
+      g_thread_join (reloader->thread);
+      g_source_remove (reloader->idle_id);
+    }
 
-              if (G_UNLIKELY (l < 0))
-                {
-                  /* just try again on EAGAIN/EINTR */
-                  if (G_LIKELY (errno != EAGAIN && errno != EINTR))
-                    {
-                      /* set an error */
-                      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
-
-                      /* bail out */
-                      goto failed;
-                    }
-                }
-              else
-                {
-                  /* advance the offset */
-                  m += l;
-                }
-            }
+  /* cleanup */
+  mousepad_disconnect_by_func (G_OBJECT (reloader->file->buffer), mousepad_file_reloader_changed, reloader);
+  mousepad_file_reloader_clear (reloader);
+  g_free (reloader->filename);
+  g_slice_free (MousepadFileReloader, reloader);
+}
 
-          /* set the new modification time */
-          if (G_LIKELY (fstat (fd, &statb) == 0))
-            file->mtime = statb.st_mtime;
 
-          /* everything has been saved */
-          gtk_text_buffer_set_modified (file->buffer, FALSE);
 
-          /* we saved succesfully */
-          mousepad_file_set_readonly (file, FALSE);
+static void
+mousepad_file_reload_patch (MousepadFile         *file,
+                            MousepadFileReloader *reloader)
+{
+  GtkTextIter       start_iter, end_iter;
+  MousepadDiffHunk *hunk;
+  guint             i;
+
+  /* patch the buffer from the end, so the offsets of the hunks before stay
+   * valid, the text, marks and cursor outside the hunks are left alone */
+  for (i = reloader->hunks->len; i > 0; i--)
+    {
+      hunk = &g_array_index (reloader->hunks, MousepadDiffHunk, i - 1);
+
+      gtk_text_buffer_get_iter_at_offset (file->buffer, &start_iter, reloader->offsets[2 * i - 2]);
+      if (hunk->old_length > 0)
+        {
+          gtk_text_buffer_get_iter_at_offset (file->buffer, &end_iter, reloader->offsets[2 * i - 1]);
+          gtk_text_buffer_delete (file->buffer, &start_iter, &end_iter);
+        }
 
-          /* if the user hasn't set the filetype, try and re-guess it now
-           * that we have a new filename to go by */
-          if (! file->user_set_language)
-            mousepad_file_set_language (file, mousepad_file_guess_language (file));
+      if (hunk->new_length > 0)
+        gtk_text_buffer_insert (file->buffer, &start_iter, reloader->text + hunk->new_offset, hunk->new_length);
+    }
+}
 
-          /* everything went file */
-          succeed = TRUE;
 
-          failed:
 
-          /* cleanup */
-          g_free (contents);
+static void
+mousepad_file_reloader_finish (MousepadFileReloader *reloader)
+{
+  MousepadFile *file = reloader->file;
+  gboolean      succeed = reloader->succeed;
 
-          /* close the file */
-          close (fd);
-        }
+  /* the worker has handed us its result, wait for it to exit */
+  if (G_LIKELY (reloader->thread != NULL))
+    {
+      g_thread_join (reloader->thread);
+      reloader->thread = NULL;
     }
-  else
+
+  /* the buffer changed while the worker diffed it, start over with the new text */
+  if (G_UNLIKELY (succeed && reloader->stale))
     {
-      /* set an error */
-      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+      mousepad_file_reloader_clear (reloader);
+      mousepad_file_reloader_start (reloader);
+
+      return;
     }
 
-  return succeed;
+  /* detach the reloader, nothing changes the buffer behind our back anymore */
+  mousepad_disconnect_by_func (G_OBJECT (file->buffer), mousepad_file_reloader_changed, reloader);
+  file->reloader = NULL;
+
+  if (G_LIKELY (succeed))
+    {
+      /* only touch the lines that changed, in a single step that can't be undone */
+      gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (file->buffer));
+      gtk_text_buffer_begin_user_action (file->buffer);
+      mousepad_file_reload_patch (file, reloader);
+      gtk_text_buffer_end_user_action (file->buffer);
+      gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (file->buffer));
+
+      /* the file is now what we've read from the disk */
+      file->compression = reloader->compression;
+      if (G_UNLIKELY (reloader->bom_encoding != MOUSEPAD_ENCODING_NONE))
+        {
+          file->write_bom = TRUE;
+          file->encoding = reloader->bom_encoding;
+        }
+
+      /* set the line ending style found most in the file */
+      mousepad_file_set_line_ending_from_stats (file, &reloader->stats);
+
+      /* guess and set the file's filetype/language, from the start of the content */
+      mousepad_file_set_language (file, mousepad_file_guess_language (file, reloader->text, reloader->length));
+
+      /* this does not count as a modified buffer */
+      gtk_text_buffer_set_modified (file->buffer, FALSE);
+
+      /* whether the file is readonly (ie. not writable by the user) */
+      mousepad_file_set_readonly (file, reloader->readonly);
+
+      /* store the file status */
+      mousepad_file_set_status (file, &reloader->status);
+    }
+
+  /* tell the world we're done */
+  g_object_ref (G_OBJECT (file));
+  g_signal_emit (G_OBJECT (file), file_signals[RELOAD_FINISHED], 0, succeed, reloader->error);
+  g_object_unref (G_OBJECT (file));
+
+  /* cleanup */
+  mousepad_file_reloader_free (reloader);
+}
+
+
+
+static gboolean
+mousepad_file_reloader_idle (gpointer user_data)
+{
+  /* the worker is done, update the buffer in the main loop */
+  mousepad_file_reloader_finish (user_data);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_file_reload_wait (MousepadFile *file)
+{
+  /* finish the reload now, instead of in the idle, it restarts when the buffer changed */
+  while (file->reloader != NULL)
+    {
+      g_thread_join (file->reloader->thread);
+      file->reloader->thread = NULL;
+      g_source_remove (file->reloader->idle_id);
+      mousepad_file_reloader_finish (file->reloader);
+    }
 }
 
 
@@ -862,14 +4040,34 @@ gboolean
 mousepad_file_reload (MousepadFile  *file,
                       GError       **error)
 {
-  GtkTextIter start, end;
-  gint        succeed;
+  MousepadFileReloader *reloader;
 
   g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
   g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
   g_return_val_if_fail (file->filename != NULL, FALSE);
 
+  /* the buffer is incomplete while the file is loading */
+  if (G_UNLIKELY (file->loader != NULL))
+    {
+      /* set an error */
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   _("The file \"%s\" is still being loaded"), file->filename);
+
+      return FALSE;
+    }
+
+  /* a reload is running, let it read the file again when it is done */
+  if (G_UNLIKELY (file->reloader != NULL))
+    {
+      file->reloader->stale = TRUE;
+
+      return TRUE;
+    }
+
+  /* make sure the file on disk is complete */
+  mousepad_file_save_wait (file);
+
   /* simple test if the file has not been removed */
   if (G_UNLIKELY (g_file_test (file->filename, G_FILE_TEST_EXISTS) == FALSE))
     {
@@ -880,14 +4078,354 @@ mousepad_file_reload (MousepadFile  *file,
       return FALSE;
     }
 
-  /* clear the buffer */
-  gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-  gtk_text_buffer_delete (file->buffer, &start, &end);
+  /* create the reloader */
+  reloader = g_slice_new0 (MousepadFileReloader);
+  reloader->file = file;
+  reloader->filename = g_strdup (file->filename);
+
+  /* edits made while the worker runs are diffed again */
+  g_signal_connect (G_OBJECT (file->buffer), "changed",
+                    G_CALLBACK (mousepad_file_reloader_changed), reloader);
+
+  file->reloader = reloader;
+  mousepad_file_reloader_start (reloader);
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_follow_append (MousepadFile  *file,
+                             gchar         *chunk,
+                             gsize          length,
+                             gsize         *consumed,
+                             GError       **error)
+{
+  MousepadFileFollow *follow = file->follow;
+  gchar              *p = chunk, *end;
+  gboolean            valid;
+  MousepadTextStats   stats;
+
+  /* append at the end of the buffer */
+  gtk_text_buffer_get_end_iter (file->buffer, &follow->insert.iter);
+
+  /* the converter carries split sequences over to the next read */
+  if (follow->converter.iconv != (GIConv) -1)
+    {
+      *consumed = length;
+
+      return mousepad_file_converter_convert (&follow->converter, chunk, length, FALSE,
+                                              mousepad_file_open_insert, &follow->insert, error);
+    }
+
+  while (p < chunk + length)
+    {
+      /* append the valid utf-8 text */
+      valid = mousepad_text_scan (p, chunk + length - p, (const gchar **) &end, &stats);
+      if (end > p && ! mousepad_file_open_insert (p, end - p, &follow->insert, error))
+        return FALSE;
+
+      p = end;
+      if (valid)
+        break;
+
+      /* an incomplete character at the end is read again next time */
+      if (g_utf8_get_char_validated (p, chunk + length - p) == (gunichar) -2)
+        break;
+
+      /* skip the invalid byte, the document no longer holds the bytes of
+       * the file, so it can't be saved over it */
+      mousepad_file_set_readonly (file, TRUE);
+      p++;
+    }
+
+  *consumed = p - chunk;
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_follow_reload (MousepadFile *file)
+{
+  GtkTextIter  start_iter, end_iter;
+  GError      *error = NULL;
+
+  /* loading the file again would throw away the changes of the user */
+  if (gtk_text_buffer_get_modified (file->buffer))
+    {
+      g_set_error (&error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   _("The file \"%s\" was replaced or truncated, it is not loaded again "
+                     "because the document has unsaved changes"), file->filename);
+      mousepad_file_follow_stop (file, error);
+      g_error_free (error);
+
+      return;
+    }
+
+  /* load the new file in the background, the loader tells when it failed */
+  if (mousepad_file_open_streaming (file, &error) != 0)
+    {
+      mousepad_file_follow_stop (file, error);
+      g_error_free (error);
+
+      return;
+    }
+
+  /* the loader appends to the buffer, empty it before the first block arrives */
+  gtk_text_buffer_get_bounds (file->buffer, &start_iter, &end_iter);
+  gtk_text_buffer_delete (file->buffer, &start_iter, &end_iter);
+}
+
+
+
+static gboolean
+mousepad_file_follow_update (MousepadFile *file)
+{
+  MousepadFileFollow *follow = file->follow;
+  MousepadFileStatus  status;
+  struct stat         statb;
+  GtkTextIter         start_iter, end_iter;
+  GError             *error = NULL;
+  gchar              *chunk;
+  gsize               consumed;
+  gssize              n;
+  gint64              deadline;
+  gint                fd, n_lines, max_lines;
+  gboolean            modified, has_more = FALSE;
+
+  /* wait for loads, saves and reloads, and for a rotated file to be created again */
+  if (file->loader != NULL || file->saver != NULL || file->reloader != NULL
+      || g_stat (file->filename, &statb) != 0)
+    return FALSE;
+
+  /* nothing was appended */
+  mousepad_file_status_from_stat (&status, &statb);
+  if (file->status.valid
+      && status.inode == file->status.inode
+      && status.device == file->status.device
+      && status.size == follow->offset)
+    return FALSE;
+
+  /* the file was rotated or truncated, open it again */
+  if (file->status.valid
+      && (status.inode != file->status.inode
+          || status.device != file->status.device
+          || status.size < follow->offset))
+    {
+      mousepad_file_follow_reload (file);
+
+      return FALSE;
+    }
+
+  fd = g_open (file->filename, O_RDONLY, 0);
+  if (G_UNLIKELY (fd == -1))
+    {
+      /* report it once, instead of trying again and again */
+      g_set_error (&error, G_FILE_ERROR, g_file_error_from_errno (errno), "%s", g_strerror (errno));
+      mousepad_file_follow_stop (file, error);
+      g_error_free (error);
+
+      return FALSE;
+    }
+
+  /* what we append is not a change of the user */
+  modified = gtk_text_buffer_get_modified (file->buffer);
+  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (file->buffer));
+
+  /* read the appended bytes until the end of the file, or until the main
+   * loop needs to run again */
+  chunk = g_malloc (MOUSEPAD_FILE_LOAD_CHUNK_SIZE);
+  deadline = g_get_monotonic_time () + MOUSEPAD_FILE_FOLLOW_TIME_BUDGET;
+
+  for (;;)
+    {
+      /* the bytes of an incomplete character are read again with the next chunk */
+      if (lseek (fd, follow->offset, SEEK_SET) == -1)
+        break;
+
+      do
+        n = read (fd, chunk, MOUSEPAD_FILE_LOAD_CHUNK_SIZE);
+      while (G_UNLIKELY (n < 0 && errno == EINTR));
+
+      if (n <= 0)
+        break;
+
+      /* only count the bytes that are in the buffer, the converter can't
+       * tell where it failed, so the document loses the whole chunk */
+      if (! mousepad_file_follow_append (file, chunk, n, &consumed, NULL))
+        {
+          mousepad_file_set_readonly (file, TRUE);
+          consumed = n;
+        }
+
+      follow->offset += consumed;
+
+      /* only an incomplete character is left */
+      if (consumed == 0)
+        break;
+
+      /* let the main loop run, the next step reads the rest */
+      if (g_get_monotonic_time () >= deadline)
+        {
+          has_more = TRUE;
+          break;
+        }
+    }
+
+  g_free (chunk);
+
+  /* the appended bytes are in the buffer, this is not an external
+   * modification, unless bytes are left that we have not read */
+  if (G_LIKELY (fstat (fd, &statb) == 0))
+    {
+      mousepad_file_status_from_stat (&status, &statb);
+      if (status.size == follow->offset)
+        file->status = status;
+    }
+
+  close (fd);
+
+  /* drop the oldest lines */
+  max_lines = MOUSEPAD_SETTING_GET_INT (FOLLOW_MAX_LINES);
+  n_lines = gtk_text_buffer_get_line_count (file->buffer);
+  if (max_lines > 0 && n_lines > max_lines)
+    {
+      gtk_text_buffer_get_start_iter (file->buffer, &start_iter);
+      gtk_text_buffer_get_iter_at_line (file->buffer, &end_iter, n_lines - max_lines);
+      gtk_text_buffer_delete (file->buffer, &start_iter, &end_iter);
+    }
+
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (file->buffer));
+  gtk_text_buffer_set_modified (file->buffer, modified);
+
+  /* tell the world, so the view can scroll to the end */
+  g_signal_emit (G_OBJECT (file), file_signals[FOLLOW_APPENDED], 0);
+
+  return has_more;
+}
+
+
+
+static gboolean
+mousepad_file_follow_timeout (gpointer user_data)
+{
+  MousepadFile *file = MOUSEPAD_FILE (user_data);
+  gboolean      has_more;
+
+  has_more = mousepad_file_follow_update (file);
+
+  /* a handler stopped following the file */
+  if (G_UNLIKELY (file->follow == NULL))
+    return FALSE;
+
+  /* keep reading while there is more, or poll the file without a monitor */
+  if (has_more || file->monitor == NULL)
+    return TRUE;
+
+  file->follow->timeout_id = 0;
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_file_follow_schedule (MousepadFile *file)
+{
+  MousepadFileFollow *follow = file->follow;
+
+  /* coalesce the changes of the monitor, without one we poll the file */
+  if (follow->timeout_id == 0)
+    follow->timeout_id = g_timeout_add (file->monitor != NULL ? MOUSEPAD_FILE_FOLLOW_DELAY
+                                                              : MOUSEPAD_FILE_FOLLOW_POLL_INTERVAL,
+                                        mousepad_file_follow_timeout, file);
+}
+
+
+
+static void
+mousepad_file_follow_stop (MousepadFile *file,
+                           const GError *error)
+{
+  /* stop following and tell why, the error can be NULL */
+  mousepad_file_set_follow (file, FALSE);
+  g_signal_emit (G_OBJECT (file), file_signals[FOLLOW_STOPPED], 0, error);
+}
+
+
+
+void
+mousepad_file_set_follow (MousepadFile *file,
+                          gboolean      follow)
+{
+  MousepadFileFollow *ff;
+  const gchar        *charset;
+
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  if (follow == (file->follow != NULL))
+    return;
+
+  if (follow)
+    {
+      g_return_if_fail (file->filename != NULL);
+      g_return_if_fail (file->piece_table == NULL);
+
+      /* appended bytes of a compressed file are not text, and a file that
+       * is still loading has no end yet */
+      if (file->compression != MOUSEPAD_COMPRESSION_NONE || file->loader != NULL)
+        return;
+
+      ff = g_slice_new0 (MousepadFileFollow);
+      ff->insert.file = file;
+      ff->converter.iconv = (GIConv) -1;
+
+      /* start at the end of what we've read or written */
+      ff->offset = file->status.valid ? file->status.size : 0;
+
+      /* setup a converter for non utf-8 files */
+      if (file->encoding != MOUSEPAD_ENCODING_UTF_8)
+        {
+          charset = mousepad_encoding_get_charset (file->encoding);
+          if (! mousepad_file_converter_init (&ff->converter, "UTF-8", charset, NULL))
+            {
+              g_slice_free (MousepadFileFollow, ff);
+              return;
+            }
+        }
+
+      file->follow = ff;
+
+      /* read what was appended since then */
+      mousepad_file_follow_schedule (file);
+    }
+  else
+    {
+      ff = file->follow;
+      file->follow = NULL;
+
+      if (ff->timeout_id != 0)
+        g_source_remove (ff->timeout_id);
+
+      mousepad_file_converter_clear (&ff->converter);
+      g_slice_free (MousepadFileFollow, ff);
+
+      /* the next check looks at the file again */
+      file->monitor_changed = TRUE;
+    }
+}
+
 
-  /* reload the file */
-  succeed = mousepad_file_open (file, NULL, error);
 
-  return (succeed == 0);
+gboolean
+mousepad_file_get_follow (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return (file->follow != NULL);
 }
 
 
@@ -896,23 +4434,44 @@ gboolean
 mousepad_file_get_externally_modified (MousepadFile  *file,
                                        GError       **error)
 {
-  struct stat statb;
-  GFileError  error_code;
+  struct stat        statb;
+  MousepadFileStatus status;
+  GFileError         error_code;
 
   g_return_val_if_fail (MOUSEPAD_IS_FILE (file), TRUE);
   g_return_val_if_fail (file->filename != NULL, TRUE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  /* check if our modification time differs from the current one */
+  /* we're writing the file ourselves, or reading what is appended to it */
+  if (G_UNLIKELY (file->saver != NULL || file->follow != NULL))
+    return FALSE;
+
+  /* the monitor did not see the file change since the last check */
+  if (G_LIKELY (file->monitor != NULL && !file->monitor_changed))
+    return file->externally_modified;
+
+  /* check if the file status differs from the one we've read or written */
   if (G_LIKELY (g_stat (file->filename, &statb) == 0))
-    return (file->mtime > 0 && statb.st_mtime != file->mtime);
+    {
+      mousepad_file_status_from_stat (&status, &statb);
+
+      file->monitor_changed = FALSE;
+      file->externally_modified = (file->status.valid && !mousepad_file_status_equal (&status, &file->status));
+
+      return file->externally_modified;
+    }
 
   /* get the error code */
   error_code = g_file_error_from_errno (errno);
 
   /* file does not exists, nothing wrong with that */
   if (G_LIKELY (error_code == G_FILE_ERROR_NOENT))
-    return FALSE;
+    {
+      file->monitor_changed = FALSE;
+      file->externally_modified = FALSE;
+
+      return FALSE;
+    }
 
   /* set an error */
   if (error != NULL)
@@ -20,6 +20,9 @@
 G_BEGIN_DECLS
 
 #include <mousepad/mousepad-encoding.h>
+#include <mousepad/mousepad-encoding-detector.h>
+#include <mousepad/mousepad-line-index.h>
+#include <mousepad/mousepad-piece-table.h>
 
 #include <gtksourceview/gtksourcelanguage.h>
 
@@ -41,6 +44,13 @@ typedef enum
 }
 MousepadLineEnding;
 
+typedef enum
+{
+  MOUSEPAD_COMPRESSION_NONE,
+  MOUSEPAD_COMPRESSION_GZIP
+}
+MousepadCompression;
+
 GType               mousepad_file_get_type                 (void) G_GNUC_CONST;
 
 MousepadFile       *mousepad_file_new                      (GtkTextBuffer       *buffer);
@@ -57,6 +67,9 @@ void                mousepad_file_set_encoding             (MousepadFile
 
 MousepadEncoding    mousepad_file_get_encoding             (MousepadFile        *file);
 
+void                mousepad_file_set_readonly             (MousepadFile        *file,
+                                                            gboolean             readonly);
+
 gboolean            mousepad_file_get_read_only            (MousepadFile        *file);
 
 void                mousepad_file_set_write_bom            (MousepadFile        *file,
@@ -70,6 +83,10 @@ void                mousepad_file_set_line_ending          (MousepadFile
 
 MousepadLineEnding  mousepad_file_get_line_ending          (MousepadFile        *file);
 
+gboolean            mousepad_file_get_mixed_line_endings   (MousepadFile        *file);
+
+MousepadCompression mousepad_file_get_compression          (MousepadFile        *file);
+
 void                mousepad_file_set_language             (MousepadFile        *file,
                                                             GtkSourceLanguage   *language);
 
@@ -80,18 +97,56 @@ void                mousepad_file_set_language_id          (MousepadFile
 
 const gchar        *mousepad_file_get_language_id          (MousepadFile        *file);
 
-GtkSourceLanguage  *mousepad_file_guess_language           (MousepadFile        *file);
+GtkSourceLanguage  *mousepad_file_guess_language           (MousepadFile        *file,
+                                                            const gchar         *data,
+                                                            gsize                length);
+
+guint               mousepad_file_guess_encodings          (MousepadFile          *file,
+                                                            MousepadEncodingGuess *guesses,
+                                                            guint                  n_guesses);
+
+GBytes             *mousepad_file_map_contents             (const gchar         *filename,
+                                                            gboolean            *complete,
+                                                            GError             **error);
 
 gint                mousepad_file_open                     (MousepadFile        *file,
                                                             const gchar         *template_filename,
                                                             GError             **error);
 
+gboolean            mousepad_file_get_prefers_streaming    (MousepadFile        *file);
+
+gboolean            mousepad_file_get_prefers_viewer       (MousepadFile        *file);
+
+gint                mousepad_file_open_streaming           (MousepadFile        *file,
+                                                            GError             **error);
+
+gint                mousepad_file_open_stdin               (MousepadFile        *file,
+                                                            GError             **error);
+
+void                mousepad_file_open_cancel              (MousepadFile        *file);
+
+gboolean            mousepad_file_get_loading              (MousepadFile        *file);
+
 gboolean            mousepad_file_save                     (MousepadFile        *file,
                                                             GError             **error);
 
+gboolean            mousepad_file_save_wait                (MousepadFile        *file);
+
+gboolean            mousepad_file_get_saving               (MousepadFile        *file);
+
+MousepadLineIndex  *mousepad_file_get_line_index           (MousepadFile        *file);
+
+void                mousepad_file_set_piece_table          (MousepadFile        *file,
+                                                            MousepadPieceTable  *table);
+
 gboolean            mousepad_file_reload                   (MousepadFile        *file,
                                                             GError             **error);
 
+void                mousepad_file_set_follow               (MousepadFile        *file,
+                                                            gboolean             follow);
+
+gboolean            mousepad_file_get_follow               (MousepadFile        *file);
+
 gboolean            mousepad_file_get_externally_modified  (MousepadFile        *file,
                                                             GError             **error);
 
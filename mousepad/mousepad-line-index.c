@@ -0,0 +1,583 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-line-index.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+
+
+/* maximum number of line lengths stored in one block */
+#define MOUSEPAD_LINE_INDEX_BLOCK_SIZE (1024)
+
+
+
+typedef struct _MousepadLineIndexBlock MousepadLineIndexBlock;
+
+struct _MousepadLineIndexBlock
+{
+  /* number of lines in the block and their total length */
+  guint     n_lines;
+  guint64   n_bytes;
+
+  /* length of each line in bytes, including the line delimiter */
+  guint32   lengths[MOUSEPAD_LINE_INDEX_BLOCK_SIZE];
+};
+
+struct _MousepadLineIndex
+{
+  /* the buffer we index */
+  GtkTextBuffer           *buffer;
+
+  /* the blocks with the line lengths */
+  MousepadLineIndexBlock **blocks;
+  guint                    n_blocks;
+  guint                    n_allocated;
+
+  /* number of lines and bytes before each block, only the first
+   * n_valid entries are up to date */
+  gint                    *line_starts;
+  guint64                 *byte_starts;
+  guint                    n_valid;
+
+  /* totals */
+  gint                     n_lines;
+  guint64                  n_bytes;
+
+  /* the index no longer matches the buffer and is rebuilt on the next query */
+  gboolean                 invalid;
+
+  /* position of the edit in progress */
+  gint                     edit_line;
+  gint                     edit_index;
+  gint                     edit_end_line;
+  gint                     edit_end_index;
+};
+
+
+
+static void
+mousepad_line_index_insert_block (MousepadLineIndex *index,
+                                  guint              b)
+{
+  /* make room for another block */
+  if (G_UNLIKELY (index->n_blocks == index->n_allocated))
+    {
+      index->n_allocated = MAX (16, index->n_allocated * 2);
+      index->blocks = g_renew (MousepadLineIndexBlock *, index->blocks, index->n_allocated);
+      index->line_starts = g_renew (gint, index->line_starts, index->n_allocated);
+      index->byte_starts = g_renew (guint64, index->byte_starts, index->n_allocated);
+    }
+
+  g_memmove (index->blocks + b + 1, index->blocks + b, (index->n_blocks - b) * sizeof (gpointer));
+  index->blocks[b] = g_slice_new0 (MousepadLineIndexBlock);
+  index->n_blocks++;
+
+  /* the starts of the blocks after this one have moved */
+  index->n_valid = MIN (index->n_valid, b);
+}
+
+
+
+static void
+mousepad_line_index_remove_block (MousepadLineIndex *index,
+                                  guint              b)
+{
+  g_slice_free (MousepadLineIndexBlock, index->blocks[b]);
+
+  g_memmove (index->blocks + b, index->blocks + b + 1, (index->n_blocks - b - 1) * sizeof (gpointer));
+  index->n_blocks--;
+
+  /* the starts of the blocks after this one have moved */
+  index->n_valid = MIN (index->n_valid, b);
+}
+
+
+
+static void
+mousepad_line_index_reset (MousepadLineIndex *index)
+{
+  /* drop all blocks */
+  while (index->n_blocks > 0)
+    mousepad_line_index_remove_block (index, index->n_blocks - 1);
+
+  /* a buffer always has a line */
+  mousepad_line_index_insert_block (index, 0);
+  index->blocks[0]->n_lines = 1;
+  index->n_lines = 1;
+  index->n_bytes = 0;
+  index->invalid = FALSE;
+}
+
+
+
+static void
+mousepad_line_index_append (MousepadLineIndex *index,
+                            guint32            length)
+{
+  MousepadLineIndexBlock *block = index->blocks[index->n_blocks - 1];
+
+  /* start a new block when the last one is full */
+  if (G_UNLIKELY (block->n_lines == MOUSEPAD_LINE_INDEX_BLOCK_SIZE))
+    {
+      mousepad_line_index_insert_block (index, index->n_blocks);
+      block = index->blocks[index->n_blocks - 1];
+    }
+
+  block->lengths[block->n_lines++] = length;
+  block->n_bytes += length;
+  index->n_lines++;
+  index->n_bytes += length;
+}
+
+
+
+static void
+mousepad_line_index_rebuild (MousepadLineIndex *index)
+{
+  GtkTextIter iter;
+
+  mousepad_line_index_reset (index);
+
+  /* walk the lines of the buffer */
+  gtk_text_buffer_get_start_iter (index->buffer, &iter);
+  index->blocks[0]->lengths[0] = gtk_text_iter_get_bytes_in_line (&iter);
+  index->blocks[0]->n_bytes = index->n_bytes = index->blocks[0]->lengths[0];
+
+  while (gtk_text_iter_forward_line (&iter))
+    mousepad_line_index_append (index, gtk_text_iter_get_bytes_in_line (&iter));
+}
+
+
+
+static void
+mousepad_line_index_update_starts (MousepadLineIndex *index)
+{
+  guint b;
+
+  /* rebuild the index if it no longer matches the buffer */
+  if (G_UNLIKELY (index->invalid))
+    mousepad_line_index_rebuild (index);
+
+  if (G_UNLIKELY (index->n_valid == 0))
+    {
+      index->line_starts[0] = 0;
+      index->byte_starts[0] = 0;
+      index->n_valid = 1;
+    }
+
+  /* update the starts after the last edited block */
+  for (b = index->n_valid; b < index->n_blocks; b++)
+    {
+      index->line_starts[b] = index->line_starts[b - 1] + index->blocks[b - 1]->n_lines;
+      index->byte_starts[b] = index->byte_starts[b - 1] + index->blocks[b - 1]->n_bytes;
+    }
+
+  index->n_valid = index->n_blocks;
+}
+
+
+
+static guint
+mousepad_line_index_find_line (MousepadLineIndex *index,
+                               gint               line,
+                               guint             *position)
+{
+  guint lower = 0, upper, b;
+
+  mousepad_line_index_update_starts (index);
+
+  /* find the last block that starts at or before the line */
+  upper = index->n_blocks;
+  while (upper - lower > 1)
+    {
+      b = (lower + upper) / 2;
+      if (index->line_starts[b] <= line)
+        lower = b;
+      else
+        upper = b;
+    }
+
+  *position = line - index->line_starts[lower];
+
+  return lower;
+}
+
+
+
+static void
+mousepad_line_index_replace (MousepadLineIndex *index,
+                             gint               line,
+                             gint               n_remove,
+                             const guint32     *lengths,
+                             gint               n_insert)
+{
+  MousepadLineIndexBlock *block, *tail;
+  guint                   b, bi, first, position, p, n, i;
+  guint64                 bytes;
+
+  b = mousepad_line_index_find_line (index, line, &position);
+
+  /* remove the old lines, this can leave empty blocks behind */
+  for (bi = b, p = position; n_remove > 0; bi++, p = 0)
+    {
+      block = index->blocks[bi];
+      n = MIN ((guint) n_remove, block->n_lines - p);
+
+      for (bytes = 0, i = p; i < p + n; i++)
+        bytes += block->lengths[i];
+
+      g_memmove (block->lengths + p, block->lengths + p + n, (block->n_lines - p - n) * sizeof (guint32));
+      block->n_lines -= n;
+      block->n_bytes -= bytes;
+      index->n_lines -= n;
+      index->n_bytes -= bytes;
+      n_remove -= n;
+    }
+
+  block = index->blocks[b];
+  first = b;
+
+  if (block->n_lines + n_insert <= MOUSEPAD_LINE_INDEX_BLOCK_SIZE)
+    {
+      /* make room in the block and insert the new lines */
+      g_memmove (block->lengths + position + n_insert, block->lengths + position,
+                 (block->n_lines - position) * sizeof (guint32));
+
+      for (i = 0; i < (guint) n_insert; i++)
+        {
+          block->lengths[position + i] = lengths[i];
+          block->n_bytes += lengths[i];
+        }
+
+      block->n_lines += n_insert;
+    }
+  else
+    {
+      /* move the lines after the position to a block of their own */
+      n = block->n_lines - position;
+      if (n > 0)
+        {
+          mousepad_line_index_insert_block (index, b + 1);
+          tail = index->blocks[b + 1];
+
+          memcpy (tail->lengths, block->lengths + position, n * sizeof (guint32));
+          for (bytes = 0, i = 0; i < n; i++)
+            bytes += tail->lengths[i];
+
+          tail->n_lines = n;
+          tail->n_bytes = bytes;
+          block->n_lines = position;
+          block->n_bytes -= bytes;
+        }
+
+      /* append the new lines, in new blocks before the tail when it's full */
+      for (i = 0; i < (guint) n_insert; i++)
+        {
+          if (G_UNLIKELY (block->n_lines == MOUSEPAD_LINE_INDEX_BLOCK_SIZE))
+            {
+              mousepad_line_index_insert_block (index, ++b);
+              block = index->blocks[b];
+            }
+
+          block->lengths[block->n_lines++] = lengths[i];
+          block->n_bytes += lengths[i];
+        }
+    }
+
+  index->n_lines += n_insert;
+  for (i = 0; i < (guint) n_insert; i++)
+    index->n_bytes += lengths[i];
+
+  /* drop the blocks we emptied */
+  for (bi = first; bi < index->n_blocks && index->n_blocks > 1;)
+    {
+      if (G_UNLIKELY (index->blocks[bi]->n_lines == 0))
+        mousepad_line_index_remove_block (index, bi);
+      else if (bi > b + 1)
+        break;
+      else
+        bi++;
+    }
+
+  /* the starts after the first edited block have changed */
+  index->n_valid = MIN (index->n_valid, first + 1);
+}
+
+
+
+static void
+mousepad_line_index_insert_text_before (GtkTextBuffer     *buffer,
+                                        GtkTextIter       *location,
+                                        const gchar       *text,
+                                        gint               length,
+                                        MousepadLineIndex *index)
+{
+  /* remember where the text is inserted */
+  index->edit_line = gtk_text_iter_get_line (location);
+  index->edit_index = gtk_text_iter_get_line_index (location);
+}
+
+
+
+static void
+mousepad_line_index_insert_text (GtkTextBuffer     *buffer,
+                                 GtkTextIter       *location,
+                                 const gchar       *text,
+                                 gint               length,
+                                 MousepadLineIndex *index)
+{
+  MousepadLineIndexBlock *block;
+  const gchar            *p, *n, *end = text + length;
+  guint32                *lengths;
+  guint32                 old_length;
+  guint                   b, position;
+  gint                    n_lines = 0, i;
+
+  /* nothing to update until we rebuild the index */
+  if (G_UNLIKELY (index->invalid) || length <= 0)
+    return;
+
+  /* count the new lines, other line delimiters are handled by a rebuild */
+  for (p = text; (p = memchr (p, '\n', end - p)) != NULL; p++)
+    n_lines++;
+
+  if (G_UNLIKELY (memchr (text, '\r', length) != NULL
+      || g_strstr_len (text, length, "\342\200\251") != NULL
+      || gtk_text_iter_get_line (location) != index->edit_line + n_lines))
+    {
+      index->invalid = TRUE;
+      return;
+    }
+
+  b = mousepad_line_index_find_line (index, index->edit_line, &position);
+  block = index->blocks[b];
+
+  if (G_LIKELY (n_lines == 0))
+    {
+      /* the line just got longer */
+      block->lengths[position] += length;
+      block->n_bytes += length;
+      index->n_bytes += length;
+      index->n_valid = MIN (index->n_valid, b + 1);
+
+      return;
+    }
+
+  /* split the line at the new line characters */
+  old_length = block->lengths[position];
+  lengths = g_new (guint32, n_lines + 1);
+
+  for (p = text, i = 0; (n = memchr (p, '\n', end - p)) != NULL; p = n + 1, i++)
+    lengths[i] = n - p + 1;
+
+  lengths[0] += index->edit_index;
+  lengths[n_lines] = (old_length - index->edit_index) + (end - p);
+
+  mousepad_line_index_replace (index, index->edit_line, 1, lengths, n_lines + 1);
+
+  g_free (lengths);
+}
+
+
+
+static void
+mousepad_line_index_delete_range_before (GtkTextBuffer     *buffer,
+                                         GtkTextIter       *start,
+                                         GtkTextIter       *end,
+                                         MousepadLineIndex *index)
+{
+  /* remember the range that is deleted */
+  index->edit_line = gtk_text_iter_get_line (start);
+  index->edit_index = gtk_text_iter_get_line_index (start);
+  index->edit_end_line = gtk_text_iter_get_line (end);
+  index->edit_end_index = gtk_text_iter_get_line_index (end);
+}
+
+
+
+static void
+mousepad_line_index_delete_range (GtkTextBuffer     *buffer,
+                                  GtkTextIter       *start,
+                                  GtkTextIter       *end,
+                                  MousepadLineIndex *index)
+{
+  guint   b, position;
+  guint32 length;
+
+  /* nothing to update until we rebuild the index */
+  if (G_UNLIKELY (index->invalid))
+    return;
+
+  /* the first and last line of the range become one line */
+  b = mousepad_line_index_find_line (index, index->edit_end_line, &position);
+  length = index->edit_index + (index->blocks[b]->lengths[position] - index->edit_end_index);
+
+  mousepad_line_index_replace (index, index->edit_line, index->edit_end_line - index->edit_line + 1, &length, 1);
+
+  /* a cr+lf pair that was split or joined */
+  if (G_UNLIKELY (index->n_lines != gtk_text_buffer_get_line_count (buffer)))
+    index->invalid = TRUE;
+}
+
+
+
+MousepadLineIndex *
+mousepad_line_index_new (GtkTextBuffer *buffer)
+{
+  MousepadLineIndex *index;
+
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+  index = g_slice_new0 (MousepadLineIndex);
+  index->buffer = buffer;
+
+  /* index the current contents */
+  mousepad_line_index_rebuild (index);
+
+  /* keep the index updated when the buffer changes */
+  g_signal_connect (G_OBJECT (buffer), "insert-text",
+                    G_CALLBACK (mousepad_line_index_insert_text_before), index);
+  g_signal_connect_after (G_OBJECT (buffer), "insert-text",
+                          G_CALLBACK (mousepad_line_index_insert_text), index);
+  g_signal_connect (G_OBJECT (buffer), "delete-range",
+                    G_CALLBACK (mousepad_line_index_delete_range_before), index);
+  g_signal_connect_after (G_OBJECT (buffer), "delete-range",
+                          G_CALLBACK (mousepad_line_index_delete_range), index);
+
+  return index;
+}
+
+
+
+void
+mousepad_line_index_free (MousepadLineIndex *index)
+{
+  /* disconnect from the buffer */
+  mousepad_disconnect_by_func (G_OBJECT (index->buffer), mousepad_line_index_insert_text_before, index);
+  mousepad_disconnect_by_func (G_OBJECT (index->buffer), mousepad_line_index_insert_text, index);
+  mousepad_disconnect_by_func (G_OBJECT (index->buffer), mousepad_line_index_delete_range_before, index);
+  mousepad_disconnect_by_func (G_OBJECT (index->buffer), mousepad_line_index_delete_range, index);
+
+  /* cleanup */
+  while (index->n_blocks > 0)
+    mousepad_line_index_remove_block (index, index->n_blocks - 1);
+
+  g_free (index->blocks);
+  g_free (index->line_starts);
+  g_free (index->byte_starts);
+  g_slice_free (MousepadLineIndex, index);
+}
+
+
+
+gint
+mousepad_line_index_get_line_count (MousepadLineIndex *index)
+{
+  /* rebuild the index if it no longer matches the buffer */
+  if (G_UNLIKELY (index->invalid))
+    mousepad_line_index_rebuild (index);
+
+  return index->n_lines;
+}
+
+
+
+guint64
+mousepad_line_index_get_byte_count (MousepadLineIndex *index)
+{
+  /* rebuild the index if it no longer matches the buffer */
+  if (G_UNLIKELY (index->invalid))
+    mousepad_line_index_rebuild (index);
+
+  return index->n_bytes;
+}
+
+
+
+guint64
+mousepad_line_index_get_line_offset (MousepadLineIndex *index,
+                                     gint               line)
+{
+  MousepadLineIndexBlock *block;
+  guint64                 offset;
+  guint                   b, position, i;
+
+  /* the end of the buffer for lines past the end */
+  if (G_UNLIKELY (line >= mousepad_line_index_get_line_count (index)))
+    return index->n_bytes;
+
+  b = mousepad_line_index_find_line (index, MAX (line, 0), &position);
+  block = index->blocks[b];
+
+  /* add the lines in the block before the line */
+  for (offset = index->byte_starts[b], i = 0; i < position; i++)
+    offset += block->lengths[i];
+
+  return offset;
+}
+
+
+
+gint
+mousepad_line_index_get_line_at (MousepadLineIndex *index,
+                                 guint64            offset,
+                                 gint              *line_index)
+{
+  MousepadLineIndexBlock *block;
+  guint                   lower = 0, upper, b, i;
+
+  mousepad_line_index_update_starts (index);
+
+  /* clamp to the end of the buffer */
+  offset = MIN (offset, index->n_bytes);
+
+  /* find the last block that starts at or before the offset */
+  upper = index->n_blocks;
+  while (upper - lower > 1)
+    {
+      b = (lower + upper) / 2;
+      if (index->byte_starts[b] <= offset)
+        lower = b;
+      else
+        upper = b;
+    }
+
+  /* walk the lines in the block */
+  block = index->blocks[lower];
+  offset -= index->byte_starts[lower];
+  for (i = 0; i + 1 < block->n_lines && offset >= block->lengths[i]; i++)
+    offset -= block->lengths[i];
+
+  if (line_index != NULL)
+    *line_index = offset;
+
+  return index->line_starts[lower] + i;
+}
+
+
+
+guint64
+mousepad_line_index_get_iter_offset (MousepadLineIndex *index,
+                                     const GtkTextIter *iter)
+{
+  /* the start of the line and the bytes before the iter */
+  return mousepad_line_index_get_line_offset (index, gtk_text_iter_get_line (iter))
+         + gtk_text_iter_get_line_index (iter);
+}
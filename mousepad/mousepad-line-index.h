@@ -0,0 +1,46 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_LINE_INDEX_H__
+#define __MOUSEPAD_LINE_INDEX_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadLineIndex MousepadLineIndex;
+
+MousepadLineIndex *mousepad_line_index_new             (GtkTextBuffer       *buffer);
+
+void               mousepad_line_index_free            (MousepadLineIndex   *index);
+
+gint               mousepad_line_index_get_line_count  (MousepadLineIndex   *index);
+
+guint64            mousepad_line_index_get_byte_count  (MousepadLineIndex   *index);
+
+guint64            mousepad_line_index_get_line_offset (MousepadLineIndex   *index,
+                                                        gint                 line);
+
+gint               mousepad_line_index_get_line_at     (MousepadLineIndex   *index,
+                                                        guint64              offset,
+                                                        gint                *line_index);
+
+guint64            mousepad_line_index_get_iter_offset (MousepadLineIndex   *index,
+                                                        const GtkTextIter   *iter);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_LINE_INDEX_H__ */
@@ -0,0 +1,924 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-util.h>
+#include <mousepad/mousepad-match-index.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+
+
+/* maximum number of matches stored in one block */
+#define MOUSEPAD_MATCH_INDEX_BLOCK_SIZE (1024)
+
+/* number of characters before and after an edit a regular expression is
+ * searched in again at first, the part after it doubles while the matches
+ * there change */
+#define MOUSEPAD_MATCH_INDEX_REGEX_CONTEXT (4 * 1024)
+
+/* the search flags that change the matches */
+#define MOUSEPAD_MATCH_INDEX_FLAGS      (MOUSEPAD_SEARCH_FLAGS_MATCH_CASE \
+                                         | MOUSEPAD_SEARCH_FLAGS_WHOLE_WORD \
+                                         | MOUSEPAD_SEARCH_FLAGS_REGEX)
+
+
+
+typedef struct _MousepadMatchIndexBlock MousepadMatchIndexBlock;
+
+struct _MousepadMatchIndexBlock
+{
+  /* number of matches in the block and the characters it covers, up
+   * to the start of the next block */
+  guint     n_matches;
+  gint      n_chars;
+
+  /* start of each match relative to the start of the block, and its
+   * length in characters */
+  gint      starts[MOUSEPAD_MATCH_INDEX_BLOCK_SIZE];
+  gint      lengths[MOUSEPAD_MATCH_INDEX_BLOCK_SIZE];
+};
+
+struct _MousepadMatchIndex
+{
+  /* the buffer we index */
+  GtkTextBuffer            *buffer;
+
+  /* the search, NULL when there is nothing to index */
+  gchar                    *string;
+  MousepadSearchFlags       flags;
+  gint                      n_string_chars;
+  gboolean                  invalid;
+
+  /* the blocks with the matches, together they cover the buffer */
+  MousepadMatchIndexBlock **blocks;
+  guint                     n_blocks;
+  guint                     n_allocated;
+
+  /* number of characters and matches before each block, only the
+   * first n_valid entries are up to date */
+  gint                     *char_starts;
+  gint                     *match_starts;
+  guint                     n_valid;
+
+  /* total number of matches */
+  gint                      n_matches;
+
+  /* the end of the last match found by a scan, the offset the matches
+   * of a scan have to start before, and the first match after it */
+  gint                      scan_end;
+  gint                      scan_limit;
+  gint                      scan_next;
+  gint                      scan_next_length;
+
+  /* the range that is deleted */
+  gint                      edit_offset;
+  gint                      edit_end_offset;
+};
+
+
+
+static void
+mousepad_match_index_insert_block (MousepadMatchIndex *index,
+                                   guint               b)
+{
+  /* make room for another block */
+  if (G_UNLIKELY (index->n_blocks == index->n_allocated))
+    {
+      index->n_allocated = MAX (16, index->n_allocated * 2);
+      index->blocks = g_renew (MousepadMatchIndexBlock *, index->blocks, index->n_allocated);
+      index->char_starts = g_renew (gint, index->char_starts, index->n_allocated);
+      index->match_starts = g_renew (gint, index->match_starts, index->n_allocated);
+    }
+
+  g_memmove (index->blocks + b + 1, index->blocks + b, (index->n_blocks - b) * sizeof (gpointer));
+  index->blocks[b] = g_slice_new (MousepadMatchIndexBlock);
+  index->blocks[b]->n_matches = 0;
+  index->blocks[b]->n_chars = 0;
+  index->n_blocks++;
+
+  /* the starts of the blocks after this one have moved */
+  index->n_valid = MIN (index->n_valid, b);
+}
+
+
+
+static void
+mousepad_match_index_remove_block (MousepadMatchIndex *index,
+                                   guint               b)
+{
+  g_slice_free (MousepadMatchIndexBlock, index->blocks[b]);
+
+  g_memmove (index->blocks + b, index->blocks + b + 1, (index->n_blocks - b - 1) * sizeof (gpointer));
+  index->n_blocks--;
+
+  /* the starts of the blocks after this one have moved */
+  index->n_valid = MIN (index->n_valid, b);
+}
+
+
+
+static void
+mousepad_match_index_drop_block (MousepadMatchIndex *index,
+                                 guint               b)
+{
+  MousepadMatchIndexBlock *block = index->blocks[b];
+  MousepadMatchIndexBlock *next;
+  guint                    i;
+
+  /* the buffer always has a block */
+  if (G_UNLIKELY (index->n_blocks == 1))
+    return;
+
+  if (b > 0)
+    {
+      /* the previous block covers the characters of the empty block */
+      index->blocks[b - 1]->n_chars += block->n_chars;
+    }
+  else
+    {
+      /* the next block starts at the start of the buffer */
+      next = index->blocks[1];
+      for (i = 0; i < next->n_matches; i++)
+        next->starts[i] += block->n_chars;
+      next->n_chars += block->n_chars;
+    }
+
+  mousepad_match_index_remove_block (index, b);
+}
+
+
+
+static void
+mousepad_match_index_reset (MousepadMatchIndex *index)
+{
+  /* drop all blocks */
+  while (index->n_blocks > 0)
+    mousepad_match_index_remove_block (index, index->n_blocks - 1);
+
+  /* one empty block for the whole buffer */
+  mousepad_match_index_insert_block (index, 0);
+  index->blocks[0]->n_chars = gtk_text_buffer_get_char_count (index->buffer);
+  index->n_matches = 0;
+  index->scan_limit = G_MAXINT;
+}
+
+
+
+static void
+mousepad_match_index_update_starts (MousepadMatchIndex *index)
+{
+  guint b;
+
+  if (G_UNLIKELY (index->n_valid == 0))
+    {
+      index->char_starts[0] = 0;
+      index->match_starts[0] = 0;
+      index->n_valid = 1;
+    }
+
+  /* update the starts after the last edited block */
+  for (b = index->n_valid; b < index->n_blocks; b++)
+    {
+      index->char_starts[b] = index->char_starts[b - 1] + index->blocks[b - 1]->n_chars;
+      index->match_starts[b] = index->match_starts[b - 1] + index->blocks[b - 1]->n_matches;
+    }
+
+  index->n_valid = index->n_blocks;
+}
+
+
+
+static guint
+mousepad_match_index_find_block (MousepadMatchIndex *index,
+                                 gint                offset)
+{
+  guint lower = 0, upper, b;
+
+  mousepad_match_index_update_starts (index);
+
+  /* find the last block that starts at or before the offset */
+  upper = index->n_blocks;
+  while (upper - lower > 1)
+    {
+      b = (lower + upper) / 2;
+      if (index->char_starts[b] <= offset)
+        lower = b;
+      else
+        upper = b;
+    }
+
+  return lower;
+}
+
+
+
+static guint
+mousepad_match_index_block_search (MousepadMatchIndexBlock *block,
+                                   gint                     start)
+{
+  guint lower = 0, upper = block->n_matches, i;
+
+  /* the first match in the block that starts at or after start */
+  while (lower < upper)
+    {
+      i = (lower + upper) / 2;
+      if (block->starts[i] < start)
+        lower = i + 1;
+      else
+        upper = i;
+    }
+
+  return lower;
+}
+
+
+
+static gint
+mousepad_match_index_position (MousepadMatchIndex *index,
+                               gint                offset)
+{
+  guint b;
+
+  /* the number of matches that start before the offset */
+  b = mousepad_match_index_find_block (index, offset);
+
+  return index->match_starts[b]
+         + mousepad_match_index_block_search (index->blocks[b], offset - index->char_starts[b]);
+}
+
+
+
+static gboolean
+mousepad_match_index_nth (MousepadMatchIndex *index,
+                          gint                n,
+                          gint               *start,
+                          gint               *length)
+{
+  MousepadMatchIndexBlock *block;
+  guint                    lower = 0, upper, b;
+
+  if (n < 0 || n >= index->n_matches)
+    return FALSE;
+
+  mousepad_match_index_update_starts (index);
+
+  /* find the last block with the n-th match at or after its first match */
+  upper = index->n_blocks;
+  while (upper - lower > 1)
+    {
+      b = (lower + upper) / 2;
+      if (index->match_starts[b] <= n)
+        lower = b;
+      else
+        upper = b;
+    }
+
+  block = index->blocks[lower];
+  n -= index->match_starts[lower];
+
+  *start = index->char_starts[lower] + block->starts[n];
+  *length = block->lengths[n];
+
+  return TRUE;
+}
+
+
+
+static gint
+mousepad_match_index_reach (MousepadMatchIndex *index,
+                            gint                offset)
+{
+  gint position, match_start, match_length;
+
+  /* the end of a match that starts before the offset and reaches past it */
+  position = mousepad_match_index_position (index, offset);
+  if (mousepad_match_index_nth (index, position - 1, &match_start, &match_length)
+      && match_start + match_length > offset)
+    return match_start + match_length;
+
+  return offset;
+}
+
+
+
+static void
+mousepad_match_index_insert (MousepadMatchIndex *index,
+                             gint                start,
+                             gint                length)
+{
+  MousepadMatchIndexBlock *block, *tail;
+  guint                    b, position, half;
+  gint                     split, i;
+
+  b = mousepad_match_index_find_block (index, start);
+  block = index->blocks[b];
+  start -= index->char_starts[b];
+  position = mousepad_match_index_block_search (block, start);
+
+  if (G_UNLIKELY (block->n_matches == MOUSEPAD_MATCH_INDEX_BLOCK_SIZE))
+    {
+      /* move the second half of the matches to a block of their own */
+      half = MOUSEPAD_MATCH_INDEX_BLOCK_SIZE / 2;
+      mousepad_match_index_insert_block (index, b + 1);
+      tail = index->blocks[b + 1];
+
+      split = block->starts[half];
+      tail->n_matches = block->n_matches - half;
+      tail->n_chars = block->n_chars - split;
+      for (i = 0; i < (gint) tail->n_matches; i++)
+        {
+          tail->starts[i] = block->starts[half + i] - split;
+          tail->lengths[i] = block->lengths[half + i];
+        }
+
+      block->n_matches = half;
+      block->n_chars = split;
+
+      /* the match goes into the new block when it starts after the split */
+      if (position > half)
+        {
+          block = tail;
+          start -= split;
+          position -= half;
+          b++;
+        }
+    }
+
+  g_memmove (block->starts + position + 1, block->starts + position,
+             (block->n_matches - position) * sizeof (gint));
+  g_memmove (block->lengths + position + 1, block->lengths + position,
+             (block->n_matches - position) * sizeof (gint));
+
+  block->starts[position] = start;
+  block->lengths[position] = length;
+  block->n_matches++;
+  index->n_matches++;
+
+  /* the match starts after this block have changed */
+  index->n_valid = MIN (index->n_valid, b + 1);
+}
+
+
+
+static void
+mousepad_match_index_remove (MousepadMatchIndex *index,
+                             gint                from,
+                             gint                to)
+{
+  MousepadMatchIndexBlock *block;
+  guint                    b, first, position, last;
+
+  if (from >= to || index->n_matches == 0)
+    return;
+
+  first = b = mousepad_match_index_find_block (index, from);
+
+  /* remove the matches that start in the range, block by block */
+  for (; b < index->n_blocks && index->char_starts[b] < to; b++)
+    {
+      block = index->blocks[b];
+      position = mousepad_match_index_block_search (block, from - index->char_starts[b]);
+      last = mousepad_match_index_block_search (block, to - index->char_starts[b]);
+
+      if (position == last)
+        continue;
+
+      g_memmove (block->starts + position, block->starts + last,
+                 (block->n_matches - last) * sizeof (gint));
+      g_memmove (block->lengths + position, block->lengths + last,
+                 (block->n_matches - last) * sizeof (gint));
+
+      block->n_matches -= last - position;
+      index->n_matches -= last - position;
+    }
+
+  /* drop the blocks we emptied, from the last one back so the blocks
+   * we still have to look at keep their place */
+  while (b-- > first)
+    if (G_UNLIKELY (index->blocks[b]->n_matches == 0))
+      mousepad_match_index_drop_block (index, b);
+
+  /* the match starts after the first edited block have changed */
+  index->n_valid = MIN (index->n_valid, first + 1);
+}
+
+
+
+static void
+mousepad_match_index_insert_chars (MousepadMatchIndex *index,
+                                   gint                offset,
+                                   gint                n_chars)
+{
+  MousepadMatchIndexBlock *block;
+  guint                    b, i;
+
+  b = mousepad_match_index_find_block (index, offset);
+  block = index->blocks[b];
+  offset -= index->char_starts[b];
+
+  /* the matches after the text move */
+  for (i = mousepad_match_index_block_search (block, offset); i < block->n_matches; i++)
+    block->starts[i] += n_chars;
+
+  block->n_chars += n_chars;
+  index->n_valid = MIN (index->n_valid, b + 1);
+}
+
+
+
+static void
+mousepad_match_index_delete_chars (MousepadMatchIndex *index,
+                                   gint                offset,
+                                   gint                n_chars)
+{
+  MousepadMatchIndexBlock *block;
+  guint                    b, first, i;
+  gint                     n;
+
+  first = b = mousepad_match_index_find_block (index, offset);
+  offset -= index->char_starts[b];
+
+  /* the matches in the range are already removed, the ones after it
+   * move back, in every block the range touches */
+  for (; n_chars > 0 && b < index->n_blocks; b++, offset = 0)
+    {
+      block = index->blocks[b];
+      n = MIN (n_chars, block->n_chars - offset);
+
+      for (i = mousepad_match_index_block_search (block, offset); i < block->n_matches; i++)
+        block->starts[i] -= n;
+
+      block->n_chars -= n;
+      n_chars -= n;
+    }
+
+  /* the starts after the first edited block have changed */
+  index->n_valid = MIN (index->n_valid, first + 1);
+}
+
+
+
+static gboolean
+mousepad_match_index_found (GtkTextBuffer *buffer,
+                            GtkTextIter   *match_start,
+                            GtkTextIter   *match_end,
+                            gpointer       user_data)
+{
+  MousepadMatchIndex *index = user_data;
+  gint                start, end;
+
+  start = gtk_text_iter_get_offset (match_start);
+  end = gtk_text_iter_get_offset (match_end);
+
+  /* the text after the range was only searched for the matches in it */
+  if (start >= index->scan_limit)
+    {
+      index->scan_next = start;
+      index->scan_next_length = end - start;
+      return FALSE;
+    }
+
+  mousepad_match_index_insert (index, start, end - start);
+  index->scan_end = MAX (index->scan_end, end);
+
+  return TRUE;
+}
+
+
+
+static gint
+mousepad_match_index_scan (MousepadMatchIndex *index,
+                           gint                from,
+                           gint                to,
+                           gint                lookahead)
+{
+  GtkTextIter start, end;
+  gint        position, match_start, match_length;
+
+  /* start at a match that reaches into the range */
+  position = mousepad_match_index_position (index, from);
+  if (mousepad_match_index_nth (index, position - 1, &match_start, &match_length)
+      && match_start + match_length > from)
+    from = match_start;
+
+  /* and end after the old matches that start in it, their text may hold
+   * other matches now */
+  to = mousepad_match_index_reach (index, to);
+
+  /* the old matches go, the ones that are found now come back */
+  mousepad_match_index_remove (index, from, to);
+
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &start, from);
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &end, to + lookahead);
+
+  /* search the text after the range too, for the matches that start in it */
+  index->scan_end = to;
+  index->scan_limit = to;
+  index->scan_next = -1;
+  if (mousepad_util_search_foreach (index->buffer, index->string, index->flags,
+                                    &start, &end, mousepad_match_index_found, index) < 0)
+    {
+      /* should never happen, the search was valid when we built the index */
+      mousepad_match_index_reset (index);
+      index->invalid = TRUE;
+      return to;
+    }
+
+  index->scan_limit = G_MAXINT;
+
+  /* a match at the end can cover old matches after the range */
+  mousepad_match_index_remove (index, to, index->scan_end);
+
+  return to;
+}
+
+
+
+static void
+mousepad_match_index_scan_regex (MousepadMatchIndex *index,
+                                 gint                from,
+                                 gint                to)
+{
+  GtkTextIter start, end;
+  gint        lookahead, n_chars, position, match_start, match_length;
+
+  /* a regular expression can match across any number of lines: start
+   * at the match before the range, which a search of the whole buffer
+   * would find there too, or on the lines before it when that is far */
+  position = mousepad_match_index_position (index, from);
+  if (mousepad_match_index_nth (index, position - 1, &match_start, &match_length)
+      && match_start >= from - MOUSEPAD_MATCH_INDEX_REGEX_CONTEXT)
+    from = match_start;
+  else
+    {
+      gtk_text_buffer_get_iter_at_offset (index->buffer, &start, MAX (from - MOUSEPAD_MATCH_INDEX_REGEX_CONTEXT, 0));
+      gtk_text_iter_set_line_offset (&start, 0);
+      from = gtk_text_iter_get_offset (&start);
+    }
+
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &end, to);
+  gtk_text_iter_forward_line (&end);
+  to = gtk_text_iter_get_offset (&end);
+
+  /* the matches can also depend on the text after the range */
+  n_chars = gtk_text_buffer_get_char_count (index->buffer);
+  for (lookahead = MOUSEPAD_MATCH_INDEX_REGEX_CONTEXT; ; lookahead *= 2)
+    {
+      to = mousepad_match_index_scan (index, from, to, lookahead);
+      if (index->invalid || to + lookahead >= n_chars)
+        break;
+
+      /* the old matches after the range are still right when the search
+       * finds the first of them again, or when nothing reaches out of the
+       * range and there are no matches close by */
+      position = mousepad_match_index_position (index, to);
+      if (index->scan_next >= 0)
+        {
+          if (mousepad_match_index_nth (index, position, &match_start, &match_length)
+              && match_start == index->scan_next && match_length == index->scan_next_length)
+            break;
+        }
+      else if (index->scan_end <= to
+               && (! mousepad_match_index_nth (index, position, &match_start, &match_length)
+                   || match_start >= to + lookahead))
+        break;
+
+      /* otherwise they change too, look further */
+      to += lookahead;
+    }
+}
+
+
+
+static void
+mousepad_match_index_scan_lines (MousepadMatchIndex *index,
+                                 gint                from,
+                                 gint                to)
+{
+  GtkTextIter start, end;
+
+  if (index->n_string_chars == 0)
+    {
+      mousepad_match_index_scan_regex (index, from, to);
+      return;
+    }
+
+  /* scan the whole lines of the range, with the line after it since
+   * its first word may no longer touch the previous one */
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &start, from);
+  gtk_text_iter_set_line_offset (&start, 0);
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &end, to);
+  gtk_text_iter_forward_line (&end);
+
+  /* a match of a string with line breaks can start on the lines before */
+  from = MAX (gtk_text_iter_get_offset (&start) - (index->n_string_chars - 1), 0);
+
+  mousepad_match_index_scan (index, from, gtk_text_iter_get_offset (&end), 0);
+}
+
+
+
+static void
+mousepad_match_index_insert_text (GtkTextBuffer      *buffer,
+                                  GtkTextIter        *location,
+                                  const gchar        *text,
+                                  gint                length,
+                                  MousepadMatchIndex *index)
+{
+  gint end, n_chars, reach;
+
+  /* nothing to update without a search */
+  if (index->string == NULL || index->invalid || length <= 0)
+    return;
+
+  /* the location is at the end of the new text now */
+  end = gtk_text_iter_get_offset (location);
+  n_chars = g_utf8_strlen (text, length);
+
+  /* a match around the new text still ends at the old place */
+  reach = mousepad_match_index_reach (index, end - n_chars) + n_chars;
+
+  mousepad_match_index_insert_chars (index, end - n_chars, n_chars);
+  mousepad_match_index_scan_lines (index, end - n_chars, reach);
+}
+
+
+
+static void
+mousepad_match_index_delete_range_before (GtkTextBuffer      *buffer,
+                                          GtkTextIter        *start,
+                                          GtkTextIter        *end,
+                                          MousepadMatchIndex *index)
+{
+  /* remember the range that is deleted */
+  index->edit_offset = gtk_text_iter_get_offset (start);
+  index->edit_end_offset = gtk_text_iter_get_offset (end);
+}
+
+
+
+static void
+mousepad_match_index_delete_range (GtkTextBuffer      *buffer,
+                                   GtkTextIter        *start,
+                                   GtkTextIter        *end,
+                                   MousepadMatchIndex *index)
+{
+  gint offset = index->edit_offset;
+  gint n_chars = index->edit_end_offset - offset;
+  gint reach;
+
+  /* nothing to update without a search */
+  if (index->string == NULL || index->invalid || n_chars <= 0)
+    return;
+
+  /* the text after the range a match in it covered */
+  reach = mousepad_match_index_reach (index, index->edit_end_offset) - n_chars;
+
+  /* drop the matches in the range, then the range itself */
+  mousepad_match_index_remove (index, offset, index->edit_end_offset);
+  mousepad_match_index_delete_chars (index, offset, n_chars);
+
+  mousepad_match_index_scan_lines (index, offset, reach);
+}
+
+
+
+/**
+ * mousepad_match_index_new:
+ * @buffer : a #GtkTextBuffer.
+ *
+ * Creates an index of the matches of a search in @buffer. The index is
+ * empty until a search is set, after that it is kept up to date by
+ * searching the lines that change again.
+ **/
+MousepadMatchIndex *
+mousepad_match_index_new (GtkTextBuffer *buffer)
+{
+  MousepadMatchIndex *index;
+
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+  index = g_slice_new0 (MousepadMatchIndex);
+  index->buffer = buffer;
+  mousepad_match_index_reset (index);
+
+  /* keep the index updated when the buffer changes */
+  g_signal_connect_after (G_OBJECT (buffer), "insert-text",
+                          G_CALLBACK (mousepad_match_index_insert_text), index);
+  g_signal_connect (G_OBJECT (buffer), "delete-range",
+                    G_CALLBACK (mousepad_match_index_delete_range_before), index);
+  g_signal_connect_after (G_OBJECT (buffer), "delete-range",
+                          G_CALLBACK (mousepad_match_index_delete_range), index);
+
+  return index;
+}
+
+
+
+void
+mousepad_match_index_free (MousepadMatchIndex *index)
+{
+  /* disconnect from the buffer */
+  mousepad_disconnect_by_func (G_OBJECT (index->buffer), mousepad_match_index_insert_text, index);
+  mousepad_disconnect_by_func (G_OBJECT (index->buffer), mousepad_match_index_delete_range_before, index);
+  mousepad_disconnect_by_func (G_OBJECT (index->buffer), mousepad_match_index_delete_range, index);
+
+  /* cleanup */
+  while (index->n_blocks > 0)
+    mousepad_match_index_remove_block (index, index->n_blocks - 1);
+
+  g_free (index->string);
+  g_free (index->blocks);
+  g_free (index->char_starts);
+  g_free (index->match_starts);
+  g_slice_free (MousepadMatchIndex, index);
+}
+
+
+
+/**
+ * mousepad_match_index_set_search:
+ * @index  : a #MousepadMatchIndex.
+ * @string : the string to search for, or %NULL.
+ * @flags  : the #MousepadSearchFlags of the search.
+ *
+ * Indexes the matches of @string in the whole buffer, unless they are
+ * already indexed.
+ *
+ * Return value: the number of matches, or -1 if @string is not a valid
+ *               regular expression.
+ **/
+gint
+mousepad_match_index_set_search (MousepadMatchIndex  *index,
+                                 const gchar         *string,
+                                 MousepadSearchFlags  flags)
+{
+  GtkTextIter start, end;
+
+  flags &= MOUSEPAD_MATCH_INDEX_FLAGS;
+  if (string != NULL && *string == '\0')
+    string = NULL;
+
+  /* the matches are already known */
+  if (g_strcmp0 (string, index->string) == 0 && flags == index->flags)
+    return index->invalid ? -1 : index->n_matches;
+
+  g_free (index->string);
+  index->string = g_strdup (string);
+  index->flags = flags;
+  index->invalid = FALSE;
+
+  mousepad_match_index_reset (index);
+
+  if (string == NULL)
+    return 0;
+
+  index->n_string_chars = (flags & MOUSEPAD_SEARCH_FLAGS_REGEX) ? 0 : g_utf8_strlen (string, -1);
+
+  /* index the matches in the buffer */
+  gtk_text_buffer_get_bounds (index->buffer, &start, &end);
+  if (mousepad_util_search_foreach (index->buffer, string, flags, &start, &end,
+                                    mousepad_match_index_found, index) < 0)
+    {
+      mousepad_match_index_reset (index);
+      index->invalid = TRUE;
+
+      return -1;
+    }
+
+  return index->n_matches;
+}
+
+
+
+gint
+mousepad_match_index_get_n_matches (MousepadMatchIndex *index)
+{
+  return index->n_matches;
+}
+
+
+
+/**
+ * mousepad_match_index_get_position:
+ * @index : a #MousepadMatchIndex.
+ * @iter  : a #GtkTextIter.
+ *
+ * Return value: the number of matches that start before @iter.
+ **/
+gint
+mousepad_match_index_get_position (MousepadMatchIndex *index,
+                                   const GtkTextIter  *iter)
+{
+  return mousepad_match_index_position (index, gtk_text_iter_get_offset (iter));
+}
+
+
+
+/**
+ * mousepad_match_index_count:
+ * @index : a #MousepadMatchIndex.
+ * @start : the start of the range.
+ * @end   : the end of the range.
+ *
+ * Return value: the number of matches between @start and @end.
+ **/
+gint
+mousepad_match_index_count (MousepadMatchIndex *index,
+                            const GtkTextIter  *start,
+                            const GtkTextIter  *end)
+{
+  gint from, to, position, counter;
+  gint match_start, match_length;
+
+  from = gtk_text_iter_get_offset (start);
+  to = gtk_text_iter_get_offset (end);
+  if (from >= to)
+    return 0;
+
+  position = mousepad_match_index_position (index, to);
+  counter = position - mousepad_match_index_position (index, from);
+
+  /* only the last match can run past the end */
+  if (counter > 0 && mousepad_match_index_nth (index, position - 1, &match_start, &match_length)
+      && match_start + match_length > to)
+    counter--;
+
+  return counter;
+}
+
+
+
+/**
+ * mousepad_match_index_get_next:
+ * @index       : a #MousepadMatchIndex.
+ * @iter        : a #GtkTextIter.
+ * @match_start : return location for the start of the match.
+ * @match_end   : return location for the end of the match.
+ *
+ * Looks up the first match that starts at or after @iter.
+ *
+ * Return value: %TRUE if there is such a match.
+ **/
+gboolean
+mousepad_match_index_get_next (MousepadMatchIndex *index,
+                               const GtkTextIter  *iter,
+                               GtkTextIter        *match_start,
+                               GtkTextIter        *match_end)
+{
+  gint start, length;
+
+  if (! mousepad_match_index_nth (index, mousepad_match_index_get_position (index, iter), &start, &length))
+    return FALSE;
+
+  gtk_text_buffer_get_iter_at_offset (index->buffer, match_start, start);
+  gtk_text_buffer_get_iter_at_offset (index->buffer, match_end, start + length);
+
+  return TRUE;
+}
+
+
+
+/**
+ * mousepad_match_index_get_previous:
+ * @index       : a #MousepadMatchIndex.
+ * @iter        : a #GtkTextIter.
+ * @match_start : return location for the start of the match.
+ * @match_end   : return location for the end of the match.
+ *
+ * Looks up the last match that starts before @iter.
+ *
+ * Return value: %TRUE if there is such a match.
+ **/
+gboolean
+mousepad_match_index_get_previous (MousepadMatchIndex *index,
+                                   const GtkTextIter  *iter,
+                                   GtkTextIter        *match_start,
+                                   GtkTextIter        *match_end)
+{
+  gint start, length;
+
+  if (! mousepad_match_index_nth (index, mousepad_match_index_get_position (index, iter) - 1, &start, &length))
+    return FALSE;
+
+  gtk_text_buffer_get_iter_at_offset (index->buffer, match_start, start);
+  gtk_text_buffer_get_iter_at_offset (index->buffer, match_end, start + length);
+
+  return TRUE;
+}
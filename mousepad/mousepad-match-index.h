@@ -0,0 +1,56 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_MATCH_INDEX_H__
+#define __MOUSEPAD_MATCH_INDEX_H__
+
+#include <gtk/gtk.h>
+#include <mousepad/mousepad-util.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadMatchIndex MousepadMatchIndex;
+
+MousepadMatchIndex *mousepad_match_index_new           (GtkTextBuffer       *buffer);
+
+void                mousepad_match_index_free          (MousepadMatchIndex  *index);
+
+gint                mousepad_match_index_set_search    (MousepadMatchIndex  *index,
+                                                        const gchar         *string,
+                                                        MousepadSearchFlags  flags);
+
+gint                mousepad_match_index_get_n_matches (MousepadMatchIndex  *index);
+
+gint                mousepad_match_index_get_position  (MousepadMatchIndex  *index,
+                                                        const GtkTextIter   *iter);
+
+gint                mousepad_match_index_count         (MousepadMatchIndex  *index,
+                                                        const GtkTextIter   *start,
+                                                        const GtkTextIter   *end);
+
+gboolean            mousepad_match_index_get_next      (MousepadMatchIndex  *index,
+                                                        const GtkTextIter   *iter,
+                                                        GtkTextIter         *match_start,
+                                                        GtkTextIter         *match_end);
+
+gboolean            mousepad_match_index_get_previous  (MousepadMatchIndex  *index,
+                                                        const GtkTextIter   *iter,
+                                                        GtkTextIter         *match_start,
+                                                        GtkTextIter         *match_end);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_MATCH_INDEX_H__ */
@@ -0,0 +1,359 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-piece-table.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+
+
+/* minimum size of a block of the add buffer */
+#define MOUSEPAD_PIECE_TABLE_BLOCK_SIZE (64 * 1024)
+
+
+
+typedef struct _MousepadPieceTableNode MousepadPieceTableNode;
+
+struct _MousepadPieceTableNode
+{
+  MousepadPiece piece;
+
+  /* offset of the piece in the document */
+  guint64       offset;
+};
+
+struct _MousepadPieceTable
+{
+  volatile gint  ref_count;
+
+  /* the original file, never modified */
+  GMappedFile   *mapped_file;
+
+  /* the pieces of the document, in order */
+  GArray        *nodes;
+  guint64        length;
+
+  /* the add buffer, only appended to and the blocks never move, so the
+   * pieces can point into them and copies of the pieces stay valid */
+  GPtrArray     *blocks;
+  gchar         *block;
+  gsize          block_used;
+  gsize          block_size;
+  gsize          added;
+};
+
+
+
+MousepadPieceTable *
+mousepad_piece_table_new (GMappedFile *mapped_file)
+{
+  MousepadPieceTable     *table;
+  MousepadPieceTableNode  node;
+
+  g_return_val_if_fail (mapped_file != NULL, NULL);
+
+  table = g_slice_new0 (MousepadPieceTable);
+  table->ref_count = 1;
+  table->mapped_file = g_mapped_file_ref (mapped_file);
+  table->nodes = g_array_new (FALSE, FALSE, sizeof (MousepadPieceTableNode));
+  table->blocks = g_ptr_array_new_with_free_func (g_free);
+
+  /* the document starts as one piece with the whole file */
+  table->length = g_mapped_file_get_length (mapped_file);
+  if (table->length > 0)
+    {
+      node.piece.data = g_mapped_file_get_contents (mapped_file);
+      node.piece.length = table->length;
+      node.offset = 0;
+      g_array_append_val (table->nodes, node);
+    }
+
+  return table;
+}
+
+
+
+MousepadPieceTable *
+mousepad_piece_table_ref (MousepadPieceTable *table)
+{
+  g_atomic_int_inc (&table->ref_count);
+
+  return table;
+}
+
+
+
+void
+mousepad_piece_table_unref (MousepadPieceTable *table)
+{
+  if (g_atomic_int_dec_and_test (&table->ref_count))
+    {
+      g_array_free (table->nodes, TRUE);
+      g_ptr_array_free (table->blocks, TRUE);
+
+#if GLIB_CHECK_VERSION (2, 21, 0)
+      g_mapped_file_unref (table->mapped_file);
+#else
+      g_mapped_file_free (table->mapped_file);
+#endif
+
+      g_slice_free (MousepadPieceTable, table);
+    }
+}
+
+
+
+guint64
+mousepad_piece_table_get_length (MousepadPieceTable *table)
+{
+  return table->length;
+}
+
+
+
+gsize
+mousepad_piece_table_get_added (MousepadPieceTable *table)
+{
+  return table->added;
+}
+
+
+
+GMappedFile *
+mousepad_piece_table_get_mapping (MousepadPieceTable *table)
+{
+  return table->mapped_file;
+}
+
+
+
+static guint
+mousepad_piece_table_find (MousepadPieceTable *table,
+                           guint64             offset)
+{
+  guint lower = 0, upper, middle;
+
+  /* the end of the document */
+  if (offset >= table->length)
+    return table->nodes->len;
+
+  /* find the piece offset lies in */
+  upper = table->nodes->len;
+  while (upper - lower > 1)
+    {
+      middle = (lower + upper) / 2;
+
+      if (g_array_index (table->nodes, MousepadPieceTableNode, middle).offset <= offset)
+        lower = middle;
+      else
+        upper = middle;
+    }
+
+  return lower;
+}
+
+
+
+static guint
+mousepad_piece_table_split (MousepadPieceTable *table,
+                            guint64             offset)
+{
+  MousepadPieceTableNode *node, tail;
+  guint                   n;
+  gsize                   head_length;
+
+  n = mousepad_piece_table_find (table, offset);
+  if (n == table->nodes->len)
+    return n;
+
+  node = &g_array_index (table->nodes, MousepadPieceTableNode, n);
+  if (node->offset == offset)
+    return n;
+
+  /* cut the piece in two, so a piece starts at offset */
+  head_length = offset - node->offset;
+  tail.piece.data = node->piece.data + head_length;
+  tail.piece.length = node->piece.length - head_length;
+  tail.offset = offset;
+  node->piece.length = head_length;
+
+  g_array_insert_val (table->nodes, n + 1, tail);
+
+  return n + 1;
+}
+
+
+
+static const gchar *
+mousepad_piece_table_append (MousepadPieceTable *table,
+                             const gchar        *text,
+                             gsize               length)
+{
+  gchar *data;
+
+  /* start a new block when the text doesn't fit, the old one stays where it is */
+  if (table->block == NULL || table->block_size - table->block_used < length)
+    {
+      table->block_size = MAX (MOUSEPAD_PIECE_TABLE_BLOCK_SIZE, length);
+      table->block = g_malloc (table->block_size);
+      table->block_used = 0;
+      g_ptr_array_add (table->blocks, table->block);
+    }
+
+  data = table->block + table->block_used;
+  memcpy (data, text, length);
+  table->block_used += length;
+  table->added += length;
+
+  return data;
+}
+
+
+
+const gchar *
+mousepad_piece_table_get_span (MousepadPieceTable *table,
+                               guint64             offset,
+                               guint64            *span_start,
+                               gsize              *span_length)
+{
+  MousepadPieceTableNode *node;
+  guint                   n;
+
+  g_return_val_if_fail (offset < table->length, NULL);
+
+  /* the piece offset lies in */
+  n = mousepad_piece_table_find (table, offset);
+  node = &g_array_index (table->nodes, MousepadPieceTableNode, n);
+
+  *span_start = node->offset;
+  *span_length = node->piece.length;
+
+  return node->piece.data;
+}
+
+
+
+void
+mousepad_piece_table_read (MousepadPieceTable *table,
+                           guint64             offset,
+                           gsize               length,
+                           gchar              *dest)
+{
+  MousepadPieceTableNode *node;
+  guint                   n;
+  gsize                   skip, count;
+
+  g_return_if_fail (offset + length <= table->length);
+
+  /* copy the bytes from the pieces the range covers */
+  for (n = mousepad_piece_table_find (table, offset); length > 0; n++)
+    {
+      node = &g_array_index (table->nodes, MousepadPieceTableNode, n);
+      skip = offset - node->offset;
+      count = MIN (node->piece.length - skip, length);
+
+      memcpy (dest, node->piece.data + skip, count);
+
+      dest += count;
+      offset += count;
+      length -= count;
+    }
+}
+
+
+
+void
+mousepad_piece_table_replace (MousepadPieceTable *table,
+                              guint64             offset,
+                              guint64             length,
+                              const gchar        *text,
+                              gsize               text_length)
+{
+  MousepadPieceTableNode *node, *prev;
+  MousepadPieceTableNode  added;
+  const gchar            *data;
+  guint                   first, last, n;
+  guint64                 position;
+
+  g_return_if_fail (offset + length <= table->length);
+
+  /* drop the pieces of the replaced range */
+  first = mousepad_piece_table_split (table, offset);
+  last = mousepad_piece_table_split (table, offset + length);
+  g_array_remove_range (table->nodes, first, last - first);
+
+  prev = first > 0 ? &g_array_index (table->nodes, MousepadPieceTableNode, first - 1) : NULL;
+
+  if (text_length > 0)
+    {
+      data = mousepad_piece_table_append (table, text, text_length);
+
+      /* grow the previous piece when it ends where we appended, which
+       * is the case when the user keeps typing at the same place */
+      if (prev != NULL
+          && prev->piece.data >= table->block
+          && prev->piece.data + prev->piece.length == data)
+        {
+          prev->piece.length += text_length;
+        }
+      else
+        {
+          added.piece.data = data;
+          added.piece.length = text_length;
+          added.offset = offset;
+          g_array_insert_val (table->nodes, first, added);
+        }
+    }
+
+  /* move the pieces after the edit */
+  position = 0;
+  n = 0;
+  if (first > 0)
+    {
+      n = first - 1;
+      node = &g_array_index (table->nodes, MousepadPieceTableNode, n);
+      position = node->offset;
+    }
+
+  for (; n < table->nodes->len; n++)
+    {
+      node = &g_array_index (table->nodes, MousepadPieceTableNode, n);
+      node->offset = position;
+      position += node->piece.length;
+    }
+
+  table->length = position;
+}
+
+
+
+GArray *
+mousepad_piece_table_copy_pieces (MousepadPieceTable *table)
+{
+  GArray *pieces;
+  guint   n;
+
+  pieces = g_array_sized_new (FALSE, FALSE, sizeof (MousepadPiece), table->nodes->len);
+
+  for (n = 0; n < table->nodes->len; n++)
+    g_array_append_val (pieces, g_array_index (table->nodes, MousepadPieceTableNode, n).piece);
+
+  return pieces;
+}
+
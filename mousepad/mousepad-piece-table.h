@@ -0,0 +1,66 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_PIECE_TABLE_H__
+#define __MOUSEPAD_PIECE_TABLE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadPiece      MousepadPiece;
+typedef struct _MousepadPieceTable MousepadPieceTable;
+
+struct _MousepadPiece
+{
+  /* the bytes of the piece, in the mapped file or the add buffer */
+  const gchar *data;
+  gsize        length;
+};
+
+MousepadPieceTable *mousepad_piece_table_new          (GMappedFile        *mapped_file);
+
+MousepadPieceTable *mousepad_piece_table_ref          (MousepadPieceTable *table);
+
+void                mousepad_piece_table_unref        (MousepadPieceTable *table);
+
+guint64             mousepad_piece_table_get_length   (MousepadPieceTable *table);
+
+gsize               mousepad_piece_table_get_added    (MousepadPieceTable *table);
+
+GMappedFile        *mousepad_piece_table_get_mapping  (MousepadPieceTable *table);
+
+const gchar        *mousepad_piece_table_get_span     (MousepadPieceTable *table,
+                                                       guint64             offset,
+                                                       guint64            *span_start,
+                                                       gsize              *span_length);
+
+void                mousepad_piece_table_read         (MousepadPieceTable *table,
+                                                       guint64             offset,
+                                                       gsize               length,
+                                                       gchar              *dest);
+
+void                mousepad_piece_table_replace      (MousepadPieceTable *table,
+                                                       guint64             offset,
+                                                       guint64             length,
+                                                       const gchar        *text,
+                                                       gsize               text_length);
+
+GArray             *mousepad_piece_table_copy_pieces  (MousepadPieceTable *table);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_PIECE_TABLE_H__ */
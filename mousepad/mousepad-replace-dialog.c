@@ -233,6 +233,14 @@ mousepad_replace_dialog_init (MousepadReplaceDialog *dialog)
 
   mousepad_replace_dialog_bind_setting (dialog, MOUSEPAD_SETTING_SEARCH_MATCH_WHOLE_WORD, check, "active");
 
+  /* regular expression */
+  check = gtk_check_button_new_with_mnemonic (_("Regular e_xpression"));
+  gtk_widget_set_tooltip_text (check, _("Refer to the groups of the match with \\1, \\2 and so on in the replacement"));
+  gtk_box_pack_start (GTK_BOX (vbox), check, FALSE, FALSE, 0);
+  gtk_widget_show (check);
+
+  mousepad_replace_dialog_bind_setting (dialog, MOUSEPAD_SETTING_SEARCH_ENABLE_REGEX, check, "active");
+
   /* horizontal box for the replace all options */
   hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 8);
   gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, 0);
@@ -304,13 +312,14 @@ mousepad_replace_dialog_response (GtkWidget *widget,
   const gchar           *search_str, *replace_str;
   gchar                 *message;
   gint                   search_direction, replace_all_location;
-  gboolean               match_case, match_whole_word, replace_all;
+  gboolean               match_case, match_whole_word, enable_regex, replace_all;
 
   /* read the search settings */
   search_direction = MOUSEPAD_SETTING_GET_INT (SEARCH_DIRECTION);
   replace_all_location = MOUSEPAD_SETTING_GET_INT (SEARCH_REPLACE_ALL_LOCATION);
   match_case = MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_MATCH_CASE);
   match_whole_word = MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_MATCH_WHOLE_WORD);
+  enable_regex = MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_ENABLE_REGEX);
   replace_all = MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_REPLACE_ALL);
 
   /* close dialog */
@@ -331,6 +340,10 @@ mousepad_replace_dialog_response (GtkWidget *widget,
   if (match_whole_word)
     flags |= MOUSEPAD_SEARCH_FLAGS_WHOLE_WORD;
 
+  /* the search string is a regular expression */
+  if (enable_regex)
+    flags |= MOUSEPAD_SEARCH_FLAGS_REGEX;
+
   /* wrap around */
   if (search_direction == DIRECTION_BOTH && ! replace_all)
     flags |= MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND;
@@ -409,6 +422,14 @@ mousepad_replace_dialog_response (GtkWidget *widget,
   /* emit the signal */
   g_signal_emit (G_OBJECT (dialog), dialog_signals[SEARCH], 0, flags, search_str, replace_str, &matches);
 
+  /* the regular expression or its replacement is not valid */
+  if (matches < 0)
+    {
+      mousepad_util_entry_error (dialog->search_entry, TRUE);
+      gtk_label_set_text (GTK_LABEL (dialog->hits_label), NULL);
+      return;
+    }
+
   /* reset counter */
   if (response_id == MOUSEPAD_RESPONSE_REPLACE && replace_all)
     matches = 0;
@@ -416,8 +437,9 @@ mousepad_replace_dialog_response (GtkWidget *widget,
   /* update entry color */
   mousepad_util_entry_error (dialog->search_entry, matches == 0);
 
-  /* update counter */
-  if (replace_all)
+  /* update counter, a match that is found shows its position instead */
+  if (response_id == MOUSEPAD_RESPONSE_CHECK_ENTRY
+      || (replace_all && response_id != MOUSEPAD_RESPONSE_FIND))
     {
       message = g_strdup_printf (ngettext ("%d occurence", "%d occurences", matches), matches);
       gtk_label_set_markup (GTK_LABEL (dialog->hits_label), message);
@@ -567,3 +589,23 @@ mousepad_replace_dialog_set_text (MousepadReplaceDialog *dialog, gchar *text)
 {
   gtk_entry_set_text (GTK_ENTRY (dialog->search_entry), text);
 }
+
+
+
+void
+mousepad_replace_dialog_set_position (MousepadReplaceDialog *dialog,
+                                      gint                   position,
+                                      gint                   total)
+{
+  gchar *message;
+
+  g_return_if_fail (MOUSEPAD_IS_REPLACE_DIALOG (dialog));
+
+  if (position > 0)
+    message = g_strdup_printf (_("%d of %d"), position, total);
+  else
+    message = g_strdup_printf (ngettext ("%d occurence", "%d occurences", total), total);
+
+  gtk_label_set_text (GTK_LABEL (dialog->hits_label), message);
+  g_free (message);
+}
@@ -41,6 +41,10 @@ void            mousepad_replace_dialog_page_switched  (MousepadReplaceDialog *d
 
 void            mousepad_replace_dialog_set_text       (MousepadReplaceDialog *dialog, gchar *text);
 
+void            mousepad_replace_dialog_set_position   (MousepadReplaceDialog *dialog,
+                                                        gint                   position,
+                                                        gint                   total);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_REPLACE_DIALOG_H__ */
@@ -46,6 +46,8 @@ static void      mousepad_search_bar_highlight_toggled          (GtkWidget
                                                                  MousepadSearchBar       *bar);
 static void      mousepad_search_bar_match_case_toggled         (GtkWidget               *button,
                                                                  MousepadSearchBar       *bar);
+static void      mousepad_search_bar_regex_toggled              (GtkWidget               *button,
+                                                                 MousepadSearchBar       *bar);
 static void      mousepad_search_bar_highlight_schedule         (MousepadSearchBar       *bar);
 static gboolean  mousepad_search_bar_highlight_timeout          (gpointer                 user_data);
 static void      mousepad_search_bar_highlight_timeout_destroy  (gpointer                 user_data);
@@ -71,12 +73,17 @@ struct _MousepadSearchBar
   /* text entry */
   GtkWidget           *entry;
 
+  /* the position of the selected match */
+  GtkWidget           *position_label;
+
   /* menu entries */
   GtkWidget           *match_case_entry;
+  GtkWidget           *regex_entry;
 
   /* flags */
   guint                highlight_all : 1;
   guint                match_case : 1;
+  guint                regex : 1;
 
   /* highlight id */
   guint                highlight_id;
@@ -185,14 +192,16 @@ mousepad_search_bar_init (MousepadSearchBar *bar)
 {
   GtkWidget   *label, *image, *check, *menuitem;
   GtkToolItem *item;
-  gboolean     match_case;
+  gboolean     match_case, regex;
 
   /* load some saved state */
   match_case = MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_MATCH_CASE);
+  regex = MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_ENABLE_REGEX);
 
   /* init variables */
   bar->highlight_id = 0;
   bar->match_case = match_case;
+  bar->regex = regex;
 
   /* the close button */
   item = gtk_tool_button_new_from_stock (GTK_STOCK_CLOSE);
@@ -223,6 +232,16 @@ mousepad_search_bar_init (MousepadSearchBar *bar)
   g_signal_connect (G_OBJECT (bar->entry), "activate-backward", G_CALLBACK (mousepad_search_bar_entry_activate_backward), bar);
   gtk_widget_show (bar->entry);
 
+  /* the position of the match */
+  item = gtk_tool_item_new ();
+  gtk_toolbar_insert (GTK_TOOLBAR (bar), item, -1);
+  gtk_widget_show (GTK_WIDGET (item));
+
+  bar->position_label = gtk_label_new (NULL);
+  gtk_container_add (GTK_CONTAINER (item), bar->position_label);
+  gtk_misc_set_padding (GTK_MISC (bar->position_label), 2, 0);
+  gtk_widget_show (bar->position_label);
+
   /* next button */
   image = gtk_image_new_from_stock (GTK_STOCK_GO_DOWN, TOOL_BAR_ICON_SIZE);
   gtk_widget_show (image);
@@ -279,6 +298,27 @@ mousepad_search_bar_init (MousepadSearchBar *bar)
   /* Keep toolbar check button and overflow proxy menu item in sync */
   g_object_bind_property (check, "active", menuitem, "active", G_BINDING_BIDIRECTIONAL | G_BINDING_SYNC_CREATE);
   gtk_widget_show (menuitem);
+
+  /* check button for regular expressions, including the proxy menu item */
+  item = gtk_tool_item_new ();
+  g_signal_connect_object (G_OBJECT (bar), "destroy", G_CALLBACK (gtk_widget_destroy), item, G_CONNECT_SWAPPED);
+  gtk_toolbar_insert (GTK_TOOLBAR (bar), item, -1);
+  gtk_widget_show (GTK_WIDGET (item));
+
+  check = gtk_check_button_new_with_mnemonic (_("Regular E_xpression"));
+  gtk_container_add (GTK_CONTAINER (item), check);
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (check), regex);
+  g_signal_connect (G_OBJECT (check), "toggled", G_CALLBACK (mousepad_search_bar_regex_toggled), bar);
+  gtk_widget_show (check);
+
+  /* keep the widgets in sync with the GSettings */
+  MOUSEPAD_SETTING_BIND (SEARCH_ENABLE_REGEX, check, "active", G_SETTINGS_BIND_DEFAULT);
+
+  /* overflow menu item for when window is too narrow to show the tool bar item */
+  bar->regex_entry = menuitem = gtk_check_menu_item_new_with_mnemonic (_("Regular E_xpression"));
+  gtk_tool_item_set_proxy_menu_item (item, "regular-expression", menuitem);
+  g_object_bind_property (check, "active", menuitem, "active", G_BINDING_BIDIRECTIONAL | G_BINDING_SYNC_CREATE);
+  gtk_widget_show (menuitem);
 }
 
 
@@ -316,6 +356,10 @@ mousepad_search_bar_find_string (MousepadSearchBar   *bar,
   if (bar->match_case)
     flags |= MOUSEPAD_SEARCH_FLAGS_MATCH_CASE;
 
+  /* the entry holds a regular expression */
+  if (bar->regex)
+    flags |= MOUSEPAD_SEARCH_FLAGS_REGEX;
+
   /* get the entry string */
   string = gtk_entry_get_text (GTK_ENTRY (bar->entry));
 
@@ -440,6 +484,24 @@ mousepad_search_bar_match_case_toggled (GtkWidget         *button,
 
 
 
+static void
+mousepad_search_bar_regex_toggled (GtkWidget         *button,
+                                   MousepadSearchBar *bar)
+{
+  g_return_if_fail (MOUSEPAD_IS_SEARCH_BAR (bar));
+
+  /* save the state */
+  bar->regex = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (button));
+
+  /* search ahead with this new flags */
+  mousepad_search_bar_entry_changed (NULL, bar);
+
+  /* schedule a new hightlight */
+  mousepad_search_bar_highlight_schedule (bar);
+}
+
+
+
 static void
 mousepad_search_bar_highlight_schedule (MousepadSearchBar *bar)
 {
@@ -452,6 +514,11 @@ mousepad_search_bar_highlight_schedule (MousepadSearchBar *bar)
   /* schedule a new timeout */
   if (bar->highlight_all)
     {
+      /* stop highlighting the old string, its tags stay until the timeout */
+      mousepad_search_bar_find_string (bar, MOUSEPAD_SEARCH_FLAGS_DIR_FORWARD
+                                            | MOUSEPAD_SEARCH_FLAGS_ACTION_HIGHTLIGHT
+                                            | MOUSEPAD_SEARCH_FLAGS_ACTION_NONE);
+
       bar->highlight_id = g_timeout_add_full (G_PRIORITY_LOW, HIGHTLIGHT_TIMEOUT, mousepad_search_bar_highlight_timeout,
                                               bar, mousepad_search_bar_highlight_timeout_destroy);
     }
@@ -559,3 +626,30 @@ mousepad_search_bar_set_text (MousepadSearchBar *bar, gchar *text)
 
   gtk_entry_set_text (GTK_ENTRY (bar->entry), text);
 }
+
+
+
+void
+mousepad_search_bar_set_position (MousepadSearchBar *bar,
+                                  gint               position,
+                                  gint               total)
+{
+  gchar *message;
+
+  g_return_if_fail (MOUSEPAD_IS_SEARCH_BAR (bar));
+
+  /* nothing to show without matches */
+  if (total < 1)
+    {
+      gtk_label_set_text (GTK_LABEL (bar->position_label), NULL);
+      return;
+    }
+
+  if (position > 0)
+    message = g_strdup_printf (_("%d of %d"), position, total);
+  else
+    message = g_strdup_printf (ngettext ("%d match", "%d matches", total), total);
+
+  gtk_label_set_text (GTK_LABEL (bar->position_label), message);
+  g_free (message);
+}
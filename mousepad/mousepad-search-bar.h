@@ -45,6 +45,10 @@ void            mousepad_search_bar_find_previous   (MousepadSearchBar *bar);
 
 void            mousepad_search_bar_set_text        (MousepadSearchBar *bar, gchar *text);
 
+void            mousepad_search_bar_set_position    (MousepadSearchBar *bar,
+                                                     gint               position,
+                                                     gint               total);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_SEARCH_BAR_H__ */
@@ -56,11 +56,15 @@ G_BEGIN_DECLS
 #define MOUSEPAD_SETTING_MENUBAR_VISIBLE_FULLSCREEN   "/preferences/window/menubar-visible-in-fullscreen"
 #define MOUSEPAD_SETTING_TOOLBAR_VISIBLE_FULLSCREEN   "/preferences/window/toolbar-visible-in-fullscreen"
 #define MOUSEPAD_SETTING_STATUSBAR_VISIBLE_FULLSCREEN "/preferences/window/statusbar-visible-in-fullscreen"
+#define MOUSEPAD_SETTING_LARGE_FILE_VIEWER_SIZE       "/preferences/window/large-file-viewer-size"
+#define MOUSEPAD_SETTING_FOLLOW_AUTO_SCROLL           "/preferences/window/follow-auto-scroll"
+#define MOUSEPAD_SETTING_FOLLOW_MAX_LINES             "/preferences/window/follow-max-lines"
 
 /* State setting names */
 #define MOUSEPAD_SETTING_SEARCH_DIRECTION            "/state/search/direction"
 #define MOUSEPAD_SETTING_SEARCH_MATCH_CASE           "/state/search/match-case"
 #define MOUSEPAD_SETTING_SEARCH_MATCH_WHOLE_WORD     "/state/search/match-whole-word"
+#define MOUSEPAD_SETTING_SEARCH_ENABLE_REGEX         "/state/search/enable-regex"
 #define MOUSEPAD_SETTING_SEARCH_REPLACE_ALL          "/state/search/replace-all"
 #define MOUSEPAD_SETTING_SEARCH_REPLACE_ALL_LOCATION "/state/search/replace-all-location"
 #define MOUSEPAD_SETTING_WINDOW_HEIGHT               "/state/window/height"
@@ -51,6 +51,9 @@ struct _MousepadStatusbar
   /* whether overwrite is enabled */
   guint               overwrite_enabled : 1;
 
+  /* whether the mixed line endings message is shown */
+  guint               mixed_line_endings : 1;
+
   /* extra labels in the statusbar */
   GtkWidget          *language;
   GtkWidget          *position;
@@ -267,17 +270,22 @@ void
 mousepad_statusbar_set_cursor_position (MousepadStatusbar *statusbar,
                                         gint               line,
                                         gint               column,
-                                        gint               selection)
+                                        gint               selection,
+                                        guint64            offset)
 {
-  gchar string[64];
+  gchar string[128];
+  gchar offset_string[32];
 
   g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
 
+  /* the 64 bit offset, formatted apart to keep the format macro out of the translations */
+  g_snprintf (offset_string, sizeof (offset_string), "%" G_GUINT64_FORMAT, offset);
+
   /* create printable string */
   if (G_UNLIKELY (selection > 0))
-    g_snprintf (string, sizeof (string), _("Line: %d Column: %d Selection: %d"), line, column, selection);
+    g_snprintf (string, sizeof (string), _("Line: %d Column: %d Offset: %s Selection: %d"), line, column, offset_string, selection);
   else
-    g_snprintf (string, sizeof (string), _("Line: %d Column: %d"), line, column);
+    g_snprintf (string, sizeof (string), _("Line: %d Column: %d Offset: %s"), line, column, offset_string);
 
   /* set label */
   gtk_label_set_text (GTK_LABEL (statusbar->position), string);
@@ -298,6 +306,31 @@ mousepad_statusbar_set_overwrite (MousepadStatusbar *statusbar,
 
 
 
+void
+mousepad_statusbar_set_mixed_line_endings (MousepadStatusbar *statusbar,
+                                           gboolean           mixed)
+{
+  gint id;
+
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  /* nothing changed */
+  if (statusbar->mixed_line_endings == !!mixed)
+    return;
+
+  statusbar->mixed_line_endings = !!mixed;
+
+  /* show or drop the message */
+  id = gtk_statusbar_get_context_id (GTK_STATUSBAR (statusbar), "line-endings");
+  if (mixed)
+    gtk_statusbar_push (GTK_STATUSBAR (statusbar), id,
+                        _("The file has mixed line endings, saving will convert them all"));
+  else
+    gtk_statusbar_pop (GTK_STATUSBAR (statusbar), id);
+}
+
+
+
 gboolean
 mousepad_statusbar_push_tooltip (MousepadStatusbar *statusbar,
                                  GtkWidget         *widget)
@@ -32,26 +32,30 @@ G_BEGIN_DECLS
 typedef struct _MousepadStatusbarClass MousepadStatusbarClass;
 typedef struct _MousepadStatusbar      MousepadStatusbar;
 
-GType       mousepad_statusbar_get_type             (void) G_GNUC_CONST;
+GType       mousepad_statusbar_get_type               (void) G_GNUC_CONST;
 
-GtkWidget  *mousepad_statusbar_new                  (void);
+GtkWidget  *mousepad_statusbar_new                    (void);
 
-void        mousepad_statusbar_set_cursor_position  (MousepadStatusbar *statusbar,
-                                                     gint               line,
-                                                     gint               column,
-                                                     gint               selection);
+void        mousepad_statusbar_set_cursor_position    (MousepadStatusbar *statusbar,
+                                                       gint               line,
+                                                       gint               column,
+                                                       gint               selection,
+                                                       guint64            offset);
 
-void        mousepad_statusbar_set_overwrite        (MousepadStatusbar *statusbar,
-                                                     gboolean           overwrite);
+void        mousepad_statusbar_set_overwrite          (MousepadStatusbar *statusbar,
+                                                       gboolean           overwrite);
 
-void        mousepad_statusbar_set_language         (MousepadStatusbar *statusbar,
-                                                     GtkSourceLanguage *language);
+void        mousepad_statusbar_set_language           (MousepadStatusbar *statusbar,
+                                                       GtkSourceLanguage *language);
 
-gboolean    mousepad_statusbar_push_tooltip         (MousepadStatusbar *statusbar,
-                                                     GtkWidget         *widget);
+void        mousepad_statusbar_set_mixed_line_endings (MousepadStatusbar *statusbar,
+                                                       gboolean           mixed);
 
-void        mousepad_statusbar_pop_tooltip          (MousepadStatusbar *statusbar,
-                                                     GtkWidget         *widget);
+gboolean    mousepad_statusbar_push_tooltip           (MousepadStatusbar *statusbar,
+                                                       GtkWidget         *widget);
+
+void        mousepad_statusbar_pop_tooltip            (MousepadStatusbar *statusbar,
+                                                       GtkWidget         *widget);
 
 G_END_DECLS
 
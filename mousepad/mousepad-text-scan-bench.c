@@ -0,0 +1,129 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* Compares the throughput of mousepad_text_scan() with the separate
+ * validation and line ending passes mousepad used to do on load.
+ *
+ * Usage: mousepad-text-scan-bench FILE [ITERATIONS] */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-text-scan.h>
+
+
+
+static gsize
+bench_legacy (const gchar *contents,
+              gsize        length)
+{
+  const gchar *end, *n;
+  gsize        n_cr = 0;
+
+  /* validate the contents */
+  if (g_utf8_validate (contents, length, &end) == FALSE)
+    return 0;
+
+  /* detect the line ending, based on the first eol */
+  for (n = contents; n < end; n = g_utf8_next_char (n))
+    if (*n == '\n' || *n == '\r')
+      break;
+
+  /* walk the contents for cr characters */
+  for (n = contents; n < end; n = g_utf8_next_char (n))
+    if (G_UNLIKELY (*n == '\r'))
+      n_cr++;
+
+  return n_cr;
+}
+
+
+
+static void
+bench_report (const gchar *name,
+              gsize        length,
+              guint        iterations,
+              gdouble      seconds)
+{
+  g_print ("%-8s %10.1f MB/s\n", name, (gdouble) length * iterations / seconds / (1024 * 1024));
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  static const struct
+  {
+    MousepadTextScanImpl  impl;
+    const gchar          *name;
+  }
+  impls[] =
+  {
+    { MOUSEPAD_TEXT_SCAN_SCALAR, "scalar" },
+    { MOUSEPAD_TEXT_SCAN_SSE2,   "sse2" },
+    { MOUSEPAD_TEXT_SCAN_AVX2,   "avx2" }
+  };
+  gchar             *contents;
+  gsize              length;
+  guint              iterations = 20, i, j;
+  GTimer            *timer;
+  GError            *error = NULL;
+  MousepadTextStats  stats;
+
+  if (argc < 2)
+    {
+      g_printerr ("Usage: %s FILE [ITERATIONS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (! g_file_get_contents (argv[1], &contents, &length, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  if (argc > 2)
+    iterations = MAX (atoi (argv[2]), 1);
+
+  timer = g_timer_new ();
+
+  /* the old code path */
+  g_timer_start (timer);
+  for (i = 0; i < iterations; i++)
+    bench_legacy (contents, length);
+  bench_report ("legacy", length, iterations, g_timer_elapsed (timer, NULL));
+
+  /* the scan kernels supported by this cpu */
+  for (j = 0; j < G_N_ELEMENTS (impls); j++)
+    {
+      if (! mousepad_text_scan_set_impl (impls[j].impl))
+        continue;
+
+      g_timer_start (timer);
+      for (i = 0; i < iterations; i++)
+        mousepad_text_scan (contents, length, NULL, &stats);
+      bench_report (impls[j].name, length, iterations, g_timer_elapsed (timer, NULL));
+    }
+
+  g_print ("\n%" G_GSIZE_FORMAT " bytes, %" G_GSIZE_FORMAT " lf, %" G_GSIZE_FORMAT " cr, %"
+           G_GSIZE_FORMAT " cr+lf line endings\n", length, stats.n_lf, stats.n_cr, stats.n_crlf);
+
+  g_timer_destroy (timer);
+  g_free (contents);
+
+  return EXIT_SUCCESS;
+}
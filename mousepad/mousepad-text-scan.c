@@ -0,0 +1,445 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-text-scan.h>
+
+#ifdef MOUSEPAD_TEXT_SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+
+/* number of bytes scanned one by one after a block with non-ascii bytes */
+#define MOUSEPAD_TEXT_SCAN_SCALAR_RUN (32)
+
+
+
+typedef struct _MousepadTextScanState MousepadTextScanState;
+
+typedef gsize (*MousepadTextScanKernel) (const guchar          *p,
+                                         gsize                  length,
+                                         gsize                  offset,
+                                         MousepadTextScanState *state);
+
+struct _MousepadTextScanState
+{
+  /* all lf and cr characters, and the cr+lf pairs among them */
+  gsize    n_lf;
+  gsize    n_cr;
+  gsize    n_crlf;
+
+  /* first line ending */
+  gssize   first_eol;
+
+  /* whether the previous byte was a cr */
+  gboolean prev_cr;
+};
+
+
+
+static inline void
+mousepad_text_scan_count (MousepadTextScanState *state,
+                          guint64                lf_mask,
+                          guint64                cr_mask,
+                          guint                  width,
+                          gsize                  offset)
+{
+  /* nothing to count */
+  if (G_LIKELY ((lf_mask | cr_mask) == 0))
+    {
+      state->prev_cr = FALSE;
+      return;
+    }
+
+  /* remember the first line ending */
+  if (G_UNLIKELY (state->first_eol < 0))
+    state->first_eol = offset + __builtin_ctzll (lf_mask | cr_mask);
+
+  /* count the line endings, including a cr+lf pair split over two blocks */
+  state->n_lf += __builtin_popcountll (lf_mask);
+  state->n_cr += __builtin_popcountll (cr_mask);
+  state->n_crlf += __builtin_popcountll (cr_mask & (lf_mask >> 1));
+  if (state->prev_cr && (lf_mask & 1))
+    state->n_crlf++;
+
+  state->prev_cr = (cr_mask >> (width - 1)) & 1;
+}
+
+
+
+#ifdef MOUSEPAD_TEXT_SCAN_X86
+__attribute__ ((target ("sse2")))
+static gsize
+mousepad_text_scan_sse2 (const guchar          *p,
+                         gsize                  length,
+                         gsize                  offset,
+                         MousepadTextScanState *state)
+{
+  const __m128i lf = _mm_set1_epi8 ('\n');
+  const __m128i cr = _mm_set1_epi8 ('\r');
+  const __m128i nul = _mm_setzero_si128 ();
+  __m128i       v;
+  gsize         i;
+
+  for (i = 0; i + 16 <= length; i += 16)
+    {
+      v = _mm_loadu_si128 ((const __m128i *) (p + i));
+
+      /* leave non-ascii and nul bytes to the scalar code */
+      if (_mm_movemask_epi8 (_mm_or_si128 (v, _mm_cmpeq_epi8 (v, nul))) != 0)
+        break;
+
+      mousepad_text_scan_count (state,
+                                (guint) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, lf)),
+                                (guint) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, cr)),
+                                16, offset + i);
+    }
+
+  return i;
+}
+
+
+
+__attribute__ ((target ("avx2")))
+static gsize
+mousepad_text_scan_avx2 (const guchar          *p,
+                         gsize                  length,
+                         gsize                  offset,
+                         MousepadTextScanState *state)
+{
+  const __m256i lf = _mm256_set1_epi8 ('\n');
+  const __m256i cr = _mm256_set1_epi8 ('\r');
+  const __m256i nul = _mm256_setzero_si256 ();
+  __m256i       v;
+  gsize         i;
+
+  for (i = 0; i + 32 <= length; i += 32)
+    {
+      v = _mm256_loadu_si256 ((const __m256i *) (p + i));
+
+      /* leave non-ascii and nul bytes to the scalar code */
+      if (_mm256_movemask_epi8 (_mm256_or_si256 (v, _mm256_cmpeq_epi8 (v, nul))) != 0)
+        break;
+
+      mousepad_text_scan_count (state,
+                                (guint32) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, lf)),
+                                (guint32) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, cr)),
+                                32, offset + i);
+    }
+
+  return i;
+}
+#endif
+
+
+
+static MousepadTextScanDispatch scan_dispatch =
+{
+  MOUSEPAD_TEXT_SCAN_AUTO,
+#ifdef MOUSEPAD_TEXT_SCAN_X86
+  { NULL, NULL, mousepad_text_scan_sse2, mousepad_text_scan_avx2 }
+#else
+  { NULL, NULL, NULL, NULL }
+#endif
+};
+
+
+
+static gboolean
+mousepad_text_scan_cpu_supports (MousepadTextScanImpl impl)
+{
+  switch (impl)
+    {
+      case MOUSEPAD_TEXT_SCAN_SCALAR:
+        return TRUE;
+
+#ifdef MOUSEPAD_TEXT_SCAN_X86
+      case MOUSEPAD_TEXT_SCAN_SSE2:
+        __builtin_cpu_init ();
+        return __builtin_cpu_supports ("sse2");
+
+      case MOUSEPAD_TEXT_SCAN_AVX2:
+        __builtin_cpu_init ();
+        return __builtin_cpu_supports ("avx2");
+#endif
+
+      default:
+        return FALSE;
+    }
+}
+
+
+
+static MousepadTextScanImpl
+mousepad_text_scan_dispatch_init (MousepadTextScanDispatch *dispatch)
+{
+  gsize impl;
+
+  /* pick the widest vector unit of this cpu, only the first caller
+   * does the detection and the other threads wait for it */
+  if (g_once_init_enter (&dispatch->impl))
+    {
+      for (impl = MOUSEPAD_TEXT_SCAN_N_IMPLS - 1; impl > MOUSEPAD_TEXT_SCAN_SCALAR; impl--)
+        if (dispatch->kernels[impl] != NULL && mousepad_text_scan_cpu_supports (impl))
+          break;
+
+      g_once_init_leave (&dispatch->impl, impl);
+    }
+
+  return dispatch->impl;
+}
+
+
+
+static inline gsize
+mousepad_text_scan_utf8_char (const guchar *p,
+                              gsize         length)
+{
+  gsize n, i;
+
+  /* the lead byte gives the sequence length and the range of the
+   * first continuation byte, this rejects overlong forms, surrogates
+   * and code points above U+10FFFF */
+  guchar min = 0x80, max = 0xbf;
+
+  if (p[0] >= 0xc2 && p[0] <= 0xdf)
+    n = 2;
+  else if (p[0] >= 0xe0 && p[0] <= 0xef)
+    {
+      n = 3;
+      if (p[0] == 0xe0)
+        min = 0xa0;
+      else if (p[0] == 0xed)
+        max = 0x9f;
+    }
+  else if (p[0] >= 0xf0 && p[0] <= 0xf4)
+    {
+      n = 4;
+      if (p[0] == 0xf0)
+        min = 0x90;
+      else if (p[0] == 0xf4)
+        max = 0x8f;
+    }
+  else
+    return 0;
+
+  if (G_UNLIKELY (n > length))
+    return 0;
+
+  if (p[1] < min || p[1] > max)
+    return 0;
+
+  for (i = 2; i < n; i++)
+    if ((p[i] & 0xc0) != 0x80)
+      return 0;
+
+  return n;
+}
+
+
+
+/**
+ * mousepad_text_scan:
+ *
+ * Validates @length bytes of utf-8 @text and counts the line endings in
+ * the same pass. Like g_utf8_validate() nul bytes are invalid, @end is
+ * set to the first invalid byte and @stats only covers the valid part.
+ **/
+gboolean
+mousepad_text_scan (const gchar        *text,
+                    gsize               length,
+                    const gchar       **end,
+                    MousepadTextStats  *stats)
+{
+  MousepadTextScanState  state = { 0, 0, 0, -1, FALSE };
+  const guchar          *p = (const guchar *) text;
+  const guchar          *text_end = p + length;
+  const guchar          *scalar_end = p;
+  gboolean               valid = TRUE;
+  gsize                  n;
+  MousepadTextScanKernel kernel;
+
+  g_return_val_if_fail (text != NULL || length == 0, FALSE);
+
+  kernel = mousepad_text_scan_dispatch_get_kernel (&scan_dispatch);
+
+  while (p < text_end)
+    {
+      /* scan blocks of plain ascii with the vector unit */
+      if (kernel != NULL && p >= scalar_end)
+        {
+          n = kernel (p, text_end - p, p - (const guchar *) text, &state);
+          p += n;
+
+          /* the block has non-ascii bytes, continue byte by byte for a while */
+          if (n == 0)
+            scalar_end = p + MOUSEPAD_TEXT_SCAN_SCALAR_RUN;
+
+          continue;
+        }
+
+      if (G_LIKELY (*p < 0x80))
+        {
+          if (G_UNLIKELY (*p == '\0'))
+            {
+              valid = FALSE;
+              break;
+            }
+
+          if (G_UNLIKELY (*p == '\n' || *p == '\r'))
+            {
+              if (G_UNLIKELY (state.first_eol < 0))
+                state.first_eol = p - (const guchar *) text;
+
+              if (*p == '\r')
+                {
+                  state.n_cr++;
+                  state.prev_cr = TRUE;
+                }
+              else
+                {
+                  state.n_lf++;
+                  if (state.prev_cr)
+                    state.n_crlf++;
+                  state.prev_cr = FALSE;
+                }
+            }
+          else
+            {
+              state.prev_cr = FALSE;
+            }
+
+          p++;
+        }
+      else
+        {
+          /* validate a multibyte character */
+          n = mousepad_text_scan_utf8_char (p, text_end - p);
+          if (G_UNLIKELY (n == 0))
+            {
+              valid = FALSE;
+              break;
+            }
+
+          state.prev_cr = FALSE;
+          p += n;
+        }
+    }
+
+  if (end != NULL)
+    *end = (const gchar *) p;
+
+  if (stats != NULL)
+    {
+      stats->n_crlf = state.n_crlf;
+      stats->n_lf = state.n_lf - state.n_crlf;
+      stats->n_cr = state.n_cr - state.n_crlf;
+      stats->first_eol = state.first_eol;
+    }
+
+  return valid;
+}
+
+
+
+/**
+ * mousepad_text_scan_set_impl:
+ *
+ * Forces the implementation used by mousepad_text_scan(), returns
+ * %FALSE if the cpu does not support it.
+ **/
+gboolean
+mousepad_text_scan_set_impl (MousepadTextScanImpl impl)
+{
+  return mousepad_text_scan_dispatch_set_impl (&scan_dispatch, impl);
+}
+
+
+
+const gchar *
+mousepad_text_scan_get_impl_name (void)
+{
+  return mousepad_text_scan_dispatch_get_impl_name (&scan_dispatch);
+}
+
+
+
+/**
+ * mousepad_text_scan_dispatch_get_kernel:
+ *
+ * Returns the kernel of the implementation picked for this cpu, or %NULL
+ * for the scalar code. The cpu is checked once, this is safe to call from
+ * any thread.
+ **/
+gpointer
+mousepad_text_scan_dispatch_get_kernel (MousepadTextScanDispatch *dispatch)
+{
+  return dispatch->kernels[mousepad_text_scan_dispatch_init (dispatch)];
+}
+
+
+
+/**
+ * mousepad_text_scan_dispatch_set_impl:
+ *
+ * Forces the implementation of @dispatch, returns %FALSE if the cpu does
+ * not support it. This is meant for benchmarks and must be called before
+ * other threads use the kernels.
+ **/
+gboolean
+mousepad_text_scan_dispatch_set_impl (MousepadTextScanDispatch *dispatch,
+                                      MousepadTextScanImpl      impl)
+{
+  /* finish the detection so it can't overwrite the forced value */
+  mousepad_text_scan_dispatch_init (dispatch);
+
+  if (impl == MOUSEPAD_TEXT_SCAN_AUTO)
+    {
+      /* detect the cpu again */
+      dispatch->impl = MOUSEPAD_TEXT_SCAN_AUTO;
+      mousepad_text_scan_dispatch_init (dispatch);
+      return TRUE;
+    }
+
+  if (impl >= MOUSEPAD_TEXT_SCAN_N_IMPLS
+      || (impl != MOUSEPAD_TEXT_SCAN_SCALAR && dispatch->kernels[impl] == NULL)
+      || ! mousepad_text_scan_cpu_supports (impl))
+    return FALSE;
+
+  dispatch->impl = impl;
+
+  return TRUE;
+}
+
+
+
+const gchar *
+mousepad_text_scan_dispatch_get_impl_name (MousepadTextScanDispatch *dispatch)
+{
+  switch (mousepad_text_scan_dispatch_init (dispatch))
+    {
+      case MOUSEPAD_TEXT_SCAN_SSE2:
+        return "sse2";
+
+      case MOUSEPAD_TEXT_SCAN_AVX2:
+        return "avx2";
+
+      default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_TEXT_SCAN_H__
+#define __MOUSEPAD_TEXT_SCAN_H__
+
+#include <glib.h>
+
+/* the vector kernels are built with gcc target attributes */
+#if defined (__GNUC__) && (__GNUC__ >= 5 || defined (__clang__)) \
+    && (defined (__x86_64__) || defined (__i386__))
+#define MOUSEPAD_TEXT_SCAN_X86 1
+#endif
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadTextStats        MousepadTextStats;
+typedef struct _MousepadTextScanDispatch MousepadTextScanDispatch;
+
+typedef enum
+{
+  MOUSEPAD_TEXT_SCAN_AUTO,
+  MOUSEPAD_TEXT_SCAN_SCALAR,
+  MOUSEPAD_TEXT_SCAN_SSE2,
+  MOUSEPAD_TEXT_SCAN_AVX2,
+  MOUSEPAD_TEXT_SCAN_N_IMPLS
+}
+MousepadTextScanImpl;
+
+struct _MousepadTextScanDispatch
+{
+  /* the implementation in use, MOUSEPAD_TEXT_SCAN_AUTO until it is
+   * picked, which happens once for all threads */
+  volatile gsize impl;
+
+  /* the kernel of each implementation, NULL for the scalar code */
+  gpointer       kernels[MOUSEPAD_TEXT_SCAN_N_IMPLS];
+};
+
+struct _MousepadTextStats
+{
+  /* number of lf, cr and cr+lf line endings, a cr at the very end
+   * of the text is counted as a cr line ending */
+  gsize  n_lf;
+  gsize  n_cr;
+  gsize  n_crlf;
+
+  /* byte offset of the first line ending, -1 if there is none */
+  gssize first_eol;
+};
+
+gboolean     mousepad_text_scan                (const gchar           *text,
+                                                gsize                  length,
+                                                const gchar          **end,
+                                                MousepadTextStats     *stats);
+
+gboolean     mousepad_text_scan_set_impl       (MousepadTextScanImpl   impl);
+
+const gchar *mousepad_text_scan_get_impl_name  (void);
+
+gpointer     mousepad_text_scan_dispatch_get_kernel    (MousepadTextScanDispatch *dispatch);
+
+gboolean     mousepad_text_scan_dispatch_set_impl      (MousepadTextScanDispatch *dispatch,
+                                                        MousepadTextScanImpl      impl);
+
+const gchar *mousepad_text_scan_dispatch_get_impl_name (MousepadTextScanDispatch *dispatch);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_TEXT_SCAN_H__ */
@@ -0,0 +1,158 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* Compares the throughput of a case insensitive search on folded text
+ * with comparing the text one lower case character at a time.
+ *
+ * Usage: mousepad-text-search-bench FILE PATTERN [ITERATIONS] */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-text-scan.h>
+#include <mousepad/mousepad-text-search.h>
+
+
+
+static gsize
+bench_legacy (const gchar *contents,
+              gsize        length,
+              const gchar *pattern)
+{
+  const gchar *p, *q, *n, *end = contents + length;
+  gsize        n_matches = 0;
+
+  /* compare every character in lower case */
+  for (p = contents; p < end; p = g_utf8_next_char (p))
+    {
+      for (q = p, n = pattern; *n != '\0' && q < end; q = g_utf8_next_char (q), n = g_utf8_next_char (n))
+        if (g_unichar_tolower (g_utf8_get_char (q)) != g_unichar_tolower (g_utf8_get_char (n)))
+          break;
+
+      if (*n == '\0')
+        n_matches++;
+    }
+
+  return n_matches;
+}
+
+
+
+static gsize
+bench_search (MousepadTextSearch *search,
+              const gchar        *contents,
+              gsize               length)
+{
+  gsize offset = 0, start, end;
+  gsize n_matches = 0;
+
+  mousepad_text_search_set_text (search, contents, length);
+
+  /* count the matches, they can overlap */
+  while (mousepad_text_search_forward (search, offset, length, &start, &end))
+    {
+      n_matches++;
+      offset = g_utf8_next_char (contents + start) - contents;
+    }
+
+  return n_matches;
+}
+
+
+
+static void
+bench_report (const gchar *name,
+              gsize        length,
+              guint        iterations,
+              gdouble      seconds,
+              gsize        n_matches)
+{
+  g_print ("%-8s %10.1f MB/s %10" G_GSIZE_FORMAT " matches\n", name,
+           (gdouble) length * iterations / seconds / (1024 * 1024), n_matches);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  static const struct
+  {
+    MousepadTextScanImpl  impl;
+    const gchar          *name;
+  }
+  impls[] =
+  {
+    { MOUSEPAD_TEXT_SCAN_SCALAR, "scalar" },
+    { MOUSEPAD_TEXT_SCAN_SSE2,   "sse2" },
+    { MOUSEPAD_TEXT_SCAN_AVX2,   "avx2" }
+  };
+  gchar              *contents;
+  gsize               length, n_matches = 0;
+  guint               iterations = 20, i, j;
+  GTimer             *timer;
+  GError             *error = NULL;
+  MousepadTextSearch *search;
+
+  if (argc < 3)
+    {
+      g_printerr ("Usage: %s FILE PATTERN [ITERATIONS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (! g_file_get_contents (argv[1], &contents, &length, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  if (! g_utf8_validate (contents, length, NULL) || ! g_utf8_validate (argv[2], -1, NULL))
+    {
+      g_printerr ("The file and the pattern have to be valid utf-8\n");
+      g_free (contents);
+      return EXIT_FAILURE;
+    }
+
+  if (argc > 3)
+    iterations = MAX (atoi (argv[3]), 1);
+
+  timer = g_timer_new ();
+
+  /* the old code path */
+  g_timer_start (timer);
+  for (i = 0; i < iterations; i++)
+    n_matches = bench_legacy (contents, length, argv[2]);
+  bench_report ("legacy", length, iterations, g_timer_elapsed (timer, NULL), n_matches);
+
+  /* the fold kernels supported by this cpu */
+  search = mousepad_text_search_new (argv[2], FALSE, FALSE);
+  for (j = 0; j < G_N_ELEMENTS (impls); j++)
+    {
+      if (! mousepad_text_search_set_impl (impls[j].impl))
+        continue;
+
+      g_timer_start (timer);
+      for (i = 0; i < iterations; i++)
+        n_matches = bench_search (search, contents, length);
+      bench_report (impls[j].name, length, iterations, g_timer_elapsed (timer, NULL), n_matches);
+    }
+
+  mousepad_text_search_free (search);
+  g_timer_destroy (timer);
+  g_free (contents);
+
+  return EXIT_SUCCESS;
+}
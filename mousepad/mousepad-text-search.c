@@ -0,0 +1,853 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-text-scan.h>
+#include <mousepad/mousepad-text-search.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef MOUSEPAD_TEXT_SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+
+/* shortest pattern we search with horspool, shorter ones are found with memchr */
+#define MOUSEPAD_TEXT_SEARCH_HORSPOOL_MIN (4)
+
+/* number of bytes folded one by one after a block with non-ascii bytes */
+#define MOUSEPAD_TEXT_SEARCH_SCALAR_RUN   (32)
+
+/* room after the folded text for a character that grows in lower case */
+#define MOUSEPAD_TEXT_SEARCH_FOLD_SLACK   (8)
+
+/* number of compiled regular expressions we keep around */
+#define MOUSEPAD_TEXT_SEARCH_REGEX_CACHE  (16)
+
+
+
+typedef struct _MousepadTextSearchRegex MousepadTextSearchRegex;
+
+typedef gsize (*MousepadTextSearchKernel) (const guchar *p,
+                                           gsize         length,
+                                           guchar       *folded);
+
+struct _MousepadTextSearch
+{
+  /* the pattern, its length in bytes and in characters */
+  gchar     *pattern;
+  gsize      length;
+  guint      n_chars;
+
+  /* search settings */
+  gboolean   match_case;
+  gboolean   whole_word;
+
+  /* lower case characters of the pattern, for case insensitive searches */
+  gunichar  *chars;
+
+  /* the bytes we look for, the pattern or its lower case characters */
+  gchar     *needle;
+  gsize      needle_length;
+
+  /* horspool shift for every byte at the end of the window */
+  gsize      shift[256];
+
+  /* the text we search, not owned */
+  const gchar *text;
+  gsize        text_length;
+
+  /* the text in lower case, when every character keeps its length */
+  gchar       *folded;
+  gsize        folded_size;
+  gboolean     folded_valid;
+
+  /* compiled regular expression and its last match, for regex searches */
+  GRegex      *regex;
+  GMatchInfo  *match_info;
+
+  /* byte offset of the last empty match, the next search steps over it */
+  gssize       empty_match;
+
+  /* the replacement and its expansion for the last match */
+  gchar       *replacement;
+  gchar       *expansion;
+};
+
+struct _MousepadTextSearchRegex
+{
+  gchar              *pattern;
+  GRegexCompileFlags  flags;
+  GRegex             *regex;
+};
+
+
+
+/* recently compiled regular expressions, the most recent first */
+static GQueue regex_cache = G_QUEUE_INIT;
+
+
+
+#ifdef MOUSEPAD_TEXT_SCAN_X86
+__attribute__ ((target ("sse2")))
+static gsize
+mousepad_text_search_fold_sse2 (const guchar *p,
+                                gsize         length,
+                                guchar       *folded)
+{
+  const __m128i shift = _mm_set1_epi8 (0x80 - 'A');
+  const __m128i upper = _mm_set1_epi8 (-128 + 26);
+  const __m128i bit = _mm_set1_epi8 (0x20);
+  __m128i       v, is_upper;
+  gsize         i;
+
+  for (i = 0; i + 16 <= length; i += 16)
+    {
+      v = _mm_loadu_si128 ((const __m128i *) (p + i));
+
+      /* leave non-ascii bytes to the scalar code */
+      if (_mm_movemask_epi8 (v) != 0)
+        break;
+
+      /* move A-Z to the bottom of the signed range and set their lower case bit */
+      is_upper = _mm_cmplt_epi8 (_mm_add_epi8 (v, shift), upper);
+      _mm_storeu_si128 ((__m128i *) (folded + i), _mm_or_si128 (v, _mm_and_si128 (is_upper, bit)));
+    }
+
+  return i;
+}
+
+
+
+__attribute__ ((target ("avx2")))
+static gsize
+mousepad_text_search_fold_avx2 (const guchar *p,
+                                gsize         length,
+                                guchar       *folded)
+{
+  const __m256i shift = _mm256_set1_epi8 (0x80 - 'A');
+  const __m256i upper = _mm256_set1_epi8 (-128 + 26);
+  const __m256i bit = _mm256_set1_epi8 (0x20);
+  __m256i       v, is_upper;
+  gsize         i;
+
+  for (i = 0; i + 32 <= length; i += 32)
+    {
+      v = _mm256_loadu_si256 ((const __m256i *) (p + i));
+
+      /* leave non-ascii bytes to the scalar code */
+      if (_mm256_movemask_epi8 (v) != 0)
+        break;
+
+      /* there is no signed less than, so compare the other way around */
+      is_upper = _mm256_cmpgt_epi8 (upper, _mm256_add_epi8 (v, shift));
+      _mm256_storeu_si256 ((__m256i *) (folded + i), _mm256_or_si256 (v, _mm256_and_si256 (is_upper, bit)));
+    }
+
+  return i;
+}
+#endif
+
+
+
+static MousepadTextScanDispatch fold_dispatch =
+{
+  MOUSEPAD_TEXT_SCAN_AUTO,
+#ifdef MOUSEPAD_TEXT_SCAN_X86
+  { NULL, NULL, mousepad_text_search_fold_sse2, mousepad_text_search_fold_avx2 }
+#else
+  { NULL, NULL, NULL, NULL }
+#endif
+};
+
+
+
+/**
+ * mousepad_text_search_new:
+ *
+ * Prepares a search for the utf-8 @pattern. Without @match_case the
+ * characters are compared in lower case, with @whole_word the match has
+ * to start and end a word.
+ **/
+MousepadTextSearch *
+mousepad_text_search_new (const gchar *pattern,
+                          gboolean     match_case,
+                          gboolean     whole_word)
+{
+  MousepadTextSearch *search;
+  const gchar        *p;
+  gchar              *q;
+  gsize               i;
+  guint               n;
+
+  g_return_val_if_fail (pattern != NULL && g_utf8_validate (pattern, -1, NULL), NULL);
+
+  search = g_slice_new0 (MousepadTextSearch);
+  search->pattern = g_strdup (pattern);
+  search->length = strlen (pattern);
+  search->n_chars = g_utf8_strlen (pattern, -1);
+  search->match_case = match_case;
+  search->whole_word = whole_word;
+
+  if (match_case)
+    {
+      search->needle = g_strdup (pattern);
+      search->needle_length = search->length;
+    }
+  else
+    {
+      /* the pattern in lower case, one character at a time */
+      search->chars = g_new (gunichar, MAX (search->n_chars, 1));
+      search->needle = q = g_new (gchar, search->n_chars * 6 + 1);
+      for (p = pattern, n = 0; *p != '\0'; p = g_utf8_next_char (p), n++)
+        {
+          search->chars[n] = g_unichar_tolower (g_utf8_get_char (p));
+          q += g_unichar_to_utf8 (search->chars[n], q);
+        }
+      *q = '\0';
+      search->needle_length = q - search->needle;
+    }
+
+  /* bytes that are not in the needle shift the window by its length */
+  for (i = 0; i < G_N_ELEMENTS (search->shift); i++)
+    search->shift[i] = search->needle_length;
+
+  for (i = 0; i + 1 < search->needle_length; i++)
+    search->shift[(guchar) search->needle[i]] = search->needle_length - 1 - i;
+
+  return search;
+}
+
+
+
+static GRegex *
+mousepad_text_search_compile (const gchar         *pattern,
+                              GRegexCompileFlags   flags,
+                              GError             **error)
+{
+  MousepadTextSearchRegex *cached;
+  GList                   *li;
+  GRegex                  *regex;
+
+  /* the pattern is often the same as for the previous keystroke or document */
+  for (li = regex_cache.head; li != NULL; li = li->next)
+    {
+      cached = li->data;
+      if (cached->flags == flags && strcmp (cached->pattern, pattern) == 0)
+        {
+          /* move it to the front */
+          g_queue_unlink (&regex_cache, li);
+          g_queue_push_head_link (&regex_cache, li);
+
+          return g_regex_ref (cached->regex);
+        }
+    }
+
+  regex = g_regex_new (pattern, flags, 0, error);
+  if (G_UNLIKELY (regex == NULL))
+    return NULL;
+
+  /* drop the least recently used expression */
+  if (regex_cache.length >= MOUSEPAD_TEXT_SEARCH_REGEX_CACHE)
+    {
+      cached = g_queue_pop_tail (&regex_cache);
+      g_regex_unref (cached->regex);
+      g_free (cached->pattern);
+      g_slice_free (MousepadTextSearchRegex, cached);
+    }
+
+  cached = g_slice_new (MousepadTextSearchRegex);
+  cached->pattern = g_strdup (pattern);
+  cached->flags = flags;
+  cached->regex = g_regex_ref (regex);
+  g_queue_push_head (&regex_cache, cached);
+
+  return regex;
+}
+
+
+
+/**
+ * mousepad_text_search_new_regex:
+ *
+ * Prepares a search for the regular expression @pattern, returns %NULL
+ * and sets @error when it does not compile. The compiled expressions are
+ * cached, so preparing the same search again is cheap.
+ **/
+MousepadTextSearch *
+mousepad_text_search_new_regex (const gchar  *pattern,
+                                gboolean      match_case,
+                                gboolean      whole_word,
+                                GError      **error)
+{
+  MousepadTextSearch *search;
+  GRegexCompileFlags  flags;
+  GRegex             *regex;
+  gchar              *wrapped = NULL;
+
+  g_return_val_if_fail (pattern != NULL && g_utf8_validate (pattern, -1, NULL), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  /* optimize lets pcre use its jit compiler where it has one */
+  flags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+  if (! match_case)
+    flags |= G_REGEX_CASELESS;
+
+  /* the same rule as for plain text, the match starts and ends a word */
+  if (whole_word)
+    pattern = wrapped = g_strdup_printf ("(?<!\\w)(?=\\w)(?:%s)(?<=\\w)(?!\\w)", pattern);
+
+  regex = mousepad_text_search_compile (pattern, flags, error);
+  g_free (wrapped);
+
+  if (G_UNLIKELY (regex == NULL))
+    return NULL;
+
+  search = g_slice_new0 (MousepadTextSearch);
+  search->pattern = g_strdup (g_regex_get_pattern (regex));
+  search->length = strlen (search->pattern);
+  search->match_case = match_case;
+  search->whole_word = whole_word;
+  search->regex = regex;
+
+  return search;
+}
+
+
+
+void
+mousepad_text_search_free (MousepadTextSearch *search)
+{
+  if (G_LIKELY (search != NULL))
+    {
+      if (search->match_info != NULL)
+        g_match_info_free (search->match_info);
+      if (search->regex != NULL)
+        g_regex_unref (search->regex);
+
+      g_free (search->pattern);
+      g_free (search->chars);
+      g_free (search->needle);
+      g_free (search->folded);
+      g_free (search->replacement);
+      g_free (search->expansion);
+      g_slice_free (MousepadTextSearch, search);
+    }
+}
+
+
+
+/**
+ * mousepad_text_search_get_max_chars:
+ *
+ * The largest number of characters a match can have. Text cut in parts
+ * has to overlap by one less than that to find the matches in between.
+ * A regular expression can match any length, then this is 0.
+ **/
+guint
+mousepad_text_search_get_max_chars (MousepadTextSearch *search)
+{
+  return search->regex != NULL ? 0 : search->n_chars;
+}
+
+
+
+/**
+ * mousepad_text_search_set_replacement:
+ *
+ * Sets the text that replaces the matches. For a regular expression it
+ * can refer to the groups of the match, like \0 or \1. Returns %FALSE
+ * and sets @error when the references are not valid.
+ **/
+gboolean
+mousepad_text_search_set_replacement (MousepadTextSearch  *search,
+                                      const gchar         *replacement,
+                                      GError             **error)
+{
+  g_return_val_if_fail (search != NULL, FALSE);
+  g_return_val_if_fail (replacement == NULL || g_utf8_validate (replacement, -1, NULL), FALSE);
+
+  if (search->regex != NULL && replacement != NULL
+      && ! g_regex_check_replacement (replacement, NULL, error))
+    return FALSE;
+
+  g_free (search->replacement);
+  search->replacement = g_strdup (replacement);
+
+  return TRUE;
+}
+
+
+
+/**
+ * mousepad_text_search_get_replacement:
+ *
+ * The replacement for the last match that was found, with the references
+ * to its groups filled in.
+ **/
+const gchar *
+mousepad_text_search_get_replacement (MousepadTextSearch *search)
+{
+  g_return_val_if_fail (search != NULL, NULL);
+
+  if (search->regex != NULL)
+    return search->expansion != NULL ? search->expansion : "";
+
+  return search->replacement != NULL ? search->replacement : "";
+}
+
+
+
+static inline gboolean
+mousepad_text_search_word_char (gunichar c)
+{
+  /* character we'd like to see in a word */
+  return (g_unichar_isalnum (c) || c == '_');
+}
+
+
+
+static gboolean
+mousepad_text_search_is_word (const gchar *text,
+                              gsize        length,
+                              gsize        match_start,
+                              gsize        match_end)
+{
+  /* the match starts and ends with a word character */
+  if (match_start == match_end
+      || ! mousepad_text_search_word_char (g_utf8_get_char (text + match_start))
+      || ! mousepad_text_search_word_char (g_utf8_get_char (g_utf8_prev_char (text + match_end))))
+    return FALSE;
+
+  /* and the word does not go on before or after it */
+  if (match_start > 0
+      && mousepad_text_search_word_char (g_utf8_get_char (g_utf8_prev_char (text + match_start))))
+    return FALSE;
+
+  if (match_end < length
+      && mousepad_text_search_word_char (g_utf8_get_char (text + match_end)))
+    return FALSE;
+
+  return TRUE;
+}
+
+
+
+static const gchar *
+mousepad_text_search_find (MousepadTextSearch *search,
+                           const gchar        *haystack,
+                           gsize               length)
+{
+  const guchar *p, *last;
+  const guchar *needle = (const guchar *) search->needle;
+  gsize         m = search->needle_length;
+
+  if (m > length)
+    return NULL;
+
+  /* last position the pattern fits */
+  last = (const guchar *) haystack + length - m;
+
+  if (m < MOUSEPAD_TEXT_SEARCH_HORSPOOL_MIN)
+    {
+      /* find the first byte with memchr and compare the rest */
+      for (p = (const guchar *) haystack; p <= last; p++)
+        {
+          p = memchr (p, needle[0], last - p + 1);
+          if (p == NULL)
+            return NULL;
+
+          if (memcmp (p + 1, needle + 1, m - 1) == 0)
+            return (const gchar *) p;
+        }
+
+      return NULL;
+    }
+
+  /* horspool, shift the window by the last byte in it */
+  for (p = (const guchar *) haystack; p <= last; p += search->shift[p[m - 1]])
+    if (p[m - 1] == needle[m - 1] && memcmp (p, needle, m - 1) == 0)
+      return (const gchar *) p;
+
+  return NULL;
+}
+
+
+
+static inline gunichar
+mousepad_text_search_lower (const gchar *p)
+{
+  /* plain ascii doesn't need the unicode tables */
+  if ((guchar) *p < 0x80)
+    return g_ascii_tolower (*p);
+
+  return g_unichar_tolower (g_utf8_get_char (p));
+}
+
+
+
+static gboolean
+mousepad_text_search_find_nocase (MousepadTextSearch *search,
+                                  const gchar        *text,
+                                  gsize               offset,
+                                  gsize               end,
+                                  gsize              *match_start,
+                                  gsize              *match_end)
+{
+  const gchar *p, *q;
+  const gchar *text_end = text + end;
+  guint        n;
+
+  for (p = text + offset; p < text_end; p = g_utf8_next_char (p))
+    {
+      /* look for the first character */
+      if (mousepad_text_search_lower (p) != search->chars[0])
+        continue;
+
+      /* compare the other characters */
+      for (q = g_utf8_next_char (p), n = 1; n < search->n_chars && q < text_end; q = g_utf8_next_char (q), n++)
+        if (mousepad_text_search_lower (q) != search->chars[n])
+          break;
+
+      if (n == search->n_chars)
+        {
+          *match_start = p - text;
+          *match_end = q - text;
+
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+
+
+static gboolean
+mousepad_text_search_fold (const gchar *text,
+                           gsize        length,
+                           gchar       *folded)
+{
+  MousepadTextSearchKernel  kernel;
+  const gchar              *p = text;
+  const gchar              *end = text + length;
+  const gchar              *scalar_end = text;
+  gchar                    *q = folded;
+  gunichar                  c, lower;
+  gsize                     n;
+
+  kernel = mousepad_text_scan_dispatch_get_kernel (&fold_dispatch);
+
+  while (p < end)
+    {
+      /* let the vector unit fold runs of ascii */
+      if (kernel != NULL && p >= scalar_end)
+        {
+          n = kernel ((const guchar *) p, end - p, (guchar *) q);
+          p += n;
+          q += n;
+
+          if (p >= end)
+            break;
+
+          scalar_end = p + MOUSEPAD_TEXT_SEARCH_SCALAR_RUN;
+        }
+
+      if ((guchar) *p < 0x80)
+        {
+          *q++ = g_ascii_tolower (*p++);
+          continue;
+        }
+
+      c = g_utf8_get_char (p);
+      n = g_utf8_next_char (p) - p;
+      lower = g_unichar_tolower (c);
+
+      if (lower == c)
+        memcpy (q, p, n);
+      else if (g_unichar_to_utf8 (lower, q) != (gint) n)
+        {
+          /* the offsets in the folded text would no longer match */
+          return FALSE;
+        }
+
+      p += n;
+      q += n;
+    }
+
+  return TRUE;
+}
+
+
+
+/**
+ * mousepad_text_search_set_text:
+ *
+ * Sets the utf-8 @text the next searches look in. The text is not copied,
+ * it has to stay around until it is replaced. Without match case it is
+ * folded to lower case once, so the searches can compare plain bytes.
+ **/
+void
+mousepad_text_search_set_text (MousepadTextSearch *search,
+                               const gchar        *text,
+                               gsize               length)
+{
+  g_return_if_fail (search != NULL);
+
+  search->text = text;
+  search->text_length = length;
+  search->empty_match = -1;
+
+  /* the last match points into the previous text */
+  if (search->match_info != NULL)
+    {
+      g_match_info_free (search->match_info);
+      search->match_info = NULL;
+    }
+
+  /* the regex engine folds the case itself */
+  if (search->match_case || search->regex != NULL || search->length == 0)
+    return;
+
+  /* reuse the buffer of the previous text when it is large enough */
+  if (search->folded_size < length + MOUSEPAD_TEXT_SEARCH_FOLD_SLACK)
+    {
+      g_free (search->folded);
+      search->folded_size = length + MOUSEPAD_TEXT_SEARCH_FOLD_SLACK;
+      search->folded = g_malloc (search->folded_size);
+    }
+
+  search->folded_valid = mousepad_text_search_fold (text, length, search->folded);
+}
+
+
+
+static gboolean
+mousepad_text_search_next_regex (MousepadTextSearch *search,
+                                 gsize               offset,
+                                 gsize               end,
+                                 gsize              *match_start,
+                                 gsize              *match_end)
+{
+  GMatchInfo *match_info;
+  gint        start, stop;
+  gsize       length = search->text_length;
+
+  /* an empty match is found once, like ^ or \b, continue after it */
+  if ((gssize) offset == search->empty_match)
+    {
+      if (offset >= end)
+        return FALSE;
+
+      offset = g_utf8_next_char (search->text + offset) - search->text;
+    }
+
+  /* look at the text after the end too, so anchors and lookaheads see the
+   * real text */
+  while (TRUE)
+    {
+      if (! g_regex_match_full (search->regex, search->text, length, offset,
+                                0, &match_info, NULL))
+        {
+          g_match_info_free (match_info);
+          return FALSE;
+        }
+
+      g_match_info_fetch_pos (match_info, 0, &start, &stop);
+      if ((gsize) stop <= end || length == end)
+        break;
+
+      g_match_info_free (match_info);
+      if ((gsize) start >= end)
+        return FALSE;
+
+      /* the match runs past the end, try again without the text after it */
+      length = end;
+    }
+
+  *match_start = start;
+  *match_end = stop;
+  search->empty_match = (start == stop) ? start : -1;
+
+  /* keep the match for the replacement */
+  if (search->match_info != NULL)
+    g_match_info_free (search->match_info);
+  search->match_info = match_info;
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_text_search_next (MousepadTextSearch *search,
+                           gsize               offset,
+                           gsize               end,
+                           gsize              *match_start,
+                           gsize              *match_end)
+{
+  const gchar *text, *haystack, *p;
+  gsize        length, start, stop;
+
+  if (G_UNLIKELY (search->length == 0))
+    return FALSE;
+
+  if (search->regex != NULL)
+    return mousepad_text_search_next_regex (search, offset, end, match_start, match_end);
+
+  text = search->text;
+  length = search->text_length;
+
+  /* folded text has the same offsets, so it is searched like the original */
+  haystack = search->match_case ? text : search->folded;
+
+  while (offset < end)
+    {
+      /* the next place the pattern occurs */
+      if (search->match_case || search->folded_valid)
+        {
+          p = mousepad_text_search_find (search, haystack + offset, end - offset);
+          if (p == NULL)
+            return FALSE;
+
+          start = p - haystack;
+          stop = start + search->needle_length;
+        }
+      else if (! mousepad_text_search_find_nocase (search, text, offset, end, &start, &stop))
+        {
+          return FALSE;
+        }
+
+      if (! search->whole_word || mousepad_text_search_is_word (text, length, start, stop))
+        {
+          *match_start = start;
+          *match_end = stop;
+
+          return TRUE;
+        }
+
+      /* try again from the next character */
+      offset = g_utf8_next_char (text + start) - text;
+    }
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_text_search_expand (MousepadTextSearch *search)
+{
+  g_free (search->expansion);
+  search->expansion = NULL;
+
+  /* fill in the groups while the text of the match is still around */
+  if (search->regex != NULL && search->replacement != NULL && search->match_info != NULL)
+    search->expansion = g_match_info_expand_references (search->match_info, search->replacement, NULL);
+}
+
+
+
+/**
+ * mousepad_text_search_forward:
+ *
+ * Finds the first match in the text that starts at or after the byte
+ * @offset and ends before or at @end. The text outside this range is
+ * only looked at to see if the match is a whole word. Searching again
+ * from the end of an empty match continues after it.
+ **/
+gboolean
+mousepad_text_search_forward (MousepadTextSearch *search,
+                              gsize               offset,
+                              gsize               end,
+                              gsize              *match_start,
+                              gsize              *match_end)
+{
+  g_return_val_if_fail (search != NULL, FALSE);
+  g_return_val_if_fail (offset <= end && end <= search->text_length, FALSE);
+
+  if (! mousepad_text_search_next (search, offset, end, match_start, match_end))
+    return FALSE;
+
+  mousepad_text_search_expand (search);
+
+  return TRUE;
+}
+
+
+
+/**
+ * mousepad_text_search_backward:
+ *
+ * Like mousepad_text_search_forward(), but finds the last match. An
+ * empty match at @end is left out, it is not in front of @end.
+ **/
+gboolean
+mousepad_text_search_backward (MousepadTextSearch *search,
+                               gsize               offset,
+                               gsize               end,
+                               gsize              *match_start,
+                               gsize              *match_end)
+{
+  gsize    start, stop;
+  gboolean found = FALSE;
+
+  g_return_val_if_fail (search != NULL, FALSE);
+  g_return_val_if_fail (offset <= end && end <= search->text_length, FALSE);
+
+  /* walk over the matches, they can overlap, an empty match at the end
+   * does not start before it */
+  while (mousepad_text_search_next (search, offset, end, &start, &stop)
+         && (start < end || start < stop))
+    {
+      *match_start = start;
+      *match_end = stop;
+      found = TRUE;
+
+      offset = g_utf8_next_char (search->text + start) - search->text;
+    }
+
+  /* only the last match is replaced */
+  if (found)
+    mousepad_text_search_expand (search);
+
+  return found;
+}
+
+
+
+/**
+ * mousepad_text_search_set_impl:
+ *
+ * Forces the implementation used to fold text to lower case, returns
+ * %FALSE if the cpu does not support it.
+ **/
+gboolean
+mousepad_text_search_set_impl (MousepadTextScanImpl impl)
+{
+  return mousepad_text_scan_dispatch_set_impl (&fold_dispatch, impl);
+}
+
+
+
+const gchar *
+mousepad_text_search_get_impl_name (void)
+{
+  return mousepad_text_scan_dispatch_get_impl_name (&fold_dispatch);
+}
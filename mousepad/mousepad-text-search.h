@@ -0,0 +1,67 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_TEXT_SEARCH_H__
+#define __MOUSEPAD_TEXT_SEARCH_H__
+
+#include <mousepad/mousepad-text-scan.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadTextSearch MousepadTextSearch;
+
+MousepadTextSearch *mousepad_text_search_new             (const gchar          *pattern,
+                                                          gboolean              match_case,
+                                                          gboolean              whole_word);
+
+MousepadTextSearch *mousepad_text_search_new_regex       (const gchar          *pattern,
+                                                          gboolean              match_case,
+                                                          gboolean              whole_word,
+                                                          GError              **error);
+
+void                mousepad_text_search_free            (MousepadTextSearch   *search);
+
+guint               mousepad_text_search_get_max_chars   (MousepadTextSearch   *search);
+
+gboolean            mousepad_text_search_set_replacement (MousepadTextSearch   *search,
+                                                          const gchar          *replacement,
+                                                          GError              **error);
+
+const gchar        *mousepad_text_search_get_replacement (MousepadTextSearch   *search);
+
+void                mousepad_text_search_set_text        (MousepadTextSearch   *search,
+                                                          const gchar          *text,
+                                                          gsize                 length);
+
+gboolean            mousepad_text_search_forward         (MousepadTextSearch   *search,
+                                                          gsize                 offset,
+                                                          gsize                 end,
+                                                          gsize                *match_start,
+                                                          gsize                *match_end);
+
+gboolean            mousepad_text_search_backward        (MousepadTextSearch   *search,
+                                                          gsize                 offset,
+                                                          gsize                 end,
+                                                          gsize                *match_start,
+                                                          gsize                *match_end);
+
+gboolean            mousepad_text_search_set_impl        (MousepadTextScanImpl  impl);
+
+const gchar        *mousepad_text_search_get_impl_name   (void);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_TEXT_SEARCH_H__ */
@@ -16,10 +16,102 @@
 
 #include <mousepad/mousepad-private.h>
 #include <mousepad/mousepad-gtkcompat.h>
+#include <mousepad/mousepad-text-scan.h>
+#include <mousepad/mousepad-text-search.h>
 #include <mousepad/mousepad-util.h>
 
 
 
+/* number of characters in the first part of the buffer we search, the
+ * next parts are twice as large up to the maximum */
+#define MOUSEPAD_UTIL_SEARCH_SEGMENT_MIN (1024)
+#define MOUSEPAD_UTIL_SEARCH_SEGMENT_MAX (64 * 1024)
+
+/* number of characters highlighted in one part, and the time in microseconds
+ * the highlight may take before the main loop gets a chance to run */
+#define MOUSEPAD_UTIL_HIGHLIGHT_CHUNK    (16 * 1024)
+#define MOUSEPAD_UTIL_HIGHLIGHT_SLICE    (5 * 1000)
+
+
+
+typedef struct _MousepadUtilSegment      MousepadUtilSegment;
+typedef struct _MousepadUtilHighlight    MousepadUtilHighlight;
+typedef struct _MousepadUtilHighlightJob MousepadUtilHighlightJob;
+typedef struct _MousepadUtilForeach      MousepadUtilForeach;
+
+struct _MousepadUtilSegment
+{
+  /* a copy of a part of the buffer */
+  gchar       *text;
+  gsize        length;
+
+  /* buffer offset of the first character */
+  gint         offset;
+
+  /* the last byte we turned into a character offset */
+  gsize        cursor_byte;
+  gint         cursor_char;
+};
+
+struct _MousepadUtilHighlight
+{
+  GtkTextTag  *tag;
+
+  /* the range of adjacent matches that is not tagged yet */
+  GtkTextIter  cache_start;
+  GtkTextIter  cache_end;
+  gboolean     cached;
+
+  /* matches that start at this offset belong to the next part */
+  gint         limit;
+
+  /* number of matches and the characters they cover */
+  gint         counter;
+  gint         first;
+  gint         last;
+};
+
+struct _MousepadUtilForeach
+{
+  MousepadUtilMatchFunc  func;
+  gpointer               user_data;
+
+  /* matches that start at this offset are outside the range */
+  gint                   limit;
+  gint                   counter;
+};
+
+struct _MousepadUtilHighlightJob
+{
+  GtkTextView         *view;
+  GtkTextBuffer       *buffer;
+  GtkTextTag          *tag;
+
+  /* the search to highlight, NULL when nothing is highlighted */
+  MousepadTextSearch  *search;
+  MousepadSearchFlags  flags;
+
+  /* the part of the buffer that can have the tag, NULL when nothing is tagged */
+  GtkTextMark         *tagged_start;
+  GtkTextMark         *tagged_end;
+
+  /* the area to highlight and the part of it that is done, -1 when
+   * the visible part has to be done first */
+  gint                 area_start;
+  gint                 area_end;
+  gint                 done_start;
+  gint                 done_end;
+
+  /* the characters covered by the matches of this search */
+  gint                 match_first;
+  gint                 match_last;
+
+  guint                idle_id;
+  gulong               changed_id;
+};
+
+
+
 static gboolean
 mousepad_util_iter_word_characters (const GtkTextIter *iter)
 {
@@ -626,129 +718,219 @@ mousepad_util_search_flags_get_type (void)
 
 
 
-static gboolean
-mousepad_util_search_iter (const GtkTextIter   *start,
-                           const gchar         *string,
-                           MousepadSearchFlags  flags,
-                           GtkTextIter         *match_start,
-                           GtkTextIter         *match_end,
-                           const GtkTextIter   *limit)
+static void
+mousepad_util_segment_init (MousepadUtilSegment *segment,
+                            GtkTextBuffer       *buffer,
+                            gint                 first,
+                            gint                 last)
 {
-  GtkTextIter  iter, begin;
-  gunichar     iter_char, str_char;
-  gboolean     succeed = FALSE;
-  const gchar *needle = string;
-  gboolean     match_case, search_backwards, whole_word;
-  guint        needle_offset = 0;
+  GtkTextIter start, end;
+
+  /* the text with a character on both sides, for the whole word checks */
+  gtk_text_buffer_get_iter_at_offset (buffer, &start, MAX (first - 1, 0));
+  gtk_text_buffer_get_iter_at_offset (buffer, &end, last + 1);
+
+  /* include the hidden characters, so the character offsets match the buffer */
+  segment->text = gtk_text_buffer_get_slice (buffer, &start, &end, TRUE);
+  segment->length = strlen (segment->text);
+  segment->offset = gtk_text_iter_get_offset (&start);
+  segment->cursor_byte = 0;
+  segment->cursor_char = 0;
+}
 
-  g_return_val_if_fail (start != NULL, FALSE);
-  g_return_val_if_fail (string != NULL, FALSE);
-  g_return_val_if_fail (limit != NULL, FALSE);
 
-  /* search properties */
-  match_case       = (flags & MOUSEPAD_SEARCH_FLAGS_MATCH_CASE) != 0;
-  search_backwards = (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD) != 0;
-  whole_word       = (flags & MOUSEPAD_SEARCH_FLAGS_WHOLE_WORD) != 0;
 
-  /* set the start iter */
-  iter = *start;
+static gsize
+mousepad_util_segment_get_byte (MousepadUtilSegment *segment,
+                                gint                 char_offset)
+{
+  return g_utf8_offset_to_pointer (segment->text, char_offset - segment->offset) - segment->text;
+}
 
-  /* walk from the start to the end iter */
-  for (;;)
-    {
-      /* break when we reach the limit iter, for backwards searching it's
-       * it has to be less than the limit which is 0 so that we can match
-       * at the very start of the buffer. for forwards searching the limit
-       * is the index after the last char so break when we are at or past
-       * the limit. */
-      if ((search_backwards && gtk_text_iter_compare (&iter, limit) < 0) ||
-          (!search_backwards && gtk_text_iter_compare (&iter, limit) >= 0))
-        {
-          break;
-        }
 
-      /* get the unichar characters */
-      iter_char = gtk_text_iter_get_char (&iter);
-      str_char  = g_utf8_get_char (needle);
 
-      /* skip unknown characters */
-      if (G_UNLIKELY (iter_char == 0xFFFC))
-        goto continue_searching;
+static void
+mousepad_util_segment_get_iter (MousepadUtilSegment *segment,
+                                GtkTextBuffer       *buffer,
+                                gsize                byte,
+                                GtkTextIter         *iter)
+{
+  /* count the characters from the previous position, the matches come in order */
+  if (G_UNLIKELY (byte < segment->cursor_byte))
+    {
+      segment->cursor_byte = 0;
+      segment->cursor_char = 0;
+    }
 
-      /* lower case searching */
-      if (!match_case)
-        {
-          /* convert the characters to lower case */
-          iter_char = g_unichar_tolower (iter_char);
-          str_char  = g_unichar_tolower (str_char);
-        }
+  segment->cursor_char += g_utf8_pointer_to_offset (segment->text + segment->cursor_byte, segment->text + byte);
+  segment->cursor_byte = byte;
 
-      /* compare the two characters */
-      if (iter_char == str_char)
-        {
-          /* first character matched, set the begin iter */
-          if (needle_offset == 0)
-            begin = iter;
+  gtk_text_buffer_get_iter_at_offset (buffer, iter, segment->offset + segment->cursor_char);
+}
 
-          /* get the next character and increase the offset counter */
-          needle = g_utf8_next_char (needle);
-          needle_offset++;
 
-          /* we hit the end of the search string, so we had a full match */
-          if (G_UNLIKELY (*needle == '\0'))
-            {
-              if (G_LIKELY (!search_backwards))
-                {
-                  /* set the end iter after the character (for selection) */
-                  gtk_text_iter_forward_char (&iter);
 
-                  /* check if we match a whole word */
-                  if (whole_word && !(mousepad_util_iter_starts_word (&begin) && mousepad_util_iter_ends_word (&iter)))
-                    goto reset_and_continue_searching;
-                }
-              else
-                {
-                  /* set the start iter after the character (for selection) */
-                  gtk_text_iter_forward_char (&begin);
+static gint
+mousepad_util_search_forward (GtkTextBuffer         *buffer,
+                              MousepadTextSearch    *search,
+                              const GtkTextIter     *start,
+                              const GtkTextIter     *limit,
+                              GtkTextIter           *match_start,
+                              GtkTextIter           *match_end,
+                              MousepadUtilMatchFunc  func,
+                              gpointer               user_data)
+{
+  MousepadUtilSegment segment;
+  gint                offset, limit_offset, last, match_limit, next;
+  gint                size = MOUSEPAD_UTIL_SEARCH_SEGMENT_MIN;
+  gint                overlap, counter = 0;
+  gsize               from, last_byte, limit_byte;
+  gsize               start_byte, end_byte;
+  gboolean            stop = FALSE;
+
+  offset = gtk_text_iter_get_offset (start);
+  limit_offset = gtk_text_iter_get_offset (limit);
+  overlap = mousepad_text_search_get_max_chars (search) - 1;
+
+  /* a regular expression can match any length, look at the whole area at once */
+  if (overlap < 0)
+    {
+      size = MAX (limit_offset - offset, 1);
+      overlap = 0;
+    }
 
-                  /* check if we match a whole word */
-                  if (whole_word && !(mousepad_util_iter_starts_word (&iter) && mousepad_util_iter_ends_word (&begin)))
-                    goto reset_and_continue_searching;
-                }
+  /* search the buffer in parts that grow, a match close by is found quickly and
+   * a long search doesn't copy the whole buffer at once */
+  while (offset < limit_offset && ! stop)
+    {
+      /* the matches have to start in this part, they can end in the next one */
+      last = MIN (offset + size, limit_offset);
+      match_limit = MIN (last + overlap, limit_offset);
+
+      mousepad_util_segment_init (&segment, buffer, offset, match_limit);
+      mousepad_text_search_set_text (search, segment.text, segment.length);
+      from = mousepad_util_segment_get_byte (&segment, offset);
+      last_byte = mousepad_util_segment_get_byte (&segment, last);
+      limit_byte = mousepad_util_segment_get_byte (&segment, match_limit);
 
-              /* set the start and end iters */
-              *match_start = begin;
-              *match_end   = iter;
+      next = last;
 
-              /* return true and stop searching */
-              succeed = TRUE;
+      while (mousepad_text_search_forward (search, from, limit_byte, &start_byte, &end_byte)
+             && start_byte < last_byte)
+        {
+          /* only now turn the match into iters */
+          mousepad_util_segment_get_iter (&segment, buffer, start_byte, match_start);
+          mousepad_util_segment_get_iter (&segment, buffer, end_byte, match_end);
+          counter++;
 
+          /* stop at the first match, or when the caller has seen enough */
+          if (func == NULL || ! func (buffer, match_start, match_end, user_data))
+            {
+              stop = TRUE;
               break;
             }
+
+          /* continue after the match, also in the next part */
+          from = end_byte;
+          next = MAX (next, gtk_text_iter_get_offset (match_end));
         }
-      else if (needle_offset > 0)
-        {
-          /* label */
-          reset_and_continue_searching:
 
-          /* reset the needle */
-          needle = string;
-          needle_offset = 0;
+      g_free (segment.text);
 
-          /* reset the iter */
-          iter = begin;
+      offset = next;
+      size = MAX (size, MIN (size * 2, MOUSEPAD_UTIL_SEARCH_SEGMENT_MAX));
+    }
+
+  return counter;
+}
+
+
+
+static gboolean
+mousepad_util_search_backward (GtkTextBuffer       *buffer,
+                               MousepadTextSearch  *search,
+                               const GtkTextIter   *start,
+                               const GtkTextIter   *limit,
+                               GtkTextIter         *match_start,
+                               GtkTextIter         *match_end)
+{
+  MousepadUtilSegment segment;
+  GtkTextIter         bound;
+  gint                offset, bound_offset, limit_offset, last, match_limit;
+  gint                size = MOUSEPAD_UTIL_SEARCH_SEGMENT_MIN;
+  gint                overlap;
+  gsize               start_byte, end_byte;
+  gboolean            found = FALSE;
+
+  limit_offset = gtk_text_iter_get_offset (limit);
+  if (gtk_text_iter_get_offset (start) < limit_offset)
+    return FALSE;
+
+  /* the match can end after the character at the start iter */
+  bound = *start;
+  gtk_text_iter_forward_char (&bound);
+  bound_offset = gtk_text_iter_get_offset (&bound);
+  overlap = mousepad_text_search_get_max_chars (search) - 1;
+
+  /* a regular expression can match any length, look at the whole area at once */
+  if (overlap < 0)
+    {
+      size = MAX (bound_offset - limit_offset, 1);
+      overlap = 0;
+    }
+
+  /* search the buffer backwards in parts that grow */
+  for (last = bound_offset; last > limit_offset && ! found; last = offset)
+    {
+      /* the matches have to start in this part, they can end in the part after it */
+      offset = MAX (last - size, limit_offset);
+      match_limit = MIN (last + overlap, bound_offset);
+
+      mousepad_util_segment_init (&segment, buffer, offset, match_limit);
+      mousepad_text_search_set_text (search, segment.text, segment.length);
+
+      found = mousepad_text_search_backward (search,
+                                             mousepad_util_segment_get_byte (&segment, offset),
+                                             mousepad_util_segment_get_byte (&segment, match_limit),
+                                             &start_byte, &end_byte);
+      if (found)
+        {
+          mousepad_util_segment_get_iter (&segment, buffer, start_byte, match_start);
+          mousepad_util_segment_get_iter (&segment, buffer, end_byte, match_end);
         }
 
-      /* label */
-      continue_searching:
+      g_free (segment.text);
 
-      /* jump to next iter in the buffer */
-      if ((!search_backwards && !gtk_text_iter_forward_char (&iter))
-          || (search_backwards && !gtk_text_iter_backward_char (&iter)))
-        break;
+      size = MAX (size, MIN (size * 2, MOUSEPAD_UTIL_SEARCH_SEGMENT_MAX));
     }
 
-  return succeed;
+  return found;
+}
+
+
+
+static gboolean
+mousepad_util_search_iter (const GtkTextIter   *start,
+                           MousepadTextSearch  *search,
+                           MousepadSearchFlags  flags,
+                           GtkTextIter         *match_start,
+                           GtkTextIter         *match_end,
+                           const GtkTextIter   *limit)
+{
+  GtkTextBuffer *buffer;
+
+  g_return_val_if_fail (start != NULL, FALSE);
+  g_return_val_if_fail (search != NULL, FALSE);
+  g_return_val_if_fail (limit != NULL, FALSE);
+
+  buffer = gtk_text_iter_get_buffer (start);
+
+  /* for backwards searching the limit is before the start iter, and the
+   * match is returned from its end to its start */
+  if (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
+    return mousepad_util_search_backward (buffer, search, start, limit, match_end, match_start);
+
+  return (mousepad_util_search_forward (buffer, search, start, limit, match_start, match_end, NULL, NULL) > 0);
 }
 
 
@@ -813,84 +995,643 @@ mousepad_util_search_get_iters (GtkTextBuffer       *buffer,
 
 
 
+static MousepadTextSearch *
+mousepad_util_search_new (const gchar         *string,
+                          MousepadSearchFlags  flags)
+{
+  MousepadTextSearch *search;
+  GError             *error = NULL;
+  gboolean            match_case, whole_word;
+
+  match_case = (flags & MOUSEPAD_SEARCH_FLAGS_MATCH_CASE) != 0;
+  whole_word = (flags & MOUSEPAD_SEARCH_FLAGS_WHOLE_WORD) != 0;
+
+  if ((flags & MOUSEPAD_SEARCH_FLAGS_REGEX) == 0)
+    return mousepad_text_search_new (string, match_case, whole_word);
+
+  /* the user is probably still typing the expression, so don't complain */
+  search = mousepad_text_search_new_regex (string, match_case, whole_word, &error);
+  if (G_UNLIKELY (search == NULL))
+    {
+      g_debug ("Invalid regular expression \"%s\": %s", string, error->message);
+      g_error_free (error);
+    }
+
+  return search;
+}
+
+
+
+static gboolean
+mousepad_util_search_foreach_match (GtkTextBuffer *buffer,
+                                    GtkTextIter   *match_start,
+                                    GtkTextIter   *match_end,
+                                    gpointer       user_data)
+{
+  MousepadUtilForeach *foreach = user_data;
+
+  /* the match starts after the range */
+  if (gtk_text_iter_get_offset (match_start) >= foreach->limit)
+    return FALSE;
+
+  foreach->counter++;
+
+  return foreach->func (buffer, match_start, match_end, foreach->user_data);
+}
+
+
+
+/**
+ * mousepad_util_search_foreach:
+ *
+ * Calls @func for every match of @string that starts between @start and
+ * @end, the match can end after @end, a regular expression on the line of
+ * @end. Stops when @func returns %FALSE.
+ *
+ * Return value: the number of matches, or -1 if @string is not a valid
+ *               regular expression.
+ **/
 gint
-mousepad_util_highlight (GtkTextBuffer       *buffer,
-                         GtkTextTag          *tag,
-                         const gchar         *string,
-                         MousepadSearchFlags  flags)
+mousepad_util_search_foreach (GtkTextBuffer         *buffer,
+                              const gchar           *string,
+                              MousepadSearchFlags    flags,
+                              const GtkTextIter     *start,
+                              const GtkTextIter     *end,
+                              MousepadUtilMatchFunc  func,
+                              gpointer               user_data)
 {
-  GtkTextIter start, iter, end;
-  GtkTextIter match_start, match_end;
-  GtkTextIter cache_start, cache_end;
-  gboolean    found, cached = FALSE;
-  gint        counter = 0;
+  MousepadTextSearch  *search;
+  MousepadUtilForeach  foreach;
+  GtkTextIter          limit, match_start, match_end;
 
   g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), -1);
-  g_return_val_if_fail (GTK_IS_TEXT_TAG (tag), -1);
-  g_return_val_if_fail (string == NULL || g_utf8_validate (string, -1, NULL), -1);
-  g_return_val_if_fail ((flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD) == 0, -1);
+  g_return_val_if_fail (string != NULL && g_utf8_validate (string, -1, NULL), -1);
+  g_return_val_if_fail (func != NULL, -1);
 
-  /* get the buffer bounds */
-  gtk_text_buffer_get_bounds (buffer, &start, &end);
+  search = mousepad_util_search_new (string, flags);
+  if (G_UNLIKELY (search == NULL))
+    return -1;
 
-  /* remove all the highlight tags */
-  gtk_text_buffer_remove_tag (buffer, tag, &start, &end);
+  foreach.func = func;
+  foreach.user_data = user_data;
+  foreach.limit = gtk_text_iter_get_offset (end);
+  foreach.counter = 0;
 
-  /* quit if there is nothing to highlight */
-  if (string == NULL || *string == '\0' || flags & MOUSEPAD_SEARCH_FLAGS_ACTION_CLEANUP)
-    return 0;
+  /* a literal match can end after the range, a regular expression on the
+   * rest of the line */
+  limit = *end;
+  if (mousepad_text_search_get_max_chars (search) > 0)
+    gtk_text_iter_forward_chars (&limit, mousepad_text_search_get_max_chars (search) - 1);
+  else if (! gtk_text_iter_ends_line (&limit))
+    gtk_text_iter_forward_to_line_end (&limit);
 
-  /* get the search iters */
-  mousepad_util_search_get_iters (buffer, flags, &start, &end, &iter);
+  mousepad_util_search_forward (buffer, search, start, &limit, &match_start, &match_end,
+                                mousepad_util_search_foreach_match, &foreach);
 
-  /* initialize cache iters */
-  cache_start = cache_end = iter;
+  mousepad_text_search_free (search);
 
-  /* highlight all the occurences of the strings */
-  do
+  return foreach.counter;
+}
+
+
+
+static void
+mousepad_util_replace_block (GtkTextBuffer       *buffer,
+                             MousepadUtilSegment *segment,
+                             GtkTextIter         *iter,
+                             gsize               *copied,
+                             gsize                block_start,
+                             gsize                block_end,
+                             GString             *output)
+{
+  GtkTextIter block_iter;
+
+  /* walk over the text in front of the block, it is not changed */
+  gtk_text_iter_forward_chars (iter, g_utf8_pointer_to_offset (segment->text + *copied,
+                                                               segment->text + block_start));
+  block_iter = *iter;
+  gtk_text_iter_forward_chars (&block_iter, g_utf8_pointer_to_offset (segment->text + block_start,
+                                                                      segment->text + block_end));
+
+  /* swap the matches for the new text, the iter ends up after it */
+  if (block_start < block_end)
+    gtk_text_buffer_delete (buffer, iter, &block_iter);
+  if (output->len > 0)
+    gtk_text_buffer_insert (buffer, iter, output->str, output->len);
+
+  *copied = block_end;
+  g_string_truncate (output, 0);
+}
+
+
+
+static gint
+mousepad_util_replace_all (GtkTextBuffer      *buffer,
+                           MousepadTextSearch *search,
+                           const GtkTextIter  *start,
+                           const GtkTextIter  *end)
+{
+  MousepadUtilSegment  segment;
+  GtkTextIter          area_start, area_end, iter;
+  GtkTextMark         *mark_end;
+  GString             *output;
+  gint                 offset, limit_offset, last, match_limit;
+  gint                 size = MOUSEPAD_UTIL_SEARCH_SEGMENT_MAX;
+  gint                 overlap, counter = 0;
+  gsize                from, copied, last_byte, limit_byte;
+  gsize                start_byte, end_byte, block_start = 0, block_end = 0;
+  gboolean             in_block;
+
+  /* the iters are reversed for backwards searching, replace in text order */
+  area_start = *start;
+  area_end = *end;
+  gtk_text_iter_order (&area_start, &area_end);
+
+  /* the end of the area moves with the replacements */
+  mark_end = gtk_text_buffer_create_mark (buffer, NULL, &area_end, FALSE);
+  offset = gtk_text_iter_get_offset (&area_start);
+  overlap = mousepad_text_search_get_max_chars (search) - 1;
+
+  /* a regular expression can match any length, look at the whole area at once */
+  if (overlap < 0)
     {
-      /* search for the next occurence of the string */
-      found = mousepad_util_search_iter (&iter, string, flags, &match_start, &match_end, &end);
+      size = MAX (gtk_text_iter_get_offset (&area_end) - offset, 1);
+      overlap = 0;
+    }
 
-      if (G_LIKELY (found))
+  output = g_string_new (NULL);
+  gtk_text_buffer_begin_user_action (buffer);
+
+  /* replace in the same parts the search copies, the text between the
+   * matches and the marks in it are left alone */
+  while (TRUE)
+    {
+      gtk_text_buffer_get_iter_at_mark (buffer, &area_end, mark_end);
+      limit_offset = gtk_text_iter_get_offset (&area_end);
+      if (offset >= limit_offset)
+        break;
+
+      /* the matches have to start in this part, they can end in the next one */
+      last = MIN (offset + size, limit_offset);
+      match_limit = MIN (last + overlap, limit_offset);
+
+      mousepad_util_segment_init (&segment, buffer, offset, match_limit);
+      mousepad_text_search_set_text (search, segment.text, segment.length);
+      from = copied = mousepad_util_segment_get_byte (&segment, offset);
+      last_byte = mousepad_util_segment_get_byte (&segment, last);
+      limit_byte = mousepad_util_segment_get_byte (&segment, match_limit);
+
+      gtk_text_buffer_get_iter_at_offset (buffer, &iter, offset);
+      in_block = FALSE;
+
+      /* an empty match at the end of the area, like $, is replaced too */
+      while (mousepad_text_search_forward (search, from, limit_byte, &start_byte, &end_byte)
+             && (start_byte < last_byte || (start_byte == last_byte && last == limit_offset)))
         {
-          /* try to extend the cache */
-          if (gtk_text_iter_equal (&cache_end, &match_start))
+          /* a match that does not touch the previous one starts a new block */
+          if (in_block && start_byte != block_end)
             {
-              /* enable caching */
-              cached = TRUE;
+              mousepad_util_replace_block (buffer, &segment, &iter, &copied,
+                                           block_start, block_end, output);
+              in_block = FALSE;
             }
-          else
+
+          if (! in_block)
             {
-              if (cached)
-                {
-                  /* highlight the cached occurences */
-                  gtk_text_buffer_apply_tag (buffer, tag, &cache_start, &cache_end);
+              block_start = start_byte;
+              in_block = TRUE;
+            }
 
-                  /* cache is flushed */
-                  cached = FALSE;
-                }
+          g_string_append (output, mousepad_text_search_get_replacement (search));
+          from = block_end = end_byte;
+          counter++;
+        }
 
-              /* highlight the matched occurence */
-              gtk_text_buffer_apply_tag (buffer, tag, &match_start, &match_end);
+      if (in_block)
+        mousepad_util_replace_block (buffer, &segment, &iter, &copied,
+                                     block_start, block_end, output);
 
-              /* set the new cache start iter */
-              cache_start = match_start;
-            }
+      /* continue after this part, or after the last match when it ran into the next one */
+      gtk_text_iter_forward_chars (&iter, g_utf8_pointer_to_offset (segment.text + copied,
+                                                                    segment.text + MAX (copied, last_byte)));
+      offset = gtk_text_iter_get_offset (&iter);
 
-          /* set the end iters */
-          iter = cache_end = match_end;
+      g_free (segment.text);
+    }
 
-          /* increase the counter */
-          counter++;
-        }
-      else if (G_UNLIKELY (cached))
-        {
-          /* flush the cached iters */
-          gtk_text_buffer_apply_tag (buffer, tag, &cache_start, &cache_end);
-        }
+  gtk_text_buffer_end_user_action (buffer);
+  gtk_text_buffer_delete_mark (buffer, mark_end);
+  g_string_free (output, TRUE);
+
+  return counter;
+}
+
+
+
+static gboolean
+mousepad_util_highlight_match (GtkTextBuffer *buffer,
+                               GtkTextIter   *match_start,
+                               GtkTextIter   *match_end,
+                               gpointer       user_data)
+{
+  MousepadUtilHighlight *highlight = user_data;
+  gint                   first, last;
+
+  /* the match is highlighted with the next part */
+  first = gtk_text_iter_get_offset (match_start);
+  if (first >= highlight->limit)
+    return FALSE;
+
+  last = gtk_text_iter_get_offset (match_end);
+  highlight->first = MIN (highlight->first, first);
+  highlight->last = MAX (highlight->last, last);
+  highlight->counter++;
+
+  /* try to extend the cache */
+  if (highlight->cached && gtk_text_iter_equal (&highlight->cache_end, match_start))
+    {
+      highlight->cache_end = *match_end;
+    }
+  else
+    {
+      /* highlight the cached occurences */
+      if (highlight->cached)
+        gtk_text_buffer_apply_tag (buffer, highlight->tag, &highlight->cache_start, &highlight->cache_end);
+
+      /* start a new cache with the match */
+      highlight->cache_start = *match_start;
+      highlight->cache_end = *match_end;
+      highlight->cached = TRUE;
+    }
+
+  /* highlight all the occurences */
+  return TRUE;
+}
+
+
+
+static void
+mousepad_util_highlight_job_tagged (MousepadUtilHighlightJob *job,
+                                    gint                      first,
+                                    gint                      last)
+{
+  GtkTextIter iter;
+
+  /* remember the part of the buffer that has the tag */
+  if (job->tagged_start == NULL)
+    {
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &iter, first);
+      job->tagged_start = gtk_text_buffer_create_mark (job->buffer, NULL, &iter, TRUE);
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &iter, last);
+      job->tagged_end = gtk_text_buffer_create_mark (job->buffer, NULL, &iter, FALSE);
+
+      return;
+    }
+
+  gtk_text_buffer_get_iter_at_mark (job->buffer, &iter, job->tagged_start);
+  if (first < gtk_text_iter_get_offset (&iter))
+    {
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &iter, first);
+      gtk_text_buffer_move_mark (job->buffer, job->tagged_start, &iter);
+    }
+
+  gtk_text_buffer_get_iter_at_mark (job->buffer, &iter, job->tagged_end);
+  if (last > gtk_text_iter_get_offset (&iter))
+    {
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &iter, last);
+      gtk_text_buffer_move_mark (job->buffer, job->tagged_end, &iter);
+    }
+}
+
+
+
+static void
+mousepad_util_highlight_job_untag (MousepadUtilHighlightJob *job,
+                                   gint                      from,
+                                   gint                      to)
+{
+  GtkTextIter start, end;
+
+  if (job->tagged_start == NULL)
+    return;
+
+  /* only look at the part that was tagged before */
+  gtk_text_buffer_get_iter_at_mark (job->buffer, &start, job->tagged_start);
+  gtk_text_buffer_get_iter_at_mark (job->buffer, &end, job->tagged_end);
+  from = MAX (from, gtk_text_iter_get_offset (&start));
+  to = MIN (to, gtk_text_iter_get_offset (&end));
+
+  if (from < to)
+    {
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &start, from);
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &end, to);
+      gtk_text_buffer_remove_tag (job->buffer, job->tag, &start, &end);
+    }
+}
+
+
+
+static void
+mousepad_util_highlight_job_forget (MousepadUtilHighlightJob *job)
+{
+  /* drop the marks, the tags stay where they are */
+  if (job->tagged_start != NULL)
+    {
+      gtk_text_buffer_delete_mark (job->buffer, job->tagged_start);
+      gtk_text_buffer_delete_mark (job->buffer, job->tagged_end);
+      job->tagged_start = job->tagged_end = NULL;
+    }
+}
+
+
+
+static void
+mousepad_util_highlight_job_clear (MousepadUtilHighlightJob *job)
+{
+  mousepad_util_highlight_job_untag (job, 0, G_MAXINT);
+  mousepad_util_highlight_job_forget (job);
+}
+
+
+
+static gint
+mousepad_util_highlight_job_range (MousepadUtilHighlightJob *job,
+                                   gint                      from,
+                                   gint                      to)
+{
+  MousepadUtilHighlight highlight;
+  GtkTextIter           start, limit;
+  GtkTextIter           match_start, match_end;
+  gint                  max_chars;
+
+  /* the old tags in this part go, the matches of the new search get them */
+  mousepad_util_highlight_job_untag (job, from, to);
+
+  /* matches can end in the next part, a string at most its length after this
+   * one and a regular expression anywhere in the lines of the next part,
+   * the matches that start there are dropped */
+  max_chars = mousepad_text_search_get_max_chars (job->search);
+  gtk_text_buffer_get_iter_at_offset (job->buffer, &start, from);
+  if (max_chars > 0)
+    gtk_text_buffer_get_iter_at_offset (job->buffer, &limit, MIN (to + max_chars - 1, job->area_end));
+  else
+    {
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &limit,
+                                          MIN (to + MOUSEPAD_UTIL_HIGHLIGHT_CHUNK, job->area_end));
+      if (! gtk_text_iter_ends_line (&limit))
+        gtk_text_iter_forward_to_line_end (&limit);
+      if (gtk_text_iter_get_offset (&limit) > job->area_end)
+        gtk_text_buffer_get_iter_at_offset (job->buffer, &limit, job->area_end);
+    }
+
+  highlight.tag = job->tag;
+  highlight.cached = FALSE;
+  highlight.limit = to;
+  highlight.counter = 0;
+  highlight.first = G_MAXINT;
+  highlight.last = -1;
+  mousepad_util_search_forward (job->buffer, job->search, &start, &limit, &match_start, &match_end,
+                                mousepad_util_highlight_match, &highlight);
+
+  /* flush the cached iters */
+  if (G_LIKELY (highlight.cached))
+    gtk_text_buffer_apply_tag (job->buffer, job->tag, &highlight.cache_start, &highlight.cache_end);
+
+  if (highlight.counter > 0)
+    {
+      mousepad_util_highlight_job_tagged (job, highlight.first, highlight.last);
+      job->match_first = MIN (job->match_first, highlight.first);
+      job->match_last = MAX (job->match_last, highlight.last);
+    }
+
+  /* a match at the end already took the start of the next part */
+  job->done_start = MIN (job->done_start, from);
+  job->done_end = MAX (job->done_end, MAX (to, highlight.last));
+
+  return highlight.counter;
+}
+
+
+
+static gint
+mousepad_util_highlight_job_viewport (MousepadUtilHighlightJob *job)
+{
+  GdkRectangle rect;
+  GtkTextIter  start, end;
+  gint         from, to;
+
+  /* the lines on the screen */
+  gtk_text_view_get_visible_rect (job->view, &rect);
+  gtk_text_view_get_line_at_y (job->view, &start, rect.y, NULL);
+  gtk_text_view_get_line_at_y (job->view, &end, rect.y + rect.height, NULL);
+  gtk_text_iter_forward_line (&end);
+
+  from = CLAMP (gtk_text_iter_get_offset (&start), job->area_start, job->area_end);
+  to = CLAMP (gtk_text_iter_get_offset (&end), from, job->area_end);
+
+  job->done_start = job->done_end = from;
+
+  return mousepad_util_highlight_job_range (job, from, to);
+}
+
+
+
+static gboolean
+mousepad_util_highlight_job_step (MousepadUtilHighlightJob *job)
+{
+  GtkTextIter iter;
+  gint        from, to;
+
+  /* a part after the highlighted lines, up to the start of a line */
+  if (job->done_end < job->area_end)
+    {
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &iter,
+                                          MIN (job->done_end + MOUSEPAD_UTIL_HIGHLIGHT_CHUNK, job->area_end));
+      if (! gtk_text_iter_starts_line (&iter))
+        gtk_text_iter_forward_line (&iter);
+
+      to = MIN (gtk_text_iter_get_offset (&iter), job->area_end);
+      mousepad_util_highlight_job_range (job, job->done_end, to);
+    }
+
+  /* and one before them */
+  if (job->done_start > job->area_start)
+    {
+      gtk_text_buffer_get_iter_at_offset (job->buffer, &iter,
+                                          MAX (job->done_start - MOUSEPAD_UTIL_HIGHLIGHT_CHUNK, job->area_start));
+      gtk_text_iter_set_line_offset (&iter, 0);
+
+      from = MAX (gtk_text_iter_get_offset (&iter), job->area_start);
+      mousepad_util_highlight_job_range (job, from, job->done_start);
+    }
+
+  return (job->done_start > job->area_start || job->done_end < job->area_end);
+}
+
+
+
+static void
+mousepad_util_highlight_job_reset (MousepadUtilHighlightJob *job)
+{
+  GtkTextIter start, end, iter;
+
+  /* the area as it is now */
+  mousepad_util_search_get_iters (job->buffer, job->flags, &start, &end, &iter);
+  job->area_start = gtk_text_iter_get_offset (&iter);
+  job->area_end = gtk_text_iter_get_offset (&end);
+
+  job->done_start = job->done_end = -1;
+  job->match_first = G_MAXINT;
+  job->match_last = -1;
+}
+
+
+
+static gboolean
+mousepad_util_highlight_job_idle (gpointer user_data)
+{
+  MousepadUtilHighlightJob *job = user_data;
+  gint64                    deadline;
+
+  deadline = g_get_monotonic_time () + MOUSEPAD_UTIL_HIGHLIGHT_SLICE;
+
+  /* start with the lines on the screen after the buffer changed */
+  if (job->done_start < 0)
+    mousepad_util_highlight_job_viewport (job);
+
+  /* grow the highlighted part until our time is up */
+  while (mousepad_util_highlight_job_step (job))
+    if (g_get_monotonic_time () >= deadline)
+      return TRUE;
+
+  /* remove the old tags outside the area, then only the matches keep the tag */
+  mousepad_util_highlight_job_untag (job, 0, job->area_start);
+  mousepad_util_highlight_job_untag (job, job->area_end, G_MAXINT);
+  mousepad_util_highlight_job_forget (job);
+
+  if (job->match_last >= 0)
+    mousepad_util_highlight_job_tagged (job, job->match_first, job->match_last);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_util_highlight_job_idle_destroy (gpointer user_data)
+{
+  ((MousepadUtilHighlightJob *) user_data)->idle_id = 0;
+}
+
+
+
+static void
+mousepad_util_highlight_job_schedule (MousepadUtilHighlightJob *job)
+{
+  if (job->idle_id == 0)
+    job->idle_id = g_idle_add_full (G_PRIORITY_LOW, mousepad_util_highlight_job_idle,
+                                    job, mousepad_util_highlight_job_idle_destroy);
+}
+
+
+
+static void
+mousepad_util_highlight_job_changed (GtkTextBuffer            *buffer,
+                                     MousepadUtilHighlightJob *job)
+{
+  if (job->search == NULL)
+    return;
+
+  /* the offsets are no longer right, start over from the screen */
+  mousepad_util_highlight_job_reset (job);
+  mousepad_util_highlight_job_schedule (job);
+}
+
+
+
+static void
+mousepad_util_highlight_job_free (MousepadUtilHighlightJob *job)
+{
+  if (job->idle_id != 0)
+    g_source_remove (job->idle_id);
+
+  g_signal_handler_disconnect (job->buffer, job->changed_id);
+  mousepad_text_search_free (job->search);
+  mousepad_util_highlight_job_forget (job);
+
+  g_object_unref (job->buffer);
+  g_slice_free (MousepadUtilHighlightJob, job);
+}
+
+
+
+/**
+ * mousepad_util_highlight:
+ *
+ * Tags the matches of @string in the lines on the screen and returns their
+ * number. The rest of the area is highlighted in small parts when the main
+ * loop is idle, starting close to the screen. A new call, or a change in the
+ * buffer, stops the highlight that is still running. With
+ * %MOUSEPAD_SEARCH_FLAGS_ACTION_NONE the highlight only stops.
+ **/
+gint
+mousepad_util_highlight (GtkTextView         *view,
+                         GtkTextTag          *tag,
+                         const gchar         *string,
+                         MousepadSearchFlags  flags)
+{
+  MousepadUtilHighlightJob *job;
+  MousepadTextSearch       *search = NULL;
+  gint                      counter;
+
+  g_return_val_if_fail (GTK_IS_TEXT_VIEW (view), -1);
+  g_return_val_if_fail (GTK_IS_TEXT_TAG (tag), -1);
+  g_return_val_if_fail (string == NULL || g_utf8_validate (string, -1, NULL), -1);
+  g_return_val_if_fail ((flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD) == 0, -1);
+
+  job = mousepad_object_get_data (G_OBJECT (view), "highlight-job");
+  if (G_UNLIKELY (job == NULL))
+    {
+      /* the highlight state of the view */
+      job = g_slice_new0 (MousepadUtilHighlightJob);
+      job->view = view;
+      job->buffer = g_object_ref (gtk_text_view_get_buffer (view));
+      job->changed_id = g_signal_connect (G_OBJECT (job->buffer), "changed",
+                                          G_CALLBACK (mousepad_util_highlight_job_changed), job);
+      mousepad_object_set_data_full (G_OBJECT (view), "highlight-job", job, mousepad_util_highlight_job_free);
     }
-  while (G_LIKELY (found));
+
+  /* stop the running highlight */
+  if (job->idle_id != 0)
+    g_source_remove (job->idle_id);
+
+  mousepad_text_search_free (job->search);
+  job->search = NULL;
+  job->tag = tag;
+
+  /* only stop, the tags are removed by the next highlight */
+  if (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_NONE)
+    return 0;
+
+  /* prepare the new search */
+  if (string != NULL && *string != '\0' && (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_CLEANUP) == 0)
+    search = mousepad_util_search_new (string, flags);
+
+  if (search == NULL)
+    {
+      /* remove the tags from where they were applied */
+      mousepad_util_highlight_job_clear (job);
+
+      return (string != NULL && *string != '\0' && (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_CLEANUP) == 0) ? -1 : 0;
+    }
+
+  job->search = search;
+  job->flags = flags;
+  mousepad_util_highlight_job_reset (job);
+
+  /* the lines on the screen right away, the rest when we're idle */
+  counter = mousepad_util_highlight_job_viewport (job);
+  mousepad_util_highlight_job_schedule (job);
 
   return counter;
 }
@@ -903,7 +1644,7 @@ mousepad_util_search (GtkTextBuffer       *buffer,
                       const gchar         *replace,
                       MousepadSearchFlags  flags)
 {
-  gchar       *reversed = NULL;
+  MousepadTextSearch *search = NULL;
   gint         counter = 0;
   gboolean     found, search_again = FALSE;
   gboolean     search_backwards, wrap_around;
@@ -935,19 +1676,40 @@ mousepad_util_search (GtkTextBuffer       *buffer,
   if (string == NULL || *string == '\0')
     goto reset_cursor;
 
-  if (search_backwards)
+  /* prepare the search, it is used for every match */
+  search = mousepad_util_search_new (string, flags);
+  if (G_UNLIKELY (search == NULL))
+    {
+      counter = -1;
+      goto reset_cursor;
+    }
+
+  if (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE)
     {
-      /* reverse the search string */
-      reversed = g_utf8_strreverse (string, -1);
+      /* the replacement can refer to the groups of a regular expression */
+      if (! mousepad_text_search_set_replacement (search, replace, NULL))
+        {
+          counter = -1;
+          goto reset_cursor;
+        }
+
+      /* replace all the matches in the area at once */
+      if (flags & MOUSEPAD_SEARCH_FLAGS_ENTIRE_AREA)
+        {
+          counter = mousepad_util_replace_all (buffer, search, &start, &end);
+
+          /* restore the begin and end iters */
+          gtk_text_buffer_get_iter_at_mark (buffer, &start, mark_start);
+          gtk_text_buffer_get_iter_at_mark (buffer, &end, mark_end);
 
-      /* set the new search string */
-      string = reversed;
+          goto finished;
+        }
     }
 
   do
     {
       /* search the string */
-      found = mousepad_util_search_iter (&iter, string, flags, &match_start, &match_end, &end);
+      found = mousepad_util_search_iter (&iter, search, flags, &match_start, &match_end, &end);
 
       /* don't search again unless changed below */
       search_again = FALSE;
@@ -957,6 +1719,16 @@ mousepad_util_search (GtkTextBuffer       *buffer,
           /* handle the action */
           if (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT)
             {
+              /* an empty match at the iter is where the cursor already is, look further */
+              if (! search_backwards
+                  && gtk_text_iter_equal (&match_start, &match_end)
+                  && gtk_text_iter_equal (&match_start, &iter)
+                  && gtk_text_iter_forward_char (&iter))
+                {
+                  search_again = TRUE;
+                  continue;
+                }
+
               /* select the match */
               if (! search_backwards)
                 gtk_text_buffer_select_range (buffer, &match_start, &match_end);
@@ -975,8 +1747,7 @@ mousepad_util_search (GtkTextBuffer       *buffer,
               gtk_text_buffer_get_iter_at_mark (buffer, &iter, mark_replace);
 
               /* insert the replacement */
-              if (G_LIKELY (replace))
-                gtk_text_buffer_insert (buffer, &iter, replace, -1);
+              gtk_text_buffer_insert (buffer, &iter, mousepad_text_search_get_replacement (search), -1);
 
               /* remove the mark */
               gtk_text_buffer_delete_mark (buffer, mark_replace);
@@ -998,8 +1769,11 @@ mousepad_util_search (GtkTextBuffer       *buffer,
               if (flags & MOUSEPAD_SEARCH_FLAGS_ENTIRE_AREA)
                 search_again = TRUE;
 
-              /* move iter */
+              /* move iter, past an empty match */
               iter = match_end;
+              if (gtk_text_iter_equal (&match_start, &match_end)
+                  && ! (search_backwards ? gtk_text_iter_backward_char (&iter) : gtk_text_iter_forward_char (&iter)))
+                search_again = FALSE;
             }
           else
             {
@@ -1038,12 +1812,14 @@ mousepad_util_search (GtkTextBuffer       *buffer,
     }
   while (search_again);
 
+  finished:
+
   /* make sure the selection is restored */
   if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION)
     gtk_text_buffer_select_range (buffer, &start, &end);
 
   /* cleanup */
-  g_free (reversed);
+  mousepad_text_search_free (search);
 
   /* cleanup marks */
   gtk_text_buffer_delete_mark (buffer, mark_start);
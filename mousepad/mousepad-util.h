@@ -45,6 +45,7 @@ typedef enum
   MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND       = 1 << 10, /* wrap around */
   MOUSEPAD_SEARCH_FLAGS_ENTIRE_AREA       = 1 << 11, /* keep searching until the end of the area is reached */
   MOUSEPAD_SEARCH_FLAGS_ALL_DOCUMENTS     = 1 << 12, /* search all documents */
+  MOUSEPAD_SEARCH_FLAGS_REGEX             = 1 << 18, /* the string is a regular expression */
 
 
   /* actions */
@@ -56,6 +57,11 @@ typedef enum
 }
 MousepadSearchFlags;
 
+typedef gboolean (*MousepadUtilMatchFunc) (GtkTextBuffer *buffer,
+                                           GtkTextIter   *match_start,
+                                           GtkTextIter   *match_end,
+                                           gpointer       user_data);
+
 gboolean   mousepad_util_iter_starts_word                 (const GtkTextIter   *iter);
 
 gboolean   mousepad_util_iter_ends_word                   (const GtkTextIter   *iter);
@@ -105,11 +111,19 @@ void       mousepad_util_save_key_file                    (GKeyFile            *
 
 GType      mousepad_util_search_flags_get_type            (void) G_GNUC_CONST;
 
-gint       mousepad_util_highlight                        (GtkTextBuffer       *buffer,
+gint       mousepad_util_highlight                        (GtkTextView         *view,
                                                            GtkTextTag          *tag,
                                                            const gchar         *string,
                                                            MousepadSearchFlags  flags);
 
+gint       mousepad_util_search_foreach                   (GtkTextBuffer         *buffer,
+                                                           const gchar           *string,
+                                                           MousepadSearchFlags    flags,
+                                                           const GtkTextIter     *start,
+                                                           const GtkTextIter     *end,
+                                                           MousepadUtilMatchFunc  func,
+                                                           gpointer               user_data);
+
 gint       mousepad_util_search                           (GtkTextBuffer       *buffer,
                                                            const gchar         *string,
                                                            const gchar         *replace,
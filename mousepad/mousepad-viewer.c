@@ -0,0 +1,1203 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-viewer.h>
+#include <mousepad/mousepad-piece-table.h>
+
+#include <gtksourceview/gtksourcebuffer.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+
+
+/* the part of the file shown in the buffer */
+#define MOUSEPAD_VIEWER_WINDOW_LINES (2000)
+#define MOUSEPAD_VIEWER_WINDOW_SIZE  (1024 * 1024)
+
+/* the line index stores the offset of every n-th line */
+#define MOUSEPAD_VIEWER_INDEX_STEP   (256)
+
+/* number of bytes scanned before the pages are given back */
+#define MOUSEPAD_VIEWER_CHUNK_SIZE   (4 * 1024 * 1024)
+
+
+
+typedef struct _MousepadViewerLine MousepadViewerLine;
+
+struct _MousepadViewerLine
+{
+  /* a line and the offset it starts at */
+  guint64 line;
+  guint64 offset;
+};
+
+struct _MousepadViewer
+{
+  /* the view we show the file in */
+  GtkTextView        *textview;
+  GtkTextBuffer      *buffer;
+  GtkAdjustment      *vadjustment;
+
+  /* byte offsets of the lines in the buffer */
+  MousepadLineIndex  *line_index;
+
+  /* the memory mapped file, as it was opened */
+  GMappedFile        *mapped_file;
+  const gchar        *contents;
+  guint64             size;
+
+  /* the document, the file with the edits of the user */
+  MousepadPieceTable *table;
+  guint64             length;
+
+  /* the piece we looked at last */
+  const gchar        *span;
+  guint64             span_start;
+  gsize               span_length;
+
+  /* the bytes of the document in the buffer, start lies in line first_line */
+  guint64             start;
+  guint64             end;
+  guint64             first_line;
+
+  /* the window was changed to show it, so it can't be edited */
+  gboolean            sanitized;
+
+  /* moving the window after the user scrolled */
+  guint               scroll_id;
+  gboolean            loading;
+
+  /* sparse line index, filled by the index thread */
+  GThread            *thread;
+  GMutex              mutex;
+  GArray             *index;
+  guint64             n_lines;
+  gboolean            complete;
+  guint               complete_id;
+  volatile gint       cancelled;
+};
+
+
+
+static void
+mousepad_viewer_release_data (MousepadViewer *viewer,
+                              const gchar    *data,
+                              gsize           length)
+{
+#if defined (HAVE_SYS_MMAN_H) && defined (MADV_DONTNEED)
+  gsize page_size = sysconf (_SC_PAGESIZE);
+  gsize begin, end;
+
+  /* only the mapping, the pages of the add buffer are not backed by the file */
+  if (data < viewer->contents || data >= viewer->contents + viewer->size)
+    return;
+
+  /* the mapping is read-only, dropped pages are read again from the file */
+  begin = (((gsize) data) + page_size - 1) & ~(page_size - 1);
+  end = ((gsize) (data + length)) & ~(page_size - 1);
+
+  if (begin < end)
+    madvise ((gpointer) begin, end - begin, MADV_DONTNEED);
+#endif
+}
+
+
+
+static const gchar *
+mousepad_viewer_get_span (MousepadViewer *viewer,
+                          guint64         offset,
+                          gsize          *length)
+{
+  /* lookup the piece, unless it's the one we looked at last */
+  if (offset < viewer->span_start || offset - viewer->span_start >= viewer->span_length)
+    viewer->span = mousepad_piece_table_get_span (viewer->table, offset, &viewer->span_start, &viewer->span_length);
+
+  /* the bytes from offset to the end of the piece */
+  if (length != NULL)
+    *length = viewer->span_length - (offset - viewer->span_start);
+
+  return viewer->span + (offset - viewer->span_start);
+}
+
+
+
+static gchar
+mousepad_viewer_get_byte (MousepadViewer *viewer,
+                          guint64         offset)
+{
+  return *mousepad_viewer_get_span (viewer, offset, NULL);
+}
+
+
+
+static void
+mousepad_viewer_release (MousepadViewer *viewer,
+                         guint64         from,
+                         guint64         to)
+{
+  const gchar *data;
+  gsize        length;
+
+  for (; from < to; from += length)
+    {
+      data = mousepad_viewer_get_span (viewer, from, &length);
+      length = MIN (length, to - from);
+
+      mousepad_viewer_release_data (viewer, data, length);
+    }
+}
+
+
+
+static void
+mousepad_viewer_update_editable (MousepadViewer *viewer)
+{
+  gboolean complete;
+
+  g_mutex_lock (&viewer->mutex);
+  complete = viewer->complete;
+  g_mutex_unlock (&viewer->mutex);
+
+  /* the index has to be complete to follow the edits, and a window we
+   * changed to show it would write the changes back to the file */
+  gtk_text_view_set_editable (viewer->textview, complete && ! viewer->sanitized);
+}
+
+
+
+static gboolean
+mousepad_viewer_index_complete (gpointer user_data)
+{
+  MousepadViewer *viewer = user_data;
+
+  g_mutex_lock (&viewer->mutex);
+  viewer->complete_id = 0;
+  g_mutex_unlock (&viewer->mutex);
+
+  /* the index can follow edits now */
+  mousepad_viewer_update_editable (viewer);
+
+  return FALSE;
+}
+
+
+
+static gpointer
+mousepad_viewer_index_thread (gpointer user_data)
+{
+  MousepadViewer     *viewer = user_data;
+  GArray             *lines;
+  MousepadViewerLine  entry;
+  const gchar        *p, *end;
+  guint64             offset, next, n_lines = 1;
+
+  lines = g_array_new (FALSE, FALSE, sizeof (MousepadViewerLine));
+
+  /* nothing is edited before the index is complete, so we read the mapping */
+  for (offset = 0; offset < viewer->size; offset = next)
+    {
+      if (g_atomic_int_get (&viewer->cancelled))
+        break;
+
+      next = MIN (offset + MOUSEPAD_VIEWER_CHUNK_SIZE, viewer->size);
+
+      /* collect the start of every n-th line in this chunk */
+      p = viewer->contents + offset;
+      end = viewer->contents + next;
+      while ((p = memchr (p, '\n', end - p)) != NULL)
+        {
+          p++;
+
+          if (n_lines++ % MOUSEPAD_VIEWER_INDEX_STEP == 0)
+            {
+              entry.line = n_lines - 1;
+              entry.offset = p - viewer->contents;
+              g_array_append_val (lines, entry);
+            }
+        }
+
+      /* publish the chunk */
+      g_mutex_lock (&viewer->mutex);
+      g_array_append_vals (viewer->index, lines->data, lines->len);
+      viewer->n_lines = n_lines;
+      g_mutex_unlock (&viewer->mutex);
+
+      g_array_set_size (lines, 0);
+
+      /* don't keep the scanned pages in memory */
+      mousepad_viewer_release_data (viewer, viewer->contents + offset, next - offset);
+    }
+
+  g_mutex_lock (&viewer->mutex);
+  viewer->complete = (offset >= viewer->size);
+  if (viewer->complete)
+    viewer->complete_id = g_idle_add (mousepad_viewer_index_complete, viewer);
+  g_mutex_unlock (&viewer->mutex);
+
+  g_array_free (lines, TRUE);
+
+  return NULL;
+}
+
+
+
+static guint
+mousepad_viewer_index_find (MousepadViewer *viewer,
+                            guint64         line,
+                            guint64         offset)
+{
+  MousepadViewerLine *entry;
+  guint               lower = 0, upper, middle;
+
+  /* the last entry before line, or before offset if line is G_MAXUINT64 */
+  upper = viewer->index->len;
+  while (upper - lower > 1)
+    {
+      middle = (lower + upper) / 2;
+      entry = &g_array_index (viewer->index, MousepadViewerLine, middle);
+
+      if (line != G_MAXUINT64 ? entry->line <= line : entry->offset <= offset)
+        lower = middle;
+      else
+        upper = middle;
+    }
+
+  return lower;
+}
+
+
+
+static void
+mousepad_viewer_index_replace (MousepadViewer *viewer,
+                               guint64         offset,
+                               guint64         length,
+                               guint64         new_length,
+                               gint64          delta_lines)
+{
+  MousepadViewerLine *entry;
+  guint               first, last, n;
+
+  g_mutex_lock (&viewer->mutex);
+
+  /* the lines starting in the replaced range, or right after it, are gone */
+  first = mousepad_viewer_index_find (viewer, G_MAXUINT64, offset) + 1;
+  for (last = first; last < viewer->index->len; last++)
+    if (g_array_index (viewer->index, MousepadViewerLine, last).offset > offset + length)
+      break;
+
+  g_array_remove_range (viewer->index, first, last - first);
+
+  /* move the lines after it */
+  for (n = first; n < viewer->index->len; n++)
+    {
+      entry = &g_array_index (viewer->index, MousepadViewerLine, n);
+      entry->line += delta_lines;
+      entry->offset = entry->offset - length + new_length;
+    }
+
+  viewer->n_lines += delta_lines;
+
+  g_mutex_unlock (&viewer->mutex);
+}
+
+
+
+static guint64
+mousepad_viewer_count_lines (MousepadViewer *viewer,
+                             guint64         from,
+                             guint64         to)
+{
+  const gchar *data, *p, *end;
+  guint64      n_lines = 0;
+  gsize        length;
+
+  for (; from < to; from += length)
+    {
+      data = mousepad_viewer_get_span (viewer, from, &length);
+      length = MIN (length, MIN (to - from, MOUSEPAD_VIEWER_CHUNK_SIZE));
+
+      for (p = data, end = data + length; (p = memchr (p, '\n', end - p)) != NULL; p++)
+        n_lines++;
+
+      mousepad_viewer_release_data (viewer, data, length);
+    }
+
+  return n_lines;
+}
+
+
+
+static guint64
+mousepad_viewer_skip_lines (MousepadViewer *viewer,
+                            guint64         offset,
+                            guint64         limit,
+                            guint          *n_lines)
+{
+  const gchar *data, *p;
+  gsize        length;
+
+  /* go past n_lines line ends before limit, n_lines is what's left */
+  while (*n_lines > 0 && offset < limit)
+    {
+      data = mousepad_viewer_get_span (viewer, offset, &length);
+      length = MIN (length, limit - offset);
+
+      p = memchr (data, '\n', length);
+      if (p == NULL)
+        {
+          offset += length;
+          continue;
+        }
+
+      offset += p - data + 1;
+      (*n_lines)--;
+    }
+
+  return offset;
+}
+
+
+
+static gboolean
+mousepad_viewer_get_line_start (MousepadViewer *viewer,
+                                guint64         line,
+                                guint64        *offset)
+{
+  MousepadViewerLine entry;
+  guint              n;
+
+  g_mutex_lock (&viewer->mutex);
+
+  /* the line is not indexed yet */
+  if (line >= viewer->n_lines)
+    {
+      g_mutex_unlock (&viewer->mutex);
+      return FALSE;
+    }
+
+  entry = g_array_index (viewer->index, MousepadViewerLine, mousepad_viewer_index_find (viewer, line, 0));
+
+  g_mutex_unlock (&viewer->mutex);
+
+  /* walk the remaining lines */
+  n = line - entry.line;
+  *offset = mousepad_viewer_skip_lines (viewer, entry.offset, viewer->length, &n);
+
+  return TRUE;
+}
+
+
+
+static guint64
+mousepad_viewer_get_line_at (MousepadViewer *viewer,
+                             guint64         offset)
+{
+  MousepadViewerLine entry;
+
+  g_mutex_lock (&viewer->mutex);
+  entry = g_array_index (viewer->index, MousepadViewerLine, mousepad_viewer_index_find (viewer, G_MAXUINT64, offset));
+  g_mutex_unlock (&viewer->mutex);
+
+  /* count the lines from there, the index might still be behind */
+  return entry.line + mousepad_viewer_count_lines (viewer, entry.offset, offset);
+}
+
+
+
+static guint64
+mousepad_viewer_char_start (MousepadViewer *viewer,
+                            guint64         offset)
+{
+  guint n;
+
+  /* step back over at most 3 utf-8 continuation bytes */
+  for (n = 0; n < 3 && offset > 0 && offset < viewer->length; n++)
+    {
+      if ((mousepad_viewer_get_byte (viewer, offset) & 0xc0) != 0x80)
+        break;
+
+      offset--;
+    }
+
+  return offset;
+}
+
+
+
+static guint64
+mousepad_viewer_back_up (MousepadViewer *viewer,
+                         guint64         offset,
+                         guint           n_lines,
+                         gsize           size)
+{
+  guint64 limit;
+
+  limit = offset > size ? offset - size : 0;
+
+  /* go back to the start of the n-th line before offset, or as far as allowed */
+  for (; offset > limit; offset--)
+    if (mousepad_viewer_get_byte (viewer, offset - 1) == '\n' && n_lines-- == 0)
+      return offset;
+
+  return mousepad_viewer_char_start (viewer, offset);
+}
+
+
+
+static guint64
+mousepad_viewer_forward (MousepadViewer *viewer,
+                         guint64         offset,
+                         guint           n_lines,
+                         gsize           size)
+{
+  guint64 limit, end;
+
+  limit = MIN (offset + size, viewer->length);
+
+  /* go to the end of the n-th line after offset */
+  end = mousepad_viewer_skip_lines (viewer, offset, limit, &n_lines);
+  if (n_lines == 0)
+    return end;
+
+  /* cut a long line at a character boundary, keeping cr+lf together */
+  if (limit < viewer->length)
+    {
+      limit = mousepad_viewer_char_start (viewer, limit);
+
+      if (limit > offset + 1
+          && mousepad_viewer_get_byte (viewer, limit) == '\n'
+          && mousepad_viewer_get_byte (viewer, limit - 1) == '\r')
+        limit--;
+    }
+
+  return limit;
+}
+
+
+
+static gboolean
+mousepad_viewer_sanitize (gchar *text,
+                          gsize  length)
+{
+  const gchar *p = text, *end;
+  gchar       *s;
+  gboolean     changed = FALSE;
+
+  /* replace all bytes that are not valid utf-8 (including nul bytes) */
+  while (! g_utf8_validate (p, text + length - p, &end))
+    {
+      *(gchar *) end = '?';
+      p = end + 1;
+      changed = TRUE;
+    }
+
+  /* the buffer also breaks lines on cr and u+2029, we only break on lf, so
+   * replace those, each byte by one character to keep the offsets equal */
+  for (s = text; s < text + length; s++)
+    {
+      if (*s == '\r' && (s + 1 == text + length || s[1] != '\n'))
+        {
+          *s = '?';
+          changed = TRUE;
+        }
+      else if (*s == '\xe2' && s + 2 < text + length && s[1] == '\x80' && s[2] == '\xa9')
+        {
+          s[0] = s[1] = s[2] = '?';
+          changed = TRUE;
+        }
+    }
+
+  return changed;
+}
+
+
+
+static guint64
+mousepad_viewer_count_line_ends (const gchar *text,
+                                 gsize        length)
+{
+  const gchar *p, *end;
+  guint64      n_lines = 0;
+
+  for (p = text, end = text + length; (p = memchr (p, '\n', end - p)) != NULL; p++)
+    n_lines++;
+
+  return n_lines;
+}
+
+
+
+static void
+mousepad_viewer_replace (MousepadViewer *viewer,
+                         guint64         offset,
+                         guint64         length,
+                         const gchar    *text,
+                         gsize           text_length)
+{
+  gint64 delta_lines;
+
+  /* never write back the text we changed to show it */
+  if (G_UNLIKELY (viewer->sanitized))
+    return;
+
+  delta_lines = (gint64) mousepad_viewer_count_line_ends (text, text_length)
+                - (gint64) mousepad_viewer_count_lines (viewer, offset, offset + length);
+
+  /* the table only grows with the inserted text */
+  mousepad_piece_table_replace (viewer->table, offset, length, text, text_length);
+  mousepad_viewer_index_replace (viewer, offset, length, text_length, delta_lines);
+
+  /* the pieces changed */
+  viewer->end = viewer->end - length + text_length;
+  viewer->length = mousepad_piece_table_get_length (viewer->table);
+  viewer->span_length = 0;
+}
+
+
+
+static void
+mousepad_viewer_insert_text (GtkTextBuffer  *buffer,
+                             GtkTextIter    *location,
+                             const gchar    *text,
+                             gint            length,
+                             MousepadViewer *viewer)
+{
+  /* put the edits of the user in the document, the buffer is not
+   * changed yet so the location is the offset before the insert */
+  if (! viewer->loading && length > 0)
+    mousepad_viewer_replace (viewer, mousepad_viewer_get_iter_offset (viewer, location), 0, text, length);
+}
+
+
+
+static void
+mousepad_viewer_delete_range (GtkTextBuffer  *buffer,
+                              GtkTextIter    *start,
+                              GtkTextIter    *end,
+                              MousepadViewer *viewer)
+{
+  guint64 from, to;
+
+  if (viewer->loading)
+    return;
+
+  from = mousepad_viewer_get_iter_offset (viewer, start);
+  to = mousepad_viewer_get_iter_offset (viewer, end);
+
+  mousepad_viewer_replace (viewer, MIN (from, to), MAX (from, to) - MIN (from, to), "", 0);
+}
+
+
+
+static void
+mousepad_viewer_load_window (MousepadViewer *viewer,
+                             guint64         start,
+                             guint64         first_line)
+{
+  gchar    *text;
+  gsize     length;
+  gboolean  modified;
+
+  viewer->start = start;
+  viewer->end = mousepad_viewer_forward (viewer, start, MOUSEPAD_VIEWER_WINDOW_LINES, MOUSEPAD_VIEWER_WINDOW_SIZE);
+  viewer->first_line = first_line;
+
+  /* copy the window out of the document and make it valid for the buffer */
+  length = viewer->end - viewer->start;
+  text = g_malloc (length + 1);
+  mousepad_piece_table_read (viewer->table, viewer->start, length, text);
+  text[length] = '\0';
+  viewer->sanitized = mousepad_viewer_sanitize (text, length);
+
+  /* replace the buffer contents, which can not be undone and doesn't
+   * change whether the document has unsaved edits */
+  modified = gtk_text_buffer_get_modified (viewer->buffer);
+  viewer->loading = TRUE;
+  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (viewer->buffer));
+  gtk_text_buffer_set_text (viewer->buffer, text, length);
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (viewer->buffer));
+  gtk_text_buffer_set_modified (viewer->buffer, modified);
+  viewer->loading = FALSE;
+
+  mousepad_viewer_update_editable (viewer);
+
+  /* the buffer has its own copy now */
+  mousepad_viewer_release (viewer, viewer->start, viewer->end);
+  g_free (text);
+}
+
+
+
+static void
+mousepad_viewer_move_to (MousepadViewer *viewer,
+                         guint64         offset,
+                         guint64         line)
+{
+  guint64 start;
+
+  /* put offset, which lies in line, in the middle of the window */
+  start = mousepad_viewer_back_up (viewer, offset, MOUSEPAD_VIEWER_WINDOW_LINES / 2, MOUSEPAD_VIEWER_WINDOW_SIZE / 2);
+
+  if (start != viewer->start || viewer->end <= offset)
+    mousepad_viewer_load_window (viewer, start, line - mousepad_viewer_count_lines (viewer, start, offset));
+}
+
+
+
+static void
+mousepad_viewer_get_iter_at_offset (MousepadViewer *viewer,
+                                    GtkTextIter    *iter,
+                                    guint64         offset)
+{
+  gint line, index;
+
+  offset = CLAMP (offset, viewer->start, viewer->end) - viewer->start;
+
+  /* find the buffer line */
+  line = mousepad_line_index_get_line_at (viewer->line_index, offset, &index);
+
+  gtk_text_buffer_get_iter_at_line_index (viewer->buffer, iter, line, index);
+}
+
+
+
+static gboolean
+mousepad_viewer_near_edge (MousepadViewer *viewer,
+                           gboolean       *down)
+{
+  gdouble  value, upper, page_size, margin;
+  gboolean near_end;
+
+  value = gtk_adjustment_get_value (viewer->vadjustment);
+  upper = gtk_adjustment_get_upper (viewer->vadjustment);
+  page_size = gtk_adjustment_get_page_size (viewer->vadjustment);
+
+  /* whether the user scrolled into the first or last quarter of the window */
+  margin = upper / 4;
+  near_end = (viewer->end < viewer->length && value + page_size > upper - margin);
+
+  if (down != NULL)
+    *down = near_end;
+
+  return (near_end || (viewer->start > 0 && value < margin));
+}
+
+
+
+static gboolean
+mousepad_viewer_scroll_idle (gpointer user_data)
+{
+  MousepadViewer *viewer = user_data;
+  GdkRectangle    rect;
+  GtkTextIter     iter;
+  GtkTextMark    *mark;
+  guint64         cursor, anchor, anchor_line, start;
+  gboolean        down;
+
+  viewer->scroll_id = 0;
+
+  if (! mousepad_viewer_near_edge (viewer, &down))
+    return FALSE;
+
+  /* the text at the top of the view stays in place, this can be in the
+   * middle of a long wrapped line */
+  gtk_text_view_get_visible_rect (viewer->textview, &rect);
+  gtk_text_view_get_iter_at_location (viewer->textview, &iter, 0, rect.y);
+  anchor = mousepad_viewer_get_iter_offset (viewer, &iter);
+  anchor_line = viewer->first_line + gtk_text_iter_get_line (&iter);
+
+  /* remember the cursor */
+  gtk_text_buffer_get_iter_at_mark (viewer->buffer, &iter, gtk_text_buffer_get_insert (viewer->buffer));
+  cursor = mousepad_viewer_get_iter_offset (viewer, &iter);
+
+  /* put the anchor in the middle of the window, unless a long line
+   * keeps the window from moving, then move it by half its size */
+  start = mousepad_viewer_back_up (viewer, anchor, MOUSEPAD_VIEWER_WINDOW_LINES / 2, MOUSEPAD_VIEWER_WINDOW_SIZE / 2);
+  if (down && start <= viewer->start)
+    start = mousepad_viewer_char_start (viewer, viewer->start + (viewer->end - viewer->start) / 2);
+  else if (! down && start >= viewer->start)
+    start = mousepad_viewer_back_up (viewer, viewer->start, MOUSEPAD_VIEWER_WINDOW_LINES / 2, MOUSEPAD_VIEWER_WINDOW_SIZE / 2);
+
+  if (start <= anchor)
+    mousepad_viewer_load_window (viewer, start, anchor_line - mousepad_viewer_count_lines (viewer, start, anchor));
+  else
+    mousepad_viewer_load_window (viewer, start, anchor_line + mousepad_viewer_count_lines (viewer, anchor, start));
+
+  /* restore the cursor, or move it along when it's no longer in the window */
+  mousepad_viewer_get_iter_at_offset (viewer, &iter, cursor >= viewer->start && cursor <= viewer->end ? cursor : anchor);
+  gtk_text_buffer_place_cursor (viewer->buffer, &iter);
+
+  /* scroll the anchor back to the top, or show the side of the window it was on */
+  mousepad_viewer_get_iter_at_offset (viewer, &iter, anchor);
+  mark = gtk_text_buffer_create_mark (viewer->buffer, NULL, &iter, TRUE);
+  gtk_text_view_scroll_to_mark (viewer->textview, mark, 0.0, TRUE, 0.0, anchor > viewer->end ? 1.0 : 0.0);
+  gtk_text_buffer_delete_mark (viewer->buffer, mark);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_viewer_move_cursor (GtkTextView     *textview,
+                             GtkMovementStep  step,
+                             gint             count,
+                             gboolean         extend_selection,
+                             MousepadViewer  *viewer)
+{
+  guint64  n_lines;
+  gboolean complete;
+
+  /* a selection can't reach out of the window, it moves in there */
+  if (step != GTK_MOVEMENT_BUFFER_ENDS || count == 0 || extend_selection)
+    return;
+
+  /* show the first or the last line of the file, then the text view moves
+   * to the start or the end of the buffer as usual */
+  if (count < 0)
+    {
+      if (viewer->start > 0)
+        mousepad_viewer_go_to_line (viewer, 0);
+    }
+  else if (viewer->end < viewer->length)
+    {
+      /* the number of the last line is known when the index is complete */
+      n_lines = mousepad_viewer_get_line_count (viewer, &complete);
+      if (complete)
+        mousepad_viewer_go_to_line (viewer, n_lines - 1);
+    }
+}
+
+
+
+static void
+mousepad_viewer_value_changed (GtkAdjustment  *adjustment,
+                               MousepadViewer *viewer)
+{
+  /* move the window from an idle, so the view finishes scrolling first */
+  if (! viewer->loading && viewer->scroll_id == 0 && mousepad_viewer_near_edge (viewer, NULL))
+    viewer->scroll_id = g_idle_add (mousepad_viewer_scroll_idle, viewer);
+}
+
+
+
+MousepadViewer *
+mousepad_viewer_new (GtkTextView        *textview,
+                     GtkAdjustment      *vadjustment,
+                     MousepadLineIndex  *line_index,
+                     const gchar        *filename,
+                     GError            **error)
+{
+  MousepadViewer     *viewer;
+  MousepadViewerLine  entry = { 0, 0 };
+  GMappedFile        *mapped_file;
+  GtkTextIter         iter;
+
+  g_return_val_if_fail (GTK_IS_TEXT_VIEW (textview), NULL);
+  g_return_val_if_fail (GTK_IS_ADJUSTMENT (vadjustment), NULL);
+  g_return_val_if_fail (line_index != NULL, NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  /* map the file, the pages are only read when we look at them */
+  mapped_file = g_mapped_file_new (filename, FALSE, error);
+  if (G_UNLIKELY (mapped_file == NULL))
+    return NULL;
+
+  viewer = g_slice_new0 (MousepadViewer);
+  viewer->textview = g_object_ref (G_OBJECT (textview));
+  viewer->buffer = g_object_ref (G_OBJECT (gtk_text_view_get_buffer (textview)));
+  viewer->vadjustment = g_object_ref (G_OBJECT (vadjustment));
+  viewer->line_index = line_index;
+  viewer->mapped_file = mapped_file;
+  viewer->contents = g_mapped_file_get_contents (mapped_file);
+  viewer->size = g_mapped_file_get_length (mapped_file);
+
+  /* edits go into a piece table on top of the mapping */
+  viewer->table = mousepad_piece_table_new (mapped_file);
+  viewer->length = viewer->size;
+
+  /* the first line is always known */
+  g_mutex_init (&viewer->mutex);
+  viewer->index = g_array_new (FALSE, FALSE, sizeof (MousepadViewerLine));
+  g_array_append_val (viewer->index, entry);
+  viewer->n_lines = 1;
+
+  /* index the lines in the background */
+  if (viewer->size > 0)
+    viewer->thread = g_thread_new ("mousepad-viewer-index", mousepad_viewer_index_thread, viewer);
+  else
+    viewer->complete = TRUE;
+
+  /* show the start of the file */
+  mousepad_viewer_load_window (viewer, 0, 0);
+  mousepad_viewer_get_iter_at_offset (viewer, &iter, 0);
+  gtk_text_buffer_place_cursor (viewer->buffer, &iter);
+
+  /* put the edits of the user in the piece table */
+  g_signal_connect (G_OBJECT (viewer->buffer), "insert-text",
+                    G_CALLBACK (mousepad_viewer_insert_text), viewer);
+  g_signal_connect (G_OBJECT (viewer->buffer), "delete-range",
+                    G_CALLBACK (mousepad_viewer_delete_range), viewer);
+
+  /* move the window when the user scrolls near its edges */
+  g_signal_connect (G_OBJECT (vadjustment), "value-changed",
+                    G_CALLBACK (mousepad_viewer_value_changed), viewer);
+
+  /* and to the ends of the file for ctrl+home and ctrl+end */
+  g_signal_connect (G_OBJECT (textview), "move-cursor",
+                    G_CALLBACK (mousepad_viewer_move_cursor), viewer);
+
+  return viewer;
+}
+
+
+
+void
+mousepad_viewer_free (MousepadViewer *viewer)
+{
+  /* stop indexing */
+  if (viewer->thread != NULL)
+    {
+      g_atomic_int_set (&viewer->cancelled, TRUE);
+      g_thread_join (viewer->thread);
+    }
+
+  if (viewer->complete_id != 0)
+    g_source_remove (viewer->complete_id);
+
+  if (viewer->scroll_id != 0)
+    g_source_remove (viewer->scroll_id);
+
+  mousepad_disconnect_by_func (G_OBJECT (viewer->vadjustment), mousepad_viewer_value_changed, viewer);
+  mousepad_disconnect_by_func (G_OBJECT (viewer->textview), mousepad_viewer_move_cursor, viewer);
+  mousepad_disconnect_by_func (G_OBJECT (viewer->buffer), mousepad_viewer_insert_text, viewer);
+  mousepad_disconnect_by_func (G_OBJECT (viewer->buffer), mousepad_viewer_delete_range, viewer);
+
+  /* the file or a running save can still use the table */
+  mousepad_piece_table_unref (viewer->table);
+
+  /* cleanup */
+  g_array_free (viewer->index, TRUE);
+  g_mutex_clear (&viewer->mutex);
+
+#if GLIB_CHECK_VERSION (2, 21, 0)
+  g_mapped_file_unref (viewer->mapped_file);
+#else
+  g_mapped_file_free (viewer->mapped_file);
+#endif
+
+  g_object_unref (G_OBJECT (viewer->vadjustment));
+  g_object_unref (G_OBJECT (viewer->buffer));
+  g_object_unref (G_OBJECT (viewer->textview));
+
+  g_slice_free (MousepadViewer, viewer);
+}
+
+
+
+MousepadPieceTable *
+mousepad_viewer_get_piece_table (MousepadViewer *viewer)
+{
+  return viewer->table;
+}
+
+
+
+guint64
+mousepad_viewer_get_line_count (MousepadViewer *viewer,
+                                gboolean       *complete)
+{
+  guint64 n_lines;
+
+  g_mutex_lock (&viewer->mutex);
+  n_lines = viewer->n_lines;
+  if (complete)
+    *complete = viewer->complete;
+  g_mutex_unlock (&viewer->mutex);
+
+  return n_lines;
+}
+
+
+
+guint64
+mousepad_viewer_get_first_line (MousepadViewer *viewer)
+{
+  return viewer->first_line;
+}
+
+
+
+guint64
+mousepad_viewer_get_iter_offset (MousepadViewer    *viewer,
+                                 const GtkTextIter *iter)
+{
+  return viewer->start + mousepad_line_index_get_iter_offset (viewer->line_index, iter);
+}
+
+
+
+gboolean
+mousepad_viewer_go_to_line (MousepadViewer *viewer,
+                            guint64         line)
+{
+  GtkTextIter iter;
+  guint64     offset;
+
+  /* lookup the line in the index */
+  if (! mousepad_viewer_get_line_start (viewer, line, &offset))
+    return FALSE;
+
+  mousepad_viewer_move_to (viewer, offset, line);
+
+  /* put the cursor at the start of the line */
+  mousepad_viewer_get_iter_at_offset (viewer, &iter, offset);
+  gtk_text_buffer_place_cursor (viewer->buffer, &iter);
+
+  return TRUE;
+}
+
+
+
+static gunichar
+mousepad_viewer_get_char (MousepadViewer *viewer,
+                          guint64         offset)
+{
+  gchar    bytes[6];
+  gsize    length;
+  gunichar c;
+
+  /* the character at offset, or 0 if there is no valid one */
+  if (offset >= viewer->length)
+    return 0;
+
+  length = MIN (viewer->length - offset, sizeof (bytes));
+  mousepad_piece_table_read (viewer->table, offset, length, bytes);
+  c = g_utf8_get_char_validated (bytes, length);
+
+  return (c == (gunichar) -1 || c == (gunichar) -2) ? 0 : c;
+}
+
+
+
+static gboolean
+mousepad_viewer_is_word_char (gunichar c)
+{
+  return (c == '_' || g_unichar_isalnum (c));
+}
+
+
+
+static gboolean
+mousepad_viewer_match (MousepadViewer *viewer,
+                       guint64         offset,
+                       const gchar    *string,
+                       gsize           length,
+                       gboolean        match_case,
+                       gboolean        whole_word)
+{
+  const gchar *data;
+  gsize        done, n;
+
+  if (offset + length > viewer->length)
+    return FALSE;
+
+  /* compare the bytes of each piece, without match case only ascii letters are folded */
+  for (done = 0; done < length; done += n)
+    {
+      data = mousepad_viewer_get_span (viewer, offset + done, &n);
+      n = MIN (n, length - done);
+
+      if (match_case ? memcmp (data, string + done, n) != 0
+                     : g_ascii_strncasecmp (data, string + done, n) != 0)
+        return FALSE;
+    }
+
+  /* the match should not start or end inside a word */
+  if (whole_word)
+    {
+      if (offset > 0
+          && mousepad_viewer_is_word_char (mousepad_viewer_get_char (viewer, mousepad_viewer_char_start (viewer, offset - 1))))
+        return FALSE;
+
+      if (mousepad_viewer_is_word_char (mousepad_viewer_get_char (viewer, offset + length)))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_viewer_find (MousepadViewer      *viewer,
+                      const gchar         *string,
+                      gsize                length,
+                      MousepadSearchFlags  flags,
+                      guint64              from,
+                      guint64              to,
+                      guint64             *match)
+{
+  const gchar *data, *p, *end;
+  gboolean     match_case, whole_word, found = FALSE;
+  guint64      chunk_start, chunk_end, offset;
+  gsize        n;
+  gchar        first[3];
+
+  match_case = (flags & MOUSEPAD_SEARCH_FLAGS_MATCH_CASE) != 0;
+  whole_word = (flags & MOUSEPAD_SEARCH_FLAGS_WHOLE_WORD) != 0;
+
+  /* the bytes a match can start with */
+  first[0] = match_case ? string[0] : g_ascii_tolower (string[0]);
+  first[1] = match_case ? string[0] : g_ascii_toupper (string[0]);
+  first[2] = '\0';
+
+  /* matches start in [from, to), look at the file in chunks so we can give back the pages */
+  while (from < to)
+    {
+      if (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
+        {
+          chunk_end = to;
+          chunk_start = to - MIN (to - from, MOUSEPAD_VIEWER_CHUNK_SIZE);
+        }
+      else
+        {
+          chunk_start = from;
+          chunk_end = from + MIN (to - from, MOUSEPAD_VIEWER_CHUNK_SIZE);
+        }
+
+      /* find the first, or when searching backwards the last, match in the chunk */
+      for (offset = chunk_start; offset < chunk_end; offset += n)
+        {
+          data = mousepad_viewer_get_span (viewer, offset, &n);
+          n = MIN (n, chunk_end - offset);
+
+          for (p = data, end = data + n; p < end; p++)
+            {
+              if (*p != first[0] && *p != first[1])
+                {
+                  /* skip to the next candidate */
+                  if (first[0] == first[1])
+                    {
+                      p = memchr (p, first[0], end - p);
+                      if (p == NULL)
+                        break;
+                    }
+                  else
+                    continue;
+                }
+
+              if (mousepad_viewer_match (viewer, offset + (p - data), string, length, match_case, whole_word))
+                {
+                  *match = offset + (p - data);
+                  found = TRUE;
+
+                  if ((flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD) == 0)
+                    break;
+                }
+            }
+
+          if (found && (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD) == 0)
+            break;
+        }
+
+      mousepad_viewer_release (viewer, chunk_start, MIN (chunk_end + length, viewer->length));
+
+      if (found)
+        return TRUE;
+
+      if (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
+        to = chunk_start;
+      else
+        from = chunk_end;
+    }
+
+  return FALSE;
+}
+
+
+
+gboolean
+mousepad_viewer_search (MousepadViewer      *viewer,
+                        const gchar         *string,
+                        MousepadSearchFlags  flags)
+{
+  GtkTextIter sel_start, sel_end;
+  guint64     from, match;
+  gsize       length;
+  gboolean    found;
+
+  g_return_val_if_fail (string != NULL, FALSE);
+
+  length = strlen (string);
+  if (length == 0)
+    return FALSE;
+
+  /* where to start searching */
+  gtk_text_buffer_get_selection_bounds (viewer->buffer, &sel_start, &sel_end);
+
+  if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_AREA_START)
+    from = 0;
+  else if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_AREA_END)
+    from = viewer->length;
+  else if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_SEL_START)
+    from = mousepad_viewer_get_iter_offset (viewer, &sel_start);
+  else
+    from = mousepad_viewer_get_iter_offset (viewer, &sel_end);
+
+  /* search the rest of the file, then wrap around */
+  if (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
+    {
+      found = mousepad_viewer_find (viewer, string, length, flags, 0, from, &match);
+
+      if (! found && (flags & MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND))
+        found = mousepad_viewer_find (viewer, string, length, flags, from, viewer->length, &match);
+    }
+  else
+    {
+      found = mousepad_viewer_find (viewer, string, length, flags, from, viewer->length, &match);
+
+      if (! found && (flags & MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND))
+        found = mousepad_viewer_find (viewer, string, length, flags, 0, from, &match);
+    }
+
+  if (! found)
+    return FALSE;
+
+  /* show the match and select it */
+  if (match < viewer->start || match + length > viewer->end)
+    mousepad_viewer_move_to (viewer, match, mousepad_viewer_get_line_at (viewer, match));
+
+  mousepad_viewer_get_iter_at_offset (viewer, &sel_start, match);
+  mousepad_viewer_get_iter_at_offset (viewer, &sel_end, match + length);
+
+  if (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
+    gtk_text_buffer_select_range (viewer->buffer, &sel_end, &sel_start);
+  else
+    gtk_text_buffer_select_range (viewer->buffer, &sel_start, &sel_end);
+
+  return TRUE;
+}
@@ -0,0 +1,56 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_VIEWER_H__
+#define __MOUSEPAD_VIEWER_H__
+
+#include <gtk/gtk.h>
+#include <mousepad/mousepad-util.h>
+#include <mousepad/mousepad-line-index.h>
+#include <mousepad/mousepad-piece-table.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadViewer MousepadViewer;
+
+MousepadViewer     *mousepad_viewer_new             (GtkTextView         *textview,
+                                                     GtkAdjustment       *vadjustment,
+                                                     MousepadLineIndex   *line_index,
+                                                     const gchar         *filename,
+                                                     GError             **error);
+
+void                mousepad_viewer_free            (MousepadViewer      *viewer);
+
+MousepadPieceTable *mousepad_viewer_get_piece_table (MousepadViewer      *viewer);
+
+guint64             mousepad_viewer_get_line_count  (MousepadViewer      *viewer,
+                                                     gboolean            *complete);
+
+guint64             mousepad_viewer_get_first_line  (MousepadViewer      *viewer);
+
+guint64             mousepad_viewer_get_iter_offset (MousepadViewer      *viewer,
+                                                     const GtkTextIter   *iter);
+
+gboolean            mousepad_viewer_go_to_line      (MousepadViewer      *viewer,
+                                                     guint64              line);
+
+gboolean            mousepad_viewer_search          (MousepadViewer      *viewer,
+                                                     const gchar         *string,
+                                                     MousepadSearchFlags  flags);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_VIEWER_H__ */
@@ -154,6 +154,35 @@ static void              mousepad_window_overwrite_changed            (MousepadD
 static void              mousepad_window_buffer_language_changed      (MousepadDocument       *document,
                                                                        GtkSourceLanguage      *language,
                                                                        MousepadWindow         *window);
+static MousepadDocument *mousepad_window_find_document                (MousepadWindow         *window,
+                                                                       MousepadFile           *file);
+static void              mousepad_window_file_load_finished           (MousepadFile           *file,
+                                                                       gint                    result,
+                                                                       const GError           *error,
+                                                                       MousepadWindow         *window);
+static void              mousepad_window_file_load_failed             (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       gint                    result,
+                                                                       const GError           *error);
+static gboolean          mousepad_window_file_load_failed_idle        (gpointer                user_data);
+static void              mousepad_window_file_save_finished           (MousepadFile           *file,
+                                                                       gboolean                succeed,
+                                                                       const GError           *error,
+                                                                       MousepadWindow         *window);
+static void              mousepad_window_file_reload_finished         (MousepadFile           *file,
+                                                                       gboolean                succeed,
+                                                                       const GError           *error,
+                                                                       MousepadWindow         *window);
+static void              mousepad_window_file_readonly_changed        (MousepadFile           *file,
+                                                                       gboolean                readonly,
+                                                                       MousepadWindow         *window);
+static void              mousepad_window_file_follow_stopped          (MousepadFile           *file,
+                                                                       const GError           *error,
+                                                                       MousepadWindow         *window);
+static void              mousepad_window_save_all_failed              (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       const GError           *error);
+static void              mousepad_window_save_all_report              (MousepadWindow         *window);
 static void              mousepad_window_can_undo                     (MousepadWindow         *window,
                                                                        GParamSpec             *unused,
                                                                        GObject                *buffer);
@@ -341,6 +370,8 @@ static void              mousepad_window_action_word_wrap             (GtkToggle
                                                                        MousepadWindow         *window);
 static void              mousepad_window_action_write_bom             (GtkToggleAction        *action,
                                                                        MousepadWindow         *window);
+static void              mousepad_window_action_follow                (GtkToggleAction        *action,
+                                                                       MousepadWindow         *window);
 static void              mousepad_window_action_prev_tab              (GtkAction              *action,
                                                                        MousepadWindow         *window);
 static void              mousepad_window_action_next_tab              (GtkAction              *action,
@@ -392,6 +423,14 @@ struct _MousepadWindow
   /* idle update functions for the recent and go menu */
   guint                update_recent_menu_id;
   guint                update_go_menu_id;
+
+  /* documents still being written by save all, and the ones that failed */
+  GSList              *save_all_pending;
+  GSList              *save_all_failed;
+
+  /* documents that failed to load, handled from an idle */
+  GSList              *load_failed;
+  guint                load_failed_id;
 };
 
 
@@ -477,7 +516,8 @@ static const GtkToggleActionEntry toggle_action_entries[] =
   { "auto-indent", NULL, N_("_Auto Indent"), NULL, N_("Auto indent a new line"), G_CALLBACK (mousepad_window_action_auto_indent), FALSE, },
   { "insert-spaces", NULL, N_("Insert _Spaces"), NULL, N_("Insert spaces when the tab button is pressed"), G_CALLBACK (mousepad_window_action_insert_spaces), FALSE, },
   { "word-wrap", NULL, N_("_Word Wrap"), NULL, N_("Toggle breaking lines in between words"), G_CALLBACK (mousepad_window_action_word_wrap), FALSE, },
-  { "write-bom", NULL, N_("Write Unicode _BOM"), NULL, N_("Store the byte-order mark in the file"), G_CALLBACK (mousepad_window_action_write_bom), FALSE, }
+  { "write-bom", NULL, N_("Write Unicode _BOM"), NULL, N_("Store the byte-order mark in the file"), G_CALLBACK (mousepad_window_action_write_bom), FALSE, },
+  { "follow", NULL, N_("F_ollow File"), NULL, N_("Append what is written to the file to the document"), G_CALLBACK (mousepad_window_action_follow), FALSE, }
 };
 
 static const GtkRadioActionEntry radio_action_entries[] =
@@ -1100,6 +1140,13 @@ mousepad_window_dispose (GObject *object)
   if (G_UNLIKELY (window->save_geometry_timer_id != 0))
     g_source_remove (window->save_geometry_timer_id);
 
+  /* the documents that failed to load are gone with the window */
+  if (G_UNLIKELY (window->load_failed_id != 0))
+    {
+      g_source_remove (window->load_failed_id);
+      window->load_failed_id = 0;
+    }
+
   (*G_OBJECT_CLASS (mousepad_window_parent_class)->dispose) (object);
 }
 
@@ -1128,6 +1175,11 @@ mousepad_window_finalize (GObject *object)
   /* release the action groups */
   g_object_unref (G_OBJECT (window->action_group));
 
+  /* the documents are gone, forget about a running save all */
+  g_slist_free (window->save_all_pending);
+  g_slist_free (window->save_all_failed);
+  g_slist_free (window->load_failed);
+
   /* free clipboard history if needed */
   if (clipboard_history_ref_count == 0 && clipboard_history != NULL)
     {
@@ -1378,8 +1430,10 @@ mousepad_window_open_file (MousepadWindow   *window,
   const gchar      *opened_filename;
   GtkWidget        *dialog;
   gboolean          encoding_from_recent = FALSE;
+  gboolean          encoding_detected = FALSE;
   gchar            *uri;
   GtkRecentInfo    *info;
+  MousepadEncodingGuess guess;
 
   g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), FALSE);
   g_return_val_if_fail (filename != NULL && *filename != '\0', FALSE);
@@ -1422,6 +1476,63 @@ mousepad_window_open_file (MousepadWindow   *window,
   /* set the passed encoding */
   mousepad_file_set_encoding (document->file, encoding);
 
+  /* only view very large files, the buffer holds the part that is shown */
+  if (mousepad_file_get_prefers_viewer (document->file))
+    {
+      if (G_LIKELY (mousepad_document_open_viewer (document, &error)))
+        {
+          /* add the document to the window */
+          mousepad_window_add (window, document);
+
+          /* insert in the recent history */
+          mousepad_window_recent_add (window, document->file);
+
+          return TRUE;
+        }
+
+      /* something went wrong, release the document */
+      g_object_unref (G_OBJECT (document));
+
+      if (G_LIKELY (error))
+        {
+          /* show the warning */
+          mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to open the document"));
+
+          /* cleanup */
+          g_error_free (error);
+        }
+
+      return FALSE;
+    }
+
+  /* load large files in chunks, so the window stays responsive */
+  if (mousepad_file_get_prefers_streaming (document->file))
+    {
+      result = mousepad_file_open_streaming (document->file, &error);
+
+      if (G_LIKELY (result == 0))
+        {
+          /* add the document to the window, the rest is handled when loading finished */
+          mousepad_window_add (window, document);
+        }
+      else
+        {
+          /* something went wrong, release the document */
+          g_object_unref (G_OBJECT (document));
+
+          if (G_LIKELY (error))
+            {
+              /* show the warning */
+              mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to open the document"));
+
+              /* cleanup */
+              g_error_free (error);
+            }
+        }
+
+      return (result == 0);
+    }
+
   retry:
 
   /* lock the undo manager */
@@ -1484,6 +1595,21 @@ mousepad_window_open_file (MousepadWindow   *window,
               }
           }
 
+        /* try the detected encoding when there is little doubt about it, also only once */
+        if (encoding_detected == FALSE)
+          {
+            encoding_detected = TRUE;
+
+            if (mousepad_file_guess_encodings (document->file, &guess, 1) == 1
+                && guess.confidence >= MOUSEPAD_ENCODING_DETECTOR_CONFIDENT)
+              {
+                /* set the new encoding */
+                mousepad_file_set_encoding (document->file, guess.encoding);
+
+                goto retry;
+              }
+          }
+
         /* run the encoding dialog */
         dialog = mousepad_encoding_dialog_new (GTK_WINDOW (window), document->file);
 
@@ -1527,6 +1653,46 @@ mousepad_window_open_file (MousepadWindow   *window,
 
 
 
+static gboolean
+mousepad_window_open_stdin (MousepadWindow *window)
+{
+  MousepadDocument *document;
+  GError           *error = NULL;
+
+  g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), FALSE);
+
+  /* new untitled document */
+  document = mousepad_document_new ();
+
+  /* make sure it's not a floating object */
+  g_object_ref_sink (G_OBJECT (document));
+
+  /* read the pipe in the background, the text is appended as it arrives */
+  if (G_LIKELY (mousepad_file_open_stdin (document->file, &error) == 0))
+    {
+      /* add the document to the window */
+      mousepad_window_add (window, document);
+
+      return TRUE;
+    }
+
+  /* something went wrong, release the document */
+  g_object_unref (G_OBJECT (document));
+
+  if (G_LIKELY (error))
+    {
+      /* show the warning */
+      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to read the standard input"));
+
+      /* cleanup */
+      g_error_free (error);
+    }
+
+  return FALSE;
+}
+
+
+
 gboolean
 mousepad_window_open_files (MousepadWindow  *window,
                             const gchar     *working_directory,
@@ -1546,6 +1712,13 @@ mousepad_window_open_files (MousepadWindow  *window,
   /* walk through all the filenames */
   for (n = 0; filenames[n] != NULL; ++n)
     {
+      /* a dash reads a new document from the standard input */
+      if (strcmp (filenames[n], "-") == 0)
+        {
+          mousepad_window_open_stdin (window);
+          continue;
+        }
+
       /* check if the filename looks like an uri */
       if (strncmp (filenames[n], "file:", 5) == 0)
         {
@@ -1644,6 +1817,9 @@ mousepad_window_close_document (MousepadWindow   *window,
   g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), FALSE);
   g_return_val_if_fail (MOUSEPAD_IS_DOCUMENT (document), FALSE);
 
+  /* stop loading the file, there is nothing to save yet */
+  mousepad_file_open_cancel (document->file);
+
   /* check if the document has been modified */
   if (gtk_text_buffer_get_modified (document->buffer))
     {
@@ -1679,6 +1855,10 @@ mousepad_window_close_document (MousepadWindow   *window,
       succeed = TRUE;
     }
 
+  /* wait until the file is written, the save can still fail */
+  if (succeed && mousepad_file_get_saving (document->file))
+    succeed = mousepad_file_save_wait (document->file);
+
   /* destroy the document */
   if (succeed)
     gtk_widget_destroy (GTK_WIDGET (document));
@@ -1824,6 +2004,15 @@ mousepad_window_notebook_added (GtkNotebook     *notebook,
   g_signal_connect_swapped (G_OBJECT (document->buffer), "notify::can-redo", G_CALLBACK (mousepad_window_can_redo), window);
   g_signal_connect_swapped (G_OBJECT (document->buffer), "modified-changed", G_CALLBACK (mousepad_window_modified_changed), window);
   g_signal_connect (G_OBJECT (document->textview), "populate-popup", G_CALLBACK (mousepad_window_menu_textview_popup), window);
+  g_signal_connect (G_OBJECT (document->file), "load-finished", G_CALLBACK (mousepad_window_file_load_finished), window);
+  g_signal_connect (G_OBJECT (document->file), "save-finished", G_CALLBACK (mousepad_window_file_save_finished), window);
+  g_signal_connect (G_OBJECT (document->file), "reload-finished", G_CALLBACK (mousepad_window_file_reload_finished), window);
+  g_signal_connect (G_OBJECT (document->file), "readonly-changed", G_CALLBACK (mousepad_window_file_readonly_changed), window);
+  g_signal_connect (G_OBJECT (document->file), "follow-stopped", G_CALLBACK (mousepad_window_file_follow_stopped), window);
+
+  /* a document moved from another window before its failed load was handled */
+  if (G_UNLIKELY (mousepad_object_get_data (G_OBJECT (document), "load-failed-result") != NULL))
+    mousepad_window_file_load_failed (window, document, 0, NULL);
 
   /* change the visibility of the tabs accordingly */
   mousepad_window_update_tabs (window, NULL, NULL);
@@ -1858,6 +2047,19 @@ mousepad_window_notebook_removed (GtkNotebook     *notebook,
   mousepad_disconnect_by_func (G_OBJECT (document->buffer), mousepad_window_can_redo, window);
   mousepad_disconnect_by_func (G_OBJECT (document->buffer), mousepad_window_modified_changed, window);
   mousepad_disconnect_by_func (G_OBJECT (document->textview), mousepad_window_menu_textview_popup, window);
+  mousepad_disconnect_by_func (G_OBJECT (document->file), mousepad_window_file_load_finished, window);
+  mousepad_disconnect_by_func (G_OBJECT (document->file), mousepad_window_file_save_finished, window);
+  mousepad_disconnect_by_func (G_OBJECT (document->file), mousepad_window_file_reload_finished, window);
+  mousepad_disconnect_by_func (G_OBJECT (document->file), mousepad_window_file_readonly_changed, window);
+  mousepad_disconnect_by_func (G_OBJECT (document->file), mousepad_window_file_follow_stopped, window);
+
+  /* the document is no longer part of a save all in this window */
+  window->save_all_pending = g_slist_remove (window->save_all_pending, document);
+  window->save_all_failed = g_slist_remove (window->save_all_failed, document);
+  mousepad_object_set_data (G_OBJECT (document), "save-all-error", NULL);
+
+  /* and no longer handled by this window when it failed to load */
+  window->load_failed = g_slist_remove (window->load_failed, document);
 
   /* unset the go menu item (part of the old window) */
   mousepad_object_set_data (G_OBJECT (page), "document-menu-action", NULL);
@@ -2130,15 +2332,24 @@ mousepad_window_cursor_changed (MousepadDocument *document,
                                 gint              selection,
                                 MousepadWindow   *window)
 {
-
+  GtkTextIter iter;
+  guint64     offset;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
   if (window->statusbar)
     {
-      /* set the new statusbar cursor position and selection length */
-      mousepad_statusbar_set_cursor_position (MOUSEPAD_STATUSBAR (window->statusbar), line, column, selection);
+      /* byte offset of the cursor, in the viewer that is the offset in the file, in
+       * a document it counts the utf-8 text of the buffer with lf line endings */
+      gtk_text_buffer_get_iter_at_mark (document->buffer, &iter, gtk_text_buffer_get_insert (document->buffer));
+      if (G_UNLIKELY (mousepad_document_get_viewer (document) != NULL))
+        offset = mousepad_viewer_get_iter_offset (mousepad_document_get_viewer (document), &iter);
+      else
+        offset = mousepad_line_index_get_iter_offset (mousepad_file_get_line_index (document->file), &iter);
+
+      /* set the new statusbar cursor position, selection length and offset */
+      mousepad_statusbar_set_cursor_position (MOUSEPAD_STATUSBAR (window->statusbar), line, column, selection, offset);
     }
 }
 
@@ -2151,9 +2362,18 @@ mousepad_window_selection_changed (MousepadDocument *document,
 {
   GtkAction   *action;
   guint        i;
+  gboolean     editable;
   const gchar *action_names1[] = { "tabs-to-spaces", "spaces-to-tabs", "duplicate", "strip-trailing" };
   const gchar *action_names2[] = { "line-up", "line-down" };
-  const gchar *action_names3[] = { "cut", "copy", "delete", "lowercase", "uppercase", "titlecase", "opposite-case" };
+  const gchar *action_names3[] = { "cut", "delete", "lowercase", "uppercase", "titlecase", "opposite-case" };
+  const gchar *action_names4[] = { "paste", "paste-menu", "transpose", "increase-indent", "decrease-indent", "replace" };
+
+  /* only the active document sets the actions */
+  if (document != window->active)
+    return;
+
+  /* the large file viewer is read-only until its line index is complete */
+  editable = gtk_text_view_get_editable (GTK_TEXT_VIEW (document->textview));
 
   /* sensitivity of the change selection action */
   action = gtk_action_group_get_action (window->action_group, "change-selection");
@@ -2163,21 +2383,31 @@ mousepad_window_selection_changed (MousepadDocument *document,
   for (i = 0; i < G_N_ELEMENTS (action_names1); i++)
     {
       action = gtk_action_group_get_action (window->action_group, action_names1[i]);
-      gtk_action_set_sensitive (action, selection == 0 || selection == 1);
+      gtk_action_set_sensitive (action, editable && (selection == 0 || selection == 1));
     }
 
   /* action that are only sensitive for normal selections */
   for (i = 0; i < G_N_ELEMENTS (action_names2); i++)
     {
       action = gtk_action_group_get_action (window->action_group, action_names2[i]);
-      gtk_action_set_sensitive (action, selection == 1);
+      gtk_action_set_sensitive (action, editable && selection == 1);
     }
 
   /* actions that are sensitive for all selections with content */
   for (i = 0; i < G_N_ELEMENTS (action_names3); i++)
     {
       action = gtk_action_group_get_action (window->action_group, action_names3[i]);
-      gtk_action_set_sensitive (action, selection > 0);
+      gtk_action_set_sensitive (action, editable && selection > 0);
+    }
+
+  action = gtk_action_group_get_action (window->action_group, "copy");
+  gtk_action_set_sensitive (action, selection > 0);
+
+  /* actions that change the text */
+  for (i = 0; i < G_N_ELEMENTS (action_names4); i++)
+    {
+      action = gtk_action_group_get_action (window->action_group, action_names4[i]);
+      gtk_action_set_sensitive (action, editable);
     }
 }
 
@@ -2212,6 +2442,366 @@ mousepad_window_buffer_language_changed (MousepadDocument  *document,
 
 
 
+static MousepadDocument *
+mousepad_window_find_document (MousepadWindow *window,
+                               MousepadFile   *file)
+{
+  GtkWidget *page;
+  gint       npages, i;
+
+  /* find the document of the file */
+  npages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
+  for (i = 0; i < npages; i++)
+    {
+      page = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i);
+      if (MOUSEPAD_DOCUMENT (page)->file == file)
+        return MOUSEPAD_DOCUMENT (page);
+    }
+
+  return NULL;
+}
+
+
+
+static void
+mousepad_window_file_load_finished (MousepadFile   *file,
+                                    gint            result,
+                                    const GError   *error,
+                                    MousepadWindow *window)
+{
+  MousepadDocument *document;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* find the document of the file */
+  document = mousepad_window_find_document (window, file);
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* text from the standard input can not be loaded again, keep what we got */
+  if (G_UNLIKELY (mousepad_file_get_filename (file) == NULL))
+    {
+      if (G_UNLIKELY (result != 0 && error != NULL))
+        mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to read the standard input"));
+
+      if (document == window->active)
+        mousepad_window_update_actions (window);
+      return;
+    }
+
+  /* a followed file that was rotated is loaded again, the file reports a failure itself */
+  if (G_UNLIKELY (mousepad_file_get_follow (file)))
+    {
+      if (document == window->active)
+        mousepad_window_update_actions (window);
+      return;
+    }
+
+  if (G_LIKELY (result == 0))
+    {
+      /* insert in the recent history */
+      mousepad_window_recent_add (window, file);
+
+      /* the line ending is known now */
+      if (document == window->active)
+        mousepad_window_update_actions (window);
+      return;
+    }
+
+  /* the dialogs run a main loop and the document might be closed, that
+   * can't happen while the file emits the signal, so do it later */
+  mousepad_window_file_load_failed (window, document, result, error);
+}
+
+
+
+static void
+mousepad_window_file_load_failed (MousepadWindow   *window,
+                                  MousepadDocument *document,
+                                  gint              result,
+                                  const GError     *error)
+{
+  /* remember the result, unless the document brought it from another window */
+  if (result != 0)
+    {
+      mousepad_object_set_data (G_OBJECT (document), "load-failed-result", GINT_TO_POINTER (result));
+      mousepad_object_set_data_full (G_OBJECT (document), "load-failed-error",
+                                     error != NULL ? g_error_copy (error) : NULL,
+                                     error != NULL ? (GDestroyNotify) g_error_free : NULL);
+    }
+
+  /* queue the document */
+  if (g_slist_find (window->load_failed, document) == NULL)
+    window->load_failed = g_slist_append (window->load_failed, document);
+
+  if (window->load_failed_id == 0)
+    window->load_failed_id = g_idle_add (mousepad_window_file_load_failed_idle, window);
+}
+
+
+
+static gboolean
+mousepad_window_file_load_failed_idle (gpointer user_data)
+{
+  MousepadWindow   *window = MOUSEPAD_WINDOW (user_data);
+  MousepadDocument *document;
+  MousepadFile     *file;
+  MousepadEncoding  encoding = MOUSEPAD_ENCODING_NONE;
+  gint              result;
+  gint              npages;
+  GtkWidget        *dialog;
+  const GError     *error;
+  const gchar      *charset;
+  gchar            *uri;
+  GtkRecentInfo    *info;
+  gboolean          again = FALSE;
+  MousepadEncodingGuess guess;
+
+  /* handle one document at a time, the next one in the following run */
+  if (G_UNLIKELY (window->load_failed == NULL))
+    {
+      window->load_failed_id = 0;
+      return FALSE;
+    }
+
+  document = MOUSEPAD_DOCUMENT (window->load_failed->data);
+  window->load_failed = g_slist_delete_link (window->load_failed, window->load_failed);
+  file = document->file;
+
+  /* keep both alive while the dialogs run */
+  g_object_ref (G_OBJECT (window));
+  g_object_ref (G_OBJECT (document));
+
+  result = GPOINTER_TO_INT (mousepad_object_get_data (G_OBJECT (document), "load-failed-result"));
+  error = mousepad_object_get_data (G_OBJECT (document), "load-failed-error");
+
+  switch (result)
+    {
+      case ERROR_CONVERTING_FAILED:
+      case ERROR_NOT_UTF8_VALID:
+        /* try to lookup the encoding from the recent history, we only try this once */
+        if (mousepad_object_get_data (G_OBJECT (document), "encoding-from-recent") == NULL)
+          {
+            mousepad_object_set_data (G_OBJECT (document), "encoding-from-recent", GINT_TO_POINTER (TRUE));
+
+            /* build uri */
+            uri = mousepad_file_get_uri (file);
+            if (G_LIKELY (uri))
+              {
+                /* try to lookup the recent item */
+                info = gtk_recent_manager_lookup_item (window->recent_manager, uri, NULL);
+
+                /* cleanup */
+                g_free (uri);
+
+                if (info)
+                  {
+                    /* try to find the encoding */
+                    charset = mousepad_window_recent_get_charset (info);
+                    encoding = mousepad_encoding_find (charset);
+
+                    /* release */
+                    gtk_recent_info_unref (info);
+                  }
+              }
+          }
+
+        /* try the detected encoding when there is little doubt about it, also only once */
+        if (encoding == MOUSEPAD_ENCODING_NONE
+            && mousepad_object_get_data (G_OBJECT (document), "encoding-detected") == NULL)
+          {
+            mousepad_object_set_data (G_OBJECT (document), "encoding-detected", GINT_TO_POINTER (TRUE));
+
+            if (mousepad_file_guess_encodings (file, &guess, 1) == 1
+                && guess.confidence >= MOUSEPAD_ENCODING_DETECTOR_CONFIDENT)
+              encoding = guess.encoding;
+          }
+
+        /* run the encoding dialog */
+        if (encoding == MOUSEPAD_ENCODING_NONE)
+          {
+            dialog = mousepad_encoding_dialog_new (GTK_WINDOW (window), file);
+
+            if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_OK)
+              encoding = mousepad_encoding_dialog_get_encoding (MOUSEPAD_ENCODING_DIALOG (dialog));
+
+            gtk_widget_destroy (dialog);
+          }
+        break;
+
+      default:
+        /* show the warning */
+        if (G_LIKELY (error))
+          mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to open the document"));
+        break;
+    }
+
+  /* the failure is handled */
+  mousepad_object_set_data (G_OBJECT (document), "load-failed-result", NULL);
+  mousepad_object_set_data (G_OBJECT (document), "load-failed-error", NULL);
+
+  /* leave the document alone when it was closed or moved while the dialogs ran */
+  if (gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document)) != -1)
+    {
+      /* load the file again with the new encoding */
+      if (encoding != MOUSEPAD_ENCODING_NONE)
+        mousepad_file_set_encoding (file, encoding);
+
+      if (encoding == MOUSEPAD_ENCODING_NONE
+          || mousepad_file_open_streaming (file, NULL) != 0)
+        {
+          /* keep the window open when this was its only document */
+          npages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
+          if (npages == 1)
+            mousepad_window_add (window, mousepad_document_new ());
+
+          /* something went wrong, close the document */
+          gtk_widget_destroy (GTK_WIDGET (document));
+        }
+    }
+
+  /* the next document, if any */
+  if (window->load_failed != NULL)
+    again = TRUE;
+  else
+    window->load_failed_id = 0;
+
+  g_object_unref (G_OBJECT (document));
+  g_object_unref (G_OBJECT (window));
+
+  return again;
+}
+
+
+
+static void
+mousepad_window_file_save_finished (MousepadFile   *file,
+                                    gboolean        succeed,
+                                    const GError   *error,
+                                    MousepadWindow *window)
+{
+  MousepadDocument *document;
+  gint              page_num;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* find the document of the file */
+  document = mousepad_window_find_document (window, file);
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* the document is written by save all, report the errors when all are done */
+  if (g_slist_find (window->save_all_pending, document) != NULL)
+    {
+      window->save_all_pending = g_slist_remove (window->save_all_pending, document);
+
+      if (G_UNLIKELY (! succeed))
+        mousepad_window_save_all_failed (window, document, error);
+
+      if (window->save_all_pending == NULL)
+        mousepad_window_save_all_report (window);
+
+      if (G_UNLIKELY (! succeed))
+        return;
+    }
+
+  if (G_LIKELY (succeed))
+    {
+      /* the file is no longer readonly and might have a new filetype */
+      if (document == window->active)
+        mousepad_window_update_actions (window);
+    }
+  else
+    {
+      /* focus the tab that triggered the problem */
+      page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document));
+      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+      /* show the error */
+      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to save the document"));
+    }
+}
+
+
+
+static void
+mousepad_window_file_reload_finished (MousepadFile   *file,
+                                      gboolean        succeed,
+                                      const GError   *error,
+                                      MousepadWindow *window)
+{
+  MousepadDocument *document;
+  gint              page_num;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* find the document of the file */
+  document = mousepad_window_find_document (window, file);
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  if (G_LIKELY (succeed))
+    {
+      /* the file might have a new line ending, filetype or readonly state */
+      if (document == window->active)
+        mousepad_window_update_actions (window);
+    }
+  else
+    {
+      /* focus the tab that triggered the problem */
+      page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document));
+      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+      /* show the error */
+      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to reload the document"));
+    }
+}
+
+
+
+static void
+mousepad_window_file_readonly_changed (MousepadFile   *file,
+                                       gboolean        readonly,
+                                       MousepadWindow *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* a followed file can become readonly at any time, update the save action and title */
+  if (window->active != NULL && window->active->file == file)
+    {
+      mousepad_window_update_actions (window);
+      mousepad_window_set_title (window);
+    }
+}
+
+
+
+static void
+mousepad_window_file_follow_stopped (MousepadFile   *file,
+                                     const GError   *error,
+                                     MousepadWindow *window)
+{
+  MousepadDocument *document;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* find the document of the file */
+  document = mousepad_window_find_document (window, file);
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* the follow action is no longer active */
+  if (document == window->active)
+    mousepad_window_update_actions (window);
+
+  /* tell the user why, this happens once since the file is no longer followed */
+  if (G_LIKELY (error != NULL))
+    mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Stopped following the document"));
+}
+
+
+
 static void
 mousepad_window_can_undo (MousepadWindow *window,
                           GParamSpec     *unused,
@@ -2667,7 +3257,8 @@ mousepad_window_update_actions (MousepadWindow *window)
       gtk_action_set_sensitive (action, (n_pages > 1));
 
       action = gtk_action_group_get_action (window->action_group, "revert");
-      gtk_action_set_sensitive (action, mousepad_file_get_filename (document->file) != NULL);
+      gtk_action_set_sensitive (action, mousepad_file_get_filename (document->file) != NULL
+                                        && mousepad_document_get_viewer (document) == NULL);
 
       /* line ending type */
       line_ending = mousepad_file_get_line_ending (document->file);
@@ -2682,11 +3273,24 @@ mousepad_window_update_actions (MousepadWindow *window)
       action = gtk_action_group_get_action (window->action_group, action_name);
       gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action), TRUE);
 
+      /* tell the user when the file mixes line endings */
+      if (window->statusbar)
+        mousepad_statusbar_set_mixed_line_endings (MOUSEPAD_STATUSBAR (window->statusbar),
+                                                   mousepad_file_get_mixed_line_endings (document->file));
+
       /* write bom */
       action = gtk_action_group_get_action (window->action_group, "write-bom");
       gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action), mousepad_file_get_write_bom (document->file, &sensitive));
       gtk_action_set_sensitive (action, sensitive);
 
+      /* follow the file */
+      action = gtk_action_group_get_action (window->action_group, "follow");
+      gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action), mousepad_file_get_follow (document->file));
+      gtk_action_set_sensitive (action, mousepad_file_get_filename (document->file) != NULL
+                                        && mousepad_file_get_compression (document->file) == MOUSEPAD_COMPRESSION_NONE
+                                        && mousepad_document_get_viewer (document) == NULL
+                                        && ! mousepad_file_get_loading (document->file));
+
       /* toggle the document settings */
       active = MOUSEPAD_SETTING_GET_BOOLEAN (WORD_WRAP);
       action = gtk_action_group_get_action (window->action_group, "word-wrap");
@@ -3252,6 +3856,128 @@ mousepad_window_drag_data_received (GtkWidget        *widget,
 /**
  * Find and replace
  **/
+static gint
+mousepad_window_search_count (MousepadDocument    *document,
+                              MousepadSearchFlags  flags,
+                              const gchar         *string)
+{
+  GtkTextIter start, end;
+  gint        nmatches;
+
+  /* the matches are counted once, after that the index keeps up with the edits */
+  nmatches = mousepad_match_index_set_search (document->match_index, string, flags);
+
+  /* only the matches inside the selection */
+  if (nmatches > 0 && (flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION))
+    {
+      gtk_text_buffer_get_selection_bounds (document->buffer, &start, &end);
+      nmatches = mousepad_match_index_count (document->match_index, &start, &end);
+    }
+
+  return nmatches;
+}
+
+
+
+static gint
+mousepad_window_search_select (MousepadDocument    *document,
+                               MousepadSearchFlags  flags,
+                               const gchar         *string)
+{
+  MousepadMatchIndex *index = document->match_index;
+  GtkTextIter         iter, bound, match_start, match_end;
+  gboolean            found = FALSE;
+  gint                nmatches;
+
+  /* the iter we search from */
+  if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_AREA_START)
+    gtk_text_buffer_get_start_iter (document->buffer, &iter);
+  else if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_AREA_END)
+    gtk_text_buffer_get_end_iter (document->buffer, &iter);
+  else if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_SEL_END)
+    gtk_text_buffer_get_selection_bounds (document->buffer, NULL, &iter);
+  else
+    gtk_text_buffer_get_selection_bounds (document->buffer, &iter, NULL);
+
+  nmatches = mousepad_match_index_set_search (index, string, flags);
+  if (nmatches > 0)
+    {
+      if (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD)
+        {
+          /* the last match before the iter, or in the whole document when we wrap */
+          found = mousepad_match_index_get_previous (index, &iter, &match_start, &match_end);
+          if (! found && (flags & MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND))
+            {
+              gtk_text_buffer_get_end_iter (document->buffer, &bound);
+              found = mousepad_match_index_get_previous (index, &bound, &match_start, &match_end);
+            }
+
+          if (found)
+            gtk_text_buffer_select_range (document->buffer, &match_end, &match_start);
+        }
+      else
+        {
+          /* the first match after the iter, or in the whole document when we wrap */
+          found = mousepad_match_index_get_next (index, &iter, &match_start, &match_end);
+
+          /* an empty match at the iter is where the cursor already is, look further */
+          if (found && gtk_text_iter_equal (&match_start, &match_end)
+              && gtk_text_iter_equal (&match_start, &iter))
+            {
+              bound = iter;
+              found = (gtk_text_iter_forward_char (&bound)
+                       && mousepad_match_index_get_next (index, &bound, &match_start, &match_end));
+            }
+
+          if (! found && (flags & MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND))
+            {
+              gtk_text_buffer_get_start_iter (document->buffer, &bound);
+              found = mousepad_match_index_get_next (index, &bound, &match_start, &match_end);
+            }
+
+          if (found)
+            gtk_text_buffer_select_range (document->buffer, &match_start, &match_end);
+        }
+    }
+
+  /* reset the cursor */
+  if (! found)
+    gtk_text_buffer_place_cursor (document->buffer, &iter);
+
+  return nmatches < 0 ? -1 : (found ? 1 : 0);
+}
+
+
+
+static void
+mousepad_window_search_position (MousepadWindow      *window,
+                                 MousepadSearchFlags  flags,
+                                 const gchar         *string,
+                                 gint                *position,
+                                 gint                *total)
+{
+  MousepadMatchIndex *index;
+  GtkTextIter         start, end, match_start, match_end;
+
+  *position = *total = 0;
+
+  /* the buffer of the viewer only holds a part of the file */
+  if (window->active == NULL || mousepad_document_get_viewer (window->active) != NULL)
+    return;
+
+  index = window->active->match_index;
+  *total = MAX (mousepad_match_index_set_search (index, string, flags), 0);
+
+  /* the number of the match when it is selected */
+  gtk_text_buffer_get_selection_bounds (window->active->buffer, &start, &end);
+  if (mousepad_match_index_get_next (index, &start, &match_start, &match_end)
+      && gtk_text_iter_equal (&start, &match_start)
+      && gtk_text_iter_equal (&end, &match_end))
+    *position = mousepad_match_index_get_position (index, &start) + 1;
+}
+
+
+
 static gint
 mousepad_window_search (MousepadWindow      *window,
                         MousepadSearchFlags  flags,
@@ -3259,7 +3985,7 @@ mousepad_window_search (MousepadWindow      *window,
                         const gchar         *replacement)
 {
   gint       nmatches = 0;
-  gint       npages, i;
+  gint       npages, i, n;
   GtkWidget *document;
 
   g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), -1);
@@ -3267,7 +3993,34 @@ mousepad_window_search (MousepadWindow      *window,
   if (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_HIGHTLIGHT)
     {
       /* highlight all the matches */
-      nmatches = mousepad_util_highlight (window->active->buffer, window->active->tag, string, flags);
+      nmatches = mousepad_util_highlight (GTK_TEXT_VIEW (window->active->textview), window->active->tag, string, flags);
+    }
+  else if (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_NONE)
+    {
+      if (flags & MOUSEPAD_SEARCH_FLAGS_ALL_DOCUMENTS)
+        {
+          /* count the matches in all the documents */
+          npages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
+          for (i = 0; i < npages; i++)
+            {
+              document = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i);
+
+              /* the buffer of the viewer only holds a part of the file */
+              if (mousepad_document_get_viewer (MOUSEPAD_DOCUMENT (document)) != NULL)
+                continue;
+
+              n = mousepad_window_search_count (MOUSEPAD_DOCUMENT (document), flags, string);
+              if (n < 0)
+                return n;
+
+              nmatches += n;
+            }
+        }
+      else if (window->active != NULL)
+        {
+          /* count the matches in the active document */
+          nmatches = mousepad_window_search_count (window->active, flags, string);
+        }
     }
   else if (flags & MOUSEPAD_SEARCH_FLAGS_ALL_DOCUMENTS)
     {
@@ -3280,14 +4033,46 @@ mousepad_window_search (MousepadWindow      *window,
           /* get the document */
           document = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i);
 
+          /* the buffer of the viewer only holds a part of the file */
+          if (mousepad_document_get_viewer (MOUSEPAD_DOCUMENT (document)) != NULL)
+            continue;
+
           /* replace the matches in the document */
-          nmatches += mousepad_util_search (MOUSEPAD_DOCUMENT (document)->buffer, string, replacement, flags);
+          n = mousepad_util_search (MOUSEPAD_DOCUMENT (document)->buffer, string, replacement, flags);
+
+          /* the expression does not compile, it won't in the other documents either */
+          if (n < 0)
+            return n;
+
+          nmatches += n;
+        }
+    }
+  else if (window->active != NULL
+           && mousepad_document_get_viewer (window->active) != NULL)
+    {
+      /* the viewer searches the whole file for plain text, but doesn't replace in it */
+      if ((flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT)
+          && (flags & MOUSEPAD_SEARCH_FLAGS_AREA_DOCUMENT)
+          && (flags & MOUSEPAD_SEARCH_FLAGS_REGEX) == 0)
+        {
+          if (mousepad_viewer_search (mousepad_document_get_viewer (window->active), string, flags))
+            {
+              nmatches = 1;
+              mousepad_view_scroll_to_cursor (window->active->textview);
+            }
+        }
+      else if ((flags & MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE) == 0)
+        {
+          nmatches = mousepad_util_search (window->active->buffer, string, replacement, flags);
         }
     }
   else if (window->active != NULL)
     {
-      /* search or replace in the active document */
-      nmatches = mousepad_util_search (window->active->buffer, string, replacement, flags);
+      /* find the next match with the match index, or search and replace in the buffer */
+      if ((flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT) && (flags & MOUSEPAD_SEARCH_FLAGS_AREA_DOCUMENT))
+        nmatches = mousepad_window_search_select (window->active, flags, string);
+      else
+        nmatches = mousepad_util_search (window->active->buffer, string, replacement, flags);
 
       /* make sure the selection is visible */
       if (flags & (MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT | MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE) && nmatches > 0)
@@ -3304,6 +4089,51 @@ mousepad_window_search (MousepadWindow      *window,
 
 
 
+static gint
+mousepad_window_search_bar_search (MousepadWindow      *window,
+                                   MousepadSearchFlags  flags,
+                                   const gchar         *string,
+                                   const gchar         *replacement)
+{
+  gint nmatches, position, total;
+
+  nmatches = mousepad_window_search (window, flags, string, replacement);
+
+  /* show which of the matches is selected */
+  if (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT)
+    {
+      mousepad_window_search_position (window, flags, string, &position, &total);
+      mousepad_search_bar_set_position (MOUSEPAD_SEARCH_BAR (window->search_bar), position, total);
+    }
+
+  return nmatches;
+}
+
+
+
+static gint
+mousepad_window_replace_dialog_search (MousepadWindow      *window,
+                                       MousepadSearchFlags  flags,
+                                       const gchar         *string,
+                                       const gchar         *replacement)
+{
+  gint nmatches, position, total;
+
+  nmatches = mousepad_window_search (window, flags, string, replacement);
+
+  /* show which of the matches is selected, also after a single replacement */
+  if ((flags & (MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT | MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE))
+      && (flags & MOUSEPAD_SEARCH_FLAGS_ENTIRE_AREA) == 0 && nmatches >= 0)
+    {
+      mousepad_window_search_position (window, flags, string, &position, &total);
+      mousepad_replace_dialog_set_position (MOUSEPAD_REPLACE_DIALOG (window->replace_dialog), position, total);
+    }
+
+  return nmatches;
+}
+
+
+
 /**
  * Search Bar
  **/
@@ -3311,6 +4141,8 @@ static void
 mousepad_window_hide_search_bar (MousepadWindow *window)
 {
   MousepadSearchFlags flags;
+  MousepadDocument   *document;
+  gint                i, npages;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
@@ -3323,6 +4155,14 @@ mousepad_window_hide_search_bar (MousepadWindow *window)
   /* remove the highlight */
   mousepad_window_search (window, flags, NULL, NULL);
 
+  /* stop keeping the matches up to date while nobody searches */
+  npages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
+  for (i = 0; i < npages; i++)
+    {
+      document = MOUSEPAD_DOCUMENT (gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i));
+      mousepad_match_index_set_search (document->match_index, NULL, 0);
+    }
+
   /* hide the search bar */
   gtk_widget_hide (window->search_bar);
 
@@ -4045,6 +4885,65 @@ mousepad_window_action_save_as (GtkAction      *action,
 
 
 
+static void
+mousepad_window_save_all_failed (MousepadWindow   *window,
+                                 MousepadDocument *document,
+                                 const GError     *error)
+{
+  /* remember the error until all documents are written */
+  mousepad_object_set_data_full (G_OBJECT (document), "save-all-error",
+                                 error != NULL ? g_error_copy (error) : NULL,
+                                 error != NULL ? (GDestroyNotify) g_error_free : NULL);
+
+  window->save_all_failed = g_slist_prepend (window->save_all_failed, document);
+}
+
+
+
+static gint
+mousepad_window_save_all_compare (gconstpointer a,
+                                  gconstpointer b,
+                                  gpointer      user_data)
+{
+  GtkNotebook *notebook = GTK_NOTEBOOK (user_data);
+
+  return gtk_notebook_page_num (notebook, GTK_WIDGET (a)) - gtk_notebook_page_num (notebook, GTK_WIDGET (b));
+}
+
+
+
+static void
+mousepad_window_save_all_report (MousepadWindow *window)
+{
+  MousepadDocument *document;
+  GSList           *failed;
+  gint              page_num;
+
+  /* take the failed documents, in the order of the tabs */
+  failed = g_slist_sort_with_data (window->save_all_failed, mousepad_window_save_all_compare, window->notebook);
+  window->save_all_failed = NULL;
+
+  while (failed != NULL)
+    {
+      document = MOUSEPAD_DOCUMENT (failed->data);
+      failed = g_slist_delete_link (failed, failed);
+
+      /* focus the tab that triggered the problem */
+      page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document));
+      if (G_UNLIKELY (page_num < 0))
+        continue;
+
+      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+      /* show the error */
+      mousepad_dialogs_show_error (GTK_WINDOW (window), mousepad_object_get_data (G_OBJECT (document), "save-all-error"),
+                                   _("Failed to save the document"));
+      mousepad_object_set_data (G_OBJECT (document), "save-all-error", NULL);
+    }
+}
+
+
+
 static void
 mousepad_window_action_save_all (GtkAction      *action,
                                  MousepadWindow *window)
@@ -4053,7 +4952,6 @@ mousepad_window_action_save_all (GtkAction      *action,
   gint              page_num;
   MousepadDocument *document;
   GSList           *li, *documents = NULL;
-  gboolean          succeed = TRUE;
   GError           *error = NULL;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
@@ -4071,8 +4969,9 @@ mousepad_window_action_save_all (GtkAction      *action,
       /* debug check */
       g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
-      /* continue if the document is not modified */
-      if (!gtk_text_buffer_get_modified (document->buffer))
+      /* continue if the document is not modified or already in a save all */
+      if (!gtk_text_buffer_get_modified (document->buffer)
+          || g_slist_find (window->save_all_pending, document) != NULL)
         continue;
 
       /* we try to quickly save files, without bothering the user */
@@ -4080,12 +4979,17 @@ mousepad_window_action_save_all (GtkAction      *action,
           && mousepad_file_get_read_only (document->file) == FALSE
           && mousepad_file_get_externally_modified (document->file, NULL) == FALSE)
         {
-          /* try to quickly save the file */
-          succeed = mousepad_file_save (document->file, &error);
-
-          /* break on problems */
-          if (G_UNLIKELY (!succeed))
-            break;
+          /* take a snapshot of the document, the worker pool writes the files in parallel */
+          if (G_LIKELY (mousepad_file_save (document->file, &error)))
+            {
+              window->save_all_pending = g_slist_prepend (window->save_all_pending, document);
+            }
+          else
+            {
+              /* collect the error, we report all of them at the end */
+              mousepad_window_save_all_failed (window, document, error);
+              g_clear_error (&error);
+            }
         }
       else
         {
@@ -4094,52 +4998,41 @@ mousepad_window_action_save_all (GtkAction      *action,
         }
     }
 
-  if (G_UNLIKELY (succeed == FALSE))
+  /* report the problems now if nothing is being written */
+  if (window->save_all_pending == NULL && window->save_all_failed != NULL)
+    mousepad_window_save_all_report (window);
+
+  /* open a save as dialog for all the unnamed files */
+  for (li = documents; li != NULL; li = li->next)
     {
-      /* focus the tab that triggered the problem */
-      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), i);
+      document = MOUSEPAD_DOCUMENT (li->data);
 
-      /* show the error */
-      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to save the document"));
+      /* get the documents page number */
+      page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (li->data));
 
-      /* free error */
-      if (error != NULL)
-        g_error_free (error);
-    }
-  else
-    {
-      /* open a save as dialog for all the unnamed files */
-      for (li = documents; li != NULL; li = li->next)
+      if (G_LIKELY (page_num > -1))
         {
-          document = MOUSEPAD_DOCUMENT (li->data);
-
-          /* get the documents page number */
-          page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (li->data));
+          /* focus the tab we're going to save */
+          gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
 
-          if (G_LIKELY (page_num > -1))
+          if (mousepad_file_get_filename (document->file) == NULL
+              || mousepad_file_get_read_only (document->file))
             {
-              /* focus the tab we're going to save */
-              gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
-
-              if (mousepad_file_get_filename (document->file) == NULL
-                  || mousepad_file_get_read_only (document->file))
-                {
-                  /* trigger the save as function */
-                  mousepad_window_action_save_as (NULL, window);
-                }
-              else
-                {
-                  /* trigger the save function (externally modified document) */
-                  mousepad_window_action_save (NULL, window);
-                }
+              /* trigger the save as function */
+              mousepad_window_action_save_as (NULL, window);
+            }
+          else
+            {
+              /* trigger the save function (externally modified document) */
+              mousepad_window_action_save (NULL, window);
             }
         }
-
-      /* focus the origional doc if everything went fine */
-      if (G_LIKELY (li == NULL))
-        gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), current);
     }
 
+  /* focus the origional doc if everything went fine */
+  if (G_LIKELY (li == NULL))
+    gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), current);
+
   /* cleanup */
   g_slist_free (documents);
 }
@@ -4180,15 +5073,8 @@ mousepad_window_action_revert (GtkAction      *action,
       g_return_if_fail (response == MOUSEPAD_RESPONSE_REVERT);
     }
 
-  /* lock the undo manager */
-  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
-
-  /* reload the file */
+  /* reload the file in the background, the file reports when it is done */
   succeed = mousepad_file_reload (document->file, &error);
-
-  /* release the lock */
-  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
-
   if (G_UNLIKELY (succeed == FALSE))
     {
       /* show the error */
@@ -4687,7 +5573,7 @@ mousepad_window_action_find (GtkAction      *action,
 
       /* connect signals */
       g_signal_connect_swapped (G_OBJECT (window->search_bar), "hide-bar", G_CALLBACK (mousepad_window_hide_search_bar), window);
-      g_signal_connect_swapped (G_OBJECT (window->search_bar), "search", G_CALLBACK (mousepad_window_search), window);
+      g_signal_connect_swapped (G_OBJECT (window->search_bar), "search", G_CALLBACK (mousepad_window_search_bar_search), window);
     }
 
   /* set the search entry text if the search bar is hidden*/
@@ -4803,7 +5689,7 @@ mousepad_window_action_replace (GtkAction      *action,
 
       /* connect signals */
       g_signal_connect_swapped (G_OBJECT (window->replace_dialog), "destroy", G_CALLBACK (mousepad_window_action_replace_destroy), window);
-      g_signal_connect_swapped (G_OBJECT (window->replace_dialog), "search", G_CALLBACK (mousepad_window_search), window);
+      g_signal_connect_swapped (G_OBJECT (window->replace_dialog), "search", G_CALLBACK (mousepad_window_replace_dialog_search), window);
       g_signal_connect_swapped (G_OBJECT (window->notebook), "switch-page", G_CALLBACK (mousepad_window_action_replace_switch_page), window);
     }
   else
@@ -4819,10 +5705,29 @@ static void
 mousepad_window_action_go_to_position (GtkAction      *action,
                                        MousepadWindow *window)
 {
+  MousepadViewer *viewer;
+  GtkTextIter     iter;
+  gint            line, n_lines;
+
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
   g_return_if_fail (GTK_IS_TEXT_BUFFER (window->active->buffer));
 
+  /* the viewer looks the line up in its index */
+  viewer = mousepad_document_get_viewer (window->active);
+  if (G_UNLIKELY (viewer != NULL))
+    {
+      gtk_text_buffer_get_iter_at_mark (window->active->buffer, &iter, gtk_text_buffer_get_insert (window->active->buffer));
+      line = MIN (mousepad_viewer_get_first_line (viewer) + gtk_text_iter_get_line (&iter) + 1, G_MAXINT);
+      n_lines = MIN (mousepad_viewer_get_line_count (viewer, NULL), G_MAXINT);
+
+      if (mousepad_dialogs_go_to_line (GTK_WINDOW (window), &line, n_lines)
+          && mousepad_viewer_go_to_line (viewer, line - 1))
+        mousepad_view_scroll_to_cursor (window->active->textview);
+
+      return;
+    }
+
   /* run jump dialog */
   if (mousepad_dialogs_go_to (GTK_WINDOW (window), window->active->buffer))
     {
@@ -5175,6 +6080,23 @@ mousepad_window_action_write_bom (GtkToggleAction *action,
 
 
 
+static void
+mousepad_window_action_follow (GtkToggleAction *action,
+                               MousepadWindow  *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
+
+  /* leave when menu updates are locked */
+  if (lock_menu_updates == 0)
+    {
+      /* append what is written to the file from now on */
+      mousepad_file_set_follow (window->active->file, gtk_toggle_action_get_active (action));
+    }
+}
+
+
+
 static void
 mousepad_window_action_prev_tab (GtkAction      *action,
                                  MousepadWindow *window)